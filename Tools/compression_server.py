@@ -0,0 +1,184 @@
+"""Stand-in standalone Duet for testing compressed HTTP responses without a printer.
+
+Serves:
+  /rr_connect      a session key, so the screen polls /rr_model
+  /rr_model        a minimal object model with a long list of heaters, so there is something to compress
+  /rr_filelist     --files files in every directory
+  /rr_fileinfo     the details of any file
+  /rr_gcode        a free buffer space of 255, and /rr_reply an empty reply
+/rr_model, /rr_filelist and /rr_fileinfo are compressed as their Accept-Encoding header allows. Each of them is logged
+with the encodings the screen offered and the one it got. The compressed body is inflated again before it is sent, and
+the totals are printed in the same form as dbg_http_compression, so the two can be compared.
+
+Example:
+  python3 Tools/compression_server.py --chunked
+then set the screen to network mode with the address <host>:8080 and turn on HTTP compression in the settings.
+--encoding uses one encoding rather than the best one offered, still only when it is offered. identity never
+compresses, so the screen has to stop offering compression after HTTP_COMPRESSION_PROBE_RESPONSES responses, and
+raw-deflate sends deflate without the zlib wrapper, like some servers do. --chunked sends bodies in small chunks, so the
+screen has to inflate across them.
+"""
+
+import argparse
+import gzip
+import http.server
+import json
+import threading
+import urllib.parse
+import zlib
+
+parser = argparse.ArgumentParser(description="Stand-in Duet serving compressed responses")
+parser.add_argument("--port", type=int, default=8080)
+parser.add_argument("--encoding", choices=["auto", "gzip", "deflate", "raw-deflate", "identity"], default="auto",
+                    help="encoding of compressible responses, auto picks the best one the screen offered")
+parser.add_argument("--chunked", action="store_true", help="send bodies in chunks of --chunk-size bytes")
+parser.add_argument("--chunk-size", type=int, default=512)
+parser.add_argument("--files", type=int, default=200, help="files listed in each directory")
+args = parser.parse_args()
+
+COMPRESSIBLE = ("/rr_model", "/rr_filelist", "/rr_fileinfo")
+
+lock = threading.Lock()
+compressed_responses = 0
+wire_bytes = 0
+body_bytes = 0
+
+
+def heater(index):
+    return {"active": 0.0, "avgPwm": 0.0, "current": 20.0 + index, "max": 285.0, "min": -10.0, "sensor": index,
+            "standby": 0.0, "state": "off"}
+
+
+def model(key):
+    result = {
+        "heat": {"bedHeaters": [0, -1, -1, -1], "chamberHeaters": [-1, -1], "heaters": [heater(i) for i in range(8)]},
+        "network": {"hostname": "compression", "name": "Stand-in Duet"},
+        "seqs": {"reply": 0},
+        "state": {"status": "idle", "upTime": 1234},
+    }
+    for part in filter(None, key.split(".")):
+        result = result.get(part) if isinstance(result, dict) else None
+    return result
+
+
+def file_list(directory, first):
+    files = [{"type": "f", "name": "part %03d with a long name.gcode" % i, "size": 1000000 + i,
+              "date": "2026-10-18T12:00:00"} for i in range(args.files)]
+    return {"dir": directory, "first": first, "files": files[first:], "next": 0, "err": 0}
+
+
+def file_info(name):
+    return {"err": 0, "fileName": name, "size": 1234567, "lastModified": "2026-10-18T12:00:00", "height": 48.0,
+            "firstLayerHeight": 0.3, "layerHeight": 0.2, "printTime": 3600, "simulatedTime": 0, "filament": [1234.5],
+            "generatedBy": "PrusaSlicer 2.8.1", "thumbnails": []}
+
+
+def accepted_encodings(header):
+    encodings = set()
+    for item in header.split(","):
+        fields = [field.strip() for field in item.split(";")]
+        if fields[0] and not any(field.replace(" ", "") in ("q=0", "q=0.0", "q=0.00", "q=0.000")
+                                 for field in fields[1:]):
+            encodings.add(fields[0].lower())
+    return encodings
+
+
+def choose_encoding(offered):
+    # Like a real server, nothing is compressed in a way the screen did not offer
+    if args.encoding == "auto":
+        for encoding in ("gzip", "deflate"):
+            if encoding in offered:
+                return encoding
+    elif args.encoding.replace("raw-", "") in offered:
+        return args.encoding
+    return "identity"
+
+
+def encode(body, encoding):
+    if encoding == "gzip":
+        data = gzip.compress(body)
+        inflated = gzip.decompress(data)
+    elif encoding == "deflate":
+        data = zlib.compress(body)
+        inflated = zlib.decompress(data)
+    elif encoding == "raw-deflate":
+        compressor = zlib.compressobj(wbits=-15)
+        data = compressor.compress(body) + compressor.flush()
+        inflated = zlib.decompress(data, wbits=-15)
+    else:
+        return body
+    if inflated != body:
+        raise ValueError("%s body does not inflate to the original" % encoding)
+    return data
+
+
+class CompressionHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *log_args):
+        print("%s %s" % (self.address_string(), format % log_args), flush=True)
+
+    def send_json(self, path, body):
+        global compressed_responses, wire_bytes, body_bytes
+        data = json.dumps(body).encode()
+        encoding = "identity"
+        if path in COMPRESSIBLE:
+            offered = accepted_encodings(self.headers.get("Accept-Encoding", ""))
+            encoding = choose_encoding(offered)
+            print("%s offered %s, sending %s" % (path, ", ".join(sorted(offered)) or "nothing", encoding), flush=True)
+        wire = encode(data, encoding)
+
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        if path in COMPRESSIBLE:
+            self.send_header("Vary", "Accept-Encoding")
+        if encoding != "identity":
+            self.send_header("Content-Encoding", "deflate" if encoding == "raw-deflate" else encoding)
+        if args.chunked:
+            self.send_header("Transfer-Encoding", "chunked")
+            self.end_headers()
+            for start in range(0, len(wire), args.chunk_size):
+                chunk = wire[start:start + args.chunk_size]
+                self.wfile.write(b"%x\r\n%s\r\n" % (len(chunk), chunk))
+                self.wfile.flush()
+            self.wfile.write(b"0\r\n\r\n")
+        else:
+            self.send_header("Content-Length", str(len(wire)))
+            self.end_headers()
+            self.wfile.write(wire)
+
+        if encoding == "identity":
+            return
+        with lock:
+            compressed_responses += 1
+            wire_bytes += len(wire)
+            body_bytes += len(data)
+            print("HTTP compression: %d responses, %d bytes sent for %d bytes of JSON" %
+                  (compressed_responses, wire_bytes, body_bytes), flush=True)
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        if url.path == "/rr_connect":
+            self.send_json(url.path, {"err": 0, "sessionTimeout": 8000, "sessionKey": 1234, "apiLevel": 1})
+        elif url.path == "/rr_model":
+            key = query.get("key", [""])[0]
+            self.send_json(url.path, {"key": key, "flags": query.get("flags", [""])[0], "result": model(key)})
+        elif url.path == "/rr_filelist":
+            self.send_json(url.path, file_list(query.get("dir", ["0:/gcodes"])[0],
+                                               int(query.get("first", ["0"])[0])))
+        elif url.path == "/rr_fileinfo":
+            self.send_json(url.path, file_info(query.get("name", [""])[0]))
+        elif url.path == "/rr_gcode":
+            self.send_json(url.path, {"buff": 255})
+        elif url.path == "/rr_reply":
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+        else:
+            self.send_error(404)
+
+
+print("Serving on port %d, encoding %s" % (args.port, args.encoding), flush=True)
+http.server.ThreadingHTTPServer(("", args.port), CompressionHandler).serve_forever()
@@ -0,0 +1,329 @@
+"""Stand-in DuetSoftwareFramework for testing SBC mode without a printer.
+
+Serves:
+  /rr_connect      answers with isEmulated, so the screen opens the object model socket
+  /rr_model        a minimal object model, used while the socket is not streaming
+  /rr_gcode        queues a reply to the command for /rr_reply
+  /rr_reply        replies queued since the last call
+  /machine         object model WebSocket: the whole object model, then a patch every --patch-interval seconds, each
+                   one after the previous one was acknowledged with "OK"
+
+The object model is laid out like the one of DSF 3.5 for a Duet 3 with an expansion board: keys the screen does not
+know, nulls in arrays and in place of objects, escaped strings, plugin and endpoint maps, and sensors, fans and tools
+at high indices. A decoding error drops the rest of a frame, so anything that does not show up on the screen, e.g. the
+temperatures of the last heaters or the chamber, points at a key it failed on.
+
+Example:
+  python3 Tools/dsf_server.py --reply-interval 5
+then set the screen to network mode with the address <host>:8080. --reply-interval queues unsolicited replies, like
+M118 from a macro, which have to show up on the console while the socket is streaming. --drop-after N closes the
+socket after N patches and --stall stops answering it, so the screen has to fall back to polling. --refuse answers
+/machine with 404, like versions of DSF without the socket.
+"""
+
+import argparse
+import base64
+import hashlib
+import http.server
+import json
+import socket
+import struct
+import threading
+import time
+import urllib.parse
+
+parser = argparse.ArgumentParser(description="Stand-in DSF object model server")
+parser.add_argument("--port", type=int, default=8080)
+parser.add_argument("--patch-interval", type=float, default=1, help="seconds between object model patches")
+parser.add_argument("--reply-interval", type=float, default=0, help="seconds between unsolicited replies, 0 for none")
+parser.add_argument("--drop-after", type=int, default=0, help="close the socket after this many patches")
+parser.add_argument("--stall", action="store_true", help="stop answering the socket after the first patch")
+parser.add_argument("--refuse", action="store_true", help="answer /machine with 404")
+args = parser.parse_args()
+
+ACCEPT_GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+lock = threading.Lock()
+replies = []
+uptime = 0
+
+
+def queue_reply(text):
+    with lock:
+        replies.append(text)
+    print("queued reply: %s" % text, flush=True)
+
+
+def temperature(heater):
+    return round(20 + 5 * heater + (uptime % 10) / 10, 1)
+
+
+def heater(index, standby):
+    return {"active": 60.0 if index == 0 else 200.0, "avgPwm": 0.0, "current": temperature(index),
+            "max": 285.0, "maxBadReadings": 3, "maxHeatingFaultTime": 5.0, "maxTempExcursion": 15.0, "min": -10.0,
+            "model": {"coolingExp": 1.35, "coolingRate": 0.56, "deadTime": 5.5, "enabled": True, "fanCoolingRate": 0.0,
+                      "heatingRate": 2.43, "inverted": False, "maxPwm": 1.0, "pid": {"d": 0.0, "i": 0.0, "overridden": False,
+                      "p": 0.0, "used": True}, "standardVoltage": 24.1},
+            "monitors": [{"action": 0, "condition": "tooHigh", "limit": 290.0, "sensor": index}, {"action": None,
+                         "condition": "disabled", "limit": None, "sensor": -1}],
+            "sensor": index, "standby": standby, "state": "off"}
+
+
+def sensor(index, name):
+    return {"beta": 4725.0, "c": 7.06e-08, "lastReading": temperature(index), "name": name, "offsetAdj": 0.0,
+            "port": "temp%d" % index, "r25": 100000.0, "rRef": 2200.0, "slopeAdj": 0.0, "state": "ok",
+            "type": "thermistor"}
+
+
+def fan(index, name):
+    return {"actualValue": 0.0, "blip": 0.1, "frequency": 250, "max": 1.0, "min": 0.0, "name": name, "requestedValue": 0.0,
+            "rpm": -1, "tachoPpr": 2.0, "thermostatic": {"heaters": [1] if index == 1 else [], "highTemperature": None,
+                                                        "lowTemperature": None}}
+
+
+def axis(letter, drivers):
+    return {"acceleration": 3000.0, "babystep": 0.0, "current": 1200, "drivers": drivers, "homed": letter != "U",
+            "jerk": 900.0, "letter": letter, "machinePosition": 0.0, "max": 300.0, "maxProbed": False, "microstepping":
+            {"interpolated": True, "value": 16}, "min": 0.0, "minProbed": False, "percentCurrent": 100,
+            "percentStstCurrent": None, "reducedAcceleration": 1000.0, "speed": 12000.0, "stepsPerMm": 80.0,
+            "userPosition": 0.0, "visible": True, "workplaceOffsets": [0.0] * 9}
+
+
+def tool(number, name, heaters, fans):
+    return {"active": [0.0] * len(heaters), "axes": [[0], [1]], "extruders": [0], "fans": fans, "feedForward": [0.0],
+            "filamentExtruder": 0, "heaters": heaters, "isRetracted": False, "mix": [1.0], "name": name, "number": number,
+            "offsets": [0.0, 0.0, 0.0], "offsetsProbed": 0, "retraction": {"extraRestart": 0.0, "length": 0.8,
+            "speed": 40.0, "unretractSpeed": 40.0, "zHop": 0.0}, "spindle": -1, "spindleRpm": 0, "standby": [0.0] *
+            len(heaters), "state": "off", "temperatureTolerance": None}
+
+
+def model():
+    # Like DSF, the pushed object model has no seqs, so a waiting reply is only found by asking for it
+    sensors = [sensor(0, "bed"), sensor(1, "nozzle \"E0\""), None, sensor(3, "chamber")] + [None] * 36
+    sensors.append(sensor(40, "expansion board \u00b0C"))
+    return {
+        "boards": [{"canAddress": 0, "directDisplay": None, "firmwareDate": "2024-10-01", "firmwareFileName":
+                    "Duet3Firmware_MB6HC.bin", "firmwareName": "RepRapFirmware for Duet 3 MB6HC", "firmwareVersion": "3.5.3",
+                    "iapFileNameSBC": "Duet3_SBCiap32_MB6HC.bin", "maxHeaters": 32, "maxMotors": 6, "mcuTemp":
+                    {"current": 38.2, "max": 39.1, "min": 30.4}, "name": "Duet 3 MB6HC", "shortName": "MB6HC",
+                    "state": "running", "uniqueId": "08DLM-996RU-N8PS4-7JTD0-3SJ6L-TUZ9M", "v12": {"current": 12.1,
+                    "max": 12.2, "min": 12.0}, "vIn": {"current": 24.1, "max": 24.3, "min": 23.9}},
+                   {"canAddress": 1, "firmwareVersion": "3.5.3", "name": "Duet 3 Expansion 3HC", "shortName": "EXP3HC",
+                    "state": "running", "vIn": {"current": 24.0, "max": 24.1, "min": 23.9}}],
+        "directories": {"filaments": "0:/filaments/", "firmware": "0:/firmware/", "gCodes": "0:/gcodes/",
+                        "macros": "0:/macros/", "menu": "0:/menu/", "system": "0:/sys/", "web": "0:/www/"},
+        "fans": [fan(0, "part cooling"), fan(1, "hotend"), None] + [None] * 9 + [fan(12, "chamber exhaust")],
+        "global": {"filamentLoaded": "PLA", "probeOffsets": [0.0, -25.5, 1.2], "note": "line 1\nline 2"},
+        "heat": {"bedHeaters": [0, -1, -1, -1], "chamberHeaters": [3, -1], "coldExtrudeTemperature": 160.0,
+                 "coldRetractTemperature": 90.0, "heaters": [heater(0, 0.0), heater(1, 0.0), None, heater(3, 0.0)]},
+        "httpEndpoints": [{"endpointType": "GET", "namespace": "my-plugin", "path": "status", "isUploadRequest": False,
+                           "unixSocket": "/run/dsf/my-plugin/status.sock"}],
+        "inputs": [{"active": True, "axesRelative": False, "compatibility": "RepRapFirmware", "distanceUnit": "mm",
+                    "drivesRelative": True, "feedRate": 50.0, "inMacro": False, "lineNumber": 0, "name": channel,
+                    "state": "idle", "stackDepth": 0, "volumetric": False} if channel != "Aux2" else None
+                   for channel in ("HTTP", "Telnet", "File", "USB", "Aux", "Trigger", "Queue", "LCD", "SBC", "Daemon",
+                                   "Aux2", "Autopause", "File2", "Queue2")],
+        "job": {"build": None, "duration": None, "file": {"fileName": None, "filament": [], "height": 0.0,
+                "layers": [], "printTime": None, "size": 0, "thumbnails": []}, "filePosition": 0, "lastDuration": 1234,
+                "lastFileName": "0:/gcodes/benchy.gcode", "lastFileAborted": False, "lastFileCancelled": False,
+                "lastFileSimulated": False, "layer": None, "layerTime": None, "pauseDuration": None, "rawExtrusion": None,
+                "timesLeft": {"filament": None, "file": None, "slicer": None}, "warmUpDuration": None},
+        "limits": {"axes": 15, "axesPlusExtruders": 25, "bedHeaters": 12, "boards": 40, "chamberHeaters": 4,
+                   "drivers": 20, "extruders": 16, "fans": 20, "gpInPorts": 40, "heaters": 32, "sensors": 56,
+                   "tools": 50, "volumes": 2},
+        "messages": [],
+        "move": {"axes": [axis("X", ["0.0"]), axis("Y", ["0.1"]), axis("Z", ["0.2", "1.0", "1.1"]), axis("U", ["1.2"])],
+                 "calibration": {"final": {"deviation": 0.0, "mean": 0.0}, "initial": {"deviation": 0.0, "mean": 0.0},
+                                 "numFactors": 0},
+                 "compensation": {"fadeHeight": None, "file": None, "liveGrid": None, "meshDeviation": None,
+                                  "probeGrid": {"axes": ["X", "Y"], "maxs": [280.0, 280.0], "mins": [20.0, 20.0],
+                                                "radius": 0.0, "spacings": [26.0, 26.0]}, "skew": {"compensateXY": True,
+                                                "tanXY": 0.0, "tanXZ": 0.0, "tanYZ": 0.0}, "type": "none"},
+                 "currentMove": {"acceleration": 0.0, "deceleration": 0.0, "extrusionRate": 0.0, "requestedSpeed": 0.0,
+                                 "topSpeed": 0.0},
+                 "extruders": [{"acceleration": 3000.0, "current": 600, "driver": "0.3", "factor": 1.0, "filament":
+                                "PLA", "jerk": 300.0, "nonlinear": {"a": 0.0, "b": 0.0, "upperLimit": 0.2},
+                                "percentCurrent": 100, "position": 0.0, "pressureAdvance": 0.05, "rawPosition": 0.0,
+                                "speed": 3600.0, "stepsPerMm": 420.0}],
+                 "kinematics": {"forwardMatrix": [[1.0, 0.0], [0.0, 1.0]], "name": "coreXY", "segmentation": None,
+                                "tiltCorrection": {"correctionFactor": 1.0, "lastCorrections": [], "maxCorrection": 10.0,
+                                                   "screwPitch": 0.5, "screwX": [], "screwY": []}},
+                 "limitAxes": True, "printingAcceleration": 10000.0, "queue": [{"gracePeriod": 0.01, "length": 60}],
+                 "speedFactor": 1.0, "travelAcceleration": 10000.0, "virtualEPos": 0.0, "workplaceNumber": 0},
+        "network": {"corsSite": None, "hostname": "duet3", "interfaces": [{"actualIP": "192.168.1.20",
+                    "activeProtocols": ["http", "ftp"], "gateway": "192.168.1.1", "mac": "00:11:22:33:44:55",
+                    "numReconnects": None, "signal": None, "speed": 100, "subnet": "255.255.255.0", "type": "lan"}],
+                    "name": "Duet 3"},
+        "plugins": {"my-plugin": {"author": "Someone", "data": {"any": ["thing", 1, None, {"nested": True}]},
+                                  "id": "my-plugin", "version": "1.0.0", "pid": 1234}},
+        "sbc": {"appArmor": False, "cpu": {"avgLoad": 0.12, "cores": 4, "hardware": "BCM2835", "temperature": 45.3},
+                "distribution": "Debian GNU/Linux 12 (bookworm)", "dsf": {"buildDateTime": "2024-10-01T12:00:00",
+                "version": "3.5.3"}, "memory": {"available": 1500000000, "total": 3900000000}, "model":
+                "Raspberry Pi 4 Model B Rev 1.4", "serial": "10000000abcdef12", "uptime": uptime},
+        "sensors": {"analog": sensors, "endstops": [{"highEnd": False, "triggered": False, "type": "inputPin",
+                    "probeNumber": None}, None, {"highEnd": True, "triggered": True, "type": "motorStallAny"}],
+                    "filamentMonitors": [None, {"calibrated": None, "configured": {"allMoves": False}, "enableMode": 1,
+                                                "status": "noDataReceived", "type": "laser"}],
+                    "gpIn": [None, {"value": 0}], "probes": [{"calibrationTemperature": 25.0, "deployedByUser": False,
+                    "disablesHeaters": False, "diveHeights": [5.0, 5.0], "lastStopHeight": 0.0, "maxProbeCount": 1,
+                    "offsets": [0.0, -25.5], "recoveryTime": 0.0, "speeds": [120.0, 120.0], "temperatureCoefficients":
+                    [0.0, 0.0], "threshold": 500, "tolerance": 0.03, "travelSpeed": 6000.0, "triggerHeight": 1.2,
+                    "type": 8, "value": [0]}]},
+        "spindles": [{"active": 0, "canReverse": False, "current": 0, "frequency": 0, "idlePwm": 0.0, "max": 10000,
+                      "maxPwm": 1.0, "min": 60, "minPwm": 0.0, "state": "unconfigured"}] + [None] * 3,
+        "state": {"atxPower": None, "atxPowerPort": None, "beep": None, "currentTool": -1, "deferredPowerDown": None,
+                  "displayMessage": "", "gpOut": [], "laserPwm": None, "logFile": "0:/sys/eventlog.txt", "logLevel": "warn",
+                  "machineMode": "FFF", "macroRestarted": False, "msUpTime": 512, "nextTool": -1, "pluginsStarted": True,
+                  "powerFailScript": "", "previousTool": -1, "restorePoints": [], "startupError": None, "status": "idle",
+                  "thisInput": None, "time": "2026-10-18T12:00:00", "upTime": uptime},
+        "tools": [tool(0, "Hotend", [1], [0])] + [None] * 14 + [tool(15, "Chamber \"tool\"", [3], [12])],
+        "userSessions": [{"accessLevel": "readWrite", "id": 1, "origin": "192.168.1.10", "originId": -1,
+                          "sessionType": "http"}],
+        "volumes": [{"capacity": 31000000000, "freeSpace": 30000000000, "mounted": True, "name": "SBC", "openFiles": None,
+                     "partitionSize": 31000000000, "path": "/opt/dsf/sd", "speed": None}],
+    }
+
+
+def patch():
+    # DSF patches hold only what changed, array items that did not change are sent as empty objects
+    heaters = [{"current": temperature(i)} if i != 2 else {} for i in range(4)]
+    analog = [{"lastReading": temperature(i)} if i in (0, 1, 3) else {} for i in range(41)]
+    analog[40] = {"lastReading": temperature(40)}
+    return {"heat": {"heaters": heaters}, "sensors": {"analog": analog},
+            "sbc": {"uptime": uptime}, "state": {"upTime": uptime, "msUpTime": (uptime * 1000) % 1000}}
+
+
+def send_frame(connection, payload, opcode=0x1):
+    header = bytes([0x80 | opcode])
+    if len(payload) < 126:
+        header += bytes([len(payload)])
+    elif len(payload) < 65536:
+        header += bytes([126]) + struct.pack(">H", len(payload))
+    else:
+        header += bytes([127]) + struct.pack(">Q", len(payload))
+    connection.sendall(header + payload)
+
+
+def receive_exactly(connection, length):
+    data = b""
+    while len(data) < length:
+        chunk = connection.recv(length - len(data))
+        if not chunk:
+            raise ConnectionError("closed")
+        data += chunk
+    return data
+
+
+def receive_frame(connection):
+    header = receive_exactly(connection, 2)
+    length = header[1] & 0x7F
+    if length == 126:
+        length = struct.unpack(">H", receive_exactly(connection, 2))[0]
+    elif length == 127:
+        length = struct.unpack(">Q", receive_exactly(connection, 8))[0]
+    mask = receive_exactly(connection, 4) if header[1] & 0x80 else b"\0\0\0\0"
+    payload = bytes(b ^ mask[i % 4] for i, b in enumerate(receive_exactly(connection, length)))
+    return header[0] & 0x0F, payload
+
+
+class DsfHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *log_args):
+        print("%s %s" % (self.address_string(), format % log_args), flush=True)
+
+    def send_json(self, body):
+        self.send_text(json.dumps(body), "application/json")
+
+    def send_text(self, body, content_type="text/plain"):
+        data = body.encode()
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        if url.path == "/rr_connect":
+            self.send_json({"err": 0, "sessionTimeout": 8000, "isEmulated": True})
+        elif url.path == "/rr_model":
+            key = query.get("key", [""])[0]
+            result = dict(model(), seqs={"reply": 0})
+            for part in filter(None, key.split(".")):
+                result = result.get(part) if isinstance(result, dict) else None
+            self.send_json({"key": key, "flags": query.get("flags", [""])[0], "result": result})
+        elif url.path == "/rr_gcode":
+            gcode = query.get("gcode", [""])[0]
+            queue_reply("echo: %s" % gcode)
+            self.send_json({"buff": 255})
+        elif url.path == "/rr_reply":
+            with lock:
+                body = "".join(reply + "\n" for reply in replies)
+                replies.clear()
+            self.send_text(body)
+        elif url.path == "/machine" and not args.refuse:
+            self.stream_model()
+        else:
+            self.send_error(404)
+
+    def stream_model(self):
+        key = self.headers.get("Sec-WebSocket-Key", "").encode()
+        accept = base64.b64encode(hashlib.sha1(key + ACCEPT_GUID).digest()).decode()
+        self.send_response(101)
+        self.send_header("Upgrade", "websocket")
+        self.send_header("Connection", "Upgrade")
+        self.send_header("Sec-WebSocket-Accept", accept)
+        self.end_headers()
+        self.wfile.flush()
+        self.close_connection = True
+
+        connection = self.connection
+        connection.settimeout(args.patch_interval)
+        send_frame(connection, json.dumps(model()).encode())
+        patches = 0
+        acknowledged = False
+        next_patch = time.time() + args.patch_interval
+        try:
+            while True:
+                try:
+                    opcode, payload = receive_frame(connection)
+                    if opcode == 0x8:
+                        print("socket closed by the screen", flush=True)
+                        return
+                    if payload == b"PING\n":
+                        send_frame(connection, b"PONG\n")
+                    elif payload == b"OK\n":
+                        acknowledged = True
+                except socket.timeout:
+                    pass
+                if acknowledged and time.time() >= next_patch:
+                    if args.drop_after and patches >= args.drop_after:
+                        print("dropping the socket after %d patches" % patches, flush=True)
+                        return
+                    if args.stall and patches > 0:
+                        print("stalling the socket", flush=True)
+                        time.sleep(3600)
+                    send_frame(connection, json.dumps(patch()).encode())
+                    patches += 1
+                    acknowledged = False
+                    next_patch = time.time() + args.patch_interval
+        except (ConnectionError, BrokenPipeError, OSError) as e:
+            print("socket ended: %s" % e, flush=True)
+
+
+def tick():
+    global uptime
+    last_reply = time.time()
+    while True:
+        time.sleep(1)
+        uptime += 1
+        if args.reply_interval and time.time() - last_reply >= args.reply_interval:
+            queue_reply("unsolicited reply at %d s" % uptime)
+            last_reply = time.time()
+
+
+threading.Thread(target=tick, daemon=True).start()
+print("Serving on port %d" % args.port, flush=True)
+http.server.ThreadingHTTPServer(("", args.port), DsfHandler).serve_forever()
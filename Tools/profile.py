@@ -0,0 +1,106 @@
+import argparse
+import os
+import subprocess
+
+parser = argparse.ArgumentParser(description="Symbolize a profile written by the dbg_profile_stop command")
+parser.add_argument("profile", help="profile file, e.g. /sys/DuetScreen_profile.txt copied from the Duet")
+parser.add_argument("--lib", default=os.path.join(os.path.dirname(__file__), "..", "src", "obj", "libzkgui.so"),
+                    help="unstripped library matching the profiled build")
+parser.add_argument("--addr2line", default=os.environ.get("CROSS_COMPILE", "") + "addr2line",
+                    help="addr2line for the target architecture")
+parser.add_argument("--thread", type=int, help="only include samples from this thread id")
+parser.add_argument("--top", type=int, default=30, help="number of functions to list")
+args = parser.parse_args()
+
+
+def read_profile(path):
+    header = {}
+    mappings = []
+    stacks = []
+    with open(path) as f:
+        for line in f:
+            fields = line.split()
+            if not fields or fields[0].startswith("#"):
+                continue
+            if fields[0] == "map":
+                start, end = (int(x, 16) for x in fields[1].split("-"))
+                offset = int(fields[3], 16)
+                name = fields[6] if len(fields) > 6 else "[anon]"
+                mappings.append((start, end, offset, name))
+            elif fields[0].isdigit():
+                count, tid = int(fields[0]), int(fields[1])
+                stacks.append((count, tid, [int(x, 16) for x in fields[2:]]))
+            else:
+                header[fields[0]] = int(fields[1])
+    return header, mappings, stacks
+
+
+def find_mapping(mappings, address):
+    for start, end, offset, name in mappings:
+        if start <= address < end:
+            return address - start + offset, name
+    return None, None
+
+
+def symbolize(mappings, addresses):
+    lib_name = os.path.basename(args.lib)
+    names = {}
+    lookups = {}
+    for address in addresses:
+        offset, name = find_mapping(mappings, address)
+        if name is None:
+            names[address] = "[unknown] 0x%x" % address
+        elif os.path.basename(name) == lib_name:
+            lookups[address] = offset
+        else:
+            names[address] = "%s+0x%x" % (os.path.basename(name), offset)
+
+    if lookups:
+        order = list(lookups)
+        command = [args.addr2line, "-f", "-C", "-e", args.lib] + ["0x%x" % lookups[a] for a in order]
+        output = subprocess.run(command, stdout=subprocess.PIPE, check=True).stdout.decode("utf-8").splitlines()
+        for i, address in enumerate(order):
+            function = output[2 * i] if 2 * i < len(output) else "??"
+            names[address] = function if function != "??" else "%s+0x%x" % (lib_name, lookups[address])
+    return names
+
+
+def print_table(title, counts, total):
+    print(title)
+    print("%8s %7s  %s" % ("samples", "%", "function"))
+    for function, count in sorted(counts.items(), key=lambda x: -x[1])[:args.top]:
+        print("%8d %6.2f%%  %s" % (count, 100.0 * count / total, function))
+    print()
+
+
+if __name__ == "__main__":
+    header, mappings, stacks = read_profile(args.profile)
+    if args.thread is not None:
+        stacks = [s for s in stacks if s[1] == args.thread]
+
+    # Return addresses point after the call, step back into the calling instruction
+    addresses = set()
+    for _, _, pcs in stacks:
+        addresses.add(pcs[0])
+        addresses.update(pc - 1 for pc in pcs[1:])
+    names = symbolize(mappings, addresses)
+
+    flat = {}
+    cumulative = {}
+    threads = {}
+    total = 0
+    for count, tid, pcs in stacks:
+        frames = [names[pcs[0]]] + [names[pc - 1] for pc in pcs[1:]]
+        flat[frames[0]] = flat.get(frames[0], 0) + count
+        for function in set(frames):
+            cumulative[function] = cumulative.get(function, 0) + count
+        threads[tid] = threads.get(tid, 0) + count
+        total += count
+
+    print("%d samples at %d Hz, %d dropped" % (total, header.get("frequency", 0), header.get("dropped", 0)))
+    if total == 0:
+        exit()
+    print("Threads: " + ", ".join("%d (%.1f%%)" % (t, 100.0 * c / total) for t, c in sorted(threads.items())))
+    print()
+    print_table("Flat profile (samples in the function itself)", flat, total)
+    print_table("Cumulative profile (samples in the function or its callees)", cumulative, total)
@@ -0,0 +1,160 @@
+"""Stand-in Duet firmware on a pseudo-terminal, for testing the UART code of the screen without a printer.
+
+Prints the path of the pty to connect to. It answers:
+  M409 ...            a minimal object model, so the screen stays connected
+  N<n> ...*<cs>       numbered lines, rejected with a resend request if the checksum or line number is wrong
+  M110 N<n>           resets the line number
+  M28 "<file>"        starts writing the following lines to <output>/<file>, M29 closes it
+  M38 "<file>"        answers with the SHA1 of <output>/<file>, which the screen checks unacknowledged uploads against
+  M575 P1 B<rate>     answers "ok", then only understands the screen once it has followed to <rate>
+  M118 P2 S"<text>"   echoes the text as a response, like the baud rate probes expect
+  <line>*<cs>         unnumbered lines with a checksum are dropped with an error if it does not match
+anything else is answered with "ok".
+
+Example:
+  python3 Tools/uart_firmware.py --corrupt 0.01 --output /tmp/uploads
+then run a host build of the screen, or a test harness of its UART code, against the printed pty. --no-ack acts like
+firmware in PanelDue mode, which does not acknowledge lines, so with --corrupt as well the upload has to fail its
+SHA1 check. --max-rate corrupts everything sent above that rate, so baud rate negotiation has to settle below it, and
+--noisy-rate does the same only after "NOISE" has been received, so a negotiated rate has to fall back.
+"""
+
+import argparse
+import hashlib
+import os
+import pty
+import random
+import re
+import termios
+import tty
+
+parser = argparse.ArgumentParser(description="Stand-in Duet firmware on a pty")
+parser.add_argument("--output", default=".", help="directory uploaded files are written to")
+parser.add_argument("--corrupt", type=float, default=0, help="probability that a received line is corrupted")
+parser.add_argument("--no-ack", action="store_true", help="don't answer numbered lines")
+parser.add_argument("--rate", type=int, default=57600, help="baud rate the firmware starts at")
+parser.add_argument("--max-rate", type=int, default=460800, help="responses are corrupted above this rate")
+parser.add_argument("--noisy-rate", type=int, default=115200, help="max rate once NOISE has been received")
+args = parser.parse_args()
+
+TERMIOS_RATES = {getattr(termios, "B%d" % rate): rate
+                 for rate in (9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600)
+                 if hasattr(termios, "B%d" % rate)}
+
+master, slave = pty.openpty()
+tty.setraw(slave)
+print(os.ttyname(slave), flush=True)
+
+expected_line = 0
+upload = None
+rate = args.rate
+max_rate = args.max_rate
+
+
+def screen_rate():
+    return TERMIOS_RATES.get(termios.tcgetattr(master)[4], 0)
+
+
+def send(text):
+    data = bytearray(text.encode())
+    if screen_rate() != rate or rate > max_rate:
+        data[len(data) // 2] ^= 0x55
+    os.write(master, bytes(data))
+
+
+def checksum(text):
+    value = 0
+    for c in text:
+        value ^= ord(c)
+    return value
+
+
+def reject(reason):
+    print("rejected line: %s, asking for %d" % (reason, expected_line), flush=True)
+    send("Error: %s\nrs %d\n%s" % (reason, expected_line, "" if args.no_ack else "ok\n"))
+
+
+def output_path(name):
+    return os.path.join(args.output, re.sub(r"^(\d:)?/*", "", name.strip('"')))
+
+
+def handle_numbered(line):
+    global expected_line, upload
+    match = re.match(r"(N(\d+) (.*))\*(\d+)$", line)
+    if match is None:
+        reject("malformed line")
+        return
+    if checksum(match.group(1)) != int(match.group(4)):
+        reject("checksum mismatch")
+        return
+    number, body = int(match.group(2)), match.group(3)
+    if body.startswith("M110"):
+        expected_line = number + 1
+    elif number != expected_line:
+        reject("Line Number is not Last Line Number+1")
+        return
+    else:
+        expected_line += 1
+        if upload is not None:
+            upload.write(body + "\n")
+        elif body.startswith("M28 "):
+            path = output_path(body[4:])
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            upload = open(path, "w")
+            print("writing %s" % path, flush=True)
+    if not args.no_ack:
+        send("ok\n")
+
+
+def handle(line):
+    global upload, rate, max_rate
+    if screen_rate() != rate:
+        print("garbage received, the screen is at %d baud and the firmware at %d" % (screen_rate(), rate), flush=True)
+        return
+    if args.corrupt and random.random() < args.corrupt and line:
+        index = random.randrange(len(line))
+        line = line[:index] + chr(ord(line[index]) ^ 1) + line[index + 1:]
+    if line.startswith("N"):
+        handle_numbered(line)
+        return
+    match = re.match(r"(.*)\*(\d+)$", line)
+    if match is not None:
+        if checksum(match.group(1)) != int(match.group(2)) or rate > max_rate:
+            send("Error: checksum mismatch\n")
+            return
+        line = match.group(1)
+
+    if line == "NOISE":
+        max_rate = args.noisy_rate
+        print("responses corrupted above %d baud" % max_rate, flush=True)
+    elif line.startswith("M575 P1 B"):
+        send("ok\n")
+        rate = int(line[9:])
+        print("firmware now at %d baud" % rate, flush=True)
+    elif line.startswith('M118 P2 S"'):
+        send('{"resp":"%s"}\n' % line[10:].rstrip('"'))
+    elif line == "M29":
+        if upload is not None:
+            print("closed %s" % upload.name, flush=True)
+            upload.close()
+            upload = None
+    elif upload is not None:
+        upload.write(line + "\n")
+    elif line.startswith("M38 "):
+        try:
+            with open(output_path(line[4:]), "rb") as f:
+                send('{"resp":"%s\\n"}\n' % hashlib.sha1(f.read()).hexdigest())
+        except OSError:
+            send("Error: M38: Cannot find file\n")
+    elif line.startswith("M409"):
+        send('{"key":"","flags":"","result":{"state":{"status":"idle"}}}\n')
+    elif line:
+        send("ok\n")
+
+
+pending = b""
+while True:
+    pending += os.read(master, 4096)
+    while b"\n" in pending:
+        line, pending = pending.split(b"\n", 1)
+        handle(line.decode("latin1").rstrip("\r"))
@@ -0,0 +1,110 @@
+"""Stand-in webcam for testing the webcam page without a camera.
+
+Serves the JPEG files given on the command line, one after another, as:
+  /stream          multipart/x-mixed-replace MJPEG stream
+  /stream?drop=N   stream that closes the connection after N frames, so the screen has to reconnect
+  /snapshot        single frame, supporting If-None-Match and If-Modified-Since
+  /snapshot?static always the first frame, so an unchanged picture can be tested
+  /snapshot?plain  no ETag or Last-Modified, like cameras that don't support conditional requests
+  /error           500 response
+  /slow            accepts the connection but never answers
+
+Example:
+  python3 Tools/webcam_server.py a.jpg b.jpg --fps 15
+then set the webcam url on the screen to http://<host>:8081/stream
+"""
+
+import argparse
+import hashlib
+import http.server
+import itertools
+import time
+import urllib.parse
+from email.utils import formatdate
+
+parser = argparse.ArgumentParser(description="Stand-in MJPEG and snapshot webcam server")
+parser.add_argument("frames", nargs="+", help="JPEG files to serve as frames")
+parser.add_argument("--port", type=int, default=8081)
+parser.add_argument("--fps", type=float, default=10, help="frame rate of /stream")
+parser.add_argument("--boundary", default="frame", help="multipart boundary, empty to leave it out of the header")
+args = parser.parse_args()
+
+frames = []
+for path in args.frames:
+    with open(path, "rb") as f:
+        frames.append(f.read())
+snapshot_counter = itertools.count()
+start_time = time.time()
+
+
+class WebcamHandler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *log_args):
+        print("%s %s" % (self.address_string(), format % log_args), flush=True)
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = urllib.parse.parse_qs(url.query, keep_blank_values=True)
+        if url.path == "/stream":
+            self.stream(int(query["drop"][0]) if "drop" in query else None)
+        elif url.path == "/snapshot":
+            self.snapshot("static" in query, "plain" in query)
+        elif url.path == "/error":
+            self.send_error(500, "Stand-in camera error")
+        elif url.path == "/slow":
+            time.sleep(3600)
+        else:
+            self.send_error(404)
+
+    def snapshot(self, static, plain):
+        index = 0 if static else next(snapshot_counter) % len(frames)
+        body = frames[index]
+        etag = '"%s"' % hashlib.md5(body).hexdigest()
+        # Each frame keeps the time the server started, so an unchanged frame is not modified since then
+        last_modified = formatdate(start_time + index, usegmt=True)
+        if not plain and (self.headers.get("If-None-Match") == etag or
+                          self.headers.get("If-Modified-Since") == last_modified):
+            self.send_response(304)
+            self.send_header("ETag", etag)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return
+        self.send_response(200)
+        self.send_header("Content-Type", "image/jpeg")
+        self.send_header("Content-Length", str(len(body)))
+        if not plain:
+            self.send_header("ETag", etag)
+            self.send_header("Last-Modified", last_modified)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def stream(self, drop):
+        boundary = args.boundary or "frame"
+        content_type = "multipart/x-mixed-replace"
+        if args.boundary:
+            content_type += "; boundary=" + boundary
+        self.send_response(200)
+        self.send_header("Content-Type", content_type)
+        self.send_header("Cache-Control", "no-cache")
+        self.send_header("Connection", "close")
+        self.end_headers()
+        sent = 0
+        try:
+            for body in itertools.cycle(frames):
+                if drop is not None and sent >= drop:
+                    break
+                self.wfile.write(b"--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %d\r\n\r\n" %
+                                 (boundary.encode(), len(body)))
+                self.wfile.write(body + b"\r\n")
+                self.wfile.flush()
+                sent += 1
+                time.sleep(1 / args.fps)
+        except (BrokenPipeError, ConnectionResetError):
+            pass
+        print("stream closed after %d frames" % sent, flush=True)
+        self.close_connection = True
+
+
+print("Serving %d frames on port %d" % (len(frames), args.port), flush=True)
+http.server.ThreadingHTTPServer(("", args.port), WebcamHandler).serve_forever()
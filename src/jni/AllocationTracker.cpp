@@ -0,0 +1,130 @@
+/*
+ * AllocationTracker.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "AllocationTracker.h"
+#include <stdio.h>
+#include <string.h>
+
+// musl, which the screen firmware is built with, has no mallinfo
+#if defined(__GLIBC__) || defined(__UCLIBC__) || defined(__BIONIC__)
+#include <malloc.h>
+#define HAVE_MALLINFO 1
+#else
+#define HAVE_MALLINFO 0
+#endif
+
+namespace Memory
+{
+	static AllocationStats s_stats[(size_t)Subsystem::COUNT];
+	static AllocationStats s_total;
+
+	static const char* s_subsystemNames[] = {"comm", "json", "thumbnails", "ui", "buffers"};
+	static_assert(sizeof(s_subsystemNames) / sizeof(s_subsystemNames[0]) == (size_t)Subsystem::COUNT,
+				  "Subsystem names out of date");
+
+	static inline void UpdatePeak(size_t& peak, size_t value)
+	{
+		size_t current = __atomic_load_n(&peak, __ATOMIC_RELAXED);
+		while (value > current &&
+			   !__atomic_compare_exchange_n(&peak, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+		}
+	}
+
+	static inline void AccountAllocation(AllocationStats& stats, size_t size)
+	{
+		__atomic_add_fetch(&stats.allocations, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&stats.liveBlocks, 1, __ATOMIC_RELAXED);
+		UpdatePeak(stats.peakBytes, __atomic_add_fetch(&stats.liveBytes, size, __ATOMIC_RELAXED));
+	}
+
+	static inline void AccountFree(AllocationStats& stats, size_t size)
+	{
+		__atomic_add_fetch(&stats.frees, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&stats.liveBlocks, 1, __ATOMIC_RELAXED);
+		__atomic_sub_fetch(&stats.liveBytes, size, __ATOMIC_RELAXED);
+	}
+
+	void RecordAllocation(Subsystem subsystem, size_t size)
+	{
+		if (subsystem >= Subsystem::COUNT)
+			return;
+		AccountAllocation(s_stats[(size_t)subsystem], size);
+		AccountAllocation(s_total, size);
+	}
+
+	void RecordFree(Subsystem subsystem, size_t size)
+	{
+		if (subsystem >= Subsystem::COUNT)
+			return;
+		AccountFree(s_stats[(size_t)subsystem], size);
+		AccountFree(s_total, size);
+	}
+
+	const char* GetSubsystemName(Subsystem subsystem)
+	{
+		if (subsystem >= Subsystem::COUNT)
+			return "unknown";
+		return s_subsystemNames[(size_t)subsystem];
+	}
+
+	static void CopyStats(const AllocationStats& from, AllocationStats& to)
+	{
+		to.allocations = __atomic_load_n(&from.allocations, __ATOMIC_RELAXED);
+		to.frees = __atomic_load_n(&from.frees, __ATOMIC_RELAXED);
+		to.liveBlocks = __atomic_load_n(&from.liveBlocks, __ATOMIC_RELAXED);
+		to.liveBytes = __atomic_load_n(&from.liveBytes, __ATOMIC_RELAXED);
+		to.peakBytes = __atomic_load_n(&from.peakBytes, __ATOMIC_RELAXED);
+	}
+
+	void GetStats(Subsystem subsystem, AllocationStats& stats)
+	{
+		if (subsystem >= Subsystem::COUNT)
+		{
+			stats = AllocationStats();
+			return;
+		}
+		CopyStats(s_stats[(size_t)subsystem], stats);
+	}
+
+	void GetTotalStats(AllocationStats& stats)
+	{
+		CopyStats(s_total, stats);
+	}
+
+	// @return the value of a "<name>: <n> kB" line of /proc/self/status in bytes, 0 if it isn't there
+	static size_t StatusBytes(const char* status, const char* name)
+	{
+		const char* line = strstr(status, name);
+		if (line == nullptr)
+			return 0;
+		return strtoul(line + strlen(name), nullptr, 10) * 1024;
+	}
+
+	void GetHeapUsage(HeapUsage& usage)
+	{
+		usage = HeapUsage();
+#if HAVE_MALLINFO
+		struct mallinfo info = mallinfo();
+		usage.haveMallocStats = true;
+		usage.arenaBytes = (size_t)info.arena;
+		usage.mappedBytes = (size_t)info.hblkhd;
+		usage.inUseBytes = (size_t)info.uordblks + (size_t)info.hblkhd;
+		usage.freeBytes = (size_t)info.fordblks;
+#endif
+
+		FILE* f = fopen("/proc/self/status", "r");
+		if (f == nullptr)
+			return;
+		char status[2048];
+		const size_t len = fread(status, 1, sizeof(status) - 1, f);
+		fclose(f);
+		status[len] = '\0';
+		usage.dataBytes = StatusBytes(status, "\nVmData:");
+		usage.residentBytes = StatusBytes(status, "\nVmRSS:");
+	}
+} // namespace Memory
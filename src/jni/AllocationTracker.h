@@ -0,0 +1,160 @@
+/*
+ * AllocationTracker.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Heap accounting per subsystem.
+ *  Classes opt in by deriving from Memory::Tracked, which gives them their own operator new and delete that count
+ *  their objects against a subsystem. Memory that is not allocated through such a class, such as a buffer owned by a
+ *  library object, can be counted explicitly with RecordAllocation and RecordFree, or held in a TrackedBytes.
+ *
+ *  Only allocations counted this way are tracked. The global operator new and delete are left alone, as this library
+ *  shares them with the zkgui framework. Object model objects come from the free lists in FreelistManager, which keep
+ *  their own counts. GetHeapUsage gives the figures for the whole process, to compare the tracked part against.
+ */
+
+#ifndef JNI_ALLOCATIONTRACKER_H_
+#define JNI_ALLOCATIONTRACKER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <stdlib.h>
+#include <string>
+
+namespace Memory
+{
+	enum class Subsystem : uint8_t
+	{
+		Comm = 0,
+		Json,
+		Thumbnails,
+		UI,
+		Buffers, // Large fixed buffers, wherever they are: JSON decoders (mostly on thread stacks), UART, log, upgrade
+		COUNT
+	};
+
+	struct AllocationStats
+	{
+		uint32_t allocations; // total number of allocations made
+		uint32_t frees;		  // total number of blocks freed
+		uint32_t liveBlocks;
+		size_t liveBytes;
+		size_t peakBytes;
+	};
+
+	void RecordAllocation(Subsystem subsystem, size_t size);
+	void RecordFree(Subsystem subsystem, size_t size);
+
+	/// @brief Base class that counts the objects of the derived class against a subsystem.
+	/// Objects must be deleted through a pointer to their own type, or to a base class with a virtual destructor, so
+	/// that the size passed to operator delete is the size that was allocated
+	template <Subsystem S>
+	struct Tracked
+	{
+		static void* operator new(size_t size) { return Allocate(size); }
+		static void* operator new[](size_t size) { return Allocate(size); }
+		static void operator delete(void* p, size_t size) { Free(p, size); }
+		static void operator delete[](void* p, size_t size) { Free(p, size); }
+
+	  private:
+		static void* Allocate(size_t size)
+		{
+			void* p = malloc(size);
+			if (p == nullptr)
+			{
+				// Nothing in this project handles std::bad_alloc, so fail the same way an uncaught exception would
+				abort();
+			}
+			RecordAllocation(S, size);
+			return p;
+		}
+
+		static void Free(void* p, size_t size)
+		{
+			if (p == nullptr)
+				return;
+			RecordFree(S, size);
+			free(p);
+		}
+	};
+
+	/// @brief Counts bytes against a subsystem for as long as it lives, for memory that is not allocated through
+	/// Tracked, such as the contents of containers. Set replaces the count, as one block freed and another allocated,
+	/// so the allocations of the subsystem also show how often the contents were rebuilt. A copy counts the same
+	/// bytes again
+	template <Subsystem S>
+	class TrackedBytes
+	{
+	  public:
+		TrackedBytes() : m_bytes(0) {}
+		explicit TrackedBytes(size_t bytes) : m_bytes(0) { Set(bytes); }
+		TrackedBytes(const TrackedBytes& other) : m_bytes(0) { Set(other.m_bytes); }
+		~TrackedBytes() { Set(0); }
+
+		TrackedBytes& operator=(const TrackedBytes& other)
+		{
+			Set(other.m_bytes);
+			return *this;
+		}
+
+		void Set(size_t bytes)
+		{
+			if (m_bytes > 0)
+				RecordFree(S, m_bytes);
+			if (bytes > 0)
+				RecordAllocation(S, bytes);
+			m_bytes = bytes;
+		}
+
+		size_t Get() const { return m_bytes; }
+
+	  private:
+		size_t m_bytes;
+	};
+
+	// Estimates of the heap used by the contents of standard containers, to pass to TrackedBytes. Neither the rounding
+	// of malloc nor a short string kept inside the object itself can be seen from here
+	constexpr size_t MAP_NODE_OVERHEAD = 4 * sizeof(void*); // links and colour of each element of a std::map
+
+	inline size_t HeapBytes(const char*)
+	{
+		return 0;
+	}
+
+	inline size_t HeapBytes(const std::string& text)
+	{
+		return text.capacity() > 0 ? text.capacity() + 1 : 0;
+	}
+
+	template <typename K, typename V, typename C, typename A>
+	size_t HeapBytes(const std::map<K, V, C, A>& map)
+	{
+		size_t bytes = 0;
+		for (typename std::map<K, V, C, A>::const_iterator it = map.begin(); it != map.end(); ++it)
+		{
+			bytes += MAP_NODE_OVERHEAD + sizeof(*it) + HeapBytes(it->first) + HeapBytes(it->second);
+		}
+		return bytes;
+	}
+
+	struct HeapUsage
+	{
+		bool haveMallocStats; // false if the C library has no mallinfo, then only the process figures are set
+		size_t arenaBytes;	  // obtained from the system by malloc, apart from the blocks it mapped on their own
+		size_t mappedBytes;	  // large blocks malloc mapped on their own
+		size_t inUseBytes;	  // allocated by the whole process, zkgui framework and libraries included
+		size_t freeBytes;	  // held by malloc but not allocated
+		size_t dataBytes;	  // VmData of the process: heap, private mappings and thread stacks
+		size_t residentBytes; // VmRSS of the process
+	};
+
+	void GetHeapUsage(HeapUsage& usage);
+
+	const char* GetSubsystemName(Subsystem subsystem);
+	void GetStats(Subsystem subsystem, AllocationStats& stats);
+	void GetTotalStats(AllocationStats& stats);
+} // namespace Memory
+
+#endif /* JNI_ALLOCATIONTRACKER_H_ */
@@ -11,6 +11,10 @@
 #include <sys/types.h>
 
 constexpr const char* UPGRADE_FILE_NAME = "DuetScreen.bin";
+constexpr const char* UPGRADE_STAGING_DIR = "/tmp"; // Where the upgrade monitor looks for update.img
+constexpr const char* UPGRADE_STAGING_FILE = "/tmp/update.img";
+constexpr const char* UPGRADE_PARTIAL_FILE = "/tmp/update.img.part"; // Renamed once written, synced and verified
+constexpr size_t UPGRADE_BLOCK_SIZE = 64 * 1024;
 
 /* Duet */
 constexpr uint32_t DEFAULT_PRINTER_POLL_INTERVAL = 500;
@@ -21,14 +25,35 @@ constexpr const char* DEFAULT_IP_ADDRESS = "192.168.0.";
 constexpr size_t MAX_IP_LENGTH = 50;
 constexpr size_t MAX_HOSTNAME_LENGTH = 64;
 constexpr unsigned long long TIME_SYNC_INTERVAL = 10e3; // Interval to resynchronize time with the Duet in milliseconds
-constexpr size_t MAX_UART_UPLOAD_SIZE = 1024;
+constexpr size_t UART_UPLOAD_WINDOW = 1024;	   // Sent but unacknowledged bytes while uploading a file via UART
+constexpr size_t UART_UPLOAD_BLOCK_SIZE = 256; // Lines are written to the UART in blocks of up to this many bytes
+constexpr uint32_t UART_UPLOAD_ACK_TIMEOUT = 2000; // Resend unacknowledged lines after this (ms)
+constexpr uint32_t UART_UPLOAD_MAX_RETRIES = 5;	   // Consecutive timeouts or resend requests before giving up
+constexpr int32_t UART_UPLOAD_POLL_INTERVAL = 5;
+constexpr long long UART_UPLOAD_PROGRESS_INTERVAL = 100; // Popup progress is refreshed this often (ms)
+constexpr uint32_t UART_UPLOAD_VERIFY_TIMEOUT = 10000;	 // Wait for M38 to hash a file that was not acknowledged (ms)
+constexpr unsigned int UART_BAUD_MAX_RATE = 921600;	   // Highest rate tried when negotiating
+constexpr uint32_t UART_BAUD_PROBE_COUNT = 4;		   // Echoes that have to come back intact before a rate is used
+constexpr size_t UART_BAUD_PROBE_LENGTH = 64;		   // Random characters in each echo
+constexpr uint32_t UART_BAUD_PROBE_TIMEOUT = 1000;	   // An echo not back after this (ms) has failed
+constexpr int32_t UART_BAUD_SWITCH_DELAY = 200;		   // Time for the firmware to act on M575 before following it
+constexpr uint32_t UART_BAUD_FALLBACK_ATTEMPTS = 3;
+constexpr int UART_BAUD_ERROR_BURST = 3; // Malformed responses in a row that make a negotiated rate fall back
+constexpr int32_t UART_BAUD_POLL_INTERVAL = 5;
 constexpr const char* DEFAULT_FILAMENTS_FILE = "filaments.csv";
 constexpr const char* DEFAULT_HEIGHTMAPS_FILE = "heightmaps.csv";
 
 /* Thumbnails */
 constexpr int32_t FILE_CACHE_REQUEST_TIMEOUT = 5000;
 constexpr size_t MAX_THUMBNAIL_CACHE_PIXELS = 64; // Largest pixel width/height thumbnail that is allowed to be cached
-constexpr int32_t BACKGROUND_FILE_CACHE_POLL_INTERVAL = 500;
+constexpr int32_t FILE_CACHE_POLL_INTERVAL = 50;			  // Used while file info or thumbnail requests are pending
+constexpr int32_t BACKGROUND_FILE_CACHE_POLL_INTERVAL = 500; // Used while idle, or when not on the file list
+constexpr size_t THUMBNAIL_WORKER_QUEUE_LENGTH = 4; // Chunks waiting to be decoded before the receiving thread waits
+constexpr size_t FILE_LIST_THUMBNAIL_LOOKUPS = 256;	// Files the file list remembers having a cached thumbnail or not
+constexpr int FILE_LIST_THUMBNAIL_PREFETCH_ROWS = 4; // Rows either side of a shown row whose thumbnails are fetched first
+
+/* USB */
+constexpr size_t USB_CACHE_MAX_DIRECTORIES = 16; // Listings kept and watched for changes, least recently used dropped
 
 /* Json Decoder */
 constexpr size_t MAX_ARRAY_NESTING = 4;
@@ -41,6 +66,17 @@ constexpr size_t MAX_JSON_VALUE_LENGTH = 4096 * 5;
 // Duet 2 seems to only support 3 concurrent connections. We need 1 connection for synchronous requests, so we can
 // only have 2 threads.
 constexpr size_t MAX_THREAD_POOL_SIZE = 2;
+constexpr int32_t ASYNC_REQUEST_QUEUE_POLL_INTERVAL = 50; // Only polled while requests are queued
+constexpr const char* HTTP_ACCEPT_ENCODING = "gzip, deflate";
+constexpr uint32_t HTTP_COMPRESSION_PROBE_RESPONSES = 4; // Uncompressed responses in a row before giving up asking
+
+// DSF object model WebSocket, used in SBC mode
+constexpr const char* OM_SOCKET_PATH = "/machine";
+constexpr int32_t OM_SOCKET_PING_INTERVAL = 2000;  // Sent when nothing else has been sent for this long
+constexpr int32_t OM_SOCKET_TIMEOUT = 5000;		   // Closed if nothing, not even a ping reply, arrives for this long
+constexpr int32_t OM_SOCKET_RETRY_INTERVAL = 10000; // The object model is polled until the socket is opened again
+constexpr int32_t OM_SOCKET_POLL_INTERVAL = 100;
+constexpr size_t OM_SOCKET_BUFFER_SIZE = 4096;
 
 /* Object Model */
 constexpr size_t MAX_TOTAL_AXES = 15; // This needs to be kept in sync with the maximum in RRF
@@ -54,7 +90,10 @@ constexpr unsigned int MAX_FANS = 12;
 constexpr unsigned int MAX_HEATERS = 32;
 constexpr unsigned int MAX_SENSORS = 32;
 constexpr unsigned int MAX_ENDSTOPS = 20;
-constexpr size_t MAX_TRACKED_OBJECTS = 40;
+constexpr size_t MAX_TRACKED_OBJECTS = 256;
+constexpr size_t OM_PROJECTION_MAX_PATHS = 8; // A key needing more paths than this is requested whole
+constexpr const char* OM_SNAPSHOT_FILE = "/data/DuetScreen_om_snapshot.bin";
+constexpr long long OM_SNAPSHOT_SAVE_DELAY = 2000; // Changes are written once no other change arrived for this long (ms)
 
 /* Move */
 constexpr int MAX_MOVE_FEEDRATE = 10000;
@@ -71,15 +110,24 @@ constexpr double HEIGHTMAP_FIXED_MAX = 0.25;
 constexpr double HEIGHTMAP_FIXED_MIN = -0.25;
 constexpr size_t HEIGHTMAP_COLORBAR_SAMPLES = 100;
 
+/* Object Cancel */
+constexpr size_t OBJECT_CANCEL_GRID_CELLS = 16; // The canvas is split into this many cells in each direction for touches
+
 /* Console */
 constexpr unsigned int MAX_COMMAND_LENGTH = 50;
-constexpr unsigned int MAX_RESPONSE_LINE_LENGTH = 80;
-constexpr unsigned int MAX_RESPONSE_LINES = 500;
+constexpr unsigned int MAX_RESPONSE_LINE_LENGTH = 80;	 // Longer responses are wrapped onto multiple rows
+constexpr unsigned int MAX_RESPONSE_LINES = 2048;		 // Maximum number of rows held in the console history
+constexpr size_t MAX_RESPONSE_BUFFER_SIZE = 32 * 1024; // Bytes shared by all rows in the console history
 
 /* Webcam */
 constexpr size_t MAX_WEBCAMS = 20;
 constexpr int32_t DEFAULT_WEBCAM_UPDATE_INTERVAL = 500;
 constexpr int32_t MINIMUM_WEBCAM_UPDATE_INTERVAL = 100;
+constexpr int32_t MAX_WEBCAM_IDLE_UPDATE_INTERVAL = 2000; // Snapshot poll interval backs off to this while unchanged
+constexpr int32_t WEBCAM_SNAPSHOT_TIMEOUT = 5000;			  // Time before another snapshot request can be made
+constexpr size_t MAX_WEBCAM_FRAME_SIZE = 2 * 1024 * 1024; // Largest MJPEG frame that will be buffered
+constexpr int32_t WEBCAM_STREAM_POLL_INTERVAL = 40;		  // How often a decoded MJPEG frame is checked for
+constexpr int32_t MJPEG_RECONNECT_DELAY = 1000;			  // Wait before reconnecting to a stream that broke
 
 /* Misc UI */
 constexpr bool DEFAULT_SHOW_SETUP_ON_STARTUP = true;
@@ -101,4 +149,28 @@ constexpr size_t DEFAULT_TEMP_GRAPH_TIME_RANGE = 60;
 constexpr float TEMP_GRAPH_Y_AXIS_PADDING = 10;
 constexpr size_t GRAPH_DATAPOINTS = DEFAULT_TEMP_GRAPH_TIME_RANGE * (1000 / MIN_PRINTER_POLL_INTERVAL);
 
+/* Debug */
+constexpr size_t LOG_THREAD_BUFFER_SIZE = 16 * 1024; // Log records waiting to be formatted, per thread
+constexpr size_t LOG_MAX_RECORD_SIZE = 1024;		  // Longer string arguments are truncated
+constexpr size_t LOG_MAX_FORMATTED_LENGTH = 1024;
+constexpr size_t LOG_HISTORY_SIZE = 32 * 1024; // Formatted lines kept for the crash log
+constexpr size_t LOG_HISTORY_LINES = 256;
+constexpr const char* LOG_CRASH_FILE = "/data/DuetScreen_crash_log.txt";
+constexpr size_t LOG_HISTORY_CONSOLE_LINES = 50;
+constexpr int32_t ALLOCATION_LOG_INTERVAL = 60000; // How often heap usage per subsystem is written to the log
+constexpr uint32_t PROFILE_SAMPLE_FREQUENCY = 200; // Samples per second of CPU time
+constexpr size_t PROFILE_MAX_SAMPLES = 12000;
+constexpr uint32_t PROFILE_MAX_DEPTH = 8;				 // Program counter plus return addresses per sample
+constexpr size_t PROFILE_MAX_STACK_SPAN = 1024 * 1024; // Frames further up the stack than this are ignored
+constexpr const char* PROFILE_FILE = "/tmp/DuetScreen_profile.txt";
+constexpr size_t LATENCY_MAX_ENTRIES = 48;	  // Endpoints and object model keys with latency histograms
+constexpr size_t UART_MAX_PENDING_TRACES = 8; // M409 requests waiting for a response
+constexpr uint32_t UI_STALL_THRESHOLD = 200;   // UI thread callbacks taking longer than this (ms) are logged
+constexpr uint32_t UI_STALL_MAX_NESTING = 8;
+constexpr uint32_t UI_STALL_BACKTRACE_DEPTH = 16;
+constexpr size_t UI_TIMING_MAX_ENTRIES = 48;
+constexpr int64_t UI_TIMING_MAX_PERIODS_LATE = 10; // Longer gaps between timer runs mean the timer was stopped
+constexpr uint32_t STARTUP_TIME_BUDGET = 1500; // From the start of the process to the UI being ready (ms)
+constexpr size_t STARTUP_MAX_PHASES = 32;
+
 #endif /* JNI_CONFIGURATION_H_ */
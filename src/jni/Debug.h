@@ -13,12 +13,6 @@
 #include "utils/Log.h"
 #include <cstdarg>
 
-#define __dbg(level, tag, fmt, args...)                                                                                \
-	do                                                                                                                 \
-	{                                                                                                                  \
-		__android_log_vprint(level, tag, fmt, args);                                                                   \
-	} while (0)
-
 constexpr const char* DebugLevelStrings[] = {
 	"dbg_verbose",
 	"dbg_debug",
@@ -42,48 +36,25 @@ enum class DebugLevel
 void SetDebugLevel(DebugLevel level);
 const DebugLevel& GetDebugLevel();
 
-void verbose_inner(const char* tag, const char* fmt, ...);
-void dbg_inner(const char* tag, const char* fmt, ...);
-void info_inner(const char* tag, const char* fmt, ...);
-void warn_inner(const char* tag, const char* fmt, ...);
-void error_inner(const char* tag, const char* fmt, ...);
-void fatal_inner(const char* tag, const char* fmt, ...);
+#include "Logger.h"
 
-#ifdef DEBUG
-#define verbose(fmt, args...)                                                                                          \
-	do                                                                                                                 \
-	{                                                                                                                  \
-		verbose_inner(__FILE__, "%s(%d): " fmt, __FUNCTION__, __LINE__, ##args);                                       \
-	} while (0)
-#define dbg(fmt, args...)                                                                                              \
+// Records are only formatted if the level is enabled for the file, see Logger.h
+#define DEBUG_LOG(level, fmt, args...)                                                                                     \
 	do                                                                                                                 \
 	{                                                                                                                  \
-		dbg_inner(__FILE__, "%s(%d): " fmt, __FUNCTION__, __LINE__, ##args);                                           \
+		static Debug::LogModule* const _logModule = Debug::GetLogModule(__FILE__);                                     \
+		if (Debug::IsLogEnabled(_logModule, level))                                                                    \
+		{                                                                                                              \
+			Debug::LogRecord _logRecord(level, _logModule, "%s(%d): " fmt);                                            \
+			Debug::AddLogArgs(_logRecord, Debug::StaticString(__FUNCTION__), __LINE__, ##args);                        \
+		}                                                                                                              \
 	} while (0)
-#else
-#define verbose(fmt, args...)
-#define dbg(fmt, args...)
-#endif
 
-#define info(fmt, args...)                                                                                             \
-	do                                                                                                                 \
-	{                                                                                                                  \
-		info_inner(__FILE__, "%s(%d): " fmt, __FUNCTION__, __LINE__, ##args);                                          \
-	} while (0)
-#define warn(fmt, args...)                                                                                             \
-	do                                                                                                                 \
-	{                                                                                                                  \
-		warn_inner(__FILE__, "%s(%d): " fmt, __FUNCTION__, __LINE__, ##args);                                          \
-	} while (0)
-#define error(fmt, args...)                                                                                            \
-	do                                                                                                                 \
-	{                                                                                                                  \
-		error_inner(__FILE__, "%s(%d): " fmt, __FUNCTION__, __LINE__, ##args);                                         \
-	} while (0)
-#define fatal(fmt, args...)                                                                                            \
-	do                                                                                                                 \
-	{                                                                                                                  \
-		fatal_inner(__FILE__, "%s(%d): " fmt, __FUNCTION__, __LINE__, ##args);                                         \
-	} while (0)
+#define verbose(fmt, args...) DEBUG_LOG(DebugLevel::Verbose, fmt, ##args)
+#define dbg(fmt, args...) DEBUG_LOG(DebugLevel::Debug, fmt, ##args)
+#define info(fmt, args...) DEBUG_LOG(DebugLevel::Info, fmt, ##args)
+#define warn(fmt, args...) DEBUG_LOG(DebugLevel::Warn, fmt, ##args)
+#define error(fmt, args...) DEBUG_LOG(DebugLevel::Error, fmt, ##args)
+#define fatal(fmt, args...) DEBUG_LOG(DebugLevel::Fatal, fmt, ##args)
 
 #endif /* JNI_DEBUG_HPP_ */
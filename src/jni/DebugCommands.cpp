@@ -2,10 +2,23 @@
 
 #include "UI/UserInterface.h"
 
+#include "AllocationTracker.h"
+#include "Comm/Communication.h"
+#include "Comm/Network.h"
+#include "Comm/OmSnapshot.h"
+#include "Comm/RequestTrace.h"
+#include "Configuration.h"
 #include "DebugCommands.h"
+#include "Duet3D/General/FreelistManager.h"
 #include "Hardware/Duet.h"
+#include "Hardware/UartBaudNegotiation.h"
 #include "Hardware/Usb.h"
+#include "Profiler.h"
+#include "StallWatchdog.h"
+#include "StartupTimeline.h"
+#include "utils/utils.h"
 #include <map>
+#include <time.h>
 
 namespace Debug
 {
@@ -33,6 +46,246 @@ namespace Debug
 									   system("rm /tmp/DuetScreen_log.txt");
 								   });
 
+	static DebugCommand s_crashLog("dbg_crash_log",
+								   []()
+								   {
+									   // Send the log written by the last crash to the Duet
+									   std::string logs;
+									   if (!USB::ReadFileContents(LOG_CRASH_FILE, logs))
+									   {
+										   return;
+									   }
+									   Comm::DUET.UploadFile("/sys/DuetScreen_crash_log.txt", logs);
+								   });
+
+	static DebugCommand s_logHistory("dbg_log_history",
+									 []()
+									 {
+										 UI::CONSOLE.AddResponses(GetLogHistory(LOG_HISTORY_CONSOLE_LINES));
+										 UI::CONSOLE.AddResponse(
+											 utils::format("%u log records dropped", GetDroppedLogRecords()).c_str());
+									 });
+
+	static DebugCommand s_profileStart("dbg_profile_start",
+									   []()
+									   {
+										   if (!StartProfiler(PROFILE_SAMPLE_FREQUENCY))
+										   {
+											   UI::CONSOLE.AddResponse("Failed to start profiler");
+											   return;
+										   }
+										   UI::CONSOLE.AddResponse(
+											   utils::format("Profiling at %u Hz, up to %u samples",
+															 PROFILE_SAMPLE_FREQUENCY,
+															 PROFILE_MAX_SAMPLES)
+												   .c_str());
+									   });
+
+	static DebugCommand s_profileStop("dbg_profile_stop",
+									  []()
+									  {
+										  // Write the profile and send it to the Duet, symbolize with Tools/profile.py
+										  if (!StopProfiler(PROFILE_FILE))
+										  {
+											  UI::CONSOLE.AddResponse("Profiler not running or profile not written");
+											  return;
+										  }
+										  UI::CONSOLE.AddResponse(utils::format("Profiled %u samples, %u dropped",
+																				GetProfilerSampleCount(),
+																				GetProfilerDroppedSamples())
+																	  .c_str());
+										  std::string profile;
+										  USB::ReadFileContents(PROFILE_FILE, profile);
+										  Comm::DUET.UploadFile("/sys/DuetScreen_profile.txt", profile);
+										  remove(PROFILE_FILE);
+									  });
+
+	static DebugCommand s_latency("dbg_latency",
+								  []()
+								  {
+									  // Times in ms as median/90th percentile/maximum
+									  std::string summary = Comm::GetLatencySummary();
+									  UI::CONSOLE.AddResponses(summary);
+									  if (summary.empty())
+									  {
+										  UI::CONSOLE.AddResponse("No requests traced");
+									  }
+								  });
+
+	static DebugCommand s_latencyCsv("dbg_latency_csv",
+									 []()
+									 {
+										 // Send the latency histograms to the Duet
+										 Comm::DUET.UploadFile("/sys/DuetScreen_latency.csv", Comm::GetLatencyCsv());
+									 });
+
+	static DebugCommand s_latencyReset("dbg_latency_reset", []() { Comm::ResetLatencyStats(); });
+
+	static DebugCommand s_omSnapshotClear("dbg_om_snapshot_clear", []() { Comm::ClearOmSnapshot(); });
+
+	static DebugCommand s_omProjection("dbg_om_projection",
+									   []()
+									   {
+										   // Sizes are from the last response to each, toggle twice to compare both
+										   UI::CONSOLE.AddResponses(Comm::GetOmProjectionSummary());
+										   Comm::SetOmProjection(!Comm::GetOmProjection());
+										   UI::CONSOLE.AddResponse(
+											   utils::format("Object model projection: %s",
+															 Comm::GetOmProjection() ? "on" : "off")
+												   .c_str());
+									   });
+
+	static DebugCommand s_uiTimings("dbg_ui_timings", []() { UI::CONSOLE.AddResponses(GetUiTimingSummary()); });
+
+	static DebugCommand s_uiTimingsReset("dbg_ui_timings_reset", []() { ResetUiTimings(); });
+
+	static DebugCommand s_startup("dbg_startup", []() { UI::CONSOLE.AddResponses(GetStartupTimeline()); });
+
+	// Whole process figures, everything allocated outside the tracked subsystems included
+	static std::string FormatHeapUsage()
+	{
+		Memory::HeapUsage usage;
+		Memory::GetHeapUsage(usage);
+		std::string text;
+		if (usage.haveMallocStats)
+		{
+			text = utils::format("malloc %u in use, %u free, %u arena, %u mapped, ",
+								 usage.inUseBytes,
+								 usage.freeBytes,
+								 usage.arenaBytes,
+								 usage.mappedBytes);
+		}
+		text += utils::format("process %u data, %u resident", usage.dataBytes, usage.residentBytes);
+		return text;
+	}
+
+	static DebugCommand s_memory("dbg_memory",
+								 []()
+								 {
+									 UI::CONSOLE.AddResponse(("Whole heap: " + FormatHeapUsage()).c_str());
+									 Memory::AllocationStats stats;
+									 Memory::GetTotalStats(stats);
+									 UI::CONSOLE.AddResponse(
+										 utils::format("Tracked memory: %u bytes live in %u blocks, peak %u bytes, "
+													   "%u allocs, %u frees",
+													   stats.liveBytes,
+													   stats.liveBlocks,
+													   stats.peakBytes,
+													   stats.allocations,
+													   stats.frees)
+											 .c_str());
+									 for (size_t i = 0; i < (size_t)Memory::Subsystem::COUNT; i++)
+									 {
+										 Memory::Subsystem subsystem = (Memory::Subsystem)i;
+										 Memory::GetStats(subsystem, stats);
+										 UI::CONSOLE.AddResponse(
+											 utils::format("  %s: %u bytes live in %u blocks, peak %u bytes, %u allocs",
+														   Memory::GetSubsystemName(subsystem),
+														   stats.liveBytes,
+														   stats.liveBlocks,
+														   stats.peakBytes,
+														   stats.allocations)
+												 .c_str());
+									 }
+									 for (FreelistManager::FreelistStats* freelist =
+											  __atomic_load_n(&FreelistManager::FirstFreelistStats(), __ATOMIC_ACQUIRE);
+										  freelist != nullptr;
+										  freelist = freelist->next)
+									 {
+										 UI::CONSOLE.AddResponse(
+											 utils::format("  om freelist %u bytes: %u in use, %u allocated",
+														   freelist->itemSize,
+														   __atomic_load_n(&freelist->inUse, __ATOMIC_RELAXED),
+														   __atomic_load_n(&freelist->heapItems, __ATOMIC_RELAXED))
+												 .c_str());
+									 }
+								 });
+
+	static DebugCommand s_httpCompression("dbg_http_compression",
+										  []()
+										  {
+											  Comm::DUET.SetHttpCompression(!Comm::DUET.GetHttpCompression());
+											  UI::CONSOLE.AddResponse(Comm::GetHttpCompressionStats().c_str());
+										  });
+
+	static DebugCommand s_baudNegotiate("dbg_baud_negotiate", []() { Comm::StartUartBaudNegotiation(); });
+
+	static DebugCommand s_baudNegotiation("dbg_baud_negotiation",
+										  []()
+										  {
+											  Comm::DUET.SetBaudNegotiation(!Comm::DUET.GetBaudNegotiation());
+											  UI::CONSOLE.AddResponse(
+												  utils::format("Baud rate negotiation on connect: %s",
+																Comm::DUET.GetBaudNegotiation() ? "on" : "off")
+													  .c_str());
+										  });
+
+	static DebugCommand s_urlBench(
+		"dbg_url_bench",
+		[]()
+		{
+			// Builds the URLs of the most frequent requests into one reused buffer
+			const size_t iterations = 10000;
+			Comm::QueryParameters_t model;
+			model["key"] = "move";
+			model["flags"] = "d99fno";
+			Comm::QueryParameters_t thumbnail;
+			thumbnail["name"] = "0:/gcodes/Benchy & friends 0.2mm.gcode";
+			thumbnail["offset"] = "65536";
+			Comm::QueryParameters_t gcode;
+			gcode["gcode"] = "M98 P\"0:/macros/Level bed\" ; X=100 Y=100";
+			std::string url;
+			size_t bytes = 0;
+			struct timespec start, end;
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			for (size_t i = 0; i < iterations; i++)
+			{
+				url.assign("http://192.168.1.100");
+				Comm::AppendRequestPath(url, "/rr_model", model);
+				bytes += url.size();
+				url.assign("http://192.168.1.100");
+				Comm::AppendRequestPath(url, "/rr_thumbnail", thumbnail);
+				bytes += url.size();
+				url.assign("http://192.168.1.100");
+				Comm::AppendRequestPath(url, "/rr_gcode", gcode);
+				bytes += url.size();
+			}
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			const long long elapsed =
+				(long long)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+			UI::CONSOLE.AddResponse(utils::format("%u URLs, %u bytes in %lld us, %lld ns per URL",
+												  3 * iterations,
+												  bytes,
+												  elapsed / 1000,
+												  elapsed / (3 * (long long)iterations))
+										.c_str());
+			UI::CONSOLE.AddResponse(url.c_str());
+		});
+
+	void LogAllocationSummary()
+	{
+		Memory::AllocationStats stats;
+		Memory::GetTotalStats(stats);
+		std::string line = utils::format("tracked %u/%u peak", stats.liveBytes, stats.peakBytes);
+		for (size_t i = 0; i < (size_t)Memory::Subsystem::COUNT; i++)
+		{
+			Memory::Subsystem subsystem = (Memory::Subsystem)i;
+			Memory::GetStats(subsystem, stats);
+			line += utils::format(", %s %u/%u", Memory::GetSubsystemName(subsystem), stats.liveBytes, stats.peakBytes);
+		}
+		size_t freelistBytes = 0;
+		for (FreelistManager::FreelistStats* freelist =
+				 __atomic_load_n(&FreelistManager::FirstFreelistStats(), __ATOMIC_ACQUIRE);
+			 freelist != nullptr;
+			 freelist = freelist->next)
+		{
+			freelistBytes += freelist->itemSize * __atomic_load_n(&freelist->heapItems, __ATOMIC_RELAXED);
+		}
+		line += utils::format(", om freelists %u", freelistBytes);
+		line += ", " + FormatHeapUsage();
+		info("Memory: %s", line.c_str());
+	}
+
 	void CreateCommand(const char* id, function<void(void)> callback)
 	{
 		new DebugCommand(id, callback);
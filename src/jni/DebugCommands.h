@@ -21,6 +21,7 @@ namespace Debug
 	};
 
 	void CreateCommand(const char* id, function<void(void)> callback);
+	void LogAllocationSummary();
 	DebugCommand* GetCommand(const char* id);
 	DebugCommand* GetCommandByIndex(size_t index);
 	size_t GetCommandCount();
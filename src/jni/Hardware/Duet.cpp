@@ -11,9 +11,14 @@
 #include "Comm/Communication.h"
 #include "Comm/FileInfo.h"
 #include "Comm/JsonDecoder.h"
+#include "Comm/OmSnapshot.h"
+#include "Comm/RequestTrace.h"
 #include "Debug.h"
 #include "Duet.h"
 #include "Hardware/SerialIo.h"
+#include "Hardware/UartBaudNegotiation.h"
+#include "Hardware/UartUpload.h"
+#include "Library/CRC.h"
 #include "ObjectModel/PrinterStatus.h"
 #include "ObjectModel/Utils.h"
 #include "Storage.h"
@@ -32,8 +37,9 @@ namespace Comm
 {
 	Duet::Duet()
 		: m_communicationType(CommunicationType::none), m_hostname(""), m_password(""), m_sessionTimeout(0),
-		  m_lastRequestTime(0), m_sessionKey(sm_noSessionKey), m_pollInterval(DEFAULT_PRINTER_POLL_INTERVAL),
-		  m_pollIntervalScale(1.0f)
+		  m_lastRequestTime(0), m_sessionKey(sm_noSessionKey), m_httpCompression(false),
+		  m_pollInterval(DEFAULT_PRINTER_POLL_INTERVAL),
+		  m_pollIntervalScale(1.0f), m_baudNegotiation(false)
 	{
 	}
 
@@ -44,6 +50,8 @@ namespace Comm
 		SetIPAddress("");
 		SetHostname(StoragePreferences::getString(ID_DUET_HOSTNAME, ""));
 		SetPassword(StoragePreferences::getString(ID_DUET_PASSWORD, ""));
+		SetHttpCompression(StoragePreferences::getBool(ID_DUET_HTTP_COMPRESSION, false));
+		SetBaudNegotiation(StoragePreferences::getBool(ID_DUET_BAUD_NEGOTIATION, false));
 		SetCommunicationType(
 			(CommunicationType)StoragePreferences::getInt(ID_DUET_COMMUNICATION_TYPE, (int)DEFAULT_COMMUNICATION_TYPE));
 	}
@@ -51,6 +59,9 @@ namespace Comm
 	void Duet::Reset()
 	{
 		verbose("");
+		// The object model is cleared, so DSF has to send all of it again. Once Stop returns the socket thread no
+		// longer passes anything to the observers
+		m_modelSocket.Stop();
 		m_sessionKey = sm_noSessionKey;
 		m_sbcMode = false;
 		m_sessionTimeout = 0;
@@ -58,7 +69,7 @@ namespace Comm
 		m_pollIntervalScale = 1.0f;
 		ClearIPAddress();
 
-		OM::RemoveAll();
+		Comm::ResetToOmSnapshot(); // Show the last known configuration until the Duet answers
 		Comm::ResetSeqs();
 		UI::HomeScreen::ClearTemperatureGraph();
 	}
@@ -137,6 +148,30 @@ namespace Comm
 		return true;
 	}
 
+	bool Duet::AsyncGetJson(const char* subUrl,
+							QueryParameters_t& queryParameters,
+							const char* jsonPrefix,
+							function<bool(RestClient::Response&)> callback,
+							bool queue)
+	{
+		if ((!m_sbcMode && m_sessionKey == sm_noSessionKey) ||
+			(TimeHelper::getCurrentTime() - m_lastRequestTime > m_sessionTimeout))
+		{
+			if (!Connect())
+			{
+				warn("Failed to connect to Duet, cannot send get request %s", subUrl);
+				return false;
+			}
+		}
+		if (!Comm::AsyncGetJson(GetBaseUrl(), subUrl, queryParameters, jsonPrefix, callback, m_sessionKey, queue))
+		{
+			warn("Failed to send async get request %s", subUrl);
+			return false;
+		}
+		m_lastRequestTime = TimeHelper::getCurrentTime();
+		return true;
+	}
+
 	/*
 	Tries to make a get request to Duet, if it returns 401 or 403 then it will run `rr_connect` and send the request
 	again
@@ -167,6 +202,36 @@ namespace Comm
 		return true;
 	}
 
+	bool Duet::Get(const char* subUrl,
+				   RestClient::Response& r,
+				   QueryParameters_t& queryParameters,
+				   function<bool(const char*, size_t, size_t)> sink)
+	{
+		if ((!m_sbcMode && m_sessionKey == sm_noSessionKey) ||
+			(TimeHelper::getCurrentTime() - m_lastRequestTime > m_sessionTimeout))
+		{
+			if (!Connect())
+			{
+				warn("Failed to connect to Duet, cannot send get request %s", subUrl);
+				r.code = -1;
+				return false;
+			}
+		}
+		// The body of an error response is not passed to the sink, so the request can be sent again
+		if (!Comm::Get(GetBaseUrl(), subUrl, r, queryParameters, sink, m_sessionKey))
+		{
+			if (r.code == 401 || r.code == 403)
+			{
+				error("HTTP error %d: Likely invalid sessionKey %u. Running rr_connect", r.code, m_sessionKey);
+				Connect();
+				return Comm::Get(GetBaseUrl(), subUrl, r, queryParameters, sink, m_sessionKey);
+			}
+			return false;
+		}
+		m_lastRequestTime = TimeHelper::getCurrentTime();
+		return true;
+	}
+
 	/*
 	Tries to make a post request to Duet, if it returns 401 or 403 then it will run `rr_connect` and send the request
 	again
@@ -204,6 +269,12 @@ namespace Comm
 		switch (m_communicationType)
 		{
 		case CommunicationType::uart:
+			if (IsUartUploading())
+			{
+				// The firmware would write it into the file
+				UI::CONSOLE.AddResponse(utils::format("Uploading a file, %s not sent", gcode).c_str());
+				break;
+			}
 			SerialIo::Sendf("%s\n", gcode);
 			break;
 		case CommunicationType::network: {
@@ -243,6 +314,22 @@ namespace Comm
 		va_end(args);
 	}
 
+	static void ShowUploadFinished(const char* filename)
+	{
+		UI::POPUP_WINDOW.Open();
+		UI::POPUP_WINDOW.SetTitle(LANGUAGEMANAGER->getValue("finished_uploading").c_str());
+		UI::POPUP_WINDOW.SetText(filename);
+		UI::POPUP_WINDOW.SetProgress(100);
+	}
+
+	static void ShowUartUploadFailed(const char* filename, const char* errorMessage)
+	{
+		UI::CONSOLE.AddResponse(utils::format("Failed to upload file %s: %s", filename, errorMessage).c_str());
+		UI::POPUP_WINDOW.Open();
+		UI::POPUP_WINDOW.SetTitle(LANGUAGEMANAGER->getValue("upload_failed").c_str());
+		UI::POPUP_WINDOW.SetText(errorMessage);
+	}
+
 	bool Duet::UploadFile(const char* filename, const std::string& contents)
 	{
 		info("Uploading file %s: %d bytes", filename, contents.size());
@@ -258,31 +345,32 @@ namespace Comm
 		switch (m_communicationType)
 		{
 		case CommunicationType::uart: {
-			/* UART is too slow to support uploading files */
-			if (contents.size() > MAX_UART_UPLOAD_SIZE)
+			if (!StartUartUpload(filename, contents))
 			{
-				warn("File too large (%u) to upload via UART, limit is %u", contents.size(), MAX_UART_UPLOAD_SIZE);
-				UI::CONSOLE.AddResponse(LANGUAGEMANAGER->getValue("file_too_large_uart").c_str());
-				UI::POPUP_WINDOW.Open();
-				UI::POPUP_WINDOW.SetTitle(LANGUAGEMANAGER->getValue("file_too_large_uart").c_str());
-				UI::POPUP_WINDOW.SetText(filename);
+				ShowUartUploadFailed(filename, "UART busy");
 				return false;
 			}
-
-			SendGcodef("M28 \"%s\"", filename);
-			size_t prevPosition = 0;
-			size_t position = contents.find("\n"); // Find the first occurrence of \n
-			std::string line;
-			while (position != std::string::npos)
-			{
-				line = contents.substr(prevPosition, position - prevPosition);
-				prevPosition = position + 1;
-				position = contents.find("\n", position + 1); // Find the next occurrence, if any
-				SendGcode(line.c_str());
-				UI::POPUP_WINDOW.SetProgress((int)((100 * prevPosition / contents.size())));
-			}
-			SendGcode("M29");
-			break;
+			// The upload thread only records its progress, the popup is updated from the UI thread
+			const std::string name = filename;
+			registerDelayedCallback("uart_upload_progress", UART_UPLOAD_PROGRESS_INTERVAL, [name]() {
+				UartUploadStatus status;
+				GetUartUploadStatus(status);
+				if (status.running)
+				{
+					UI::POPUP_WINDOW.SetProgress(status.percent);
+					return true;
+				}
+				if (status.succeeded)
+				{
+					ShowUploadFinished(name.c_str());
+				}
+				else
+				{
+					ShowUartUploadFailed(name.c_str(), status.errorMessage.c_str());
+				}
+				return false;
+			});
+			return true;
 		}
 		case CommunicationType::network: {
 			registerDelayedCallback("upload_file_progress", 1000, []() {
@@ -296,6 +384,8 @@ namespace Comm
 			RestClient::Response r;
 			QueryParameters_t query;
 			query["name"] = filename;
+			// The firmware checks the file against this before keeping it
+			query["crc32"] = utils::format("%08x", CRC::Calculate(contents.data(), contents.size(), CRC::CRC_32()));
 			if (!Post("/rr_upload", r, query, contents))
 			{
 				UI::CONSOLE.AddResponse(
@@ -311,29 +401,53 @@ namespace Comm
 		default:
 			break;
 		}
-		UI::POPUP_WINDOW.Open();
-		UI::POPUP_WINDOW.SetTitle(LANGUAGEMANAGER->getValue("finished_uploading").c_str());
-		UI::POPUP_WINDOW.SetText(filename);
-		UI::POPUP_WINDOW.SetProgress(100);
+		ShowUploadFinished(filename);
 		return true;
 	}
 
 	bool Duet::DownloadFile(const char* filename, std::string& contents)
+	{
+		contents.clear();
+		return DownloadFile(filename, [&contents](const char* data, size_t len, size_t total) {
+			if (contents.empty() && total > 0)
+				contents.reserve(total);
+			contents.append(data, len);
+			return true;
+		});
+	}
+
+	bool Duet::DownloadFile(const char* filename, function<bool(const char*, size_t, size_t)> sink)
 	{
 		info("Downloading file %s", filename);
 		switch (m_communicationType)
 		{
 		case CommunicationType::network: {
+			if ((!m_sbcMode && m_sessionKey == sm_noSessionKey) ||
+				(TimeHelper::getCurrentTime() - m_lastRequestTime > m_sessionTimeout))
+			{
+				if (!Connect())
+				{
+					warn("Failed to connect to Duet, cannot download %s", filename);
+					return false;
+				}
+			}
 			RestClient::Response r;
 			QueryParameters_t query;
 			query["name"] = filename;
-			if (!Get("/rr_download", r, query))
+			bool success = Comm::Download(GetBaseUrl(), "/rr_download", r, query, sink, m_sessionKey);
+			if (!success && (r.code == 401 || r.code == 403))
+			{
+				error("HTTP error %d: Likely invalid sessionKey %u. Running rr_connect", r.code, m_sessionKey);
+				Connect();
+				success = Comm::Download(GetBaseUrl(), "/rr_download", r, query, sink, m_sessionKey);
+			}
+			if (!success)
 			{
 				UI::CONSOLE.AddResponse(
 					utils::format("HTTP error %d: Failed to download file: %s", r.code, filename).c_str());
 				return false;
 			}
-			contents = r.body;
+			m_lastRequestTime = TimeHelper::getCurrentTime();
 			break;
 		}
 		default:
@@ -348,14 +462,14 @@ namespace Comm
 		switch (m_communicationType)
 		{
 		case CommunicationType::uart:
+			TraceUartRequest("");
 			SendGcodef("M409 F\"%s\"\n", flags);
 			break;
 		case CommunicationType::network: {
 			RestClient::Response r;
 			QueryParameters_t query;
 			query["flags"] = flags;
-			AsyncGet("/rr_model", query, [this, flags](RestClient::Response& r) {
-				JsonDecoder decoder;
+			AsyncGetJson("/rr_model", query, nullptr, [this, flags](RestClient::Response& r) {
 				if (r.code != 200)
 				{
 					UI::CONSOLE.AddResponse(
@@ -363,7 +477,6 @@ namespace Comm
 							.c_str());
 					return false;
 				}
-				decoder.CheckInput((const unsigned char*)r.body.c_str(), r.body.length() + 1);
 				return true;
 			});
 			break;
@@ -378,6 +491,7 @@ namespace Comm
 		switch (m_communicationType)
 		{
 		case CommunicationType::uart:
+			TraceUartRequest(key);
 			SendGcodef("M409 K\"%s\" F\"%s\"\n", key, flags);
 			break;
 		case CommunicationType::network: {
@@ -385,8 +499,7 @@ namespace Comm
 			QueryParameters_t query;
 			query["key"] = key;
 			query["flags"] = flags;
-			AsyncGet("/rr_model", query, [this, key, flags](RestClient::Response& r) {
-				JsonDecoder decoder;
+			AsyncGetJson("/rr_model", query, nullptr, [this, key, flags](RestClient::Response& r) {
 				if (r.code != 200)
 				{
 					UI::CONSOLE.AddResponse(
@@ -395,7 +508,6 @@ namespace Comm
 							.c_str());
 					return false;
 				}
-				decoder.CheckInput((const unsigned char*)r.body.c_str(), r.body.length() + 1);
 				return true;
 			});
 			break;
@@ -419,9 +531,10 @@ namespace Comm
 			QueryParameters_t query;
 			query["dir"] = dir;
 			query["first"] = utils::format("%d", first);
-			if (!Get("/rr_filelist", r, query))
-				break;
-			decoder.CheckInput((const unsigned char*)r.body.c_str(), r.body.length() + 1);
+			Get("/rr_filelist", r, query, [&decoder](const char* data, size_t len, size_t) {
+				decoder.CheckInput((const unsigned char*)data, len);
+				return true;
+			});
 			break;
 		}
 		default:
@@ -439,23 +552,15 @@ namespace Comm
 			SendGcodef("M36 \"%s\"", filename);
 			break;
 		case CommunicationType::network: {
-			JsonDecoder decoder;
 			QueryParameters_t query;
 			query["name"] = filename;
 
 #if 1
-			AsyncGet(
+			AsyncGetJson(
 				"/rr_fileinfo",
 				query,
-				[this](RestClient::Response& r) -> bool {
-					JsonDecoder decoder;
-					if (r.code != 200)
-					{
-						return false;
-					}
-					decoder.CheckInput((const unsigned char*)r.body.c_str(), r.body.length() + 1);
-					return true;
-				},
+				nullptr,
+				[this](RestClient::Response& r) -> bool { return r.code == 200; },
 				true);
 
 			break;
@@ -597,19 +702,11 @@ namespace Comm
 			QueryParameters_t query;
 			query["name"] = filename;
 			query["offset"] = utils::format("%d", offset);
-			AsyncGet(
+			AsyncGetJson(
 				"/rr_thumbnail",
 				query,
-				[this](RestClient::Response& r) -> bool {
-					JsonDecoder decoder;
-					if (r.code != 200)
-					{
-						return false;
-					}
-					decoder.SetPrefix("thumbnail:");
-					decoder.CheckInput((const unsigned char*)r.body.c_str(), r.body.size() + 1);
-					return true;
-				},
+				"thumbnail:",
+				[this](RestClient::Response& r) -> bool { return r.code == 200; },
 				true);
 			break;
 		}
@@ -671,6 +768,16 @@ namespace Comm
 		Get("/rr_reply", r, query);
 	}
 
+	void Duet::PollReply()
+	{
+		QueryParameters_t query;
+		AsyncGet("/rr_reply", query, [this](RestClient::Response& r) {
+			if (!r.body.empty())
+				ProcessReply(r);
+			return true;
+		});
+	}
+
 	const bool Duet::Connect(bool useSessionKey)
 	{
 		Disconnect();
@@ -679,11 +786,17 @@ namespace Comm
 		switch (m_communicationType)
 		{
 		case CommunicationType::uart: {
-			info("Opening UART %s at %u", CONFIGMANAGER->getUartName().c_str(), m_baudRate.rate);
-			return UARTCONTEXT->openUart(CONFIGMANAGER->getUartName().c_str(), m_baudRate.internal);
+			info("Opening UART %s at %u", CONFIGMANAGER->getUartName().c_str(), m_activeBaudRate.rate);
+			if (!UARTCONTEXT->openUart(CONFIGMANAGER->getUartName().c_str(), m_activeBaudRate.internal))
+				return false;
+			if (m_baudNegotiation)
+				StartUartBaudNegotiation();
+			return true;
 		}
 		case CommunicationType::network: {
 			info("Connecting to Duet at %s", GetBaseUrl().c_str());
+			// The server may have changed, so find out again whether it compresses responses
+			Comm::SetHttpCompression(m_httpCompression);
 
 			RestClient::Response r;
 			QueryParameters_t query;
@@ -726,6 +839,8 @@ namespace Comm
 					}
 					if (body.isMember("isEmulated"))
 					{
+						// DSF pushes object model updates over a WebSocket, polling continues until it streams
+						m_modelSocket.Start(GetBaseUrl(), m_sessionKey);
 						m_sessionKey = sm_noSessionKey;
 						m_sbcMode = true;
 						info("Connected to Duet in SBC mode");
@@ -749,6 +864,13 @@ namespace Comm
 		switch (m_communicationType)
 		{
 		case CommunicationType::uart:
+			if (m_activeBaudRate.rate != m_baudRate.rate && UARTCONTEXT->isOpen())
+			{
+				// Take the firmware back to the configured rate too, in case it did not reset
+				SerialIo::Sendf("M575 P1 B%u\n", m_baudRate.rate);
+				Thread::sleep(UART_BAUD_SWITCH_DELAY);
+			}
+			m_activeBaudRate = m_baudRate;
 			UARTCONTEXT->closeUart();
 			Thread::sleep(100);
 			break;
@@ -804,6 +926,15 @@ namespace Comm
 		info("Setting baud rate to %u (%u)", baudRate.rate, baudRate.internal);
 		StoragePreferences::putInt(ID_DUET_BAUD_RATE, baudRate.internal);
 		m_baudRate = baudRate;
+		UseBaudRate(baudRate);
+	}
+
+	void Duet::UseBaudRate(const baudrate_t& baudRate)
+	{
+		dbg("Using baud rate %u", baudRate.rate);
+		// Sends from other threads would fail or go out half at each rate
+		SerialIo::Exclusive exclusive;
+		m_activeBaudRate = baudRate;
 		if (UARTCONTEXT->isOpen())
 		{
 			UARTCONTEXT->closeUart();
@@ -852,6 +983,19 @@ namespace Comm
 		m_password = password;
 	}
 
+	void Duet::SetHttpCompression(bool enabled)
+	{
+		StoragePreferences::putBool(ID_DUET_HTTP_COMPRESSION, enabled);
+		m_httpCompression = enabled;
+		Comm::SetHttpCompression(enabled);
+	}
+
+	void Duet::SetBaudNegotiation(bool enabled)
+	{
+		StoragePreferences::putBool(ID_DUET_BAUD_NEGOTIATION, enabled);
+		m_baudNegotiation = enabled;
+	}
+
 	void Duet::SetSessionKey(const uint32_t key)
 	{
 		m_sessionKey = key;
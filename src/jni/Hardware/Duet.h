@@ -13,6 +13,7 @@
 #include "utils/utils.h"
 
 #include "Comm/Network.h"
+#include "Comm/ObjectModelSocket.h"
 #include "Configuration.h"
 #include "Duet3D/General/String.h"
 #include "Duet3D/General/StringRef.h"
@@ -79,9 +80,13 @@ namespace Comm
 		void SendGcodef(const char* fmt, ...);
 		void RequestReply(RestClient::Response& r);
 		void ProcessReply(RestClient::Response& r);
+		/// @brief Fetch and process any G-code replies in the background
+		void PollReply();
 
 		bool UploadFile(const char* filename, const std::string& contents);
 		bool DownloadFile(const char* filename, std::string& contents);
+		/// @brief Download a file without holding it in memory, see Comm::Download
+		bool DownloadFile(const char* filename, function<bool(const char*, size_t, size_t)> sink);
 
 		void RequestModel(const char* flags = "d99f");
 		void RequestModel(const char* key, const char* flags);
@@ -93,6 +98,12 @@ namespace Comm
 		void SetBaudRate(const unsigned int baudRateCode);
 		void SetBaudRate(const baudrate_t& baudRate);
 		const baudrate_t& GetBaudRate() const { return m_baudRate; }
+		/// @brief Reopen the UART at a rate without saving it, used while negotiating a faster rate
+		void UseBaudRate(const baudrate_t& baudRate);
+		const baudrate_t& GetActiveBaudRate() const { return m_activeBaudRate; }
+		/// @brief Negotiate a faster rate each time the UART is connected, see UartBaudNegotiation.h
+		void SetBaudNegotiation(bool enabled);
+		const bool GetBaudNegotiation() const { return m_baudNegotiation; }
 
 		// Network methods
 		const bool Connect(bool useSessionKey = true);
@@ -112,6 +123,13 @@ namespace Comm
 
 		void SetSessionKey(const uint32_t sessionKey);
 
+		/// @brief Ask for compressed JSON responses, see Comm::SetHttpCompression
+		void SetHttpCompression(bool enabled);
+		const bool GetHttpCompression() const { return m_httpCompression; }
+
+		/// @brief True while DSF pushes object model updates over its WebSocket, the object model is not polled then
+		const bool IsModelPushed() const { return m_modelSocket.IsDelivering(); }
+
 		// USB methods
 
 	  private:
@@ -120,7 +138,16 @@ namespace Comm
 					  QueryParameters_t& queryParameters,
 					  function<bool(RestClient::Response&)> callback,
 					  bool queue = false);
+		bool AsyncGetJson(const char* subUrl,
+						  QueryParameters_t& queryParameters,
+						  const char* jsonPrefix,
+						  function<bool(RestClient::Response&)> callback,
+						  bool queue = false);
 		bool Get(const char* subUrl, RestClient::Response& r, QueryParameters_t& queryParameters);
+		bool Get(const char* subUrl,
+				 RestClient::Response& r,
+				 QueryParameters_t& queryParameters,
+				 function<bool(const char*, size_t, size_t)> sink);
 		bool Post(const char* subUrl,
 				  RestClient::Response& r,
 				  QueryParameters_t& queryParameters,
@@ -134,10 +161,14 @@ namespace Comm
 		long long m_lastRequestTime;
 		uint32_t m_sessionKey;
 		bool m_sbcMode;
+		bool m_httpCompression;
+		ObjectModelSocket m_modelSocket;
 
 		uint32_t m_pollInterval;
 		float m_pollIntervalScale;
 		baudrate_t m_baudRate;
+		baudrate_t m_activeBaudRate;
+		bool m_baudNegotiation;
 
 		static constexpr uint32_t sm_noSessionKey = 0;
 	};
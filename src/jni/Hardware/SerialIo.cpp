@@ -14,14 +14,46 @@
 
 #include "SerialIo.h"
 #include "uart/UartContext.h"
+#include <pthread.h>
 #include <string>
+#include <system/Mutex.h>
 
 #include "Debug.h"
 
 namespace SerialIo
 {
+	// Held by every send from a thread without an Exclusive, and by the thread holding one
+	static Mutex s_sendLock;
+	static volatile bool s_exclusive = false;
+	static pthread_t s_owner;
+
+	static bool HeldByCaller()
+	{
+		return s_exclusive && pthread_equal(s_owner, pthread_self());
+	}
+
+	Exclusive::Exclusive() : m_nested(HeldByCaller())
+	{
+		if (m_nested)
+			return;
+		s_sendLock.lock();
+		s_owner = pthread_self();
+		s_exclusive = true;
+	}
+
+	Exclusive::~Exclusive()
+	{
+		if (m_nested)
+			return;
+		s_exclusive = false;
+		s_sendLock.unlock();
+	}
+
 	bool Send(const char* data, size_t len)
 	{
+		if (HeldByCaller())
+			return UARTCONTEXT->send((unsigned char*)data, len);
+		Mutex::Autolock lock(s_sendLock);
 		return UARTCONTEXT->send((unsigned char*)data, len);
 	}
 
@@ -36,7 +68,7 @@ namespace SerialIo
 		buf.resize(ret);
 		vsnprintf((char*)buf.data(), buf.capacity(), fmt, vargs);
 		info("Sending %s", buf.c_str());
-		UARTCONTEXT->send((unsigned char*)buf.c_str(), ret);
+		Send(buf.c_str(), ret);
 
 		va_end(vargs);
 
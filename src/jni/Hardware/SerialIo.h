@@ -24,6 +24,21 @@ namespace SerialIo
 {
 	bool Send(const char* data, size_t len);
 	size_t Sendf(const char* fmt, ...) __attribute__((format(printf, 1, 0)));
+
+	/// @brief While an Exclusive is held, sends from other threads wait, e.g. while the baud rate is being changed.
+	/// Sends from the holding thread go through, and it may hold another one
+	class Exclusive
+	{
+	  public:
+		Exclusive();
+		~Exclusive();
+
+	  private:
+		Exclusive(const Exclusive&);
+		Exclusive& operator=(const Exclusive&);
+
+		bool m_nested;
+	};
 } // namespace SerialIo
 
 #endif /* JNI_SERIALIO_HPP_ */
@@ -0,0 +1,293 @@
+/*
+ * UartBaudNegotiation.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "DebugLevels.h"
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+#include "Debug.h"
+
+#include "Comm/Communication.h"
+#include "Configuration.h"
+#include "Hardware/Duet.h"
+#include "Hardware/SerialIo.h"
+#include "UI/UserInterface.h"
+#include "UartBaudNegotiation.h"
+#include "UartUpload.h"
+#include "uart/UartContext.h"
+#include "utils/TimeHelper.h"
+#include "utils/utils.h"
+#include <stdlib.h>
+#include <string.h>
+#include <system/Mutex.h>
+#include <system/Thread.h>
+
+namespace Comm
+{
+	// Shared between the negotiating thread and the UART thread
+	static Mutex s_lock;
+	static std::string s_expected; // Text the next echo has to contain, empty while not probing
+	static bool s_echoed = false;
+	static bool s_rejected = false;
+
+	static volatile bool s_negotiating = false;
+	static unsigned int s_failedRate = 0; // Lowest rate that turned out unreliable, 0 if none has
+
+	void HandleUartBaudProbeResponse(const unsigned char* data, size_t len)
+	{
+		Mutex::Autolock lock(s_lock);
+		if (s_expected.empty())
+			return;
+
+		const std::string response((const char*)data, len);
+		if (response.find(s_expected) != std::string::npos)
+		{
+			s_echoed = true;
+			return;
+		}
+		// A corrupted line is rejected with a resend request or a checksum error
+		if (response.compare(0, 3, "rs ") == 0 || response.find("\nrs ") != std::string::npos ||
+			response.find("Resend:") != std::string::npos || response.find("Error:") != std::string::npos)
+		{
+			s_rejected = true;
+		}
+	}
+
+	// Sends a checksummed line with random text, the firmware drops it if it was corrupted on the way and the text has
+	// to come back unchanged. Returns the bytes moved in both directions, 0 if the echo failed
+	static size_t Probe()
+	{
+		std::string text = "baud probe ";
+		for (size_t i = 0; i < UART_BAUD_PROBE_LENGTH; i++)
+		{
+			text += "0123456789abcdef"[rand() & 0xF];
+		}
+		std::string line = utils::format("M118 P2 S\"%s\"", text.c_str());
+		uint8_t checksum = 0;
+		for (const char c : line)
+		{
+			checksum ^= (uint8_t)c;
+		}
+		line += utils::format("*%u\n", checksum);
+
+		{
+			Mutex::Autolock lock(s_lock);
+			s_expected = text;
+			s_echoed = false;
+			s_rejected = false;
+		}
+		bool echoed = false;
+		if (SerialIo::Send(line.c_str(), line.size()))
+		{
+			const long long start = TimeHelper::getCurrentTime();
+			while (TimeHelper::getCurrentTime() - start < (long long)UART_BAUD_PROBE_TIMEOUT)
+			{
+				{
+					Mutex::Autolock lock(s_lock);
+					if (s_echoed || s_rejected)
+					{
+						echoed = s_echoed;
+						break;
+					}
+				}
+				Thread::sleep(UART_BAUD_POLL_INTERVAL);
+			}
+		}
+
+		Mutex::Autolock lock(s_lock);
+		s_expected.clear();
+		return echoed ? line.size() + text.size() : 0;
+	}
+
+	// True if every echo at the rate in use came back intact
+	static bool ProbeLink()
+	{
+		const unsigned int rate = DUET.GetActiveBaudRate().rate;
+		// Ends whatever partial line switching rates left in the firmware's input buffer
+		SerialIo::Send("\n", 1);
+		Thread::sleep(UART_BAUD_SWITCH_DELAY);
+
+		size_t bytes = 0;
+		const long long start = TimeHelper::getCurrentTime();
+		for (uint32_t i = 0; i < UART_BAUD_PROBE_COUNT; i++)
+		{
+			const size_t moved = Probe();
+			if (moved == 0)
+			{
+				info("Echo %u of %u failed at %u baud", i + 1, UART_BAUD_PROBE_COUNT, rate);
+				return false;
+			}
+			bytes += moved;
+		}
+		const long long elapsed = TimeHelper::getCurrentTime() - start;
+		info("%u echoes intact at %u baud, %lld bytes/s",
+			 UART_BAUD_PROBE_COUNT,
+			 rate,
+			 elapsed > 0 ? 1000ll * (long long)bytes / elapsed : 0ll);
+		return true;
+	}
+
+	// Asks the firmware to change rate, then follows it. Other threads' sends would reach the firmware at the old rate
+	// after it has switched, so they wait until the UART has followed
+	static void SwitchBaudRate(const baudrate_t& baudRate)
+	{
+		SerialIo::Exclusive exclusive;
+		SerialIo::Sendf("M575 P1 B%u\n", baudRate.rate);
+		Thread::sleep(UART_BAUD_SWITCH_DELAY);
+		DUET.UseBaudRate(baudRate);
+	}
+
+	// Goes back to a rate that worked. The firmware may or may not have switched to the rate that failed, so the
+	// request is repeated from that rate until the lower one is confirmed
+	static bool FallBack(const baudrate_t& failed, const baudrate_t& baudRate)
+	{
+		for (uint32_t attempt = 0; attempt < UART_BAUD_FALLBACK_ATTEMPTS; attempt++)
+		{
+			if (attempt > 0)
+			{
+				DUET.UseBaudRate(failed);
+			}
+			SwitchBaudRate(baudRate);
+			if (ProbeLink())
+				return true;
+		}
+		return false;
+	}
+
+	bool NegotiateUartBaudRate(std::string& errorMessage)
+	{
+		if (DUET.GetCommunicationType() != Duet::CommunicationType::uart || !UARTCONTEXT->isOpen())
+		{
+			errorMessage = "UART not connected";
+			return false;
+		}
+
+		const baudrate_t start = DUET.GetActiveBaudRate();
+		info("Negotiating UART baud rate from %u", start.rate);
+		if (!ProbeLink())
+		{
+			errorMessage = utils::format("No intact echo at %u baud", start.rate);
+			return false;
+		}
+
+		baudrate_t best = start;
+		for (const baudrate_t& baudRate : baudRates)
+		{
+			if (baudRate.rate <= best.rate)
+				continue;
+			if (baudRate.rate > UART_BAUD_MAX_RATE || (s_failedRate != 0 && baudRate.rate >= s_failedRate))
+				break;
+
+			SwitchBaudRate(baudRate);
+			if (ProbeLink())
+			{
+				best = baudRate;
+				continue;
+			}
+			warn("UART unreliable at %u baud, going back to %u", baudRate.rate, best.rate);
+			s_failedRate = baudRate.rate;
+			if (!FallBack(baudRate, best))
+			{
+				errorMessage = utils::format("Lost the link going back to %u baud", best.rate);
+				return false;
+			}
+			break;
+		}
+
+		info("UART baud rate negotiated: %u (set to %u)", best.rate, DUET.GetBaudRate().rate);
+		return true;
+	}
+
+	class UartBaudThread : public Thread
+	{
+	  public:
+		UartBaudThread() : m_fallBack(false) {}
+
+		bool Start(bool fallBack)
+		{
+			// The firmware would write the probes into the file being uploaded
+			if (isRunning() || IsUartUploading())
+				return false;
+			m_fallBack = fallBack;
+			if (!fallBack)
+			{
+				// A new connection, e.g. over another cable, so the rates that failed before are tried again
+				s_failedRate = 0;
+			}
+			s_negotiating = true;
+			if (!run("uart_baud"))
+			{
+				s_negotiating = false;
+				return false;
+			}
+			return true;
+		}
+
+	  protected:
+		virtual bool threadLoop()
+		{
+			std::string errorMessage;
+			if (m_fallBack)
+			{
+				FallBackFromErrors();
+			}
+			else if (NegotiateUartBaudRate(errorMessage))
+			{
+				UI::CONSOLE.AddResponse(
+					utils::format("UART running at %u baud", DUET.GetActiveBaudRate().rate).c_str());
+			}
+			else
+			{
+				UI::CONSOLE.AddResponse(
+					utils::format("UART baud rate negotiation failed: %s", errorMessage.c_str()).c_str());
+			}
+			// Polling was paused, don't let the watchdog take that for a lost connection
+			KickWatchdog();
+			s_negotiating = false;
+			return false;
+		}
+
+	  private:
+		void FallBackFromErrors()
+		{
+			const baudrate_t active = DUET.GetActiveBaudRate();
+			baudrate_t lower = DUET.GetBaudRate();
+			for (const baudrate_t& baudRate : baudRates)
+			{
+				if (baudRate.rate > lower.rate && baudRate.rate < active.rate)
+					lower = baudRate;
+			}
+			warn("Malformed responses at %u baud, falling back to %u", active.rate, lower.rate);
+			s_failedRate = active.rate;
+			if (FallBack(active, lower) ||
+				(lower.rate != DUET.GetBaudRate().rate && FallBack(active, DUET.GetBaudRate())))
+				return;
+			error("No intact echo after falling back from %u baud", active.rate);
+		}
+
+		bool m_fallBack;
+	};
+
+	static UartBaudThread s_thread;
+
+	void StartUartBaudNegotiation()
+	{
+		s_thread.Start(false);
+	}
+
+	bool IsUartBaudNegotiating()
+	{
+		return s_negotiating;
+	}
+
+	void ReportUartResponseErrors(int errors)
+	{
+		if (errors < UART_BAUD_ERROR_BURST || s_negotiating ||
+			DUET.GetCommunicationType() != Duet::CommunicationType::uart ||
+			DUET.GetActiveBaudRate().rate == DUET.GetBaudRate().rate)
+			return;
+		s_thread.Start(true);
+	}
+} // namespace Comm
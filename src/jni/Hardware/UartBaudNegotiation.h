@@ -0,0 +1,36 @@
+/*
+ * UartBaudNegotiation.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Raises the UART baud rate above the one chosen in the settings while the link stays reliable. Each rate is
+ *  switched to with M575 and checked with checksummed M118 lines whose random text has to be echoed back intact.
+ *  The highest rate that passes is kept until the next connect, the firmware goes back to the rate in its config.g
+ *  when it resets. A burst of malformed responses drops the link to a lower rate and stops it being tried again.
+ */
+
+#ifndef JNI_HARDWARE_UARTBAUDNEGOTIATION_H_
+#define JNI_HARDWARE_UARTBAUDNEGOTIATION_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace Comm
+{
+	/// @brief Probe higher rates, blocking until the highest reliable one is in use
+	/// @param errorMessage Set to the reason the current rate could not be verified
+	bool NegotiateUartBaudRate(std::string& errorMessage);
+
+	/// @brief Negotiate in the background, the object model is not polled meanwhile
+	void StartUartBaudNegotiation();
+	bool IsUartBaudNegotiating();
+
+	/// @brief Called from the UART thread with each response, picks out the echoes
+	void HandleUartBaudProbeResponse(const unsigned char* data, size_t len);
+
+	/// @brief Called by the JSON decoder with the number of malformed responses in a row
+	void ReportUartResponseErrors(int errors);
+} // namespace Comm
+
+#endif /* JNI_HARDWARE_UARTBAUDNEGOTIATION_H_ */
@@ -0,0 +1,500 @@
+/*
+ * UartUpload.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "DebugLevels.h"
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+#include "Debug.h"
+
+#include "Comm/Communication.h"
+#include "Configuration.h"
+#include "Hardware/UartBaudNegotiation.h"
+#include "Hardware/SerialIo.h"
+#include "UartUpload.h"
+#include "utils/TimeHelper.h"
+#include "utils/utils.h"
+#include <ctype.h>
+#include <openssl/sha.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system/Mutex.h>
+#include <system/Thread.h>
+#include <list>
+#include <vector>
+
+namespace Comm
+{
+	// The firmware answers every line with "ok", after a resend request if it rejected the line, so the answers
+	// match the lines in the order they were sent
+	struct SentFrame
+	{
+		uint32_t frame;
+		uint32_t generation; // Lines sent before the last resend are rejected as well, without another resend
+	};
+
+	// Shared between the uploading thread and the UART thread. Frames are numbered from 0, which is also the line
+	// number they are sent with
+	static Mutex s_lock;
+	static bool s_active = false;
+	static std::list<SentFrame> s_inFlight;
+	static uint32_t s_generation = 0;
+	static uint32_t s_acked = 0; // Frames accepted by the firmware
+	static bool s_acksSeen = false;
+	static int32_t s_rejected = -1; // Line the firmware asked for before its next "ok"
+	static int32_t s_resendFrom = -1;
+	static std::string s_error;
+	static bool s_verifying = false; // Waiting for the answer to M38
+	static std::string s_hash;		 // SHA1 reported by M38, as hex
+
+	static bool StartsWith(const char* line, size_t len, const char* prefix)
+	{
+		const size_t prefixLen = strlen(prefix);
+		return len >= prefixLen && strncmp(line, prefix, prefixLen) == 0;
+	}
+
+	// The firmware reports errors of other commands, e.g. ones sent by macros, on the same UART, so only errors about
+	// the file being written end the transfer
+	static bool IsUploadError(const std::string& message)
+	{
+		return message.find("M28") != std::string::npos || message.find("M29") != std::string::npos ||
+			   message.find("file") != std::string::npos || message.find("File") != std::string::npos;
+	}
+
+	// M38 answers with the SHA1 of the file as 40 hex digits, possibly wrapped in a JSON response
+	static bool FindHash(const char* line, size_t len, std::string& hash)
+	{
+		size_t run = 0;
+		for (size_t i = 0; i < len; i++)
+		{
+			run = isxdigit((unsigned char)line[i]) ? run + 1 : 0;
+			if (run == 2 * SHA_DIGEST_LENGTH && (i + 1 == len || !isxdigit((unsigned char)line[i + 1])))
+			{
+				hash.assign(line + i + 1 - run, run);
+				for (char& c : hash)
+				{
+					c = (char)tolower((unsigned char)c);
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Called with s_lock held
+	static void HandleResponseLine(const char* line, size_t len)
+	{
+		if (s_verifying)
+		{
+			if (FindHash(line, len, s_hash))
+				return;
+		}
+
+		if (StartsWith(line, len, "ok"))
+		{
+			s_acksSeen = true;
+			if (s_inFlight.empty())
+				return;
+			const SentFrame sent = s_inFlight.front();
+			s_inFlight.pop_front();
+			if (s_rejected < 0)
+			{
+				s_acked = sent.frame + 1;
+				return;
+			}
+			if (sent.generation == s_generation)
+			{
+				s_generation++;
+				s_resendFrom = s_rejected;
+				s_acked = (uint32_t)s_rejected;
+			}
+			s_rejected = -1;
+			return;
+		}
+
+		if (StartsWith(line, len, "rs ") || StartsWith(line, len, "Resend:"))
+		{
+			const char* number = line + (line[0] == 'r' ? 3 : 7);
+			s_rejected = (int32_t)strtol(number, nullptr, 10);
+			return;
+		}
+
+		if (StartsWith(line, len, "Error:"))
+		{
+			// Checksum and line number errors are followed by a resend request
+			std::string message(line, len);
+			if (message.find("hecksum") != std::string::npos || message.find("Line Number") != std::string::npos)
+			{
+				warn("Upload line rejected: %s", message.c_str());
+				return;
+			}
+			if (!IsUploadError(message))
+			{
+				warn("Ignoring error during upload: %s", message.c_str());
+				return;
+			}
+			s_error = message;
+		}
+	}
+
+	void HandleUartUploadResponse(const unsigned char* data, size_t len)
+	{
+		Mutex::Autolock lock(s_lock);
+		if (!s_active)
+			return;
+
+		const char* line = (const char*)data;
+		const char* end = line + len;
+		while (line < end)
+		{
+			const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+			if (lineEnd == nullptr)
+				lineEnd = end;
+			size_t lineLen = lineEnd - line;
+			while (lineLen > 0 && line[lineLen - 1] == '\r')
+			{
+				lineLen--;
+			}
+			HandleResponseLine(line, lineLen);
+			line = lineEnd + 1;
+		}
+	}
+
+	// Appends "N<n> <text>*<checksum>\n", where the checksum is the XOR of every character before the '*'
+	static void AppendFrame(std::string& block, uint32_t lineNumber, const char* text, size_t len)
+	{
+		const size_t start = block.size();
+		block += utils::format("N%u ", lineNumber);
+		block.append(text, len);
+		uint8_t checksum = 0;
+		for (size_t i = start; i < block.size(); i++)
+		{
+			checksum ^= (uint8_t)block[i];
+		}
+		block += utils::format("*%u\n", checksum);
+	}
+
+	// Lines that were not acknowledged may have been lost, so have the firmware hash what it wrote. It writes each
+	// line without its number and checksum, ended by a single '\n'
+	static void VerifyUpload(const char* filename,
+							 const std::string& contents,
+							 const std::vector<uint32_t>& offsets,
+							 uint32_t frameCount,
+							 std::string& errorMessage)
+	{
+		SHA_CTX context;
+		SHA1_Init(&context);
+		for (uint32_t frame = 2; frame < frameCount; frame++)
+		{
+			size_t len = offsets[frame + 1] - offsets[frame];
+			const char* text = contents.c_str() + offsets[frame];
+			while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+			{
+				len--;
+			}
+			SHA1_Update(&context, text, len);
+			SHA1_Update(&context, "\n", 1);
+		}
+		unsigned char digest[SHA_DIGEST_LENGTH];
+		SHA1_Final(digest, &context);
+		std::string expected;
+		for (size_t i = 0; i < SHA_DIGEST_LENGTH; i++)
+		{
+			expected += utils::format("%02x", digest[i]);
+		}
+
+		{
+			Mutex::Autolock lock(s_lock);
+			s_hash.clear();
+			s_verifying = true;
+		}
+		SerialIo::Sendf("M38 \"%s\"\n", filename);
+		const long long start = TimeHelper::getCurrentTime();
+		while (TimeHelper::getCurrentTime() - start < (long long)UART_UPLOAD_VERIFY_TIMEOUT)
+		{
+			{
+				Mutex::Autolock lock(s_lock);
+				if (!s_error.empty())
+				{
+					errorMessage = s_error;
+					return;
+				}
+				if (!s_hash.empty())
+				{
+					if (s_hash != expected)
+					{
+						errorMessage = "Lines were lost, the uploaded file does not match";
+						warn("%s: SHA1 %s, expected %s", filename, s_hash.c_str(), expected.c_str());
+					}
+					return;
+				}
+			}
+			Thread::sleep(UART_UPLOAD_POLL_INTERVAL);
+		}
+		errorMessage = "The firmware did not acknowledge any line or report the SHA1 of the file";
+	}
+
+	bool UartUploadFile(const char* filename,
+						const std::string& contents,
+						function<void(int)> progress,
+						std::string& errorMessage)
+	{
+		// Frame 0 resets the line numbers, frame 1 opens the file and the rest are the lines of the file. The offsets
+		// are where each frame's line starts in the file, the window is counted in file bytes
+		std::vector<uint32_t> offsets;
+		const std::string open = utils::format("M28 \"%s\"", filename);
+		offsets.push_back(0);
+		offsets.push_back(0);
+		for (size_t pos = 0; pos < contents.size();)
+		{
+			offsets.push_back((uint32_t)pos);
+			const size_t next = contents.find('\n', pos);
+			pos = next == std::string::npos ? contents.size() : next + 1;
+		}
+		const uint32_t frameCount = (uint32_t)offsets.size();
+		offsets.push_back((uint32_t)contents.size());
+
+		{
+			Mutex::Autolock lock(s_lock);
+			s_active = true;
+			s_inFlight.clear();
+			s_acked = 0;
+			s_acksSeen = false;
+			s_rejected = -1;
+			s_resendFrom = -1;
+			s_error.clear();
+			s_verifying = false;
+		}
+
+		const long long start = TimeHelper::getCurrentTime();
+		long long lastProgress = start;
+		uint32_t nextFrame = 0;
+		uint32_t acked = 0;
+		uint32_t retries = 0;
+		uint32_t resends = 0;
+		bool paced = false;
+		int lastPercent = -1;
+		std::string block;
+		block.reserve(2 * UART_UPLOAD_BLOCK_SIZE);
+		while (true)
+		{
+			bool acksSeen;
+			{
+				Mutex::Autolock lock(s_lock);
+				if (!s_error.empty())
+				{
+					errorMessage = s_error;
+					break;
+				}
+				if (s_acked > acked)
+				{
+					lastProgress = TimeHelper::getCurrentTime();
+					retries = 0;
+				}
+				acked = s_acked;
+				if (s_resendFrom >= 0)
+				{
+					nextFrame = (uint32_t)s_resendFrom;
+					s_resendFrom = -1;
+					resends++;
+				}
+				acksSeen = s_acksSeen;
+				if (paced)
+					s_inFlight.clear();
+			}
+
+			// Firmware in PanelDue mode does not acknowledge lines, rely on the UART send time instead
+			if (!paced && !acksSeen && nextFrame > 0 &&
+				TimeHelper::getCurrentTime() - start > (long long)UART_UPLOAD_ACK_TIMEOUT)
+			{
+				info("No acknowledgements received, sending %s without waiting for them", filename);
+				paced = true;
+			}
+			if (paced)
+			{
+				acked = nextFrame;
+			}
+			if (acked >= frameCount)
+				break;
+
+			block.clear();
+			const uint32_t firstFrame = nextFrame;
+			while (nextFrame < frameCount && block.size() < UART_UPLOAD_BLOCK_SIZE &&
+				   (paced || offsets[nextFrame] - offsets[acked] < UART_UPLOAD_WINDOW || nextFrame == acked))
+			{
+				if (nextFrame == 0)
+				{
+					AppendFrame(block, nextFrame, "M110 N0", 7);
+				}
+				else if (nextFrame == 1)
+				{
+					AppendFrame(block, nextFrame, open.c_str(), open.size());
+				}
+				else
+				{
+					size_t len = offsets[nextFrame + 1] - offsets[nextFrame];
+					const char* text = contents.c_str() + offsets[nextFrame];
+					while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+					{
+						len--;
+					}
+					AppendFrame(block, nextFrame, text, len);
+				}
+				nextFrame++;
+			}
+
+			if (!block.empty())
+			{
+				{
+					Mutex::Autolock lock(s_lock);
+					for (uint32_t frame = firstFrame; frame < nextFrame; frame++)
+					{
+						s_inFlight.push_back({frame, s_generation});
+					}
+				}
+				if (!SerialIo::Send(block.c_str(), block.size()))
+				{
+					errorMessage = "UART write failed";
+					break;
+				}
+			}
+			else if (TimeHelper::getCurrentTime() - lastProgress > (long long)UART_UPLOAD_ACK_TIMEOUT)
+			{
+				if (++retries > UART_UPLOAD_MAX_RETRIES)
+				{
+					errorMessage = utils::format("No acknowledgement for line %u", acked);
+					break;
+				}
+				warn("No acknowledgement for line %u, resending", acked);
+				Mutex::Autolock lock(s_lock);
+				nextFrame = acked;
+				s_inFlight.clear();
+				s_generation++;
+				s_rejected = -1;
+				lastProgress = TimeHelper::getCurrentTime();
+			}
+			else
+			{
+				Thread::sleep(UART_UPLOAD_POLL_INTERVAL);
+			}
+
+			const int percent = (int)(100ull * offsets[acked] / (contents.empty() ? 1 : contents.size()));
+			if (percent != lastPercent)
+			{
+				progress(percent);
+				lastPercent = percent;
+			}
+		}
+
+		// Closes the file even if the transfer failed, a partial file is better than one left open
+		SerialIo::Sendf("M29\n");
+		if (paced && errorMessage.empty())
+		{
+			VerifyUpload(filename, contents, offsets, frameCount, errorMessage);
+		}
+		{
+			Mutex::Autolock lock(s_lock);
+			s_active = false;
+			s_verifying = false;
+		}
+
+		if (!errorMessage.empty())
+		{
+			error("Failed to upload %s: %s", filename, errorMessage.c_str());
+			return false;
+		}
+		info("Uploaded %s: %u bytes, %u lines in %lld ms, %u resend requests%s",
+			 filename,
+			 contents.size(),
+			 frameCount - 2,
+			 TimeHelper::getCurrentTime() - start,
+			 resends,
+			 paced ? ", not acknowledged but verified" : "");
+		return true;
+	}
+
+	// Shared between the upload thread and the UI thread
+	static Mutex s_statusLock;
+	static UartUploadStatus s_status = {false, false, 0, ""};
+	static volatile bool s_uploading = false;
+
+	class UartUploadThread : public Thread
+	{
+	  public:
+		bool Start(const char* filename, const std::string& contents)
+		{
+			if (s_uploading || isRunning() || IsUartBaudNegotiating())
+				return false;
+			m_filename = filename;
+			m_contents = contents;
+			{
+				Mutex::Autolock lock(s_statusLock);
+				s_status.running = true;
+				s_status.succeeded = false;
+				s_status.percent = 0;
+				s_status.errorMessage.clear();
+			}
+			s_uploading = true;
+			if (!run("uart_upload"))
+			{
+				Finish(false, "Failed to start the upload thread");
+				return false;
+			}
+			return true;
+		}
+
+	  protected:
+		virtual bool threadLoop()
+		{
+			std::string errorMessage;
+			const bool succeeded = UartUploadFile(
+				m_filename.c_str(),
+				m_contents,
+				[](int percent) {
+					Mutex::Autolock lock(s_statusLock);
+					s_status.percent = percent;
+				},
+				errorMessage);
+			m_contents.clear();
+			// Polling was paused, don't let the watchdog take that for a lost connection
+			KickWatchdog();
+			Finish(succeeded, errorMessage);
+			return false;
+		}
+
+	  private:
+		void Finish(bool succeeded, const std::string& errorMessage)
+		{
+			{
+				Mutex::Autolock lock(s_statusLock);
+				s_status.running = false;
+				s_status.succeeded = succeeded;
+				s_status.errorMessage = errorMessage;
+			}
+			s_uploading = false;
+		}
+
+		std::string m_filename;
+		std::string m_contents;
+	};
+
+	static UartUploadThread s_thread;
+
+	bool StartUartUpload(const char* filename, const std::string& contents)
+	{
+		return s_thread.Start(filename, contents);
+	}
+
+	bool IsUartUploading()
+	{
+		return s_uploading;
+	}
+
+	void GetUartUploadStatus(UartUploadStatus& status)
+	{
+		Mutex::Autolock lock(s_statusLock);
+		status = s_status;
+	}
+} // namespace Comm
@@ -0,0 +1,52 @@
+/*
+ * UartUpload.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Streams a file to the Duet over UART between M28 and M29. Every line is sent with a line number and checksum so
+ *  the firmware rejects corrupted lines and asks for them again. Lines are written in blocks, with at most
+ *  UART_UPLOAD_WINDOW bytes waiting for an "ok". Firmware that does not acknowledge lines is detected and the file
+ *  is then sent at the speed of the UART instead, and checked afterwards against the SHA1 the firmware reports for
+ *  it with M38.
+ *
+ *  Uploads started from the UI run on their own thread. The object model is not polled and G-code is not sent
+ *  meanwhile, as the firmware would write those lines into the file.
+ */
+
+#ifndef JNI_HARDWARE_UARTUPLOAD_H_
+#define JNI_HARDWARE_UARTUPLOAD_H_
+
+#include "std_fixed/functional.h"
+#include <stddef.h>
+#include <string>
+
+namespace Comm
+{
+	/// @brief Upload a file, blocking until the firmware has acknowledged every line or the transfer failed
+	/// @param progress Called with the percentage of the file that has been acknowledged
+	/// @param errorMessage Set to the reason the transfer failed
+	bool UartUploadFile(const char* filename,
+						const std::string& contents,
+						function<void(int)> progress,
+						std::string& errorMessage);
+
+	struct UartUploadStatus
+	{
+		bool running;
+		bool succeeded; // Only meaningful once running is false
+		int percent;
+		std::string errorMessage;
+	};
+
+	/// @brief Upload a file in the background, see GetUartUploadStatus for its progress
+	/// @return false if an upload or a baud rate negotiation is already using the UART
+	bool StartUartUpload(const char* filename, const std::string& contents);
+	bool IsUartUploading();
+	void GetUartUploadStatus(UartUploadStatus& status);
+
+	/// @brief Called from the UART thread with each response, picks out the acknowledgements and resend requests
+	void HandleUartUploadResponse(const unsigned char* data, size_t len);
+} // namespace Comm
+
+#endif /* JNI_HARDWARE_UARTUPLOAD_H_ */
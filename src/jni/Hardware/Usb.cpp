@@ -8,14 +8,67 @@
 #include "DebugLevels.h"
 #define DEBUG_LEVEL DEBUG_LEVEL_DBG
 
+#include "Configuration.h"
 #include "UI/UserInterface.h"
 #include "Usb.h"
 #include "sys/stat.h"
+#include "utils/TimeHelper.h"
 #include "utils/utils.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
 #include <fstream>
+#include <map>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <system/Mutex.h>
+#include <system/Thread.h>
+#include <unistd.h>
 
 namespace USB
 {
+	static bool IsHidden(const char* name)
+	{
+		return strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, "System Volume Information") == 0;
+	}
+
+	// Only regular files are stat'ed, the type comes from the directory entry unless the file system does not
+	// provide it
+	static bool ReadEntry(int dirFd, const char* name, unsigned char type, FileInfo& info)
+	{
+		memset(&info, 0, sizeof(info));
+		if (type == DT_DIR)
+		{
+			info.d_type = DT_DIR;
+			strncpy(info.d_name, name, sizeof(info.d_name) - 1);
+			return true;
+		}
+		if (type != DT_REG && type != DT_UNKNOWN)
+			return false;
+
+		struct stat sb;
+		if (fstatat(dirFd, name, &sb, 0) == -1)
+		{
+			error("Failed to get file stats for %s", name);
+			return false;
+		}
+		if (S_ISDIR(sb.st_mode))
+			info.d_type = DT_DIR;
+		else if (S_ISREG(sb.st_mode))
+			info.d_type = DT_REG;
+		else
+			return false;
+		strncpy(info.d_name, name, sizeof(info.d_name) - 1);
+		info.st_size = sb.st_size;
+		info.st_blksize = sb.st_blksize;
+		info.st_blocks = sb.st_blocks;
+		info.st_atim = sb.st_atim;
+		info.st_ctim = sb.st_ctim;
+		info.st_mtim = sb.st_mtim;
+		return true;
+	}
+
 	std::vector<FileInfo> ListEntriesInDirectory(const std::string& directoryPath)
 	{
 		std::vector<FileInfo> files;
@@ -30,31 +83,13 @@ namespace USB
 
 		// Read the directory entries
 		dirent* entry;
+		FileInfo info;
 		while ((entry = readdir(dir)) != nullptr)
 		{
-			std::string name = entry->d_name;
-			if (name == "." || name == ".." || name == "System Volume Information")
-			{
+			if (IsHidden(entry->d_name))
 				continue;
-			}
-
-			// Add files to the vector
-			if (entry->d_type == DT_REG || entry->d_type == DT_DIR)
-			{ // Regular file or folder
-				FileInfo info;
-				struct stat sb;
-				if (stat((directoryPath + "/" + entry->d_name).c_str(), &sb) == -1)
-				{
-					error("Failed to get file stats for %s", (directoryPath + entry->d_name).c_str());
-				}
-				strncpy(info.d_name, entry->d_name, 256);
-				info.d_type = entry->d_type;
-				info.st_size = sb.st_size;
-				info.st_blksize = sb.st_blksize;
-				info.st_blocks = sb.st_blocks;
-				info.st_atim = sb.st_atim;
-				info.st_ctim = sb.st_ctim;
-				info.st_mtim = sb.st_mtim;
+			if (ReadEntry(dirfd(dir), entry->d_name, entry->d_type, info))
+			{
 				files.push_back(info);
 			}
 		}
@@ -65,6 +100,360 @@ namespace USB
 		return files;
 	}
 
+	struct DirectoryListing
+	{
+		std::vector<FileInfo> entries;
+		uint32_t generation; // 0 until the directory has been listed
+		int watch;			 // inotify watch descriptor, -1 if not watched
+		long long lastUsed;
+	};
+
+	// Shared between the UI thread and the monitor thread
+	static Mutex s_lock;
+	static std::map<std::string, DirectoryListing> s_listings;
+	static std::vector<std::string> s_scanQueue;
+	static uint32_t s_generation = 0;
+	static uint32_t s_cacheEpoch = 0; // Listings that finish after the cache was cleared are dropped
+	static int s_inotify = -1;
+	static int s_wakePipe[2] = {-1, -1};
+	static void (*s_listingChanged)() = nullptr;
+
+	static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_CLOSE_WRITE |
+									   IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT;
+
+	static std::string NormalisePath(const std::string& path)
+	{
+		std::string normalised = path;
+		while (normalised.size() > 1 && normalised[normalised.size() - 1] == '/')
+		{
+			normalised.erase(normalised.size() - 1);
+		}
+		return normalised;
+	}
+
+	// Called with s_lock held
+	static void RemoveListing(std::map<std::string, DirectoryListing>::iterator it)
+	{
+		if (it->second.watch >= 0)
+			inotify_rm_watch(s_inotify, it->second.watch);
+		s_listings.erase(it);
+	}
+
+	// Called with s_lock held
+	static std::map<std::string, DirectoryListing>::iterator FindWatch(int watch)
+	{
+		for (auto it = s_listings.begin(); it != s_listings.end(); ++it)
+		{
+			if (it->second.watch == watch)
+				return it;
+		}
+		return s_listings.end();
+	}
+
+	class UsbMonitorThread : public Thread
+	{
+	  protected:
+		virtual bool threadLoop()
+		{
+			struct pollfd fds[2];
+			fds[0].fd = s_wakePipe[0];
+			fds[0].events = POLLIN;
+			fds[0].revents = 0;
+			fds[1].fd = s_inotify;
+			fds[1].events = POLLIN;
+			fds[1].revents = 0;
+			if (poll(fds, s_inotify >= 0 ? 2 : 1, -1) < 0 && errno != EINTR)
+			{
+				error("USB monitor poll failed: %d", errno);
+				Thread::sleep(1000);
+				return true;
+			}
+
+			uint32_t generation;
+			{
+				Mutex::Autolock lock(s_lock);
+				generation = s_generation;
+			}
+			if (fds[0].revents & POLLIN)
+			{
+				char drain[16];
+				while (read(s_wakePipe[0], drain, sizeof(drain)) > 0)
+				{
+				}
+			}
+			if (s_inotify >= 0 && (fds[1].revents & POLLIN))
+			{
+				HandleEvents();
+			}
+			ScanQueued();
+
+			// Listings only change on this thread
+			void (*listingChanged)() = nullptr;
+			{
+				Mutex::Autolock lock(s_lock);
+				if (s_generation != generation)
+					listingChanged = s_listingChanged;
+			}
+			if (listingChanged != nullptr)
+			{
+				listingChanged();
+			}
+			return true;
+		}
+
+	  private:
+		void ScanQueued()
+		{
+			while (true)
+			{
+				std::string path;
+				uint32_t epoch;
+				{
+					Mutex::Autolock lock(s_lock);
+					if (s_scanQueue.empty())
+						return;
+					path = s_scanQueue.front();
+					s_scanQueue.erase(s_scanQueue.begin());
+					epoch = s_cacheEpoch;
+				}
+
+				// Watch before listing so no change is missed in between
+				const int watch = s_inotify >= 0 ? inotify_add_watch(s_inotify, path.c_str(), WATCH_MASK) : -1;
+				const long long start = TimeHelper::getCurrentTime();
+				std::vector<FileInfo> entries = ListEntriesInDirectory(path);
+				dbg("Listed %s: %u entries in %lld ms",
+					path.c_str(),
+					entries.size(),
+					TimeHelper::getCurrentTime() - start);
+
+				Mutex::Autolock lock(s_lock);
+				auto it = s_listings.find(path);
+				if (epoch != s_cacheEpoch || it == s_listings.end())
+				{
+					if (watch >= 0 && FindWatch(watch) == s_listings.end())
+						inotify_rm_watch(s_inotify, watch);
+					continue;
+				}
+				it->second.entries.swap(entries);
+				it->second.generation = ++s_generation;
+				it->second.watch = watch;
+			}
+		}
+
+		void HandleEvents()
+		{
+			// Aligned for struct inotify_event
+			uint32_t buffer[1024];
+			ssize_t len;
+			while ((len = read(s_inotify, buffer, sizeof(buffer))) > 0)
+			{
+				const char* p = (const char*)buffer;
+				const char* end = p + len;
+				while (p < end)
+				{
+					const struct inotify_event* event = (const struct inotify_event*)p;
+					p += sizeof(struct inotify_event) + event->len;
+					HandleEvent(event);
+				}
+			}
+		}
+
+		void HandleEvent(const struct inotify_event* event)
+		{
+			std::string path;
+			{
+				Mutex::Autolock lock(s_lock);
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					// Events were lost, list every cached directory again
+					warn("USB monitor event queue overflowed");
+					for (auto& listing : s_listings)
+					{
+						if (std::find(s_scanQueue.begin(), s_scanQueue.end(), listing.first) == s_scanQueue.end())
+							s_scanQueue.push_back(listing.first);
+					}
+					return;
+				}
+
+				auto it = FindWatch(event->wd);
+				if (it == s_listings.end())
+					return;
+				if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT))
+				{
+					dbg("No longer watching %s", it->first.c_str());
+					if (!(event->mask & IN_IGNORED))
+						inotify_rm_watch(s_inotify, it->second.watch);
+					s_listings.erase(it);
+					return;
+				}
+				if (event->len == 0 || IsHidden(event->name))
+					return;
+				path = it->first;
+				if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+				{
+					RemoveEntry(it->second, event->name);
+					return;
+				}
+			}
+
+			// Created or changed, only this entry is read again
+			FileInfo info;
+			bool found = false;
+			const int dirFd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+			if (dirFd >= 0)
+			{
+				found = ReadEntry(dirFd, event->name, DT_UNKNOWN, info);
+				close(dirFd);
+			}
+
+			Mutex::Autolock lock(s_lock);
+			auto it = s_listings.find(path);
+			if (it == s_listings.end())
+				return;
+			if (!found)
+			{
+				RemoveEntry(it->second, event->name);
+				return;
+			}
+			for (FileInfo& entry : it->second.entries)
+			{
+				if (strcmp(entry.d_name, info.d_name) == 0)
+				{
+					entry = info;
+					it->second.generation = ++s_generation;
+					return;
+				}
+			}
+			it->second.entries.push_back(info);
+			it->second.generation = ++s_generation;
+		}
+
+		// Called with s_lock held
+		void RemoveEntry(DirectoryListing& listing, const char* name)
+		{
+			for (auto entry = listing.entries.begin(); entry != listing.entries.end(); ++entry)
+			{
+				if (strcmp(entry->d_name, name) == 0)
+				{
+					listing.entries.erase(entry);
+					listing.generation = ++s_generation;
+					return;
+				}
+			}
+		}
+	};
+
+	static bool StartMonitor()
+	{
+		static int s_state = 0; // 1 once running, -1 if it could not be started
+		if (s_state != 0)
+			return s_state > 0;
+
+		s_state = -1;
+		if (pipe(s_wakePipe) != 0)
+		{
+			error("Failed to create USB monitor wake pipe");
+			return false;
+		}
+		fcntl(s_wakePipe[0], F_SETFL, O_NONBLOCK);
+		s_inotify = inotify_init();
+		if (s_inotify < 0)
+		{
+			// Listings are then read again each time a directory is shown, still off the UI thread
+			warn("inotify not available, USB directories will not be watched");
+		}
+		else
+		{
+			fcntl(s_inotify, F_SETFL, O_NONBLOCK);
+		}
+
+		UsbMonitorThread* thread = new UsbMonitorThread();
+		if (!thread->run("usb_monitor"))
+		{
+			error("Failed to start USB monitor");
+			return false;
+		}
+		s_state = 1;
+		return true;
+	}
+
+	// Called with s_lock held
+	static void QueueScan(const std::string& path)
+	{
+		if (std::find(s_scanQueue.begin(), s_scanQueue.end(), path) != s_scanQueue.end())
+			return;
+		s_scanQueue.push_back(path);
+		const char wake = 0;
+		if (write(s_wakePipe[1], &wake, 1) < 0)
+		{
+			warn("Failed to wake USB monitor");
+		}
+	}
+
+	bool GetDirectoryListing(const std::string& directoryPath, std::vector<FileInfo>& entries, uint32_t& generation)
+	{
+		const std::string path = NormalisePath(directoryPath);
+		Mutex::Autolock lock(s_lock);
+		if (!StartMonitor())
+		{
+			// Nothing to list it in the background, list it here once
+			if (generation != 0)
+				return false;
+			entries = ListEntriesInDirectory(path);
+			generation = 1;
+			return true;
+		}
+
+		auto it = s_listings.find(path);
+		if (it == s_listings.end())
+		{
+			if (s_listings.size() >= USB_CACHE_MAX_DIRECTORIES)
+			{
+				auto oldest = s_listings.begin();
+				for (auto listing = s_listings.begin(); listing != s_listings.end(); ++listing)
+				{
+					if (listing->second.lastUsed < oldest->second.lastUsed)
+						oldest = listing;
+				}
+				RemoveListing(oldest);
+			}
+			it = s_listings.insert(std::make_pair(path, DirectoryListing())).first;
+			it->second.generation = 0;
+			it->second.watch = -1;
+			QueueScan(path);
+		}
+		else if (generation == 0 && it->second.watch < 0 && it->second.generation != 0)
+		{
+			// Not watched, show the previous listing while it is read again
+			QueueScan(path);
+		}
+		it->second.lastUsed = TimeHelper::getCurrentTime();
+
+		if (it->second.generation == 0 || it->second.generation == generation)
+			return false;
+		entries = it->second.entries;
+		generation = it->second.generation;
+		return true;
+	}
+
+	void SetListingChangedHandler(void (*handler)())
+	{
+		Mutex::Autolock lock(s_lock);
+		s_listingChanged = handler;
+	}
+
+	void ClearDirectoryCache()
+	{
+		Mutex::Autolock lock(s_lock);
+		info("Clearing %u cached USB directory listings", s_listings.size());
+		while (!s_listings.empty())
+		{
+			RemoveListing(s_listings.begin());
+		}
+		s_scanQueue.clear();
+		s_cacheEpoch++;
+	}
+
 	bool ReadUsbFileContents(const std::string& filePath, std::string& contents)
 	{
 	    std::string fullPath;
@@ -29,6 +29,20 @@ namespace USB
 	} FileInfo;
 
 	std::vector<FileInfo> ListEntriesInDirectory(const std::string& directoryPath);
+
+	/// @brief Copy the cached listing of a directory if it changed since `generation`, which is then updated.
+	/// Directories that are not cached yet are listed by a background thread and then watched with inotify, so the
+	/// listing is kept up to date without listing the directory again
+	/// @param generation 0 the first time a directory is shown
+	/// @return true if `entries` was filled
+	bool GetDirectoryListing(const std::string& directoryPath, std::vector<FileInfo>& entries, uint32_t& generation);
+
+	/// @brief Set the function called from the monitor thread after any cached listing has changed, nullptr for none
+	void SetListingChangedHandler(void (*handler)());
+
+	/// @brief Forget every cached listing, called when a USB drive is mounted or removed
+	void ClearDirectoryCache();
+
 	bool ReadUsbFileContents(const std::string& filePath, std::string& contents);
 	bool ReadFileContents(const std::string& filePath, std::string& contents);
 } // namespace USB
@@ -0,0 +1,1099 @@
+/*
+ * Logger.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "AllocationTracker.h"
+#include "Configuration.h"
+#include "Duet3D/General/LineBuffer.h"
+#include "Logger.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <system/Thread.h>
+#include <unistd.h>
+
+namespace Debug
+{
+	static_assert((LOG_THREAD_BUFFER_SIZE & (LOG_THREAD_BUFFER_SIZE - 1)) == 0, "Log buffer size must be a power of 2");
+	static_assert(LOG_THREAD_BUFFER_SIZE <= UINT16_MAX, "Log buffer size must fit in a record header");
+	static_assert(LOG_MAX_RECORD_SIZE <= LOG_THREAD_BUFFER_SIZE / 4, "Log records too large for the buffer");
+
+	enum class LogArgType : uint8_t
+	{
+		Int = 0,
+		Uint,
+		Double,
+		String,
+		StaticString,
+		Pointer,
+	};
+
+	struct LogRecordHeader
+	{
+		uint16_t size;	  // including this header, a multiple of LOG_RECORD_ALIGNMENT
+		uint8_t level;	  // LOG_PADDING_RECORD for unused space at the end of the buffer
+		uint8_t argCount; // arguments follow the header, each a LogArgType followed by its value
+		uint32_t sequence;
+		const char* fmt;
+		const LogModule* module;
+	};
+
+	constexpr uint8_t LOG_PADDING_RECORD = 0xFF;
+	constexpr size_t LOG_RECORD_ALIGNMENT = 8;
+
+	enum class LogBufferState : uint8_t
+	{
+		InUse = 0,
+		Orphaned, // the owning thread has exited, records may still be waiting
+		Free,	  // orphaned and empty, can be given to a new thread
+	};
+
+	/// Single producer, single consumer ring buffer. Only the owning thread writes records and moves head, only the
+	/// thread holding s_drainLock reads records and moves tail.
+	struct LogThreadBuffer
+	{
+		alignas(LOG_RECORD_ALIGNMENT) uint8_t data[LOG_THREAD_BUFFER_SIZE];
+		uint32_t head;
+		uint32_t tail;
+		uint32_t dropped;
+		uint32_t reportedDropped;
+		uint8_t state;
+		LogThreadBuffer* next;
+	};
+
+	static pthread_mutex_t s_moduleLock = PTHREAD_MUTEX_INITIALIZER;
+	static LogModule* s_firstModule = nullptr;
+
+	static pthread_mutex_t s_bufferLock = PTHREAD_MUTEX_INITIALIZER;
+	static LogThreadBuffer* s_firstBuffer = nullptr;
+	static __thread LogThreadBuffer* s_threadBuffer = nullptr;
+	static pthread_key_t s_threadExitKey;
+	static pthread_once_t s_threadExitKeyOnce = PTHREAD_ONCE_INIT;
+	static uint32_t s_sequence = 0;
+
+	static pthread_mutex_t s_drainLock = PTHREAD_MUTEX_INITIALIZER;
+	// The flush thread sleeps on s_flushCondition until a record is queued. Only the first record after it has woken
+	// signals it, the rest find s_flushRequested already set
+	static pthread_mutex_t s_flushLock = PTHREAD_MUTEX_INITIALIZER;
+	static pthread_cond_t s_flushCondition = PTHREAD_COND_INITIALIZER;
+	static bool s_flushRequested = false;
+	static pthread_mutex_t s_historyLock = PTHREAD_MUTEX_INITIALIZER;
+	static LineBuffer<LOG_HISTORY_SIZE, LOG_HISTORY_LINES> s_history;
+	static volatile bool s_loggerRunning = false;
+
+	static const int s_crashSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+	static struct sigaction s_previousCrashHandlers[sizeof(s_crashSignals) / sizeof(s_crashSignals[0])];
+
+	/*
+	 * Modules
+	 */
+	static void GetModuleName(const char* file, char* name, size_t size)
+	{
+		const char* start = strrchr(file, '/');
+		start = (start != nullptr) ? start + 1 : file;
+		const char* end = strrchr(start, '.');
+		size_t len = (end != nullptr) ? (size_t)(end - start) : strlen(start);
+		if (len >= size)
+			len = size - 1;
+		memcpy(name, start, len);
+		name[len] = '\0';
+	}
+
+	// Must be called with s_moduleLock held
+	static LogModule* FindOrCreateModule(const char* name)
+	{
+		for (LogModule* module = s_firstModule; module != nullptr; module = module->next)
+		{
+			if (strcmp(module->name, name) == 0)
+				return module;
+		}
+
+		LogModule* module = new LogModule;
+		module->tag = nullptr;
+		strncpy(module->name, name, sizeof(module->name) - 1);
+		module->name[sizeof(module->name) - 1] = '\0';
+		module->level = -1;
+		module->next = s_firstModule;
+		s_firstModule = module;
+		return module;
+	}
+
+	LogModule* GetLogModule(const char* file)
+	{
+		char name[sizeof(LogModule::name)];
+		GetModuleName(file, name, sizeof(name));
+
+		pthread_mutex_lock(&s_moduleLock);
+		LogModule* module = FindOrCreateModule(name);
+		if (module->tag == nullptr)
+			module->tag = file;
+		pthread_mutex_unlock(&s_moduleLock);
+		return module;
+	}
+
+	LogModule* GetFirstLogModule()
+	{
+		return s_firstModule;
+	}
+
+	void SetLogModuleLevel(const char* name, int level)
+	{
+		if (level >= (int)DebugLevel::COUNT)
+			level = (int)DebugLevel::COUNT - 1;
+		if (level < -1)
+			level = -1;
+
+		pthread_mutex_lock(&s_moduleLock);
+		FindOrCreateModule(name)->level = (int8_t)level;
+		pthread_mutex_unlock(&s_moduleLock);
+	}
+
+	/*
+	 * Thread buffers
+	 */
+	static void OnThreadExit(void* buffer)
+	{
+		__atomic_store_n(&static_cast<LogThreadBuffer*>(buffer)->state,
+						 (uint8_t)LogBufferState::Orphaned,
+						 __ATOMIC_RELEASE);
+	}
+
+	static void CreateThreadExitKey()
+	{
+		pthread_key_create(&s_threadExitKey, OnThreadExit);
+	}
+
+	static LogThreadBuffer* GetThreadBuffer()
+	{
+		if (s_threadBuffer != nullptr)
+			return s_threadBuffer;
+
+		pthread_once(&s_threadExitKeyOnce, CreateThreadExitKey);
+		pthread_mutex_lock(&s_bufferLock);
+
+		// Reuse the buffer of a thread that has exited, the thread pool threads come and go with every request
+		LogThreadBuffer* buffer = nullptr;
+		for (LogThreadBuffer* b = s_firstBuffer; b != nullptr; b = b->next)
+		{
+			if (__atomic_load_n(&b->state, __ATOMIC_ACQUIRE) == (uint8_t)LogBufferState::Free)
+			{
+				buffer = b;
+				break;
+			}
+		}
+		if (buffer == nullptr)
+		{
+			buffer = new LogThreadBuffer();
+			Memory::RecordAllocation(Memory::Subsystem::Buffers, sizeof(LogThreadBuffer));
+			buffer->next = s_firstBuffer;
+			__atomic_store_n(&s_firstBuffer, buffer, __ATOMIC_RELEASE);
+		}
+		__atomic_store_n(&buffer->state, (uint8_t)LogBufferState::InUse, __ATOMIC_RELEASE);
+
+		pthread_mutex_unlock(&s_bufferLock);
+		pthread_setspecific(s_threadExitKey, buffer);
+		s_threadBuffer = buffer;
+		return buffer;
+	}
+
+	/*
+	 * Writing records
+	 */
+	LogRecord::LogRecord(DebugLevel level, const LogModule* module, const char* fmt)
+		: m_buffer(nullptr), m_head(0), m_size(sizeof(LogRecordHeader))
+	{
+		LogThreadBuffer* buffer = GetThreadBuffer();
+		uint32_t head = buffer->head;
+		const uint32_t tail = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+
+		// Every record is given the maximum record size of contiguous space, so it never has to wrap
+		const uint32_t contiguous = LOG_THREAD_BUFFER_SIZE - (head & (LOG_THREAD_BUFFER_SIZE - 1));
+		const uint32_t padding = (contiguous < LOG_MAX_RECORD_SIZE) ? contiguous : 0;
+		if (LOG_THREAD_BUFFER_SIZE - (head - tail) < padding + LOG_MAX_RECORD_SIZE)
+		{
+			buffer->dropped++;
+			return;
+		}
+
+		if (padding > 0)
+		{
+			LogRecordHeader* pad =
+				reinterpret_cast<LogRecordHeader*>(buffer->data + (head & (LOG_THREAD_BUFFER_SIZE - 1)));
+			pad->size = (uint16_t)padding;
+			pad->level = LOG_PADDING_RECORD;
+			head += padding;
+		}
+
+		LogRecordHeader* header =
+			reinterpret_cast<LogRecordHeader*>(buffer->data + (head & (LOG_THREAD_BUFFER_SIZE - 1)));
+		header->level = (uint8_t)level;
+		header->argCount = 0;
+		header->sequence = __atomic_fetch_add(&s_sequence, 1, __ATOMIC_RELAXED);
+		header->fmt = fmt;
+		header->module = module;
+		m_buffer = buffer;
+		m_head = head;
+	}
+
+	static void DrainBuffers();
+
+	static void RequestFlush()
+	{
+		if (__atomic_exchange_n(&s_flushRequested, true, __ATOMIC_ACQ_REL))
+			return;
+		pthread_mutex_lock(&s_flushLock);
+		pthread_cond_signal(&s_flushCondition);
+		pthread_mutex_unlock(&s_flushLock);
+	}
+
+	LogRecord::~LogRecord()
+	{
+		if (m_buffer == nullptr)
+			return;
+
+		const size_t size = (m_size + LOG_RECORD_ALIGNMENT - 1) & ~(LOG_RECORD_ALIGNMENT - 1);
+		reinterpret_cast<LogRecordHeader*>(m_buffer->data + (m_head & (LOG_THREAD_BUFFER_SIZE - 1)))->size =
+			(uint16_t)size;
+		__atomic_store_n(&m_buffer->head, m_head + (uint32_t)size, __ATOMIC_RELEASE);
+
+		if (!s_loggerRunning)
+		{
+			// No flush thread yet, so write it out now
+			DrainBuffers();
+			return;
+		}
+		RequestFlush();
+	}
+
+	uint8_t* LogRecord::Reserve(size_t len)
+	{
+		if (m_buffer == nullptr || m_size + len > LOG_MAX_RECORD_SIZE)
+			return nullptr;
+
+		LogRecordHeader* header =
+			reinterpret_cast<LogRecordHeader*>(m_buffer->data + (m_head & (LOG_THREAD_BUFFER_SIZE - 1)));
+		if (header->argCount == UINT8_MAX)
+			return nullptr;
+
+		uint8_t* p = reinterpret_cast<uint8_t*>(header) + m_size;
+		header->argCount++;
+		m_size += len;
+		return p;
+	}
+
+	void LogRecord::AddInt(int64_t value)
+	{
+		uint8_t* p = Reserve(1 + sizeof(value));
+		if (p == nullptr)
+			return;
+		*p = (uint8_t)LogArgType::Int;
+		memcpy(p + 1, &value, sizeof(value));
+	}
+
+	void LogRecord::AddUint(uint64_t value)
+	{
+		uint8_t* p = Reserve(1 + sizeof(value));
+		if (p == nullptr)
+			return;
+		*p = (uint8_t)LogArgType::Uint;
+		memcpy(p + 1, &value, sizeof(value));
+	}
+
+	void LogRecord::AddPointer(const void* ptr)
+	{
+		uint8_t* p = Reserve(1 + sizeof(ptr));
+		if (p == nullptr)
+			return;
+		*p = (uint8_t)LogArgType::Pointer;
+		memcpy(p + 1, &ptr, sizeof(ptr));
+	}
+
+	void LogRecord::AddString(const char* str, size_t len)
+	{
+		// Long strings are truncated to whatever space is left in the record. The address of the string is kept as well
+		// in case it is formatted with %p
+		const size_t overhead = 1 + sizeof(str) + sizeof(uint16_t);
+		if (m_buffer == nullptr || m_size + overhead > LOG_MAX_RECORD_SIZE)
+			return;
+		if (len > LOG_MAX_RECORD_SIZE - m_size - overhead)
+			len = LOG_MAX_RECORD_SIZE - m_size - overhead;
+
+		uint8_t* p = Reserve(overhead + len);
+		if (p == nullptr)
+			return;
+		const uint16_t len16 = (uint16_t)len;
+		*p = (uint8_t)LogArgType::String;
+		memcpy(p + 1, &str, sizeof(str));
+		memcpy(p + 1 + sizeof(str), &len16, sizeof(len16));
+		memcpy(p + overhead, str, len);
+	}
+
+	void LogRecord::Add(bool value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(char value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(signed char value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(unsigned char value)
+	{
+		AddUint(value);
+	}
+
+	void LogRecord::Add(short value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(unsigned short value)
+	{
+		AddUint(value);
+	}
+
+	void LogRecord::Add(int value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(unsigned int value)
+	{
+		AddUint(value);
+	}
+
+	void LogRecord::Add(long value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(unsigned long value)
+	{
+		AddUint(value);
+	}
+
+	void LogRecord::Add(long long value)
+	{
+		AddInt(value);
+	}
+
+	void LogRecord::Add(unsigned long long value)
+	{
+		AddUint(value);
+	}
+
+	void LogRecord::Add(double value)
+	{
+		uint8_t* p = Reserve(1 + sizeof(value));
+		if (p == nullptr)
+			return;
+		*p = (uint8_t)LogArgType::Double;
+		memcpy(p + 1, &value, sizeof(value));
+	}
+
+	void LogRecord::Add(const char* str)
+	{
+		if (str == nullptr)
+		{
+			AddPointer(nullptr);
+			return;
+		}
+		AddString(str, strlen(str));
+	}
+
+	void LogRecord::Add(const std::string& str)
+	{
+		AddString(str.c_str(), str.size());
+	}
+
+	void LogRecord::Add(StaticString str)
+	{
+		uint8_t* p = Reserve(1 + sizeof(str.str));
+		if (p == nullptr)
+			return;
+		*p = (uint8_t)LogArgType::StaticString;
+		memcpy(p + 1, &str.str, sizeof(str.str));
+	}
+
+	/*
+	 * Formatting
+	 */
+	struct LogArg
+	{
+		LogArgType type;
+		union
+		{
+			int64_t i;
+			uint64_t u;
+			double d;
+			const void* p;
+		};
+		const char* str;
+		size_t len;
+	};
+
+	class LogArgReader
+	{
+	  public:
+		LogArgReader(const LogRecordHeader* header)
+			: m_next(reinterpret_cast<const uint8_t*>(header) + sizeof(LogRecordHeader)),
+			  m_remaining(header->argCount)
+		{
+		}
+
+		bool Next(LogArg& arg)
+		{
+			if (m_remaining == 0)
+				return false;
+			m_remaining--;
+
+			arg.type = (LogArgType)*m_next++;
+			arg.str = nullptr;
+			arg.len = 0;
+			switch (arg.type)
+			{
+			case LogArgType::Int:
+			case LogArgType::Uint:
+			case LogArgType::Double:
+				memcpy(&arg.u, m_next, sizeof(arg.u));
+				m_next += sizeof(arg.u);
+				break;
+			case LogArgType::Pointer:
+				memcpy(&arg.p, m_next, sizeof(arg.p));
+				m_next += sizeof(arg.p);
+				break;
+			case LogArgType::StaticString:
+				memcpy(&arg.str, m_next, sizeof(arg.str));
+				m_next += sizeof(arg.str);
+				arg.p = arg.str;
+				arg.len = strlen(arg.str);
+				break;
+			case LogArgType::String: {
+				memcpy(&arg.p, m_next, sizeof(arg.p));
+				m_next += sizeof(arg.p);
+				uint16_t len;
+				memcpy(&len, m_next, sizeof(len));
+				arg.str = reinterpret_cast<const char*>(m_next + sizeof(len));
+				arg.len = len;
+				m_next += sizeof(len) + len;
+				break;
+			}
+			}
+			return true;
+		}
+
+		int64_t NextInt()
+		{
+			LogArg arg;
+			if (!Next(arg))
+				return 0;
+			switch (arg.type)
+			{
+			case LogArgType::Int:
+			case LogArgType::Uint:
+				return arg.i;
+			case LogArgType::Double:
+				return (int64_t)arg.d;
+			default:
+				return 0;
+			}
+		}
+
+	  private:
+		const uint8_t* m_next;
+		size_t m_remaining;
+	};
+
+	class LogLineWriter
+	{
+	  public:
+		LogLineWriter(char* out, size_t size) : m_out(out), m_size(size), m_len(0) { m_out[0] = '\0'; }
+
+		void Append(const char* str, size_t len)
+		{
+			if (m_len + len >= m_size)
+				len = m_size - m_len - 1;
+			memcpy(m_out + m_len, str, len);
+			m_len += len;
+			m_out[m_len] = '\0';
+		}
+
+		template <typename T>
+		void AppendFormat(const char* spec, T value)
+		{
+			if (m_len + 1 >= m_size)
+				return;
+			int written = snprintf(m_out + m_len, m_size - m_len, spec, value);
+			if (written > 0)
+				m_len += ((size_t)written < m_size - m_len) ? (size_t)written : m_size - m_len - 1;
+		}
+
+		size_t Length() const { return m_len; }
+
+	  private:
+		char* m_out;
+		size_t m_size;
+		size_t m_len;
+	};
+
+	// Formats one conversion specification, starting at the '%', with the next argument(s) from the record
+	static const char* FormatConversion(const char* fmt, LogArgReader& args, LogLineWriter& out)
+	{
+		char spec[32];
+		size_t specLen = 0;
+		spec[specLen++] = *fmt++; // '%'
+
+		// Flags, width and precision are copied, '*' is replaced by the value of its argument
+		while (*fmt != '\0' && strchr("-+ #0123456789.*", *fmt) != nullptr && specLen < sizeof(spec) - 8)
+		{
+			if (*fmt == '*')
+			{
+				specLen += snprintf(spec + specLen, sizeof(spec) - specLen, "%d", (int)args.NextInt());
+				fmt++;
+				continue;
+			}
+			spec[specLen++] = *fmt++;
+		}
+
+		// Arguments are stored at full width, so the length modifiers are replaced
+		while (*fmt != '\0' && strchr("hlLqjzt", *fmt) != nullptr)
+		{
+			fmt++;
+		}
+
+		const char conversion = *fmt;
+		if (conversion == '\0')
+			return fmt;
+		fmt++;
+
+		LogArg arg;
+		if (!args.Next(arg))
+		{
+			out.Append("<missing>", 9);
+			return fmt;
+		}
+
+		switch (conversion)
+		{
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			strcpy(spec + specLen, "ll");
+			spec[specLen + 2] = (conversion == 'i') ? 'd' : conversion;
+			spec[specLen + 3] = '\0';
+			if (arg.type == LogArgType::Double)
+				arg.i = (int64_t)arg.d;
+			else if (arg.type != LogArgType::Int && arg.type != LogArgType::Uint)
+			{
+				out.Append("<?>", 3);
+				break;
+			}
+			if (conversion == 'd' || conversion == 'i')
+				out.AppendFormat(spec, (long long)arg.i);
+			else
+				out.AppendFormat(spec, (unsigned long long)arg.u);
+			break;
+		case 'c':
+			strcpy(spec + specLen, "c");
+			out.AppendFormat(spec, (int)arg.i);
+			break;
+		case 'e':
+		case 'E':
+		case 'f':
+		case 'F':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			spec[specLen] = conversion;
+			spec[specLen + 1] = '\0';
+			if (arg.type == LogArgType::Int)
+				arg.d = (double)arg.i;
+			else if (arg.type == LogArgType::Uint)
+				arg.d = (double)arg.u;
+			else if (arg.type != LogArgType::Double)
+			{
+				out.Append("<?>", 3);
+				break;
+			}
+			out.AppendFormat(spec, arg.d);
+			break;
+		case 's':
+			if (arg.str == nullptr)
+			{
+				out.Append("(null)", 6);
+				break;
+			}
+			if (specLen == 1)
+			{
+				out.Append(arg.str, arg.len);
+				break;
+			}
+			spec[specLen] = '\0';
+			if (strchr(spec, '.') != nullptr)
+			{
+				// Precision already given, so make sure the string is terminated
+				std::string str(arg.str, arg.len);
+				strcpy(spec + specLen, "s");
+				out.AppendFormat(spec, str.c_str());
+				break;
+			}
+			// Stored strings aren't terminated, use the length as the precision
+			snprintf(spec + specLen, sizeof(spec) - specLen, ".%ds", (int)arg.len);
+			out.AppendFormat(spec, arg.str);
+			break;
+		case 'p':
+			strcpy(spec + specLen, "p");
+			out.AppendFormat(spec, arg.p);
+			break;
+		default:
+			// Includes %n, which is never written
+			out.Append("<?>", 3);
+			break;
+		}
+		return fmt;
+	}
+
+	static size_t FormatRecord(const LogRecordHeader* header, char* out, size_t size)
+	{
+		LogLineWriter writer(out, size);
+		LogArgReader args(header);
+		const char* fmt = header->fmt;
+		while (*fmt != '\0')
+		{
+			const char* percent = strchr(fmt, '%');
+			if (percent == nullptr)
+			{
+				writer.Append(fmt, strlen(fmt));
+				break;
+			}
+			writer.Append(fmt, percent - fmt);
+			if (percent[1] == '%')
+			{
+				writer.Append("%", 1);
+				fmt = percent + 2;
+				continue;
+			}
+			fmt = FormatConversion(percent, args, writer);
+		}
+		return writer.Length();
+	}
+
+	/*
+	 * Output
+	 */
+	static int GetAndroidPriority(uint8_t level)
+	{
+		switch ((DebugLevel)level)
+		{
+		case DebugLevel::Verbose:
+			return ANDROID_LOG_VERBOSE;
+		case DebugLevel::Debug:
+			return ANDROID_LOG_DEBUG;
+		case DebugLevel::Info:
+			return ANDROID_LOG_INFO;
+		case DebugLevel::Warn:
+			return ANDROID_LOG_WARN;
+		case DebugLevel::Error:
+			return ANDROID_LOG_ERROR;
+		default:
+			return ANDROID_LOG_FATAL;
+		}
+	}
+
+	static void OutputLine(uint8_t level, const char* tag, const char* name, const char* text, size_t len)
+	{
+		__android_log_write(GetAndroidPriority(level), tag, text);
+
+		char line[LOG_MAX_FORMATTED_LENGTH];
+		int prefix = snprintf(line, sizeof(line), "%c %s: ", "VDIWEF"[level < 6 ? level : 5], name);
+		if (prefix < 0 || (size_t)prefix >= sizeof(line))
+			return;
+		if (len > sizeof(line) - prefix - 1)
+			len = sizeof(line) - prefix - 1;
+		memcpy(line + prefix, text, len);
+
+		pthread_mutex_lock(&s_historyLock);
+		s_history.Push(line, prefix + len);
+		pthread_mutex_unlock(&s_historyLock);
+	}
+
+	static void OutputRecord(const LogRecordHeader* header)
+	{
+		char text[LOG_MAX_FORMATTED_LENGTH];
+		size_t len = FormatRecord(header, text, sizeof(text));
+		const LogModule* module = header->module;
+		OutputLine(header->level, module->tag != nullptr ? module->tag : module->name, module->name, text, len);
+	}
+
+	// Returns the next record of a buffer without consuming it, skipping any padding
+	static const LogRecordHeader* PeekRecord(LogThreadBuffer* buffer)
+	{
+		const uint32_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+		while (buffer->tail != head)
+		{
+			const LogRecordHeader* header = reinterpret_cast<const LogRecordHeader*>(
+				buffer->data + (buffer->tail & (LOG_THREAD_BUFFER_SIZE - 1)));
+			if (header->level != LOG_PADDING_RECORD)
+				return header;
+			__atomic_store_n(&buffer->tail, buffer->tail + header->size, __ATOMIC_RELEASE);
+		}
+		return nullptr;
+	}
+
+	// Writes out every queued record from all threads in the order they were logged
+	static void DrainBuffersLocked()
+	{
+		LogThreadBuffer* const first = __atomic_load_n(&s_firstBuffer, __ATOMIC_ACQUIRE);
+		while (true)
+		{
+			LogThreadBuffer* oldestBuffer = nullptr;
+			const LogRecordHeader* oldest = nullptr;
+			for (LogThreadBuffer* buffer = first; buffer != nullptr; buffer = buffer->next)
+			{
+				const LogRecordHeader* header = PeekRecord(buffer);
+				if (header != nullptr && (oldest == nullptr || (int32_t)(header->sequence - oldest->sequence) < 0))
+				{
+					oldest = header;
+					oldestBuffer = buffer;
+				}
+			}
+			if (oldest == nullptr)
+				break;
+
+			OutputRecord(oldest);
+			__atomic_store_n(&oldestBuffer->tail, oldestBuffer->tail + oldest->size, __ATOMIC_RELEASE);
+		}
+
+		for (LogThreadBuffer* buffer = first; buffer != nullptr; buffer = buffer->next)
+		{
+			const uint32_t dropped = buffer->dropped;
+			if (dropped != buffer->reportedDropped)
+			{
+				char text[64];
+				int len = snprintf(text, sizeof(text), "Dropped %u log records", dropped - buffer->reportedDropped);
+				OutputLine((uint8_t)DebugLevel::Warn, "Logger", "Logger", text, len);
+				buffer->reportedDropped = dropped;
+			}
+
+			uint8_t orphaned = (uint8_t)LogBufferState::Orphaned;
+			if (buffer->tail == __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE))
+			{
+				__atomic_compare_exchange_n(&buffer->state,
+											&orphaned,
+											(uint8_t)LogBufferState::Free,
+											false,
+											__ATOMIC_ACQ_REL,
+											__ATOMIC_RELAXED);
+			}
+		}
+	}
+
+	static void DrainBuffers()
+	{
+		pthread_mutex_lock(&s_drainLock);
+		DrainBuffersLocked();
+		pthread_mutex_unlock(&s_drainLock);
+	}
+
+	class LogFlushThread : public Thread
+	{
+	  protected:
+		virtual bool threadLoop()
+		{
+			pthread_mutex_lock(&s_flushLock);
+			while (!__atomic_load_n(&s_flushRequested, __ATOMIC_ACQUIRE))
+			{
+				pthread_cond_wait(&s_flushCondition, &s_flushLock);
+			}
+			pthread_mutex_unlock(&s_flushLock);
+
+			// Cleared before draining, so a record queued meanwhile wakes the thread again
+			__atomic_store_n(&s_flushRequested, false, __ATOMIC_RELEASE);
+			DrainBuffers();
+			return true;
+		}
+	};
+
+	/*
+	 * Crash handling
+	 */
+	static void WriteAll(int fd, const char* data, size_t len)
+	{
+		while (len > 0)
+		{
+			ssize_t written = write(fd, data, len);
+			if (written <= 0)
+				return;
+			data += written;
+			len -= written;
+		}
+	}
+
+	// The crash handler may only use async-signal-safe functions, so it can't use snprintf to format its message
+	class CrashText
+	{
+	  public:
+		CrashText() : m_len(0) {}
+
+		void Append(const char* str)
+		{
+			while (*str != '\0' && m_len < sizeof(m_text))
+			{
+				m_text[m_len++] = *str++;
+			}
+		}
+
+		void AppendDecimal(long value)
+		{
+			unsigned long magnitude = (unsigned long)value;
+			if (value < 0)
+			{
+				Append("-");
+				magnitude = 0 - magnitude;
+			}
+			AppendDigits(magnitude, 10);
+		}
+
+		void AppendHex(uintptr_t value)
+		{
+			Append("0x");
+			AppendDigits(value, 16);
+		}
+
+		void AppendHex64(uint64_t value)
+		{
+			Append("0x");
+			if (value >> 32 != 0)
+			{
+				AppendDigits((unsigned long)(value >> 32), 16);
+				char low[8];
+				for (size_t i = 0; i < sizeof(low); i++)
+				{
+					low[i] = "0123456789abcdef"[(value >> (28 - 4 * i)) & 0xF];
+				}
+				for (size_t i = 0; i < sizeof(low) && m_len < sizeof(m_text); i++)
+				{
+					m_text[m_len++] = low[i];
+				}
+				return;
+			}
+			AppendDigits((unsigned long)value, 16);
+		}
+
+		const char* Text() const { return m_text; }
+		size_t Length() const { return m_len; }
+
+	  private:
+		void AppendDigits(unsigned long value, unsigned base)
+		{
+			char digits[3 * sizeof(value)];
+			size_t count = 0;
+			do
+			{
+				digits[count++] = "0123456789abcdef"[value % base];
+				value /= base;
+			} while (value != 0);
+			while (count > 0 && m_len < sizeof(m_text))
+			{
+				m_text[m_len++] = digits[--count];
+			}
+		}
+
+		char m_text[96];
+		size_t m_len;
+	};
+
+	static void CrashWrite(int fd, const char* data, size_t len)
+	{
+		WriteAll(STDERR_FILENO, data, len);
+		if (fd >= 0)
+		{
+			WriteAll(fd, data, len);
+		}
+	}
+
+	static void CrashWrite(int fd, const CrashText& text)
+	{
+		CrashWrite(fd, text.Text(), text.Length());
+	}
+
+	// Records still queued in the per-thread buffers can't be formatted, snprintf isn't async-signal-safe. They are
+	// written raw instead: sequence, level, module, format string and the arguments in hex, strings as they were
+	// copied. Each buffer is written in order, the sequence numbers give the order across threads. The tail is left
+	// alone, the crash may have happened while the buffers were being drained
+	static void CrashDumpQueuedRecords(int fd)
+	{
+		for (const LogThreadBuffer* buffer = __atomic_load_n(&s_firstBuffer, __ATOMIC_ACQUIRE); buffer != nullptr;
+			 buffer = buffer->next)
+		{
+			const uint32_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+			uint32_t pos = __atomic_load_n(&buffer->tail, __ATOMIC_ACQUIRE);
+			while (pos != head && head - pos <= LOG_THREAD_BUFFER_SIZE)
+			{
+				const LogRecordHeader* header =
+					reinterpret_cast<const LogRecordHeader*>(buffer->data + (pos & (LOG_THREAD_BUFFER_SIZE - 1)));
+				if (header->size < sizeof(LogRecordHeader) || header->size > head - pos)
+					break;
+				pos += header->size;
+				if (header->level == LOG_PADDING_RECORD)
+					continue;
+
+				CrashText text;
+				text.Append("queued #");
+				text.AppendDecimal((long)header->sequence);
+				text.Append(" ");
+				const char level[] = {"VDIWEF"[header->level < 6 ? header->level : 5], ' ', '\0'};
+				text.Append(level);
+				text.Append(header->module->name);
+				text.Append(": ");
+				text.AppendHex((uintptr_t)header->fmt);
+				text.Append(" \"");
+				CrashWrite(fd, text);
+				CrashWrite(fd, header->fmt, strlen(header->fmt));
+				CrashWrite(fd, "\"", 1);
+
+				LogArgReader args(header);
+				LogArg arg;
+				while (args.Next(arg))
+				{
+					CrashText value;
+					value.Append(" ");
+					switch (arg.type)
+					{
+					case LogArgType::String:
+						CrashWrite(fd, value);
+						CrashWrite(fd, "\"", 1);
+						CrashWrite(fd, arg.str, arg.len);
+						CrashWrite(fd, "\"", 1);
+						continue;
+					case LogArgType::Pointer:
+					case LogArgType::StaticString:
+						value.AppendHex((uintptr_t)arg.p);
+						break;
+					default:
+						value.AppendHex64(arg.u);
+						break;
+					}
+					CrashWrite(fd, value);
+				}
+				CrashWrite(fd, "\n", 1);
+			}
+		}
+	}
+
+	static void CrashHandler(int sig, siginfo_t* info, void* context)
+	{
+		CrashText text;
+		text.Append("Crashed with signal ");
+		text.AppendDecimal(sig);
+		text.Append(" (code ");
+		text.AppendDecimal(info->si_code);
+		text.Append(", address ");
+		text.AppendHex((uintptr_t)info->si_addr);
+		text.Append("), last ");
+		text.AppendDecimal((long)s_history.GetFilled());
+		text.Append(" log lines:\n");
+
+		int fd = open(LOG_CRASH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		CrashWrite(fd, text);
+		for (size_t i = 0; i < s_history.GetFilled(); i++)
+		{
+			CrashWrite(fd, s_history.GetItem(i), s_history.GetItemLength(i));
+			CrashWrite(fd, "\n", 1);
+		}
+		// Newer than the history, the last one may repeat it if it was being written out
+		CrashDumpQueuedRecords(fd);
+		if (fd >= 0)
+		{
+			fsync(fd);
+			close(fd);
+		}
+
+		// Hand over to whatever handled the signal before. A fault will happen again when this handler returns, a
+		// signal that was sent needs raising again
+		for (size_t i = 0; i < sizeof(s_crashSignals) / sizeof(s_crashSignals[0]); i++)
+		{
+			if (s_crashSignals[i] == sig)
+			{
+				sigaction(sig, &s_previousCrashHandlers[i], nullptr);
+				break;
+			}
+		}
+		if (info->si_code <= 0)
+		{
+			raise(sig);
+		}
+		(void)context;
+	}
+
+	static void InstallCrashHandler()
+	{
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_sigaction = CrashHandler;
+		action.sa_flags = SA_SIGINFO;
+		sigemptyset(&action.sa_mask);
+		for (size_t i = 0; i < sizeof(s_crashSignals) / sizeof(s_crashSignals[0]); i++)
+		{
+			sigaction(s_crashSignals[i], &action, &s_previousCrashHandlers[i]);
+		}
+	}
+
+	void StartLogger()
+	{
+		static LogFlushThread* s_flushThread = nullptr;
+		if (s_flushThread != nullptr)
+			return;
+
+		if (access(LOG_CRASH_FILE, F_OK) == 0)
+		{
+			warn("A crash log from a previous run is in %s", LOG_CRASH_FILE);
+		}
+
+		InstallCrashHandler();
+		s_flushThread = new LogFlushThread();
+		s_loggerRunning = s_flushThread->run("logger");
+	}
+
+	uint32_t GetDroppedLogRecords()
+	{
+		uint32_t dropped = 0;
+		for (LogThreadBuffer* buffer = __atomic_load_n(&s_firstBuffer, __ATOMIC_ACQUIRE); buffer != nullptr;
+			 buffer = buffer->next)
+		{
+			dropped += buffer->dropped;
+		}
+		return dropped;
+	}
+
+	std::string GetLogHistory(size_t count)
+	{
+		std::string history;
+		pthread_mutex_lock(&s_historyLock);
+		const size_t filled = s_history.GetFilled();
+		for (size_t i = (count < filled) ? filled - count : 0; i < filled; i++)
+		{
+			history.append(s_history.GetItem(i), s_history.GetItemLength(i));
+			history += '\n';
+		}
+		pthread_mutex_unlock(&s_historyLock);
+		return history;
+	}
+} // namespace Debug
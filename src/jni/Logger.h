@@ -0,0 +1,135 @@
+/*
+ * Logger.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Deferred formatting logger used by the macros in Debug.h.
+ *  A log call only copies the format string pointer and its raw arguments into a ring buffer owned by the calling
+ *  thread. A background thread formats the records and passes them on to the system log, and keeps the most recent
+ *  lines so they can be written out if the program crashes.
+ */
+
+#ifndef JNI_LOGGER_H_
+#define JNI_LOGGER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+enum class DebugLevel;
+
+const DebugLevel& GetDebugLevel();
+
+namespace Debug
+{
+	struct LogThreadBuffer;
+
+	/// @brief Log level state for one source file. Created once per call site and never destroyed
+	struct LogModule
+	{
+		const char* tag;	   // source file, used as the log tag
+		char name[32];		   // file name without directory or extension
+		volatile int8_t level; // -1 to follow the global debug level
+		LogModule* next;
+	};
+
+	LogModule* GetLogModule(const char* file);
+	LogModule* GetFirstLogModule();
+
+	/// @brief Override the log level of a source file
+	/// @param name File name without directory or extension, e.g. "Network"
+	/// @param level Level to use, or -1 to follow the global debug level again
+	void SetLogModuleLevel(const char* name, int level);
+
+	inline bool IsLogEnabled(const LogModule* module, DebugLevel level)
+	{
+		const int moduleLevel = module->level;
+		return (int)level >= (moduleLevel >= 0 ? moduleLevel : (int)GetDebugLevel());
+	}
+
+	/// @brief Wraps a string that lives for the whole program, e.g. __FUNCTION__, so that only its pointer is recorded
+	struct StaticString
+	{
+		explicit StaticString(const char* str) : str(str) {}
+		const char* str;
+	};
+
+	/// @brief A record being written into the calling thread's log buffer. It is published when destroyed
+	class LogRecord
+	{
+	  public:
+		LogRecord(DebugLevel level, const LogModule* module, const char* fmt);
+		~LogRecord();
+
+		void Add(bool value);
+		void Add(char value);
+		void Add(signed char value);
+		void Add(unsigned char value);
+		void Add(short value);
+		void Add(unsigned short value);
+		void Add(int value);
+		void Add(unsigned int value);
+		void Add(long value);
+		void Add(unsigned long value);
+		void Add(long long value);
+		void Add(unsigned long long value);
+		void Add(float value) { Add((double)value); }
+		void Add(double value);
+		void Add(long double value) { Add((double)value); }
+		void Add(const char* str);
+		void Add(char* str) { Add((const char*)str); }
+		void Add(const unsigned char* str) { Add((const char*)str); }
+		void Add(unsigned char* str) { Add((const char*)str); }
+		void Add(const std::string& str);
+		void Add(StaticString str);
+		void Add(decltype(nullptr)) { AddPointer(nullptr); }
+		template <typename T>
+		void Add(T* ptr)
+		{
+			AddPointer((const void*)ptr);
+		}
+		template <typename T>
+		void Add(const T& value)
+		{
+			static_assert(__is_enum(T), "Unsupported log argument type");
+			Add((long long)value);
+		}
+
+	  private:
+		LogRecord(const LogRecord&);
+		LogRecord& operator=(const LogRecord&);
+
+		void AddInt(int64_t value);
+		void AddUint(uint64_t value);
+		void AddPointer(const void* ptr);
+		void AddString(const char* str, size_t len);
+		uint8_t* Reserve(size_t len);
+
+		LogThreadBuffer* m_buffer; // nullptr if the record was dropped
+		uint32_t m_head;
+		size_t m_size;
+	};
+
+	inline void AddLogArgs(LogRecord&) {}
+
+	template <typename T, typename... Args>
+	inline void AddLogArgs(LogRecord& record, const T& value, const Args&... args)
+	{
+		record.Add(value);
+		AddLogArgs(record, args...);
+	}
+
+	/// @brief Start the thread that formats log records, and install the crash handler. Until this is called records
+	/// are formatted on the thread that logs them
+	void StartLogger();
+
+	/// @brief Number of records dropped because a thread's log buffer was full
+	uint32_t GetDroppedLogRecords();
+
+	/// @brief Copy of the most recent formatted log lines
+	/// @param count Maximum number of lines, counting back from the newest
+	std::string GetLogHistory(size_t count);
+} // namespace Debug
+
+#endif /* JNI_LOGGER_H_ */
@@ -13,6 +13,7 @@
 #include "Comm/Communication.h"
 #include "Configuration.h"
 #include "Hardware/Duet.h"
+#include "StartupTimeline.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -25,6 +26,7 @@ extern "C"
 		info("");
 		setenv("TZ", "CST-8", 1);
 
+		Debug::StartupPhase phase("onEasyUIInit");
 		Comm::init();
 	}
 
@@ -35,6 +37,7 @@ extern "C"
 
 	const char* onStartupApp(EasyUIContext* pContext)
 	{
+		Debug::StartupPhase phase("onStartupApp");
 		RestClient::init();
 		if (StoragePreferences::getString(ID_SYS_LANG_CODE_KEY, "") == "")
 		{
@@ -17,8 +17,8 @@
 #include "Debug.h"
 #include "ListHelpers.h"
 
-typedef Vector<OM::Move::Axis*, MAX_TOTAL_AXES> AxisList;
-typedef Vector<OM::Move::ExtruderAxis*, MAX_TOTAL_AXES> ExtruderAxisList;
+typedef IndexedList<OM::Move::Axis, MAX_TOTAL_AXES> AxisList;
+typedef IndexedList<OM::Move::ExtruderAxis, MAX_TOTAL_AXES> ExtruderAxisList;
 static AxisList s_axes;
 static ExtruderAxisList s_extruderAxes;
 static uint8_t s_currentWorkplaceNumber = OM::Move::Workplaces::MaxTotalWorkplaces;
@@ -18,8 +18,8 @@
 
 #include "Debug.h"
 
-typedef Vector<OM::Bed*, MAX_SLOTS> BedList;
-typedef Vector<OM::Chamber*, MAX_SLOTS> ChamberList;
+typedef IndexedList<OM::Bed, MAX_SLOTS> BedList;
+typedef IndexedList<OM::Chamber, MAX_SLOTS> ChamberList;
 
 static BedList s_beds;
 static ChamberList s_chambers;
@@ -16,7 +16,7 @@
 
 #include "Debug.h"
 
-typedef Vector<OM::Fan*, MAX_FANS> FanList;
+typedef IndexedList<OM::Fan, MAX_FANS> FanList;
 static FanList s_fans;
 
 namespace OM
@@ -11,8 +11,10 @@
 #include "UI/Logic/FileList.h"
 
 #include "Comm/Communication.h"
+#include "Configuration.h"
 #include "Hardware/Duet.h"
 #include "Hardware/Usb.h"
+#include "timer.h"
 #include <algorithm>
 
 namespace OM::FileSystem
@@ -21,6 +23,7 @@ namespace OM::FileSystem
 	static std::vector<FileSystemItem*> s_items;
 	static bool s_inMacroFolder = false;
 	static bool s_usbFolder = false;
+	static uint32_t s_usbListingGeneration = 0;
 
 	std::string FileSystemItem::GetPath() const
 	{
@@ -226,16 +229,20 @@ namespace OM::FileSystem
 	{
 		ClearFileSystem();
 		s_usbFolder = false;
+		USB::SetListingChangedHandler(nullptr);
+		unregisterDelayedCallback("usb_files");
 		s_inMacroFolder = path.find("macro") != std::string::npos;
 		Comm::DUET.RequestFileList(path.c_str());
 	}
 
-	void RequestUsbFiles(const std::string& path)
+	// Shows the listing of the current USB folder if it changed since it was last shown
+	static void UpdateUsbFiles()
 	{
+		std::vector<USB::FileInfo> files;
+		if (!USB::GetDirectoryListing(std::string("/mnt/usb1/") + s_currentDirPath, files, s_usbListingGeneration))
+			return;
+
 		ClearFileSystem();
-		s_usbFolder = true;
-		s_currentDirPath = path;
-		std::vector<USB::FileInfo> files = USB::ListEntriesInDirectory(std::string("/mnt/usb1/") + path);
 		size_t index = 0;
 		for (auto& fileInfo : files)
 		{
@@ -249,13 +256,36 @@ namespace OM::FileSystem
 				File* file = AddFileAt(index);
 				file->SetName(fileInfo.d_name);
 				file->SetSize(fileInfo.st_size);
-				file->SetDate(utils::format("%d", fileInfo.st_mtim));
+				file->SetDate(utils::format("%ld", (long)fileInfo.st_mtim.tv_sec));
 			}
 			index++;
 		}
 		UI::FileList::RefreshFileList();
 	}
 
+	// Called from the USB monitor thread, the listing is shown again on the UI thread. Nothing is done while the file
+	// list is not shown, it is listed again when the file list is next opened
+	static void UsbListingChanged()
+	{
+		registerDelayedCallback("usb_files", 0, []() {
+			if (s_usbFolder && UI::GetUIControl<ZKWindow>(ID_MAIN_FilesWindow)->isVisible())
+				UpdateUsbFiles();
+			return false;
+		});
+	}
+
+	void RequestUsbFiles(const std::string& path)
+	{
+		ClearFileSystem();
+		s_usbFolder = true;
+		s_currentDirPath = path;
+		s_usbListingGeneration = 0;
+		// The listing is read in the background and kept up to date as files change
+		USB::SetListingChangedHandler(UsbListingChanged);
+		UpdateUsbFiles();
+		UI::FileList::RefreshFileList();
+	}
+
 	bool IsMacroFolder()
 	{
 		return s_inMacroFolder;
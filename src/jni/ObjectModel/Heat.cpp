@@ -16,7 +16,7 @@
 
 #include "Debug.h"
 
-typedef Vector<OM::Heat::Heater*, MAX_HEATERS> HeaterList;
+typedef IndexedList<OM::Heat::Heater, MAX_HEATERS> HeaterList;
 static HeaterList heaters;
 
 namespace OM
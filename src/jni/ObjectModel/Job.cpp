@@ -28,9 +28,9 @@
 
 namespace OM
 {
-	typedef Vector<JobObject*, MAX_TRACKED_OBJECTS> JobObjectList;
+	typedef IndexedList<JobObject, MAX_TRACKED_OBJECTS> JobObjectList;
 	static JobObjectList s_jobObjects;
-	static int8_t s_currentJobObjectIndex = -1;
+	static int32_t s_currentJobObjectIndex = -1;
 
 	static std::string s_jobName;
 	static std::string s_lastJobName;
@@ -120,7 +120,7 @@ namespace OM
 		bounds.y[1] = 0;
 	}
 
-	void SetCurrentJobObject(int8_t index)
+	void SetCurrentJobObject(int32_t index)
 	{
 		if (index >= (int)MAX_TRACKED_OBJECTS)
 		{
@@ -134,12 +134,12 @@ namespace OM
 		UI::ObjectCancel::RenderObjectMap();
 	}
 
-	const int8_t GetCurrentJobObjectIndex()
+	const int32_t GetCurrentJobObjectIndex()
 	{
 		return s_currentJobObjectIndex;
 	}
 
-	JobObject* GetJobObject(const int8_t index)
+	JobObject* GetJobObject(const int32_t index)
 	{
 		if (index < 0 || (size_t)index >= MAX_TRACKED_OBJECTS)
 		{
@@ -149,7 +149,7 @@ namespace OM
 		return GetOrCreate<JobObjectList, JobObject>(s_jobObjects, index, false);
 	}
 
-	JobObject* GetOrCreateJobObject(const int8_t index)
+	JobObject* GetOrCreateJobObject(const int32_t index)
 	{
 		if (index < 0 || (size_t)index >= MAX_TRACKED_OBJECTS)
 		{
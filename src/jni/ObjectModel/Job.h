@@ -61,11 +61,11 @@ namespace OM
 	void SetPrintRemaining(RemainingTimeType type, const uint32_t printRemaining);
 	const uint32_t GetPrintRemaining(RemainingTimeType type);
 
-	void SetCurrentJobObject(int8_t index);
-	const int8_t GetCurrentJobObjectIndex();
+	void SetCurrentJobObject(int32_t index);
+	const int32_t GetCurrentJobObjectIndex();
 
-	JobObject* GetJobObject(const int8_t index);
-	JobObject* GetOrCreateJobObject(const int8_t index);
+	JobObject* GetJobObject(const int32_t index);
+	JobObject* GetOrCreateJobObject(const int32_t index);
 	size_t GetJobObjectCount();
 	bool IterateJobObjectsWhile(function_ref<bool(JobObject*&, size_t)> func, const size_t startAt = 0);
 	size_t RemoveJobObject(const size_t index, const bool allFollowing);
@@ -11,30 +11,158 @@
 #include "Debug.h"
 
 //#include <cstdint>
+#include <Duet3D/General/Vector.h>
 #include <Duet3D/General/function_ref.h>
 #include <sys/types.h>
 
-template <typename L, typename T>
-T* GetOrCreate(L& list, const size_t index, const bool create, const bool silent = false)
+/// Object model collection addressed by the object model index of its elements.
+/// Elements are iterated in ascending index order. Indices below N are looked up through a table, higher ones, such
+/// as sparse tool numbers, by a binary search of the ordered elements. The list holds at most N elements whatever
+/// their indices. Elements are owned by the list once inserted and deleted by Truncate/Erase, except by Clear.
+template <typename T, size_t N>
+class IndexedList
 {
-	const size_t count = list.Size();
-	for (size_t i = 0; i < count; ++i)
+  public:
+	IndexedList()
 	{
-		if (list[i]->index == index)
+		for (size_t i = 0; i < N; ++i)
 		{
-			verbose("Getting index=%d", index);
-			return list[i];
+			m_slots[i] = nullptr;
 		}
 	}
 
+	constexpr size_t Capacity() const { return N; }
+	size_t Size() const { return m_ordered.Size(); }
+	bool IsEmpty() const { return m_ordered.IsEmpty(); }
+	bool Full() const { return m_ordered.Full(); }
+
+	/// Element with the given object model index, nullptr if there is none
+	T* Get(const size_t index) const
+	{
+		if (index < N)
+			return m_slots[index];
+		const size_t pos = LowerBound(index);
+		return pos < m_ordered.Size() && m_ordered[pos]->index == index ? m_ordered[pos] : nullptr;
+	}
+
+	/// Element at the given position in index order, nullptr if out of range
+	T* operator[](const size_t slot) const { return slot < m_ordered.Size() ? m_ordered[slot] : nullptr; }
+
+	/// Insert an element whose index is not yet in the list. Constant time when elements arrive in index order,
+	/// which is how the object model reports them
+	bool Insert(T* elem)
+	{
+		const size_t index = elem->index;
+		if (m_ordered.Full() || Get(index) != nullptr)
+			return false;
+
+		SetSlot(index, elem);
+		size_t pos = m_ordered.Size();
+		if (pos == 0 || m_ordered[pos - 1]->index < index)
+		{
+			m_ordered.Add(elem);
+			return true;
+		}
+
+		pos = LowerBound(index);
+		m_ordered.Add(elem);
+		for (size_t i = m_ordered.Size() - 1; i > pos; --i)
+		{
+			m_ordered[i] = m_ordered[i - 1];
+		}
+		m_ordered[pos] = elem;
+		return true;
+	}
+
+	/// Delete the element with the given index
+	/// @return Number of elements deleted
+	size_t Erase(const size_t index)
+	{
+		T* elem = Get(index);
+		if (elem == nullptr)
+			return 0;
+
+		m_ordered.Erase(LowerBound(index));
+		SetSlot(index, nullptr);
+		delete elem;
+		return 1;
+	}
+
+	/// Delete all elements with an index greater than or equal to the given index
+	/// @return Number of elements deleted
+	size_t Truncate(const size_t index)
+	{
+		const size_t pos = LowerBound(index);
+		const size_t count = m_ordered.Size();
+		for (size_t i = pos; i < count; ++i)
+		{
+			T* elem = m_ordered[i];
+			SetSlot(elem->index, nullptr);
+			delete elem;
+		}
+		m_ordered.Truncate(pos);
+		return count - pos;
+	}
+
+	/// Forget all elements without deleting them
+	void Clear()
+	{
+		for (size_t i = 0; i < m_ordered.Size(); ++i)
+		{
+			SetSlot(m_ordered[i]->index, nullptr);
+		}
+		m_ordered.Clear();
+	}
+
+	bool IterateWhile(function_ref_noexcept<bool(T*&, size_t) noexcept> func, size_t startAt = 0)
+	{
+		return m_ordered.IterateWhile(func, startAt);
+	}
+
+  private:
+	void SetSlot(const size_t index, T* elem)
+	{
+		if (index < N)
+			m_slots[index] = elem;
+	}
+
+	// Position of the first element with an index not less than the given index
+	size_t LowerBound(const size_t index) const
+	{
+		size_t low = 0;
+		size_t high = m_ordered.Size();
+		while (low < high)
+		{
+			const size_t mid = (low + high) / 2;
+			if (m_ordered[mid]->index < index)
+				low = mid + 1;
+			else
+				high = mid;
+		}
+		return low;
+	}
+
+	T* m_slots[N];
+	Vector<T*, N> m_ordered;
+};
+
+template <typename L, typename T>
+T* GetOrCreate(L& list, const size_t index, const bool create, const bool silent = false)
+{
+	T* elem = list.Get(index);
+	if (elem != nullptr)
+	{
+		verbose("Getting index=%d", index);
+		return elem;
+	}
+
 	if (create && !list.Full())
 	{
 		verbose("Creating index=%d", index);
-		T* elem = new T;
+		elem = new T;
 		elem->Reset();
 		elem->index = index;
-		list.Add(elem);
-		list.Sort([] (T* e1, T* e2) { return e1->index > e2->index; });
+		list.Insert(elem);
 		return elem;
 	}
 
@@ -60,32 +188,7 @@ T* Find(L& list, function_ref<bool(T*)> filter)
 template<typename L, typename T>
 size_t Remove(L& list, const size_t index, const bool allFollowing)
 {
-	// Nothing to do on an empty list or
-	// if the last element is already smaller than what we look for
-	if (list.IsEmpty() || list[list.Size()-1]->index < index)
-	{
-		// dbg("Nothing removed");
-		return 0;
-	}
-
-	size_t removed = 0;
-	for (size_t i = list.Size(); i != 0;)
-	{
-		--i;
-		T* elem = list[i];
-		if (elem->index == index || (allFollowing && elem->index > index))
-		{
-			// dbg("Removing index=%d", i);
-			list.Erase(i);
-			delete elem;
-			++removed;
-			if (!allFollowing)
-			{
-				break;
-			}
-		}
-	}
-	return removed;
+	return allFollowing ? list.Truncate(index) : list.Erase(index);
 }
 
 #endif /* SRC_OBJECTMODEL_LISTHELPERS_HPP_ */
@@ -12,8 +12,8 @@
 #include "utils/TimeHelper.h"
 #include <Duet3D/General/Vector.h>
 
-typedef Vector<OM::AnalogSensor*, MAX_SENSORS> AnalogSensorList;
-typedef Vector<OM::Endstop*, MAX_ENDSTOPS> EndstopList;
+typedef IndexedList<OM::AnalogSensor, MAX_SENSORS> AnalogSensorList;
+typedef IndexedList<OM::Endstop, MAX_ENDSTOPS> EndstopList;
 
 static AnalogSensorList s_analogSensors;
 static EndstopList s_endstops;
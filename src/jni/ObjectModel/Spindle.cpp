@@ -12,7 +12,7 @@
 #include "uart/CommDef.h"
 #include <Duet3D/General/Vector.h>
 
-typedef Vector<OM::Spindle*, MAX_SLOTS> SpindleList;
+typedef IndexedList<OM::Spindle, MAX_SLOTS> SpindleList;
 static SpindleList s_spindles;
 
 namespace OM
@@ -21,7 +21,7 @@
 
 #include "Debug.h"
 
-typedef Vector<OM::Tool*, MAX_SLOTS> ToolList;
+typedef IndexedList<OM::Tool, MAX_SLOTS> ToolList;
 static ToolList s_tools;
 
 namespace OM
@@ -0,0 +1,334 @@
+/*
+ * Profiler.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "Configuration.h"
+#include "Profiler.h"
+#include <errno.h>
+#include <map>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace Debug
+{
+	struct ProfileSample
+	{
+		uint32_t tid;
+		uint32_t depth;
+		uint32_t committed; // set once the handler has filled in the rest
+		uintptr_t pcs[PROFILE_MAX_DEPTH]; // interrupted program counter followed by return addresses
+	};
+
+	static ProfileSample* s_samples = nullptr;
+	static size_t s_nextSample = 0; // may run past PROFILE_MAX_SAMPLES, samples beyond it are dropped
+	static uint32_t s_droppedSamples = 0;
+	static uint32_t s_handlersRunning = 0;
+	static uint32_t s_frequency = 0;
+	static bool s_running = false;
+	static struct sigaction s_previousHandler;
+
+#if defined(__arm__) || defined(__x86_64__) || defined(__i386__)
+	constexpr bool PROFILER_SUPPORTED = true;
+#else
+	constexpr bool PROFILER_SUPPORTED = false;
+#endif
+
+	static bool GetRegisters(const ucontext_t* context, uintptr_t& pc, uintptr_t& lr, uintptr_t& fp, uintptr_t& sp)
+	{
+#if defined(__arm__)
+		pc = context->uc_mcontext.arm_pc;
+		lr = context->uc_mcontext.arm_lr;
+		fp = context->uc_mcontext.arm_fp;
+		sp = context->uc_mcontext.arm_sp;
+		return true;
+#elif defined(__x86_64__)
+		pc = context->uc_mcontext.gregs[REG_RIP];
+		lr = 0;
+		fp = context->uc_mcontext.gregs[REG_RBP];
+		sp = context->uc_mcontext.gregs[REG_RSP];
+		return true;
+#elif defined(__i386__)
+		pc = context->uc_mcontext.gregs[REG_EIP];
+		lr = 0;
+		fp = context->uc_mcontext.gregs[REG_EBP];
+		sp = context->uc_mcontext.gregs[REG_ESP];
+		return true;
+#else
+		(void)context;
+		pc = lr = fp = sp = 0;
+		return false;
+#endif
+	}
+
+#ifdef PROFILE_FRAME_POINTERS
+	/// Frame layouts produced by -fno-omit-frame-pointer. On ARM (-marm) fp points at the saved lr with the caller's
+	/// fp below it, on x86 fp points at the caller's fp with the return address above it.
+#if defined(__arm__)
+	constexpr ptrdiff_t FRAME_RETURN_OFFSET = 0;
+	constexpr ptrdiff_t FRAME_NEXT_OFFSET = -1;
+#else
+	constexpr ptrdiff_t FRAME_RETURN_OFFSET = 1;
+	constexpr ptrdiff_t FRAME_NEXT_OFFSET = 0;
+#endif
+
+	static uint32_t WalkFrames(uintptr_t fp, uintptr_t sp, uintptr_t* pcs, uint32_t maxDepth)
+	{
+		// Only follow frames that stay on the interrupted thread's stack and move towards its base, so a function
+		// built without frame pointers ends the walk instead of faulting
+		uint32_t depth = 0;
+		while (depth < maxDepth && fp >= sp && fp - sp < PROFILE_MAX_STACK_SPAN && (fp % sizeof(uintptr_t)) == 0)
+		{
+			const uintptr_t* frame = reinterpret_cast<const uintptr_t*>(fp);
+			if (fp + FRAME_NEXT_OFFSET * (ptrdiff_t)sizeof(uintptr_t) < sp)
+				break;
+			const uintptr_t returnAddress = frame[FRAME_RETURN_OFFSET];
+			const uintptr_t next = frame[FRAME_NEXT_OFFSET];
+			if (returnAddress == 0)
+				break;
+			pcs[depth++] = returnAddress;
+			if (next <= fp)
+				break;
+			fp = next;
+		}
+		return depth;
+	}
+#endif
+
+	uint32_t CaptureStack(const void* context, uintptr_t* pcs, uint32_t maxDepth)
+	{
+		uintptr_t pc, lr, fp, sp;
+		if (maxDepth == 0 || !GetRegisters(static_cast<const ucontext_t*>(context), pc, lr, fp, sp))
+			return 0;
+
+		uint32_t depth = 0;
+		pcs[depth++] = pc;
+#ifdef PROFILE_FRAME_POINTERS
+		depth += WalkFrames(fp, sp, pcs + depth, maxDepth - depth);
+#else
+		(void)fp;
+		(void)sp;
+#endif
+		// Without frame records lr is the best guess at the caller. It is only certain in a leaf function, e.g. a
+		// system call wrapper, elsewhere it points back into the current function
+		if (depth == 1 && lr != 0 && depth < maxDepth)
+		{
+			pcs[depth++] = lr;
+		}
+		return depth;
+	}
+
+	static void ProfileHandler(int sig, siginfo_t* siginfo, void* context)
+	{
+		(void)sig;
+		(void)siginfo;
+		const int savedErrno = errno;
+		__atomic_add_fetch(&s_handlersRunning, 1, __ATOMIC_ACQUIRE);
+
+		const size_t index = __atomic_fetch_add(&s_nextSample, 1, __ATOMIC_RELAXED);
+		ProfileSample* samples = __atomic_load_n(&s_samples, __ATOMIC_ACQUIRE);
+		if (samples == nullptr || index >= PROFILE_MAX_SAMPLES)
+		{
+			__atomic_add_fetch(&s_droppedSamples, 1, __ATOMIC_RELAXED);
+		}
+		else
+		{
+			ProfileSample& sample = samples[index];
+			sample.tid = (uint32_t)syscall(SYS_gettid);
+			sample.depth = CaptureStack(context, sample.pcs, PROFILE_MAX_DEPTH);
+			__atomic_store_n(&sample.committed, 1, __ATOMIC_RELEASE);
+		}
+
+		__atomic_sub_fetch(&s_handlersRunning, 1, __ATOMIC_RELEASE);
+		errno = savedErrno;
+	}
+
+	static bool SetTimer(uint32_t frequency)
+	{
+		struct itimerval timer;
+		memset(&timer, 0, sizeof(timer));
+		if (frequency > 0)
+		{
+			timer.it_interval.tv_sec = 0;
+			timer.it_interval.tv_usec = 1000000 / frequency;
+			timer.it_value = timer.it_interval;
+		}
+		return setitimer(ITIMER_PROF, &timer, nullptr) == 0;
+	}
+
+	bool StartProfiler(uint32_t frequency)
+	{
+		if (s_running)
+		{
+			warn("Profiler already running");
+			return false;
+		}
+		if (!PROFILER_SUPPORTED)
+		{
+			error("Profiler not supported on this platform");
+			return false;
+		}
+		if (frequency == 0 || frequency > 1000000)
+		{
+			error("Invalid profiler frequency %u", frequency);
+			return false;
+		}
+
+		ProfileSample* samples = new ProfileSample[PROFILE_MAX_SAMPLES]();
+		__atomic_store_n(&s_nextSample, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s_droppedSamples, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&s_samples, samples, __ATOMIC_RELEASE);
+
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_sigaction = ProfileHandler;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		if (sigaction(SIGPROF, &action, &s_previousHandler) != 0)
+		{
+			error("Failed to install profiler signal handler: %s", strerror(errno));
+			__atomic_store_n(&s_samples, (ProfileSample*)nullptr, __ATOMIC_RELEASE);
+			delete[] samples;
+			return false;
+		}
+		if (!SetTimer(frequency))
+		{
+			error("Failed to start profiler timer: %s", strerror(errno));
+			sigaction(SIGPROF, &s_previousHandler, nullptr);
+			__atomic_store_n(&s_samples, (ProfileSample*)nullptr, __ATOMIC_RELEASE);
+			delete[] samples;
+			return false;
+		}
+
+		s_frequency = frequency;
+		s_running = true;
+		info("Profiler started at %u Hz", frequency);
+		return true;
+	}
+
+	static void WriteMappings(FILE* f)
+	{
+		// Executable mappings let the symbolizer turn addresses into offsets within each library
+		FILE* maps = fopen("/proc/self/maps", "r");
+		if (maps == nullptr)
+			return;
+		char line[512];
+		while (fgets(line, sizeof(line), maps) != nullptr)
+		{
+			char perms[8];
+			if (sscanf(line, "%*x-%*x %7s", perms) == 1 && perms[2] == 'x')
+			{
+				fprintf(f, "map %s", line);
+			}
+		}
+		fclose(maps);
+	}
+
+	// Of the first slots samples, count were filled in by the handler
+	static bool WriteProfile(
+		const char* path, const ProfileSample* samples, size_t slots, size_t count, uint32_t dropped)
+	{
+		// Identical stacks are written once with a count to keep the file small
+		std::map<std::string, uint32_t> stacks;
+		char address[24];
+		for (size_t i = 0; i < slots; i++)
+		{
+			const ProfileSample& sample = samples[i];
+			if (!__atomic_load_n(&sample.committed, __ATOMIC_ACQUIRE) || sample.depth == 0)
+				continue;
+			std::string key;
+			snprintf(address, sizeof(address), "%u", sample.tid);
+			key += address;
+			for (uint32_t j = 0; j < sample.depth && j < PROFILE_MAX_DEPTH; j++)
+			{
+				snprintf(address, sizeof(address), " %lx", (unsigned long)sample.pcs[j]);
+				key += address;
+			}
+			stacks[key]++;
+		}
+
+		FILE* f = fopen(path, "w");
+		if (f == nullptr)
+		{
+			error("Failed to create profile \"%s\": %s", path, strerror(errno));
+			return false;
+		}
+		fprintf(f, "# DuetScreen profile v1\n");
+		fprintf(f, "frequency %u\n", s_frequency);
+		fprintf(f, "samples %u\n", (unsigned)count);
+		fprintf(f, "dropped %u\n", dropped);
+		WriteMappings(f);
+		for (auto& stack : stacks)
+		{
+			fprintf(f, "%u %s\n", stack.second, stack.first.c_str());
+		}
+		const bool ok = ferror(f) == 0;
+		if (fclose(f) != 0 || !ok)
+		{
+			error("Failed to write profile \"%s\"", path);
+			return false;
+		}
+		return true;
+	}
+
+	bool StopProfiler(const char* path)
+	{
+		if (!s_running)
+		{
+			warn("Profiler not running");
+			return false;
+		}
+
+		SetTimer(0);
+		sigaction(SIGPROF, &s_previousHandler, nullptr);
+		s_running = false;
+
+		// A handler may still be running on another thread, its sample must be complete before the buffer is read
+		ProfileSample* samples = __atomic_exchange_n(&s_samples, (ProfileSample*)nullptr, __ATOMIC_ACQ_REL);
+		while (__atomic_load_n(&s_handlersRunning, __ATOMIC_ACQUIRE) != 0)
+		{
+			sched_yield();
+		}
+
+		// A handler that claimed a slot after the buffer was swapped out counts it as dropped and never fills it in
+		const size_t slots = GetProfilerSampleCount();
+		size_t count = 0;
+		for (size_t i = 0; i < slots; i++)
+		{
+			if (__atomic_load_n(&samples[i].committed, __ATOMIC_ACQUIRE))
+				count++;
+		}
+		const uint32_t dropped = GetProfilerDroppedSamples();
+		const bool ok = WriteProfile(path, samples, slots, count, dropped);
+		delete[] samples;
+		info("Profiler stopped, %u samples (%u dropped)", (unsigned)count, dropped);
+		return ok;
+	}
+
+	bool IsProfilerRunning()
+	{
+		return s_running;
+	}
+
+	size_t GetProfilerSampleCount()
+	{
+		const size_t next = __atomic_load_n(&s_nextSample, __ATOMIC_RELAXED);
+		return next < PROFILE_MAX_SAMPLES ? next : PROFILE_MAX_SAMPLES;
+	}
+
+	uint32_t GetProfilerDroppedSamples()
+	{
+		return __atomic_load_n(&s_droppedSamples, __ATOMIC_RELAXED);
+	}
+} // namespace Debug
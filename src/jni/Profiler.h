@@ -0,0 +1,46 @@
+/*
+ * Profiler.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Sampling profiler driven by SIGPROF.
+ *  Each sample records the interrupted thread, its program counter and, when built with PROFILE=1, a few return
+ *  addresses found by walking the frame pointers. Tools/profile.py symbolizes the file written when the profiler is
+ *  stopped.
+ */
+
+#ifndef JNI_PROFILER_H_
+#define JNI_PROFILER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Debug
+{
+	/// @brief Start sampling all threads of this process
+	/// @param frequency Samples per second of CPU time used by the process
+	/// @return false if the profiler is already running or sampling is not supported on this platform
+	bool StartProfiler(uint32_t frequency);
+
+	/// @brief Stop sampling and write the profile
+	/// @param path File to write the profile to
+	/// @return false if the profiler was not running or the file could not be written
+	bool StopProfiler(const char* path);
+
+	bool IsProfilerRunning();
+
+	/// @brief Samples recorded since the profiler was last started
+	size_t GetProfilerSampleCount();
+
+	/// @brief Samples lost because the buffer was full
+	uint32_t GetProfilerDroppedSamples();
+
+	/// @brief Record the program counter and return addresses of an interrupted thread. Safe to call from a signal
+	/// handler
+	/// @param context ucontext_t passed to an SA_SIGINFO signal handler
+	/// @return Number of addresses written to pcs, 0 if not supported on this platform
+	uint32_t CaptureStack(const void* context, uintptr_t* pcs, uint32_t maxDepth);
+} // namespace Debug
+
+#endif /* JNI_PROFILER_H_ */
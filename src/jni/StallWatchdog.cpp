@@ -0,0 +1,426 @@
+/*
+ * StallWatchdog.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "Configuration.h"
+#include "Profiler.h"
+#include "StallWatchdog.h"
+#include "utils/utils.h"
+#include <dlfcn.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <system/Thread.h>
+#include <time.h>
+#include <vector>
+
+namespace Debug
+{
+	// Ignored by default and not used by anything else in the process, so a late delivery does no harm
+	constexpr int UI_STALL_SIGNAL = SIGURG;
+
+	struct UiTiming
+	{
+		const char* name;
+		uint32_t runs;
+		uint32_t stalls;
+		int64_t total; // us
+		int64_t max;
+		int64_t lastStart;
+		uint32_t lateRuns; // periodic runs, for the lateness figures
+		int64_t lateTotal;
+		int64_t lateMax;
+	};
+
+	// Only used on the UI thread
+	static UiTiming s_timings[UI_TIMING_MAX_ENTRIES];
+	static size_t s_timingCount = 0;
+
+	// Callbacks currently running on the UI thread, innermost last. Written by the UI thread, read by the watchdog,
+	// which uses s_activeSeq to detect that the stack changed while it was reading
+	struct ActiveScope
+	{
+		const char* name;
+		uint32_t startMs;
+	};
+	static ActiveScope s_active[UI_STALL_MAX_NESTING];
+	static uint32_t s_activeDepth = 0;
+	static uint32_t s_activeSeq = 0;
+
+	// The watchdog sleeps on s_watchCondition while no callback is running. The outermost scope wakes it when it
+	// starts, so it can wait for the callback to reach UI_STALL_THRESHOLD, and when it ends, so it can sleep again
+	static pthread_mutex_t s_watchLock = PTHREAD_MUTEX_INITIALIZER;
+	static pthread_cond_t s_watchCondition;
+
+	static pthread_t s_uiThread;
+	static bool s_watchdogRunning = false;
+	static uintptr_t s_backtrace[UI_STALL_BACKTRACE_DEPTH];
+	static uint32_t s_backtraceDepth = 0;
+	static uint32_t s_backtraceReady = 0;
+
+	static int64_t NowUs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+	static void WakeWatchdog()
+	{
+		if (!s_watchdogRunning)
+			return;
+		pthread_mutex_lock(&s_watchLock);
+		pthread_cond_signal(&s_watchCondition);
+		pthread_mutex_unlock(&s_watchLock);
+	}
+
+	static size_t FindTiming(const char* name)
+	{
+		for (size_t i = 0; i < s_timingCount; i++)
+		{
+			if (s_timings[i].name == name)
+				return i;
+		}
+		if (s_timingCount >= UI_TIMING_MAX_ENTRIES)
+			return UI_TIMING_MAX_ENTRIES;
+
+		UiTiming& timing = s_timings[s_timingCount];
+		memset(&timing, 0, sizeof(timing));
+		timing.name = name;
+		return s_timingCount++;
+	}
+
+	UiTimingScope::UiTimingScope(const char* name, int period) : m_start(NowUs()), m_entry(FindTiming(name))
+	{
+		if (m_entry < UI_TIMING_MAX_ENTRIES)
+		{
+			UiTiming& timing = s_timings[m_entry];
+			// How late a periodic callback ran. Long gaps mean the timer was stopped in between
+			const int64_t interval = m_start - timing.lastStart;
+			if (period > 0 && timing.lastStart != 0 && interval < (int64_t)period * 1000 * UI_TIMING_MAX_PERIODS_LATE)
+			{
+				const int64_t late = interval > (int64_t)period * 1000 ? interval - (int64_t)period * 1000 : 0;
+				timing.lateRuns++;
+				timing.lateTotal += late;
+				if (late > timing.lateMax)
+					timing.lateMax = late;
+			}
+			timing.lastStart = m_start;
+		}
+
+		const uint32_t depth = s_activeDepth;
+		if (depth < UI_STALL_MAX_NESTING)
+		{
+			__atomic_store_n(&s_active[depth].name, name, __ATOMIC_RELAXED);
+			__atomic_store_n(&s_active[depth].startMs, (uint32_t)(m_start / 1000), __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&s_activeDepth, depth + 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&s_activeSeq, 1, __ATOMIC_RELEASE);
+		if (depth == 0)
+		{
+			WakeWatchdog();
+		}
+	}
+
+	UiTimingScope::~UiTimingScope()
+	{
+		const uint32_t depth = s_activeDepth - 1;
+		__atomic_store_n(&s_activeDepth, depth, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&s_activeSeq, 1, __ATOMIC_RELEASE);
+		if (depth == 0)
+		{
+			WakeWatchdog();
+		}
+
+		const int64_t duration = NowUs() - m_start;
+		const bool stalled = duration >= (int64_t)UI_STALL_THRESHOLD * 1000;
+		if (m_entry < UI_TIMING_MAX_ENTRIES)
+		{
+			UiTiming& timing = s_timings[m_entry];
+			timing.runs++;
+			timing.total += duration;
+			if (duration > timing.max)
+				timing.max = duration;
+			if (stalled)
+				timing.stalls++;
+		}
+		if (stalled)
+		{
+			warn("UI thread blocked for %lld ms by %s",
+				 (long long)(duration / 1000),
+				 m_entry < UI_TIMING_MAX_ENTRIES ? s_timings[m_entry].name : "?");
+		}
+	}
+
+	static void BacktraceHandler(int sig, siginfo_t* siginfo, void* context)
+	{
+		(void)sig;
+		(void)siginfo;
+		if (!pthread_equal(pthread_self(), s_uiThread))
+			return;
+		s_backtraceDepth = CaptureStack(context, s_backtrace, UI_STALL_BACKTRACE_DEPTH);
+		__atomic_store_n(&s_backtraceReady, 1, __ATOMIC_RELEASE);
+	}
+
+	static void LogUiBacktrace()
+	{
+		__atomic_store_n(&s_backtraceReady, 0, __ATOMIC_RELAXED);
+		if (pthread_kill(s_uiThread, UI_STALL_SIGNAL) != 0)
+			return;
+		for (int i = 0; i < 20 && __atomic_load_n(&s_backtraceReady, __ATOMIC_ACQUIRE) == 0; i++)
+		{
+			Thread::sleep(1);
+		}
+		if (__atomic_load_n(&s_backtraceReady, __ATOMIC_ACQUIRE) == 0)
+		{
+			warn("UI thread did not respond to the backtrace request");
+			return;
+		}
+
+		for (uint32_t i = 0; i < s_backtraceDepth; i++)
+		{
+			// dladdr only knows exported symbols, the library offset can be passed to addr2line for the rest
+			Dl_info dlInfo;
+			const void* pc = (const void*)s_backtrace[i];
+			if (dladdr(pc, &dlInfo) == 0 || dlInfo.dli_fname == nullptr)
+			{
+				warn("  #%u %p", i, pc);
+				continue;
+			}
+			const char* library = strrchr(dlInfo.dli_fname, '/');
+			library = library != nullptr ? library + 1 : dlInfo.dli_fname;
+			const uintptr_t offset = (uintptr_t)pc - (uintptr_t)dlInfo.dli_fbase;
+			if (dlInfo.dli_sname != nullptr)
+			{
+				warn("  #%u %p %s+0x%x (%s+0x%x)",
+					 i,
+					 pc,
+					 library,
+					 (unsigned)offset,
+					 dlInfo.dli_sname,
+					 (unsigned)((uintptr_t)pc - (uintptr_t)dlInfo.dli_saddr));
+			}
+			else
+			{
+				warn("  #%u %p %s+0x%x", i, pc, library, (unsigned)offset);
+			}
+		}
+	}
+
+	// Reads the innermost running scope
+	// @return false if no callback is running or the UI thread changed the scopes while they were being read
+	static bool ReadInnermostScope(uint32_t& seq, const char*& name, uint32_t& startMs)
+	{
+		seq = __atomic_load_n(&s_activeSeq, __ATOMIC_ACQUIRE);
+		uint32_t depth = __atomic_load_n(&s_activeDepth, __ATOMIC_RELAXED);
+		if (depth == 0)
+			return false;
+		if (depth > UI_STALL_MAX_NESTING)
+			depth = UI_STALL_MAX_NESTING;
+		name = __atomic_load_n(&s_active[depth - 1].name, __ATOMIC_RELAXED);
+		startMs = __atomic_load_n(&s_active[depth - 1].startMs, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return __atomic_load_n(&s_activeSeq, __ATOMIC_RELAXED) == seq;
+	}
+
+	class StallWatchdogThread : public Thread
+	{
+	  public:
+		StallWatchdogThread() : m_reportedSeq(0) {}
+
+	  protected:
+		virtual bool threadLoop()
+		{
+			pthread_mutex_lock(&s_watchLock);
+			while (__atomic_load_n(&s_activeDepth, __ATOMIC_RELAXED) == 0)
+			{
+				pthread_cond_wait(&s_watchCondition, &s_watchLock);
+			}
+
+			// Wait until the innermost callback reaches the threshold, or the outermost one ends. Scopes nested in it
+			// don't wake the watchdog, it finds them when it checks. A stall that has been reported is checked again
+			// every UI_STALL_THRESHOLD, in case a callback nested in it stalls as well
+			uint32_t seq;
+			const char* name;
+			uint32_t startMs;
+			uint32_t wait = UI_STALL_THRESHOLD;
+			if (!ReadInnermostScope(seq, name, startMs))
+			{
+				// Changed while being read, look again shortly
+				wait = 1;
+			}
+			else if (seq != m_reportedSeq)
+			{
+				const uint32_t elapsed = (uint32_t)(NowUs() / 1000) - startMs;
+				wait = elapsed < UI_STALL_THRESHOLD ? UI_STALL_THRESHOLD - elapsed : 0;
+			}
+			if (wait > 0)
+			{
+				struct timespec deadline;
+				clock_gettime(CLOCK_MONOTONIC, &deadline);
+				deadline.tv_sec += wait / 1000;
+				deadline.tv_nsec += (long)(wait % 1000) * 1000000;
+				if (deadline.tv_nsec >= 1000000000)
+				{
+					deadline.tv_sec++;
+					deadline.tv_nsec -= 1000000000;
+				}
+				pthread_cond_timedwait(&s_watchCondition, &s_watchLock, &deadline);
+			}
+			pthread_mutex_unlock(&s_watchLock);
+
+			CheckUiThread();
+			return true;
+		}
+
+	  private:
+		void CheckUiThread()
+		{
+			uint32_t seq;
+			const char* name;
+			uint32_t startMs;
+			if (!ReadInnermostScope(seq, name, startMs) || seq == m_reportedSeq)
+				return;
+
+			const uint32_t elapsed = (uint32_t)(NowUs() / 1000) - startMs;
+			if (elapsed < UI_STALL_THRESHOLD)
+				return;
+
+			// Once per callback run, the scope logs the final duration when it ends
+			m_reportedSeq = seq;
+			warn("UI thread stalled for %u ms in %s, backtrace:", elapsed, name);
+			LogUiBacktrace();
+		}
+
+		uint32_t m_reportedSeq;
+	};
+
+	void StartStallWatchdog()
+	{
+		static StallWatchdogThread* s_thread = nullptr;
+		if (s_thread != nullptr)
+			return;
+
+		s_uiThread = pthread_self();
+
+		struct sigaction action;
+		memset(&action, 0, sizeof(action));
+		action.sa_sigaction = BacktraceHandler;
+		action.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&action.sa_mask);
+		if (sigaction(UI_STALL_SIGNAL, &action, nullptr) != 0)
+		{
+			error("Failed to install UI backtrace handler");
+		}
+
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&s_watchCondition, &attr);
+		pthread_condattr_destroy(&attr);
+
+		s_thread = new StallWatchdogThread();
+		s_watchdogRunning = s_thread->run("stall_watchdog");
+		if (!s_watchdogRunning)
+		{
+			error("Failed to start UI stall watchdog");
+		}
+	}
+
+	class TimedListAdapter : public ZKListView::AbsListAdapter, public ZKListView::IItemClickListener
+	{
+	  public:
+		TimedListAdapter(ZKListView::AbsListAdapter* adapter, ZKListView::IItemClickListener* listener)
+			: m_adapter(adapter), m_listener(listener)
+		{
+		}
+
+		virtual int getListItemCount(const ZKListView* pListView) const
+		{
+			UiTimingScope timing("getListItemCount");
+			return m_adapter->getListItemCount(pListView);
+		}
+
+		virtual void obtainListItemData(ZKListView* pListView, ZKListView::ZKListItem* pListItem, int index)
+		{
+			UiTimingScope timing("obtainListItemData");
+			m_adapter->obtainListItemData(pListView, pListItem, index);
+		}
+
+		virtual void onItemClick(ZKListView* pListView, int index, int itemID)
+		{
+			UiTimingScope timing("onItemClick");
+			m_listener->onItemClick(pListView, index, itemID);
+		}
+
+	  private:
+		ZKListView::AbsListAdapter* m_adapter;
+		ZKListView::IItemClickListener* m_listener;
+	};
+
+	void TimeListViews(ZKWindow* root, ZKListView::AbsListAdapter* adapter, ZKListView::IItemClickListener* listener)
+	{
+		static TimedListAdapter* s_adapter = nullptr;
+		if (s_adapter != nullptr || root == nullptr)
+			return;
+		s_adapter = new TimedListAdapter(adapter, listener);
+
+		std::vector<ZKBase*> controls;
+		root->getAllControls(controls);
+		size_t count = 0;
+		for (auto control : controls)
+		{
+			ZKListView* list = dynamic_cast<ZKListView*>(control);
+			if (list == nullptr)
+				continue;
+			list->setListAdapter(s_adapter);
+			list->setItemClickListener(s_adapter);
+			count++;
+		}
+		dbg("Timing callbacks of %u list views", (unsigned)count);
+	}
+
+	std::string GetUiTimingSummary()
+	{
+		std::string summary;
+		for (size_t i = 0; i < s_timingCount; i++)
+		{
+			const UiTiming& timing = s_timings[i];
+			if (timing.runs == 0)
+				continue;
+			summary += utils::format("%s: %u runs, avg %.2f ms, max %.1f ms, %u stalls",
+									 timing.name,
+									 timing.runs,
+									 timing.total / 1000.0 / timing.runs,
+									 timing.max / 1000.0,
+									 timing.stalls);
+			if (timing.lateRuns > 0)
+			{
+				summary += utils::format(", late avg %.1f ms, max %.1f ms",
+										 timing.lateTotal / 1000.0 / timing.lateRuns,
+										 timing.lateMax / 1000.0);
+			}
+			summary += "\n";
+		}
+		if (!s_watchdogRunning)
+		{
+			summary += "Stall watchdog not running\n";
+		}
+		return summary;
+	}
+
+	void ResetUiTimings()
+	{
+		for (size_t i = 0; i < s_timingCount; i++)
+		{
+			const char* name = s_timings[i].name;
+			memset(&s_timings[i], 0, sizeof(s_timings[i]));
+			s_timings[i].name = name;
+		}
+	}
+} // namespace Debug
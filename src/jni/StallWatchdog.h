@@ -0,0 +1,53 @@
+/*
+ * StallWatchdog.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Measures how long callbacks take on the UI thread. A background thread watches the callback that is currently
+ *  running and, if it runs for longer than UI_STALL_THRESHOLD, logs its name and a backtrace of the UI thread.
+ */
+
+#ifndef JNI_STALLWATCHDOG_H_
+#define JNI_STALLWATCHDOG_H_
+
+#include "control/ZKListView.h"
+#include "window/ZKWindow.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace Debug
+{
+	/// @brief Times a callback running on the UI thread. Scopes may be nested, a stall is attributed to the innermost.
+	/// Only for use on the UI thread, callbacks on other threads such as the UART reader must not be timed with it
+	class UiTimingScope
+	{
+	  public:
+		/// @param name Must live for the whole program, e.g. a string literal
+		/// @param period Expected time between runs in ms, for timers. 0 if the callback is not periodic
+		explicit UiTimingScope(const char* name, int period = 0);
+		~UiTimingScope();
+
+	  private:
+		UiTimingScope(const UiTimingScope&);
+		UiTimingScope& operator=(const UiTimingScope&);
+
+		int64_t m_start;
+		size_t m_entry;
+	};
+
+	/// @brief Start the watchdog thread. Must be called from the UI thread
+	void StartStallWatchdog();
+
+	/// @brief Time the list callbacks of every list view under root. Each list view is given an adapter and click
+	/// listener that time the call and pass it on, so the generated activity code doesn't need changing
+	void TimeListViews(ZKWindow* root, ZKListView::AbsListAdapter* adapter, ZKListView::IItemClickListener* listener);
+
+	/// @brief One line per callback with its run count, average and maximum duration, number of stalls and, for
+	/// timers, how late it ran on average and at worst
+	std::string GetUiTimingSummary();
+	void ResetUiTimings();
+} // namespace Debug
+
+#endif /* JNI_STALLWATCHDOG_H_ */
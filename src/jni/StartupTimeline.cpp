@@ -0,0 +1,149 @@
+/*
+ * StartupTimeline.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "Configuration.h"
+#include "StartupTimeline.h"
+#include "utils/utils.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace Debug
+{
+	struct StartupEntry
+	{
+		const char* name;
+		uint32_t depth;
+		int64_t start; // us from the start of the process
+		int64_t duration;
+	};
+
+	static StartupEntry s_entries[STARTUP_MAX_PHASES];
+	static size_t s_entryCount = 0;
+	static uint32_t s_depth = 0;
+	static int64_t s_processStart = -1; // us since boot
+	static int64_t s_uiReady = 0;
+
+	static int64_t NowUs()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+
+	// The kernel records when the process started in clock ticks since boot, which is also the origin of
+	// CLOCK_MONOTONIC. Falls back to the first phase if it cannot be read
+	static int64_t ProcessStart()
+	{
+		if (s_processStart >= 0)
+			return s_processStart;
+
+		s_processStart = NowUs();
+		FILE* f = fopen("/proc/self/stat", "r");
+		if (f == nullptr)
+			return s_processStart;
+		char stat[512];
+		const size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+		fclose(f);
+		stat[len] = '\0';
+
+		// The command name may contain spaces, so fields are counted from the closing bracket. starttime is the
+		// 22nd field, the 20th after the bracket
+		const char* p = strrchr(stat, ')');
+		unsigned long long startTicks = 0;
+		for (int field = 0; p != nullptr && field < 20; field++)
+		{
+			p = strchr(p + 1, ' ');
+		}
+		const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+		if (p != nullptr && sscanf(p + 1, "%llu", &startTicks) == 1 && ticksPerSecond > 0)
+		{
+			s_processStart = (int64_t)(startTicks * 1000000 / ticksPerSecond);
+		}
+		return s_processStart;
+	}
+
+	StartupPhase::StartupPhase(const char* name) : m_name(name), m_start(NowUs())
+	{
+		ProcessStart();
+		s_depth++;
+	}
+
+	StartupPhase::~StartupPhase()
+	{
+		s_depth--;
+		if (s_entryCount >= STARTUP_MAX_PHASES)
+			return;
+
+		StartupEntry& entry = s_entries[s_entryCount++];
+		entry.name = m_name;
+		entry.depth = s_depth;
+		entry.start = m_start - ProcessStart();
+		entry.duration = NowUs() - m_start;
+	}
+
+	void MarkUiReady()
+	{
+		s_uiReady = NowUs() - ProcessStart();
+		if (s_uiReady > (int64_t)STARTUP_TIME_BUDGET * 1000)
+		{
+			warn("UI ready %lld ms after the process started, over the budget of %u ms",
+				 (long long)(s_uiReady / 1000),
+				 STARTUP_TIME_BUDGET);
+		}
+	}
+
+	void LogStartupTimeline()
+	{
+		std::string timeline = GetStartupTimeline();
+		size_t start = 0;
+		size_t end;
+		while ((end = timeline.find('\n', start)) != std::string::npos)
+		{
+			info("%s", timeline.substr(start, end - start).c_str());
+			start = end + 1;
+		}
+	}
+
+	std::string GetStartupTimeline()
+	{
+		std::string timeline = utils::format("Process started %.1f ms after boot\n", ProcessStart() / 1000.0);
+
+		// Phases are recorded as they end, so a phase comes after the ones nested in it. Listed by start time
+		bool listed[STARTUP_MAX_PHASES] = {};
+		for (size_t n = 0; n < s_entryCount; n++)
+		{
+			size_t next = s_entryCount;
+			for (size_t i = 0; i < s_entryCount; i++)
+			{
+				if (!listed[i] && (next == s_entryCount || s_entries[i].start < s_entries[next].start ||
+								   (s_entries[i].start == s_entries[next].start &&
+									s_entries[i].depth < s_entries[next].depth)))
+				{
+					next = i;
+				}
+			}
+			listed[next] = true;
+			const StartupEntry& entry = s_entries[next];
+			timeline += utils::format("%8.1f ms %7.1f ms %*s%s\n",
+									  entry.start / 1000.0,
+									  entry.duration / 1000.0,
+									  (int)entry.depth * 2,
+									  "",
+									  entry.name);
+		}
+		if (s_uiReady > 0)
+		{
+			timeline +=
+				utils::format("UI ready at %.1f ms, budget %u ms\n", s_uiReady / 1000.0, STARTUP_TIME_BUDGET);
+		}
+		return timeline;
+	}
+} // namespace Debug
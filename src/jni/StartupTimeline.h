@@ -0,0 +1,47 @@
+/*
+ * StartupTimeline.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Records how long each phase of startup takes, from the start of the process until the UI is ready and the
+ *  deferred initialisation has run.
+ */
+
+#ifndef JNI_STARTUPTIMELINE_H_
+#define JNI_STARTUPTIMELINE_H_
+
+#include <stdint.h>
+#include <string>
+
+namespace Debug
+{
+	/// @brief Times a phase of startup. Phases may be nested. Only used on the UI thread
+	class StartupPhase
+	{
+	  public:
+		/// @param name Must live for the whole program, e.g. a string literal
+		explicit StartupPhase(const char* name);
+		~StartupPhase();
+
+	  private:
+		StartupPhase(const StartupPhase&);
+		StartupPhase& operator=(const StartupPhase&);
+
+		const char* m_name;
+		int64_t m_start;
+	};
+
+	/// @brief Called on the first timer tick after onUI_init, warns if it came later than STARTUP_TIME_BUDGET.
+	/// zkgui does not report when a frame has been drawn, so this only marks that the UI thread is free to draw and
+	/// respond to touches, not that a frame was shown
+	void MarkUiReady();
+
+	/// @brief Log the timeline, called once the deferred initialisation has finished
+	void LogStartupTimeline();
+
+	/// @brief One line per phase with its start and duration in ms from the start of the process
+	std::string GetStartupTimeline();
+} // namespace Debug
+
+#endif /* JNI_STARTUPTIMELINE_H_ */
@@ -24,7 +24,7 @@ namespace UI::ConsoleWindow
 	void SetConsoleListItem(ZKListView::ZKListItem* pListItem, const int index)
 	{
 		verbose("%d", index);
-		pListItem->setText(UI::CONSOLE.GetItem(index).c_str());
+		pListItem->setText(UI::CONSOLE.GetItem(index));
 	}
 
 	size_t GetGcodeListCount()
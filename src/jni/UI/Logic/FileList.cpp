@@ -14,6 +14,7 @@
 #include <activity/mainActivity.h>
 #include <comm/FileInfo.h>
 #include <comm/Thumbnail.h>
+#include <comm/ThumbnailListCache.h>
 #include <control/ZKListView.h>
 #include <control/ZKTextView.h>
 #include <manager/LanguageManager.h>
@@ -27,6 +28,7 @@ namespace UI::FileList
 	static ZKListView* s_listView = nullptr;
 	static ZKTextView* s_thumbnail;
 	static const OM::FileSystem::File* s_selectedFile;
+	static int s_lastPrefetchIndex = -1;
 
 	void Init()
 	{
@@ -72,6 +74,32 @@ namespace UI::FileList
 		return OM::FileSystem::GetItemCount();
 	}
 
+	static void PrioritiseThumbnail(int index)
+	{
+		if (index < 0 || (size_t)index >= OM::FileSystem::GetItemCount())
+			return;
+		OM::FileSystem::FileSystemItem* item = OM::FileSystem::GetItem(index);
+		if (item == nullptr || item->GetType() != OM::FileSystem::FileSystemItemType::file)
+			return;
+		FILEINFO_CACHE->PrioritiseThumbnailRequest(item->GetPath());
+	}
+
+	// Moves the thumbnails of the rows around a shown row to the front of the queue, so they are ready by the time
+	// they are scrolled into view
+	static void PrefetchThumbnails(int index)
+	{
+		if (index == s_lastPrefetchIndex || FILEINFO_CACHE->IsIdle())
+			return;
+		s_lastPrefetchIndex = index;
+		// Furthest first, so the shown row ends up at the front
+		for (int offset = FILE_LIST_THUMBNAIL_PREFETCH_ROWS; offset > 0; offset--)
+		{
+			PrioritiseThumbnail(index + offset);
+			PrioritiseThumbnail(index - offset);
+		}
+		PrioritiseThumbnail(index);
+	}
+
 	void SetFileListItem(ZKListView::ZKListItem* pListItem, int index)
 	{
 		verbose("%d", index);
@@ -92,21 +120,14 @@ namespace UI::FileList
 			pListItem->setSelected(false);
 			pFileType->setTextTr("file");
 			pFileSize->setTextTrf("file_size", item->GetReadableSize().c_str());
-			if (IsThumbnailCached(item->GetPath().c_str()))
-			{
-				SetThumbnail(pFileThumbnail, item->GetPath().c_str());
-			}
-			else
-			{
-				pFileThumbnail->setBackgroundPic("");
-			}
+			Comm::SetListThumbnail(pFileThumbnail, item->GetPath().c_str());
 			break;
 		}
 		case OM::FileSystem::FileSystemItemType::folder:
 			pListItem->setSelected(true);
 			pFileType->setTextTr("folder");
 			pFileSize->setText("");
-			pFileThumbnail->setBackgroundPic("");
+			Comm::SetListThumbnail(pFileThumbnail, nullptr);
 
 			pFileName->setSelected(true);
 			pFileType->setSelected(true);
@@ -116,6 +137,7 @@ namespace UI::FileList
 			break;
 		}
 		pFileDate->setTextTrf("file_date", item->GetDate().c_str());
+		PrefetchThumbnails(index);
 	}
 
 	void FileListItemCallback(int index)
@@ -10,6 +10,9 @@
 #include "ObjectCancel.h"
 #include "UI/Themes.h"
 #include "control/ZKPainter.h"
+#include <algorithm>
+#include <system/Mutex.h>
+#include <vector>
 
 namespace UI::ObjectCancel
 {
@@ -66,9 +69,98 @@ namespace UI::ObjectCancel
 		return pos;
 	}
 
-	static bool TouchInObjectBounds(const OM::JobObject& object, const LayoutPosition& canvasPos, const MotionEvent& ev)
+	// Object bounds converted to canvas coordinates, in drawing order. Worked out once per object update rather than
+	// on every touch and render. Object updates render the map from the threads receiving them while touches come from
+	// the UI thread, so everything below is guarded by s_layoutLock
+	struct ObjectRect
+	{
+		size_t index; // Job object index
+		LayoutPosition pos;
+	};
+
+	static Mutex s_layoutLock;
+	static std::vector<ObjectRect> s_rects;
+	// Indices into s_rects of the objects overlapping each cell, in drawing order
+	static std::vector<uint16_t> s_grid[OBJECT_CANCEL_GRID_CELLS * OBJECT_CANCEL_GRID_CELLS];
+	static int s_cellWidth = 1;
+	static int s_cellHeight = 1;
+	static bool s_layoutValid = false;
+	static float s_layoutAxes[4]; // X min/max and Y min/max the layout was made for
+
+	// What is currently drawn on the canvas
+	static bool s_overlayValid = false;
+	static int32_t s_renderedCurrent = -1;
+	static const UI::Theme::Theme* s_renderedTheme = nullptr;
+
+	static size_t ClampCell(int coordinate, int cellSize)
+	{
+		if (coordinate < 0)
+			return 0;
+		const size_t cell = coordinate / cellSize;
+		return cell < OBJECT_CANCEL_GRID_CELLS ? cell : OBJECT_CANCEL_GRID_CELLS - 1;
+	}
+
+	static bool LayoutMatchesAxes(const OM::Move::Axis* xAxis, const OM::Move::Axis* yAxis)
+	{
+		return s_layoutAxes[0] == xAxis->minPosition && s_layoutAxes[1] == xAxis->maxPosition &&
+			   s_layoutAxes[2] == yAxis->minPosition && s_layoutAxes[3] == yAxis->maxPosition;
+	}
+
+	// Called with s_layoutLock held
+	static bool UpdateLayout()
+	{
+		OM::Move::Axis* xAxis = OM::Move::GetAxisByLetter('X');
+		OM::Move::Axis* yAxis = OM::Move::GetAxisByLetter('Y');
+		if (xAxis == nullptr || yAxis == nullptr || s_canvas == nullptr)
+		{
+			warn("Failed to get axes or canvas");
+			return false;
+		}
+		if (s_layoutValid && LayoutMatchesAxes(xAxis, yAxis))
+			return true;
+
+		const LayoutPosition canvasPos = s_canvas->getPosition();
+		s_cellWidth = std::max(1, (int)((canvasPos.mWidth + OBJECT_CANCEL_GRID_CELLS - 1) / OBJECT_CANCEL_GRID_CELLS));
+		s_cellHeight = std::max(1, (int)((canvasPos.mHeight + OBJECT_CANCEL_GRID_CELLS - 1) / OBJECT_CANCEL_GRID_CELLS));
+		for (auto& cell : s_grid)
+		{
+			cell.clear();
+		}
+		s_rects.clear();
+		OM::IterateJobObjectsWhile(
+			[&](OM::JobObject*& object, size_t)
+			{
+				if (object == nullptr)
+					return true;
+				const LayoutPosition pos = ConvertBoundsToCanvas(*object, canvasPos);
+				const uint16_t rect = s_rects.size();
+				s_rects.push_back({object->index, pos});
+
+				const size_t right = ClampCell(pos.mLeft + pos.mWidth, s_cellWidth);
+				const size_t bottom = ClampCell(pos.mTop + pos.mHeight, s_cellHeight);
+				for (size_t y = ClampCell(pos.mTop, s_cellHeight); y <= bottom; y++)
+				{
+					for (size_t x = ClampCell(pos.mLeft, s_cellWidth); x <= right; x++)
+					{
+						s_grid[y * OBJECT_CANCEL_GRID_CELLS + x].push_back(rect);
+					}
+				}
+				return true;
+			},
+			0);
+
+		s_layoutAxes[0] = xAxis->minPosition;
+		s_layoutAxes[1] = xAxis->maxPosition;
+		s_layoutAxes[2] = yAxis->minPosition;
+		s_layoutAxes[3] = yAxis->maxPosition;
+		s_layoutValid = true;
+		s_overlayValid = false;
+		dbg("Laid out %u objects", s_rects.size());
+		return true;
+	}
+
+	static bool TouchInRect(const LayoutPosition& pos, const MotionEvent& ev)
 	{
-		LayoutPosition pos = ConvertBoundsToCanvas(object, canvasPos);
 		if (ev.mX < pos.mLeft || ev.mX > pos.mLeft + pos.mWidth)
 		{
 			return false;
@@ -80,55 +172,48 @@ namespace UI::ObjectCancel
 		return true;
 	}
 
+	/// @return the index of the job object at the touch position, or -1
+	static int32_t FindTouchedObject(const MotionEvent& ev)
+	{
+		Mutex::Autolock lock(s_layoutLock);
+		if (!UpdateLayout())
+			return -1;
+
+		const std::vector<uint16_t>& cell =
+			s_grid[ClampCell(ev.mY, s_cellHeight) * OBJECT_CANCEL_GRID_CELLS + ClampCell(ev.mX, s_cellWidth)];
+
+		// The current object is drawn on top of the others
+		const int32_t current = OM::GetCurrentJobObjectIndex();
+		for (uint16_t rect : cell)
+		{
+			if ((int32_t)s_rects[rect].index == current && TouchInRect(s_rects[rect].pos, ev))
+				return current;
+		}
+
+		// In reverse so that it picks the top object first
+		for (auto it = cell.rbegin(); it != cell.rend(); ++it)
+		{
+			if (TouchInRect(s_rects[*it].pos, ev))
+				return s_rects[*it].index;
+		}
+		return -1;
+	}
+
 	void TouchListener::onTouchEvent(ZKBase* pBase, const MotionEvent& ev)
 	{
 		if (ev.mActionStatus == MotionEvent::E_ACTION_UP)
 		{
-			ZKPainter* canvas = dynamic_cast<ZKPainter*>(pBase);
-			if (canvas == nullptr)
-			{
-				error("Failed to get canvas");
-				return;
-			}
-
-			LayoutPosition canvasPos = canvas->getPosition();
-			verbose("Canvas position: %d, %d, %d, %d",
-					canvasPos.mLeft,
-					canvasPos.mTop,
-					canvasPos.mWidth,
-					canvasPos.mHeight);
 			dbg("Touch position: %d, %d", ev.mX, ev.mY);
-
-			OM::JobObject* object = OM::GetJobObject(OM::GetCurrentJobObjectIndex());
-			if (object != nullptr)
-			{
-				if (TouchInObjectBounds(*object, canvasPos, ev))
-				{
-					CancelJobObject(object->index);
-					return;
-				}
-			}
-
-			// In reverse so that it picks the top object first
 			if (OM::GetJobObjectCount() <= 0)
 			{
 				info("No objects to cancel");
 				return;
 			}
 
-			for (int i = OM::GetJobObjectCount() - 1; i >= 0; i--)
+			const int32_t index = FindTouchedObject(ev);
+			if (index >= 0)
 			{
-				object = OM::GetJobObject(i);
-				if (object == nullptr)
-				{
-					warn("Invalid object index %d", i);
-					continue;
-				}
-				if (TouchInObjectBounds(*object, canvasPos, ev))
-				{
-					CancelJobObject(object->index);
-					return;
-				}
+				CancelJobObject(index);
 			}
 		}
 	}
@@ -228,7 +313,7 @@ namespace UI::ObjectCancel
 
 	void CancelCurrentJobObject()
 	{
-		int8_t index = OM::GetCurrentJobObjectIndex();
+		int32_t index = OM::GetCurrentJobObjectIndex();
 		OM::JobObject* object = OM::GetJobObject(index);
 		if (object == nullptr)
 		{
@@ -242,44 +327,48 @@ namespace UI::ObjectCancel
 		UI::POPUP_WINDOW.CancelTimeout();
 	}
 
-	static void DrawObject(const OM::JobObject* object,
-						   ZKPainter* canvas,
+	static void DrawObject(const ObjectRect& rect,
+						   const OM::JobObject* object,
 						   const UI::Theme::Theme* theme,
 						   const bool current)
 	{
-		if (object == nullptr || canvas == nullptr || theme == nullptr)
+		if (object == nullptr)
 		{
-			warn("object, canvas, or theme is null");
+			warn("Invalid object index %d", rect.index);
 			return;
 		}
-		verbose("Drawing Object %d (%d, %d) -> (%d, %d)",
-				object->index,
-				object->bounds.x[0],
-				object->bounds.y[0],
-				object->bounds.x[1],
-				object->bounds.y[1]);
+		verbose("Drawing Object %d (%d, %d, %d, %d)",
+				rect.index,
+				rect.pos.mLeft,
+				rect.pos.mTop,
+				rect.pos.mWidth,
+				rect.pos.mHeight);
 		if (object->cancelled)
 		{
-			canvas->setSourceColor(theme->colors->objectCancel.bgCancelled);
+			s_canvas->setSourceColor(theme->colors->objectCancel.bgCancelled);
 		}
 		else if (current)
 		{
-			canvas->setSourceColor(theme->colors->objectCancel.bgCurrent);
+			s_canvas->setSourceColor(theme->colors->objectCancel.bgCurrent);
 		}
 		else
 		{
-			canvas->setSourceColor(theme->colors->objectCancel.bgDefault);
+			s_canvas->setSourceColor(theme->colors->objectCancel.bgDefault);
 		}
 
 		// Fill
-		LayoutPosition pos = ConvertBoundsToCanvas(*object, canvas->getPosition());
-		canvas->fillRect(pos.mLeft, pos.mTop, pos.mWidth, pos.mHeight);
+		s_canvas->fillRect(rect.pos.mLeft, rect.pos.mTop, rect.pos.mWidth, rect.pos.mHeight);
 
 		// Border
-		canvas->setSourceColor(theme->colors->objectCancel.bgBorder);
-		canvas->drawRect(pos.mLeft, pos.mTop, pos.mWidth, pos.mHeight);
-		verbose("Finished drawing object %u", object->index);
-		return;
+		s_canvas->setSourceColor(theme->colors->objectCancel.bgBorder);
+		s_canvas->drawRect(rect.pos.mLeft, rect.pos.mTop, rect.pos.mWidth, rect.pos.mHeight);
+	}
+
+	void InvalidateObjectMap()
+	{
+		Mutex::Autolock lock(s_layoutLock);
+		s_layoutValid = false;
+		s_overlayValid = false;
 	}
 
 	void RenderObjectMap()
@@ -289,7 +378,6 @@ namespace UI::ObjectCancel
 			error("Failed to get canvas");
 			return;
 		}
-		static LayoutPosition canvasPos = s_canvas->getPosition();
 
 		const UI::Theme::Theme* theme = UI::Theme::GetCurrentTheme();
 		if (theme == nullptr)
@@ -297,28 +385,42 @@ namespace UI::ObjectCancel
 			warn("Failed to get current theme");
 			return;
 		}
+		Mutex::Autolock lock(s_layoutLock);
+		if (!UpdateLayout())
+			return;
+
+		// The canvas keeps what was drawn, so it only needs drawing again when something shown on it changed
+		const int32_t current = OM::GetCurrentJobObjectIndex();
+		if (s_overlayValid && current == s_renderedCurrent && theme == s_renderedTheme)
+		{
+			verbose("ObjectCancel canvas unchanged");
+			return;
+		}
 		dbg("Rendering ObjectCancel canvas");
 
+		const LayoutPosition canvasPos = s_canvas->getPosition();
 		s_canvas->erase(0, 0, canvasPos.mWidth, canvasPos.mHeight);
 		s_canvas->setLineWidth(3);
 
-		OM::IterateJobObjectsWhile(
-			[&](OM::JobObject*& object, size_t index)
+		const ObjectRect* currentRect = nullptr;
+		for (const auto& rect : s_rects)
+		{
+			if ((int32_t)rect.index == current)
 			{
-				if (object == nullptr)
-				{
-					warn("Invalid object index %d", index);
-					return true;
-				}
-				DrawObject(object, s_canvas, theme, index == (size_t)OM::GetCurrentJobObjectIndex());
-				return true;
-			},
-			0);
-		verbose("Drawing current object");
+				currentRect = &rect;
+				continue;
+			}
+			DrawObject(rect, OM::GetJobObject(rect.index), theme, false);
+		}
 		// Draw the current object last so it is on top
-		OM::JobObject* object = OM::GetJobObject(OM::GetCurrentJobObjectIndex());
-		if (object != nullptr)
-			DrawObject(object, s_canvas, theme, true);
+		if (currentRect != nullptr)
+		{
+			DrawObject(*currentRect, OM::GetJobObject(currentRect->index), theme, true);
+		}
+
+		s_overlayValid = true;
+		s_renderedCurrent = current;
+		s_renderedTheme = theme;
 	}
 
 	TouchListener& GetTouchListener()
@@ -34,6 +34,8 @@ namespace UI::ObjectCancel
 	void CancelJobObject(const int index);
 	void CancelCurrentJobObject();
 
+	/// @brief Called when the objects or their bounds changed, the map is laid out again on the next render or touch
+	void InvalidateObjectMap();
 	void RenderObjectMap();
 	TouchListener& GetTouchListener();
 } // namespace UI::ObjectCancel
@@ -12,6 +12,7 @@
 #include "Hardware/Duet.h"
 #include "Hardware/Reset.h"
 #include "Settings.h"
+#include "StartupTimeline.h"
 #include "Storage.h"
 #include "UI/GuidedSetup.h"
 #include "UI/Logic/Console.h"
@@ -90,6 +91,18 @@ namespace UI::Settings
 		{"screensaver", []() { UI::WINDOW.OpenOverlay(ID_MAIN_ScreensaverSettingWindow); }},
 		{"buzzer", []() { UI::WINDOW.OpenOverlay(ID_MAIN_BuzzerSettingWindow); }},
 		{"webcam", []() { UI::WINDOW.OpenOverlay(ID_MAIN_WebcamSettingWindow); }},
+		{"http_compression",
+		 []()
+		 {
+			 // Shows how well compression is doing, the ok button turns it on or off
+			 const bool enabled = Comm::DUET.GetHttpCompression();
+			 UI::POPUP_WINDOW.Open([enabled]() { Comm::DUET.SetHttpCompression(!enabled); });
+			 UI::POPUP_WINDOW.SetTitle(LANGUAGEMANAGER->getValue("http_compression").c_str());
+			 UI::POPUP_WINDOW.SetText(Comm::GetHttpCompressionStats());
+			 UI::POPUP_WINDOW.SetOkBtnText(
+				 LANGUAGEMANAGER->getValue(enabled ? "http_compression_disable" : "http_compression_enable").c_str());
+			 UI::POPUP_WINDOW.CancelTimeout();
+		 }},
 	};
 
 	void Init()
@@ -111,8 +124,7 @@ namespace UI::Settings
 		UI::GetUIControl<ZKEditText>(ID_MAIN_ScreensaverTimeoutInput)
 			->setText(StoragePreferences::getInt(ID_SCREENSAVER_TIMEOUT, 120));
 
-		// Webcams
-		UI::Webcam::RestoreWebcamSettings();
+		// Webcams are restored once the UI is ready, see DeferredInit
 
 		// Guided setup
 		UI::GetUIControl<ZKCheckBox>(ID_MAIN_ShowSetupOnStartup)
@@ -123,7 +135,10 @@ namespace UI::Settings
 			->setChecked(StoragePreferences::getBool(ID_BUZZER_ENABLED, true));
 
 		// Theme
-		UI::Theme::SetTheme(StoragePreferences::getString(ID_THEME, "dark"));
+		{
+			Debug::StartupPhase phase("theme");
+			UI::Theme::SetTheme(StoragePreferences::getString(ID_THEME, "dark"));
+		}
 
 		// Duet communication settings
 		UI::GetUIControl<ZKTextView>(ID_MAIN_CommunicationType)
@@ -10,11 +10,16 @@
 #include "Configuration.h"
 #include "Storage.h"
 #include "Webcam.h"
+#include "comm/MjpegStream.h"
 #include "comm/Network.h"
 #include "timer.h"
+#include "utils/TimeHelper.h"
+#include <algorithm>
 #include <entry/EasyUIContext.h>
 #include <storage/StoragePreferences.h>
 #include <string>
+#include <strings.h>
+#include <system/Mutex.h>
 #include <vector>
 
 namespace UI::Webcam
@@ -24,6 +29,19 @@ namespace UI::Webcam
 	static int s_webcamUpdateInterval = DEFAULT_WEBCAM_UPDATE_INTERVAL;
 	static const char* s_webcamFile = "/tmp/webcam.png";
 	static std::string s_nullString = "";
+	static Comm::MjpegStream s_stream;
+
+	// Snapshot polling state, updated from the request thread
+	struct SnapshotState
+	{
+		std::string etag;
+		std::string lastModified;
+		uint64_t hash;
+		volatile int interval;			 // current poll interval, backs off while the frame is unchanged
+		volatile long long requestStart; // 0 if no request is in flight
+	};
+	static SnapshotState s_snapshot = {"", "", 0, DEFAULT_WEBCAM_UPDATE_INTERVAL, 0};
+	static Mutex s_snapshotLock;
 
 	class IMETextUpdateListener : public IMEContext::IIMETextUpdateListener
 	{
@@ -40,6 +58,37 @@ namespace UI::Webcam
 		size_t m_index;
 	};
 
+	static void ResetSnapshotState()
+	{
+		Mutex::Autolock lock(s_snapshotLock);
+		s_snapshot.etag.clear();
+		s_snapshot.lastModified.clear();
+		s_snapshot.hash = 0;
+		s_snapshot.interval = s_webcamUpdateInterval;
+	}
+
+	static uint64_t HashFrame(const std::string& data)
+	{
+		// FNV-1a
+		uint64_t hash = 14695981039346656037ULL;
+		for (unsigned char c : data)
+		{
+			hash ^= c;
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static const std::string* FindHeader(const RestClient::HeaderFields& headers, const char* name)
+	{
+		for (auto& header : headers)
+		{
+			if (strcasecmp(header.first.c_str(), name) == 0)
+				return &header.second;
+		}
+		return nullptr;
+	}
+
 	size_t GetWebcamCount()
 	{
 		UI::GetUIControl<ZKButton>(ID_MAIN_AddWebcamBtn)->setInvalid(s_webcamUrls.size() >= MAX_WEBCAMS);
@@ -73,6 +122,8 @@ namespace UI::Webcam
 		s_activeWebcamIndex = index;
 		StoragePreferences::putInt(ID_ACTIVE_WEBCAM_INDEX, s_activeWebcamIndex);
 
+		s_stream.Stop();
+		ResetSnapshotState();
 		system(utils::format("rm -f %s", s_webcamFile).c_str());
 		UpdateWebcamFrame(); // Clears the existing frame
 		return true;
@@ -168,6 +219,34 @@ namespace UI::Webcam
 		return s_webcamUrls[index];
 	}
 
+	/// @brief True if the active url is not a stream, or the stream could not be connected to
+	static bool IsPollingSnapshots()
+	{
+		if (s_stream.GetUrl() != s_webcamUrls[s_activeWebcamIndex])
+			return false;
+		const Comm::MjpegStream::State state = s_stream.GetState();
+		return state == Comm::MjpegStream::State::NotAStream || state == Comm::MjpegStream::State::Error;
+	}
+
+	static bool GetActiveWebcamStreamFrame()
+	{
+		const std::string& url = s_webcamUrls[s_activeWebcamIndex];
+		if (s_stream.GetUrl() != url || s_stream.GetState() == Comm::MjpegStream::State::Stopped)
+		{
+			static ZKTextView* feed = UI::GetUIControl<ZKTextView>(ID_MAIN_WebcamFeed);
+			LayoutPosition pos = feed->getPosition();
+			return s_stream.Start(url, pos.mWidth, pos.mHeight);
+		}
+
+		const char* frame = s_stream.TakeFrame();
+		if (frame == nullptr)
+		{
+			return true;
+		}
+		UI::GetUIControl<ZKTextView>(ID_MAIN_WebcamFeed)->setBackgroundPic(frame);
+		return true;
+	}
+
 	bool GetActiveWebcamFrame()
 	{
 		RestClient::Response r;
@@ -178,32 +257,107 @@ namespace UI::Webcam
 			return false;
 		}
 
-		size_t currentIndex = s_activeWebcamIndex;
-		return Comm::AsyncGet(s_webcamUrls[currentIndex], "", queryParameters, [currentIndex](RestClient::Response& r) {
-			if (r.code != 200)
-			{
-				warn("Failed to get webcam frame: [%d] %s", r.code, r.body.c_str());
-				return false;
-			}
+		// Use a persistent MJPEG stream where the url provides one, otherwise fall back to fetching single snapshots
+		if (!IsPollingSnapshots())
+		{
+			return GetActiveWebcamStreamFrame();
+		}
 
-			// Save the frame to a file
-			FILE* f = fopen(s_webcamFile, "wb");
-			if (f == nullptr)
-			{
-				warn("Failed to open file");
-				return false;
-			}
-			fwrite(r.body.c_str(), 1, r.body.size(), f);
-			fclose(f);
+		const long long now = TimeHelper::getCurrentTime();
+		if (s_snapshot.requestStart > 0 && now - s_snapshot.requestStart < WEBCAM_SNAPSHOT_TIMEOUT)
+		{
+			verbose("Previous webcam snapshot request still in progress");
+			return true;
+		}
 
-			if (currentIndex != s_activeWebcamIndex)
-			{
-				return false;
-			}
+		// Only ask for the frame if it has changed since the last one
+		RestClient::HeaderFields headers;
+		{
+			Mutex::Autolock lock(s_snapshotLock);
+			if (!s_snapshot.etag.empty())
+				headers["If-None-Match"] = s_snapshot.etag;
+			if (!s_snapshot.lastModified.empty())
+				headers["If-Modified-Since"] = s_snapshot.lastModified;
+		}
 
-			UpdateWebcamFrame();
-			return true;
-		});
+		size_t currentIndex = s_activeWebcamIndex;
+		s_snapshot.requestStart = now;
+		bool result = Comm::AsyncGet(
+			s_webcamUrls[currentIndex],
+			"",
+			queryParameters,
+			[currentIndex, now](RestClient::Response& r) {
+				s_snapshot.requestStart = 0;
+				if (currentIndex != s_activeWebcamIndex)
+				{
+					return false;
+				}
+
+				if (r.code != 200 && r.code != 304)
+				{
+					// Try again at the normal rate rather than waiting for WEBCAM_SNAPSHOT_TIMEOUT
+					warn("Failed to get webcam frame: [%d] %s", r.code, r.body.c_str());
+					s_snapshot.interval = s_webcamUpdateInterval;
+					return false;
+				}
+
+				bool changed = false;
+				if (r.code == 200)
+				{
+					Mutex::Autolock lock(s_snapshotLock);
+					const std::string* etag = FindHeader(r.headers, "ETag");
+					const std::string* lastModified = FindHeader(r.headers, "Last-Modified");
+					s_snapshot.etag = etag != nullptr ? *etag : "";
+					s_snapshot.lastModified = lastModified != nullptr ? *lastModified : "";
+
+					// Cameras that don't support conditional requests often still return an identical image
+					uint64_t hash = HashFrame(r.body);
+					changed = hash != s_snapshot.hash;
+					s_snapshot.hash = hash;
+				}
+
+				// Poll at the configured rate while the picture is changing, but no faster than the camera can
+				// respond, and back off while it is static
+				const int fetchTime = (int)(TimeHelper::getCurrentTime() - now);
+				if (changed)
+				{
+					s_snapshot.interval = std::max(s_webcamUpdateInterval, fetchTime);
+				}
+				else
+				{
+					s_snapshot.interval = std::min(s_snapshot.interval * 3 / 2,
+												   std::max(s_webcamUpdateInterval, MAX_WEBCAM_IDLE_UPDATE_INTERVAL));
+					verbose("Webcam frame unchanged, polling every %dms", s_snapshot.interval);
+					return true;
+				}
+
+				// Save the frame to a file
+				FILE* f = fopen(s_webcamFile, "wb");
+				if (f == nullptr)
+				{
+					warn("Failed to open file");
+					return false;
+				}
+				fwrite(r.body.c_str(), 1, r.body.size(), f);
+				fclose(f);
+
+				if (currentIndex != s_activeWebcamIndex)
+				{
+					return false;
+				}
+
+				UpdateWebcamFrame();
+				return true;
+			},
+			0,
+			false,
+			headers,
+			true);
+		if (!result)
+		{
+			s_snapshot.requestStart = 0;
+		}
+		return result;
 	}
 
 	void UpdateWebcamFrame()
@@ -234,19 +388,36 @@ namespace UI::Webcam
 			return;
 		}
 		s_webcamUpdateInterval = interval;
+		s_snapshot.interval = interval;
 		StoragePreferences::putInt(ID_WEBCAM_UPADTE_ITERVAL, s_webcamUpdateInterval);
 	}
 
+	static int GetWebcamPollInterval()
+	{
+		if (GetWebcamCount() > 0 && IsPollingSnapshots())
+		{
+			return s_snapshot.interval;
+		}
+		// Frames are decoded as they arrive, so show them at the rate the camera sends them
+		return WEBCAM_STREAM_POLL_INTERVAL;
+	}
+
 	void RegisterUpdateLoop()
 	{
+		if (s_stream.GetState() == Comm::MjpegStream::State::Error)
+		{
+			s_stream.Stop(); // Try the stream again rather than staying on snapshots
+		}
 		GetActiveWebcamFrame(); // So there is no delay in getting the first frame
-		registerDelayedCallback("WebcamUpdate", s_webcamUpdateInterval, []() {
+		registerDelayedCallback("WebcamUpdate", GetWebcamPollInterval(), []() {
 			if (!UI::GetUIControl<ZKWindow>(ID_MAIN_WebcamWindow)->isVisible())
 			{
 				// unregister callback if window is not visible
+				s_stream.Stop();
 				return false;
 			}
 			GetActiveWebcamFrame();
+			setDelayedCallbackDelay("WebcamUpdate", GetWebcamPollInterval());
 			return true;
 		});
 	}
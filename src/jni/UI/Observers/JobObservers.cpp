@@ -61,10 +61,25 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 				  {
 					  dbg("Job: build is null");
 					  OM::RemoveJobObject(indices[0], true);
+					  UI::ObjectCancel::InvalidateObjectMap();
+					  UI::ObjectCancel::RenderObjectMap();
+				  }),
+	OBSERVER_CHAR("job:build:objects",
+				  [](OBSERVER_CHAR_ARGS)
+				  {
+					  // The objects are fetched on their own, their key is null when there is no build
+					  dbg("Job: build objects are null");
+					  OM::RemoveJobObject(0, true);
+					  UI::ObjectCancel::InvalidateObjectMap();
 					  UI::ObjectCancel::RenderObjectMap();
 				  }),
 	OBSERVER_INT("job:build:currentObject", [](OBSERVER_INT_ARGS) { OM::SetCurrentJobObject(val); }),
-	OBSERVER_CHAR("job:build:objects^", [](OBSERVER_CHAR_ARGS) { OM::RemoveJobObject(indices[0], false); }),
+	OBSERVER_CHAR("job:build:objects^",
+				  [](OBSERVER_CHAR_ARGS)
+				  {
+					  OM::RemoveJobObject(indices[0], false);
+					  UI::ObjectCancel::InvalidateObjectMap();
+				  }),
 	OBSERVER_BOOL("job:build:objects^:cancelled",
 				  [](OBSERVER_BOOL_ARGS)
 				  {
@@ -72,8 +87,10 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 					  if (jobObject == nullptr)
 					  {
 						  warn("Job object %u not found", indices[0]);
+						  return;
 					  }
 					  jobObject->cancelled = val;
+					  UI::ObjectCancel::InvalidateObjectMap();
 				  }),
 	OBSERVER_CHAR("job:build:objects^:name",
 				  [](OBSERVER_CHAR_ARGS)
@@ -82,6 +99,7 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 					  if (jobObject == nullptr)
 					  {
 						  warn("Job object %u not found", indices[0]);
+						  return;
 					  }
 					  jobObject->name = val;
 				  }),
@@ -92,6 +110,7 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 					 if (jobObject == nullptr)
 					 {
 						 warn("Job object %u not found", indices[0]);
+						 return;
 					 }
 					 if (indices[1] < 0 || indices[1] >= 2)
 					 {
@@ -99,6 +118,7 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 						 return;
 					 }
 					 jobObject->bounds.x[indices[1]] = val;
+					 UI::ObjectCancel::InvalidateObjectMap();
 				 }),
 	OBSERVER_INT("job:build:objects^:y^",
 				 [](OBSERVER_INT_ARGS)
@@ -107,6 +127,7 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 					 if (jobObject == nullptr)
 					 {
 						 warn("Job object %u not found", indices[0]);
+						 return;
 					 }
 					 if (indices[1] < 0 || indices[1] >= 2)
 					 {
@@ -114,6 +135,7 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
 						 return;
 					 }
 					 jobObject->bounds.y[indices[1]] = val;
+					 UI::ObjectCancel::InvalidateObjectMap();
 				 }),
 };
 
@@ -123,5 +145,15 @@ static UI::Observer<UI::ui_field_update_cb> JobObserversField[] = {
  */
 static UI::Observer<UI::ui_array_end_update_cb> JobObserversArrayEnd[] = {
 	OBSERVER_ARRAY_END("job:build^", [](OBSERVER_ARRAY_END_ARGS) { dbg("Job: build end %u", indices[0]); }),
-	OBSERVER_ARRAY_END("job:build:objects^", [](OBSERVER_ARRAY_END_ARGS) { OM::RemoveJobObject(indices[0], true); }),
+	OBSERVER_ARRAY_END("job:build:objects^",
+					   [](OBSERVER_ARRAY_END_ARGS)
+					   {
+						   // Only passed on after the last page of the objects, see Seq::paged
+						   if (OM::RemoveJobObject(indices[0], true) > 0)
+						   {
+							   UI::ObjectCancel::InvalidateObjectMap();
+						   }
+						   UI::GetUIControl<ZKListView>(ID_MAIN_ObjectCancelObjectsList)->refreshListView();
+						   UI::ObjectCancel::RenderObjectMap();
+					   }),
 };
@@ -32,18 +32,7 @@ static UI::Observer<UI::ui_field_update_cb> PushObserversField[] = {
 				  [](OBSERVER_CHAR_ARGS) {
 					  info("resp length=%d", strlen(val));
 					  dbg("resp: %s", val);
-					  static std::string str;
-					  size_t substrlen;
-
-					  str = val;
-					  for (size_t i = 0; i < str.length(); i += MAX_RESPONSE_LINE_LENGTH)
-					  {
-						  String<MAX_RESPONSE_LINE_LENGTH> line;
-						  substrlen = std::min(str.length() - i, MAX_RESPONSE_LINE_LENGTH);
-						  dbg("resp: str.length()=%d, i=%d, substrlen=%d", str.length(), i, substrlen);
-						  line.copy(str.substr(i, substrlen).c_str());
-						  UI::CONSOLE.AddResponse(line.GetRef());
-					  }
+					  UI::CONSOLE.AddResponse(val);
 
 					  // Only show if console is not visible and a M291 message box is not showing
 					  if (!UI::GetUIControl<ZKWindow>(ID_MAIN_ConsoleWindow)->isVisible() &&
@@ -16,6 +16,6 @@ namespace UI
 {
 	Observer<ui_field_update_cb>* g_omFieldObserverHead = nullptr;
 	Observer<ui_array_end_update_cb>* g_omArrayEndObserverHead = nullptr;
-	ObserverMap<ui_field_update_cb> g_observerMap;
-	ObserverMap<ui_array_end_update_cb> g_observerMapArrayEnd;
+	ObserverMap<ui_field_update_cb> g_observerMap(g_omFieldObserverHead);
+	ObserverMap<ui_array_end_update_cb> g_observerMapArrayEnd(g_omArrayEndObserverHead);
 }
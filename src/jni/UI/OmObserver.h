@@ -15,6 +15,7 @@
 #include <Duet3D/General/String.h>
 #include <Duet3D/General/StringFunctions.h>
 #include <map>
+#include <system/Mutex.h>
 #include <vector>
 
 #include "Debug.h"
@@ -133,25 +134,51 @@ namespace UI
 		cbType m_cb;
 	};
 
+	// Built from the list of static observers on the first lookup rather than at startup, so the UI can be shown
+	// before the map has been populated
 	template <typename cbType>
 	class ObserverMap
 	{
 	  public:
+		explicit ObserverMap(Observer<cbType>*& head) : m_head(head), m_built(false) {}
+
 		void RegisterObserver(const char* key, const Observer<cbType>& observer)
 		{
 			auto& observerList = m_observersMap[key];
 			observerList.push_back(observer);
 
-			dbg("%d observers registered against key \"%s\"", observerList.size(), key);
+			verbose("%d observers registered against key \"%s\"", observerList.size(), key);
 		}
-		const std::vector<Observer<cbType>>& GetObservers(const char* key) const
+		const std::vector<Observer<cbType>>& GetObservers(const char* key)
 		{
+			if (!__atomic_load_n(&m_built, __ATOMIC_ACQUIRE))
+			{
+				Build();
+			}
 			static const std::vector<Observer<cbType>> emptyVector; // Return an empty vector if key not found
 			auto it = m_observersMap.find(key);
 			return (it != m_observersMap.end()) ? it->second : emptyVector;
 		}
 
 	  private:
+		void Build()
+		{
+			Mutex::Autolock lock(m_lock);
+			if (m_built)
+				return;
+			size_t count = 0;
+			for (auto* observer = m_head; observer != nullptr; observer = observer->next)
+			{
+				observer->Init(*this);
+				count++;
+			}
+			dbg("%u observers registered against %u keys", count, m_observersMap.size());
+			__atomic_store_n(&m_built, true, __ATOMIC_RELEASE);
+		}
+
+		Observer<cbType>*& m_head;
+		bool m_built;
+		Mutex m_lock;
 		std::map<const char*, std::vector<Observer<cbType>>, ConstCharComparator> m_observersMap;
 	};
 
@@ -3,8 +3,11 @@
 #include "Storage.h"
 #include "Themes.h"
 #include "control/ZKSlideText.h"
+#include "utils/TimeHelper.h"
 #include <map>
+#include <set>
 #include <storage/StoragePreferences.h>
+#include <string.h>
 #include <string>
 #include <typeinfo>
 
@@ -65,227 +68,400 @@ namespace UI::Theme
 		return it->second;
 	}
 
-	static void ThemeControls(ThemeColors* colors, std::vector<ZKBase*> controls)
+	// Each theme is compiled into a table of property writes per control type. Switching theme only writes the
+	// properties that differ from the theme already applied to a control
+	enum class ControlKind : uint8_t
 	{
-		dbg("%d controls in window to theme", controls.size());
+		Window = 0,
+		Text,
+		Button,
+		Input,
+		Slider,
+		CircularBar,
+		Pointer,
+		DigitalClock,
+		Checkbox,
+		List,
+		Diagram,
+		SlideWindow,
+		Count,
+	};
+
+	enum class StyleProperty : uint8_t
+	{
+		BackgroundColor = 0,
+		BackgroundPic,
+		BgStatusColor,
+		TextStatusColor,
+		ButtonStatusPic,
+		ProgressPic,
+		ThumbPic,
+		TextColor,
+		PenColor,
+		LongMode,
+		IconPosition,
+	};
+
+	struct StyleValue
+	{
+		StyleProperty property;
+		int param; // Control status, pen index or long mode
+		uint32_t color;
+		const char* pic;
+	};
+
+	typedef std::vector<StyleValue> StyleTable;
+
+	struct CompiledTheme
+	{
+		StyleTable kinds[(size_t)ControlKind::Count];
+	};
+
+	struct StyledControl
+	{
+		ZKBase* control;
+		ControlKind kind;
+		const CompiledTheme* applied;
+	};
+
+	static std::map<const Theme*, CompiledTheme> s_compiledThemes;
+	static std::vector<StyledControl> s_styledControls;
+	static std::set<ZKBase*> s_overriddenControls; // Changed by the overrides of the applied theme
+	static bool s_trackingOverrides = false;
+
+	static void AddColor(StyleTable& table, StyleProperty property, int param, uint32_t color)
+	{
+		table.push_back({property, param, color, nullptr});
+	}
+
+	static void AddPic(StyleTable& table, StyleProperty property, int param, const char* pic)
+	{
+		table.push_back({property, param, 0, pic});
+	}
+
+	static void AddBackground(StyleTable& table, uint32_t color, const char* pic)
+	{
+		AddColor(table, StyleProperty::BackgroundColor, 0, color);
+		AddPic(table, StyleProperty::BackgroundPic, 0, pic);
+	}
+
+	static void AddStates(StyleTable& table, StyleProperty property, const ControlState& state)
+	{
+		AddColor(table, property, ZK_CONTROL_STATUS_NORMAL, state.normal);
+		AddColor(table, property, ZK_CONTROL_STATUS_PRESSED, state.pressed);
+		AddColor(table, property, ZK_CONTROL_STATUS_SELECTED, state.selected);
+		AddColor(table, property, ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED, state.pressedAndSelected);
+		AddColor(table, property, ZK_CONTROL_STATUS_INVALID, state.invalid);
+	}
+
+	static void AddImages(StyleTable& table, const Images& images)
+	{
+		AddPic(table, StyleProperty::ButtonStatusPic, ZK_CONTROL_STATUS_NORMAL, images.normal);
+		AddPic(table, StyleProperty::ButtonStatusPic, ZK_CONTROL_STATUS_PRESSED, images.pressed);
+		AddPic(table, StyleProperty::ButtonStatusPic, ZK_CONTROL_STATUS_SELECTED, images.selected);
+		AddPic(table,
+			   StyleProperty::ButtonStatusPic,
+			   ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
+			   images.pressedAndSelected);
+		AddPic(table, StyleProperty::ButtonStatusPic, ZK_CONTROL_STATUS_INVALID, images.invalid);
+	}
+
+	static void AddThumb(StyleTable& table, const char* progressPic, const ThumbImage& thumb)
+	{
+		AddPic(table, StyleProperty::ProgressPic, 0, progressPic);
+		AddPic(table, StyleProperty::ThumbPic, ZK_CONTROL_STATUS_NORMAL, thumb.normal);
+		AddPic(table, StyleProperty::ThumbPic, ZK_CONTROL_STATUS_PRESSED, thumb.pressed);
+	}
+
+	static void CompileTheme(const ThemeColors* colors, CompiledTheme& compiled)
+	{
+		StyleTable* kinds = compiled.kinds;
+
+		StyleTable& window = kinds[(size_t)ControlKind::Window];
+		AddBackground(window, colors->window.bgDefault, colors->window.bgImage);
+
+		StyleTable& text = kinds[(size_t)ControlKind::Text];
+		AddBackground(text, colors->text.bgDefault, colors->text.bgImage);
+		AddStates(text, StyleProperty::BgStatusColor, colors->text.background);
+		AddStates(text, StyleProperty::TextStatusColor, colors->text.foreground);
+		AddColor(text, StyleProperty::LongMode, ZKTextView::E_LONG_MODE_DOTS, 0);
+
+		StyleTable& button = kinds[(size_t)ControlKind::Button];
+		AddBackground(button, colors->button.bgDefault, colors->button.bgImage);
+		AddStates(button, StyleProperty::BgStatusColor, colors->button.background);
+		AddStates(button, StyleProperty::TextStatusColor, colors->button.foreground);
+		AddImages(button, colors->button.images);
+		AddColor(button, StyleProperty::IconPosition, 0, 0);
+		AddColor(button, StyleProperty::LongMode, ZKTextView::E_LONG_MODE_DOTS, 0);
+
+		StyleTable& input = kinds[(size_t)ControlKind::Input];
+		AddBackground(input, colors->input.bgDefault, colors->input.bgImage);
+		AddStates(input, StyleProperty::BgStatusColor, colors->input.background);
+		AddStates(input, StyleProperty::TextStatusColor, colors->input.foreground);
+
+		StyleTable& slider = kinds[(size_t)ControlKind::Slider];
+		AddBackground(slider, colors->slider.bgDefault, colors->slider.bgImage);
+		AddThumb(slider, colors->slider.validImage, colors->slider.thumb);
+
+		StyleTable& circularBar = kinds[(size_t)ControlKind::CircularBar];
+		AddBackground(circularBar, colors->circularBar.bgDefault, colors->circularBar.bgImage);
+		AddColor(circularBar, StyleProperty::TextColor, 0, colors->circularBar.text);
+		AddThumb(circularBar, colors->circularBar.validImage, colors->circularBar.thumb);
+
+		// TODO Work out how to set pointer picture
+		StyleTable& pointer = kinds[(size_t)ControlKind::Pointer];
+		AddBackground(pointer, colors->pointer.bgDefault, colors->pointer.bgImage);
+
+		StyleTable& digitalClock = kinds[(size_t)ControlKind::DigitalClock];
+		AddBackground(digitalClock, colors->digitalClock.bgDefault, colors->digitalClock.bgImage);
+		AddColor(digitalClock, StyleProperty::TextColor, 0, colors->digitalClock.text); // TODO This doesn't work
+
+		StyleTable& checkbox = kinds[(size_t)ControlKind::Checkbox];
+		AddBackground(checkbox, colors->checkbox.bgDefault, colors->checkbox.bgImage);
+		AddStates(checkbox, StyleProperty::BgStatusColor, colors->checkbox.background);
+		AddStates(checkbox, StyleProperty::TextStatusColor, colors->checkbox.foreground);
+		AddImages(checkbox, colors->checkbox.images);
+		AddColor(checkbox, StyleProperty::LongMode, ZKTextView::E_LONG_MODE_DOTS, 0);
+		AddColor(checkbox, StyleProperty::IconPosition, 0, 0);
+
+		StyleTable& list = kinds[(size_t)ControlKind::List];
+		AddBackground(list, colors->list.bgDefault, colors->list.bgImage);
+		AddStates(list, StyleProperty::BgStatusColor, colors->list.background);
+
+		StyleTable& diagram = kinds[(size_t)ControlKind::Diagram];
+		AddBackground(diagram, colors->diagram.bgDefault, colors->diagram.bgImage);
+		for (size_t i = 0; i < sizeof(colors->diagram.colors) / sizeof(colors->diagram.colors[0]); i++)
+		{
+			AddColor(diagram, StyleProperty::PenColor, (int)i, colors->diagram.colors[i]);
+		}
+
+		StyleTable& slideWindow = kinds[(size_t)ControlKind::SlideWindow];
+		AddBackground(slideWindow, colors->slideWindow.bgDefault, colors->slideWindow.bgImage);
+	}
+
+	static const CompiledTheme& GetCompiledTheme(const Theme* theme)
+	{
+		auto it = s_compiledThemes.find(theme);
+		if (it != s_compiledThemes.end())
+			return it->second;
+
+		CompiledTheme& compiled = s_compiledThemes[theme];
+		CompileTheme(theme->colors, compiled);
+		return compiled;
+	}
+
+	static ControlKind GetControlKind(ZKBase* control)
+	{
+		const std::type_info& type = typeid(*control);
+		if (type == typeid(ZKWindow))
+			return ControlKind::Window;
+		if (type == typeid(ZKTextView))
+			return ControlKind::Text;
+		if (type == typeid(ZKButton))
+			return ControlKind::Button;
+		if (type == typeid(ZKEditText))
+			return ControlKind::Input;
+		if (type == typeid(ZKSeekBar))
+			return ControlKind::Slider;
+		if (type == typeid(ZKCircleBar))
+			return ControlKind::CircularBar;
+		if (type == typeid(ZKPointer))
+			return ControlKind::Pointer;
+		if (type == typeid(ZKDigitalClock))
+			return ControlKind::DigitalClock;
+		if (type == typeid(ZKCheckBox))
+			return ControlKind::Checkbox;
+		if (type == typeid(ZKListView))
+			return ControlKind::List;
+		if (type == typeid(ZKDiagram))
+			return ControlKind::Diagram;
+		if (type == typeid(ZKSlideWindow))
+			return ControlKind::SlideWindow;
+		return ControlKind::Count;
+	}
+
+	// The controls are all created from the layout at startup, so their types are only worked out once
+	static void BuildStyledControls()
+	{
+		std::vector<ZKBase*> controls;
+		UI::GetRootWindow()->getAllControls(controls);
+		s_styledControls.reserve(controls.size());
 		for (auto control : controls)
 		{
-			dbg("Theming control ID %d, type %s, typeid %s",
-				control->getID(),
-				control->getClassName(),
-				typeid(*control).name());
-			if (typeid(*control) == typeid(ZKWindow))
-			{
-				ZKWindow* window = static_cast<ZKWindow*>(control);
-				window->setBackgroundColor(colors->window.bgDefault);
-				window->setBackgroundPic(colors->window.bgImage);
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKTextView))
+			const ControlKind kind = GetControlKind(control);
+			if (kind == ControlKind::Count)
 			{
-				ZKTextView* text = static_cast<ZKTextView*>(control);
-				// Background
-				text->setBackgroundColor(colors->text.bgDefault);
-				text->setBackgroundPic(colors->text.bgImage);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->text.background.normal);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->text.background.pressed);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->text.background.selected);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-									   colors->text.background.pressedAndSelected);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_INVALID, colors->text.background.invalid);
-
-				// Foreground
-				text->setTextStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->text.foreground.normal);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->text.foreground.pressed);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->text.foreground.selected);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-										 colors->text.foreground.pressedAndSelected);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_INVALID, colors->text.foreground.invalid);
-
-				text->setLongMode(ZKTextView::E_LONG_MODE_DOTS);
+				verbose("Control ID %d, type %s is not themed", control->getID(), control->getClassName());
 				continue;
 			}
-			if (typeid(*control) == typeid(ZKButton))
-			{
-				ZKButton* button = static_cast<ZKButton*>(control);
-				// Background
-				button->setBackgroundColor(colors->button.bgDefault);
-				button->setBackgroundPic(colors->button.bgImage);
-				button->setBgStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->button.background.normal);
-				button->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->button.background.pressed);
-				button->setBgStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->button.background.selected);
-				button->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-										 colors->button.background.pressedAndSelected);
-				button->setBgStatusColor(ZK_CONTROL_STATUS_INVALID, colors->button.background.invalid);
-
-				// Foreground
-				button->setTextStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->button.foreground.normal);
-				button->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->button.foreground.pressed);
-				button->setTextStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->button.foreground.selected);
-				button->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-										   colors->button.foreground.pressedAndSelected);
-				button->setTextStatusColor(ZK_CONTROL_STATUS_INVALID, colors->button.foreground.invalid);
-
-				// Pictures
-				button->setButtonStatusPic(ZK_CONTROL_STATUS_NORMAL, colors->button.images.normal);
-				button->setButtonStatusPic(ZK_CONTROL_STATUS_PRESSED, colors->button.images.pressed);
-				button->setButtonStatusPic(ZK_CONTROL_STATUS_SELECTED, colors->button.images.selected);
-				button->setButtonStatusPic(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-										   colors->button.images.pressedAndSelected);
-				button->setButtonStatusPic(ZK_CONTROL_STATUS_INVALID, colors->button.images.invalid);
-
-				LayoutPosition pos = button->getPosition();
-				pos.mLeft = 0;
-				pos.mTop = 0;
-				button->setIconPosition(pos);
-
-				button->setLongMode(ZKTextView::E_LONG_MODE_DOTS);
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKEditText))
-			{
-				ZKEditText* text = static_cast<ZKEditText*>(control);
-				// Background
-				text->setBackgroundColor(colors->input.bgDefault);
-				text->setBackgroundPic(colors->input.bgImage);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->input.background.normal);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->input.background.pressed);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->input.background.selected);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-									   colors->input.background.pressedAndSelected);
-				text->setBgStatusColor(ZK_CONTROL_STATUS_INVALID, colors->input.background.invalid);
-
-				// Foreground
-				text->setTextStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->input.foreground.normal);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->input.foreground.pressed);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->input.foreground.selected);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-										 colors->input.foreground.pressedAndSelected);
-				text->setTextStatusColor(ZK_CONTROL_STATUS_INVALID, colors->input.foreground.invalid);
+			s_styledControls.push_back({control, kind, nullptr});
+		}
+		dbg("%d of %d controls are themed", s_styledControls.size(), controls.size());
+	}
 
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKSeekBar))
-			{
-				ZKSeekBar* seek = static_cast<ZKSeekBar*>(control);
-				// Background
-				seek->setBackgroundColor(colors->slider.bgDefault);
-				seek->setBackgroundPic(colors->slider.bgImage);
-
-				// Foreground
-				seek->setProgressPic(colors->slider.validImage);
-				seek->setThumbPic(ZK_CONTROL_STATUS_NORMAL, colors->slider.thumb.normal);
-				seek->setThumbPic(ZK_CONTROL_STATUS_PRESSED, colors->slider.thumb.pressed);
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKCircleBar))
-			{
-				ZKCircleBar* circleBar = static_cast<ZKCircleBar*>(control);
-				// Background
-				circleBar->setBackgroundColor(colors->circularBar.bgDefault);
-				circleBar->setBackgroundPic(colors->circularBar.bgImage);
-
-				// Foreground
-				circleBar->setTextColor(colors->circularBar.text);
-				circleBar->setProgressPic(colors->circularBar.validImage);
-				circleBar->setThumbPic(ZK_CONTROL_STATUS_NORMAL, colors->circularBar.thumb.normal);
-				circleBar->setThumbPic(ZK_CONTROL_STATUS_PRESSED, colors->circularBar.thumb.pressed);
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKPointer))
-			{
-				ZKPointer* pointer = static_cast<ZKPointer*>(control);
-				// Background
-				pointer->setBackgroundColor(colors->pointer.bgDefault);
-				pointer->setBackgroundPic(colors->pointer.bgImage);
+	// Properties that overwrite each other, e.g. the background colour is also the normal status colour, so they
+	// are written together when any of them changes
+	static int GetStyleGroup(StyleProperty property)
+	{
+		switch (property)
+		{
+		case StyleProperty::BackgroundColor:
+		case StyleProperty::BackgroundPic:
+		case StyleProperty::BgStatusColor:
+			return 0;
+		case StyleProperty::TextStatusColor:
+		case StyleProperty::TextColor:
+			return 1;
+		case StyleProperty::ButtonStatusPic:
+		case StyleProperty::ProgressPic:
+		case StyleProperty::ThumbPic:
+			return 2;
+		case StyleProperty::PenColor:
+			return 3;
+		case StyleProperty::LongMode:
+		case StyleProperty::IconPosition:
+			return 4;
+		}
+		return 0;
+	}
 
-				// Foreground
-				// TODO Work out how to set pointer picture
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKDigitalClock))
-			{
-				ZKDigitalClock* digitalClock = static_cast<ZKDigitalClock*>(control);
-				// Background
-				digitalClock->setBackgroundColor(colors->digitalClock.bgDefault);
-				digitalClock->setBackgroundPic(colors->digitalClock.bgImage);
+	static bool StyleEqual(const StyleValue& a, const StyleValue& b)
+	{
+		if (a.color != b.color)
+			return false;
+		if (a.pic == b.pic)
+			return true;
+		return a.pic != nullptr && b.pic != nullptr && strcmp(a.pic, b.pic) == 0;
+	}
 
-				// Foreground
-				digitalClock->setTextColor(colors->digitalClock.text); // TODO This doesn't work
-				continue;
-			}
-			if (typeid(*control) == typeid(ZKCheckBox))
+	// Indices of the entries of the new table that have to be written to a control showing the old one
+	static void DiffStyleTables(const StyleTable& previous, const StyleTable& next, std::vector<size_t>& changes)
+	{
+		changes.clear();
+		uint32_t changedGroups = 0;
+		for (size_t i = 0; i < next.size(); i++)
+		{
+			if (!StyleEqual(previous[i], next[i]))
 			{
-				ZKCheckBox* checkbox = static_cast<ZKCheckBox*>(control);
-				// Background
-				checkbox->setBackgroundColor(colors->checkbox.bgDefault);
-				checkbox->setBackgroundPic(colors->checkbox.bgImage);
-				checkbox->setBgStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->checkbox.background.normal);
-				checkbox->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->checkbox.background.pressed);
-				checkbox->setBgStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->checkbox.background.selected);
-				checkbox->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-										   colors->checkbox.background.pressedAndSelected);
-				checkbox->setBgStatusColor(ZK_CONTROL_STATUS_INVALID, colors->checkbox.background.invalid);
-
-				// Foreground
-				checkbox->setTextStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->checkbox.foreground.normal);
-				checkbox->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->checkbox.foreground.pressed);
-				checkbox->setTextStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->checkbox.foreground.selected);
-				checkbox->setTextStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-											 colors->checkbox.foreground.pressedAndSelected);
-				checkbox->setTextStatusColor(ZK_CONTROL_STATUS_INVALID, colors->checkbox.foreground.invalid);
-
-				// Pictures
-				checkbox->setButtonStatusPic(ZK_CONTROL_STATUS_NORMAL, colors->checkbox.images.normal);
-				checkbox->setButtonStatusPic(ZK_CONTROL_STATUS_PRESSED, colors->checkbox.images.pressed);
-				checkbox->setButtonStatusPic(ZK_CONTROL_STATUS_SELECTED, colors->checkbox.images.selected);
-				checkbox->setButtonStatusPic(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-											 colors->checkbox.images.pressedAndSelected);
-				checkbox->setButtonStatusPic(ZK_CONTROL_STATUS_INVALID, colors->checkbox.images.invalid);
-
-				checkbox->setLongMode(ZKTextView::E_LONG_MODE_DOTS);
-
-				LayoutPosition pos = checkbox->getPosition();
-				pos.mLeft = 0;
-				pos.mTop = 0;
-				checkbox->setIconPosition(pos);
-				continue;
+				changedGroups |= 1u << GetStyleGroup(next[i].property);
 			}
-			if (typeid(*control) == typeid(ZKListView))
+		}
+		for (size_t i = 0; i < next.size(); i++)
+		{
+			if (changedGroups & (1u << GetStyleGroup(next[i].property)))
 			{
-				ZKListView* list = static_cast<ZKListView*>(control);
-				// Background
-				list->setBackgroundColor(colors->list.bgDefault);
-				list->setBackgroundPic(colors->list.bgImage);
-
-				list->setBgStatusColor(ZK_CONTROL_STATUS_NORMAL, colors->list.background.normal);
-				list->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED, colors->list.background.pressed);
-				list->setBgStatusColor(ZK_CONTROL_STATUS_SELECTED, colors->list.background.selected);
-				list->setBgStatusColor(ZK_CONTROL_STATUS_PRESSED | ZK_CONTROL_STATUS_SELECTED,
-									   colors->list.background.pressedAndSelected);
-				list->setBgStatusColor(ZK_CONTROL_STATUS_INVALID, colors->list.background.invalid);
-				continue;
+				changes.push_back(i);
 			}
-			if (typeid(*control) == typeid(ZKDiagram))
-			{
-				ZKDiagram* diagram = static_cast<ZKDiagram*>(control);
-				// Background
-				diagram->setBackgroundColor(colors->diagram.bgDefault);
-				diagram->setBackgroundPic(colors->diagram.bgImage);
+		}
+	}
 
-				for (size_t i = 0; i < sizeof(colors->diagram.colors) / sizeof(colors->diagram.colors[0]); i++)
+	static void ApplyStyle(ZKBase* control, ControlKind kind, const StyleValue& style)
+	{
+		switch (style.property)
+		{
+		case StyleProperty::BackgroundColor:
+			control->setBackgroundColor(style.color);
+			break;
+		case StyleProperty::BackgroundPic:
+			control->setBackgroundPic(style.pic);
+			break;
+		case StyleProperty::BgStatusColor:
+			control->setBgStatusColor(style.param, style.color);
+			break;
+		case StyleProperty::TextStatusColor:
+			static_cast<ZKTextView*>(control)->setTextStatusColor(style.param, style.color);
+			break;
+		case StyleProperty::ButtonStatusPic:
+			static_cast<ZKButton*>(control)->setButtonStatusPic(style.param, style.pic);
+			break;
+		case StyleProperty::ProgressPic:
+			if (kind == ControlKind::Slider)
+				static_cast<ZKSeekBar*>(control)->setProgressPic(style.pic);
+			else
+				static_cast<ZKCircleBar*>(control)->setProgressPic(style.pic);
+			break;
+		case StyleProperty::ThumbPic:
+			if (kind == ControlKind::Slider)
+				static_cast<ZKSeekBar*>(control)->setThumbPic(style.param, style.pic);
+			else
+				static_cast<ZKCircleBar*>(control)->setThumbPic(style.param, style.pic);
+			break;
+		case StyleProperty::TextColor:
+			if (kind == ControlKind::CircularBar)
+				static_cast<ZKCircleBar*>(control)->setTextColor(style.color);
+			else
+				static_cast<ZKTextView*>(control)->setTextColor(style.color);
+			break;
+		case StyleProperty::PenColor:
+			static_cast<ZKDiagram*>(control)->setPenColor(style.param, style.color);
+			break;
+		case StyleProperty::LongMode:
+			static_cast<ZKTextView*>(control)->setLongMode((ZKTextView::ELongMode)style.param);
+			break;
+		case StyleProperty::IconPosition:
+		{
+			ZKButton* button = static_cast<ZKButton*>(control);
+			LayoutPosition pos = button->getPosition();
+			pos.mLeft = 0;
+			pos.mTop = 0;
+			button->setIconPosition(pos);
+			break;
+		}
+		}
+	}
+
+	/// @return the number of properties written
+	static size_t ApplyCompiledTheme(const CompiledTheme& compiled, size_t& controlsChanged)
+	{
+		if (s_styledControls.empty())
+		{
+			BuildStyledControls();
+		}
+
+		// Diffs are worked out once per control type and previously applied theme
+		std::map<std::pair<const CompiledTheme*, ControlKind>, std::vector<size_t>> diffs;
+		size_t writes = 0;
+		controlsChanged = 0;
+		for (auto& styled : s_styledControls)
+		{
+			const StyleTable& table = compiled.kinds[(size_t)styled.kind];
+			const bool overridden = s_overriddenControls.find(styled.control) != s_overriddenControls.end();
+			if (styled.applied == nullptr || overridden)
+			{
+				for (const auto& style : table)
 				{
-					diagram->setPenColor(i, colors->diagram.colors[i]);
+					ApplyStyle(styled.control, styled.kind, style);
 				}
-				continue;
+				writes += table.size();
+				controlsChanged++;
 			}
-			if (typeid(*control) == typeid(ZKSlideWindow))
+			else if (styled.applied != &compiled)
 			{
-				ZKSlideWindow* slideWindow = static_cast<ZKSlideWindow*>(control);
-				slideWindow->setBackgroundColor(colors->slideWindow.bgDefault);
-				slideWindow->setBackgroundPic(colors->slideWindow.bgImage);
-				continue;
+				auto key = std::make_pair(styled.applied, styled.kind);
+				auto it = diffs.find(key);
+				if (it == diffs.end())
+				{
+					it = diffs.insert(std::make_pair(key, std::vector<size_t>())).first;
+					DiffStyleTables(styled.applied->kinds[(size_t)styled.kind], table, it->second);
+				}
+				for (size_t index : it->second)
+				{
+					ApplyStyle(styled.control, styled.kind, table[index]);
+				}
+				writes += it->second.size();
+				if (!it->second.empty())
+					controlsChanged++;
 			}
+			styled.applied = &compiled;
+		}
+		return writes;
+	}
+
+	void TrackOverriddenControl(ZKBase* control)
+	{
+		if (s_trackingOverrides && control != nullptr)
+		{
+			s_overriddenControls.insert(control);
 		}
 	}
 
@@ -319,11 +495,21 @@ namespace UI::Theme
 		info("Set theme to \"%s\"", s_currentTheme->id.c_str());
 
 		s_themedListItems.clear();
-		ZKWindow* window = UI::GetRootWindow();
-		std::vector<ZKBase*> children;
-		window->getAllControls(children);
-		ThemeControls(s_currentTheme->colors, children);
+		const long long start = TimeHelper::getCurrentTime();
+		size_t controlsChanged;
+		const size_t writes = ApplyCompiledTheme(GetCompiledTheme(s_currentTheme), controlsChanged);
+
+		// The controls changed by the overrides are fully themed again by the next theme
+		s_overriddenControls.clear();
+		s_trackingOverrides = true;
 		s_currentTheme->overrides();
+		s_trackingOverrides = false;
+		info("Applied theme \"%s\": %u properties on %u controls, %u overridden, in %lld ms",
+			 s_currentTheme->id.c_str(),
+			 writes,
+			 controlsChanged,
+			 s_overriddenControls.size(),
+			 TimeHelper::getCurrentTime() - start);
 	}
 
 	void ThemeListItem(ZKListView* pListView, ZKListView::ZKListItem* pListItem, int index)
@@ -182,6 +182,10 @@ namespace UI::Theme
 	void SetTheme(const std::string& id);
 	void SetTheme(Theme* theme);
 	void ThemeListItem(ZKListView* pListView, ZKListView::ZKListItem* pListItem, int index);
+
+	/// @brief Called by UI::GetUIControl, records the controls that the theme overrides change so they are fully
+	/// themed again on the next theme switch
+	void TrackOverriddenControl(ZKBase* control);
 } // namespace UI::Theme
 
 #endif /* JNI_UI_COLORS_HPP_ */
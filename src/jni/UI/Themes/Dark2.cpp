@@ -332,6 +332,7 @@ namespace UI::Theme
 				{"screensaver", {.normal = "Dark2/screensaver.png"}},
 				{"buzzer", {.normal = "Dark2/baseline_notifications_active_white_48dp.png"}},
 				{"webcam", {.normal = "Dark2/webcam.png"}},
+				{"http_compression", {}},
 			},
 	};
 
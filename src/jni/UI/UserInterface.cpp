@@ -12,6 +12,7 @@
 #include "Hardware/Duet.h"
 #include "ObjectModel/Files.h"
 #include "ObjectModel/Tool.h"
+#include "UI/Themes.h"
 #include "utils/utils.h"
 #include <algorithm>
 #include <map>
@@ -742,6 +743,21 @@ namespace UI
 		AddMessage(ref);
 	}
 
+	void Console::AddResponses(const std::string& text)
+	{
+		size_t start = 0;
+		size_t end;
+		while ((end = text.find('\n', start)) != std::string::npos)
+		{
+			AddMessage(text.substr(start, end - start).c_str());
+			start = end + 1;
+		}
+		if (start < text.size())
+		{
+			AddMessage(text.c_str() + start);
+		}
+	}
+
 	void Console::AddLineBreak()
 	{
 		AddMessage("");
@@ -749,10 +765,17 @@ namespace UI
 
 	void Console::AddMessage(const char* str)
 	{
-		String<MAX_RESPONSE_LINE_LENGTH> line;
-		line.copy(str);
-		m_buffer.Push(line);
-		info("Adding line to Console buffer[%d] = %s", m_buffer.GetHead(), line.c_str());
+		// Long messages are wrapped onto multiple rows, each only taking up as much of the buffer as it needs
+		size_t len = strlen(str);
+		do
+		{
+			size_t rowLen = std::min(len, (size_t)MAX_RESPONSE_LINE_LENGTH);
+			m_buffer.Push(str, rowLen);
+			const size_t index = m_buffer.GetFilled() - 1;
+			info("Adding line to Console buffer[%d] = %s", index, m_buffer.GetItem(index));
+			str += rowLen;
+			len -= rowLen;
+		} while (len > 0);
 		Refresh();
 	}
 
@@ -764,18 +787,11 @@ namespace UI
 	void Console::Refresh()
 	{
 		m_console->refreshListView();
-		if (!m_buffer.Full())
-			m_console->setSelection(m_buffer.GetHead() - m_console->getRows());
+		m_console->setSelection((int)m_buffer.GetFilled() - m_console->getRows());
 	}
 
 	void Console::Clear()
 	{
-		String<MAX_RESPONSE_LINE_LENGTH> line;
-		line.copy("");
-		for (size_t i = 0; i < MAX_RESPONSE_LINES; i++)
-		{
-			m_buffer.Push(line);
-		}
 		m_buffer.Reset();
 		Refresh();
 	}
@@ -801,6 +817,7 @@ namespace UI
 		{
 			error("Control with id %d not found", id);
 		}
+		Theme::TrackOverriddenControl(control);
 		return control;
 	}
 
@@ -23,6 +23,7 @@
 #include "Comm/FileInfo.h"
 #include "Configuration.h"
 #include "Duet3D/General/CircularBuffer.h"
+#include "Duet3D/General/LineBuffer.h"
 #include "Duet3D/General/String.h"
 #include "Duet3D/General/StringRef.h"
 #include "Duet3D/General/Vector.h"
@@ -141,9 +142,10 @@ namespace UI
 		void AddCommand(const std::string& command);
 		void AddResponse(const char* str);
 		void AddResponse(const StringRef& ref);
+		void AddResponses(const std::string& text); // one response per line of the text
 		void AddLineBreak();
 		size_t GetItemCount() const { return m_buffer.GetFilled(); }
-		String<MAX_RESPONSE_LINE_LENGTH> GetItem(size_t index) { return m_buffer.GetItem(index); }
+		const char* GetItem(size_t index) const { return m_buffer.GetItem(index); }
 		void Refresh();
 		void Clear();
 
@@ -151,7 +153,7 @@ namespace UI
 		void AddMessage(const StringRef& ref);
 		void AddMessage(const char* str);
 
-		CircularBuffer<String<MAX_RESPONSE_LINE_LENGTH>, MAX_RESPONSE_LINES> m_buffer;
+		LineBuffer<MAX_RESPONSE_BUFFER_SIZE, MAX_RESPONSE_LINES> m_buffer;
 		ZKListView* m_console = nullptr;
 		ZKEditText* m_input = nullptr;
 	};
@@ -15,16 +15,18 @@
 #include "Comm/Commands.h"
 #include "ObjectModel/Utils.h"
 #include "uart/CommDef.h"
+#include <pthread.h>
 #include <stdlib.h>
 
 namespace Comm
 {
-	// The following tables will be sorted once on startup so entries can be better grouped for code maintenance
+	// The following tables will be sorted before the first search so entries can be better grouped for code maintenance
 	// A '^' character indicates the position of an _ecv_array index, and a ':' character indicates the start of a
 	// sub-field name
 	FieldTableEntry g_fieldTable[] = {
 		// M409 common fields
 		{rcvKey, "key"},
+		{rcvNext, "next"},
 
 		// M409 K"boards" response
 		{rcvBoardsFirmwareName, "boards^:firmwareName"},
@@ -159,7 +161,11 @@ namespace Comm
 		{rcvControlCommand, "controlCommand"},
 	};
 
-	void SortFieldTable()
+	const size_t g_fieldTableSize = ARRAY_SIZE(g_fieldTable);
+
+	static pthread_once_t s_fieldTableSorted = PTHREAD_ONCE_INIT;
+
+	static void SortFieldTable()
 	{
 		// Sort the g_fieldTable prior searching using binary search
 		qsort(g_fieldTable, ARRAY_SIZE(g_fieldTable), sizeof(FieldTableEntry), compareKey<FieldTableEntry>);
@@ -167,6 +173,8 @@ namespace Comm
 
 	const FieldTableEntry* SearchFieldTable(const char* id)
 	{
+		// Responses are decoded on the UI thread and the network threads, whichever comes first sorts the table
+		pthread_once(&s_fieldTableSorted, SortFieldTable);
 		const FieldTableEntry key = {ReceivedDataEvent::rcvUnknown, id};
 		const FieldTableEntry* searchResult = (FieldTableEntry*)bsearch(
 			&key, g_fieldTable, ARRAY_SIZE(g_fieldTable), sizeof(FieldTableEntry), compareKey<FieldTableEntry>);
@@ -8,6 +8,8 @@
 #ifndef JNI_COMM_COMMANDS_H_
 #define JNI_COMM_COMMANDS_H_
 
+#include <stddef.h>
+
 namespace Comm
 {
 	enum ReceivedDataEvent
@@ -55,6 +57,7 @@ namespace Comm
 		rcvKey,
 		rcvFlags,
 		rcvResult,
+		rcvNext,
 
 		// Available keys
 		rcvOMKeyBoards,
@@ -63,6 +66,7 @@ namespace Comm
 		rcvOMKeyHeat,
 		rcvOMKeyInputs,
 		rcvOMKeyJob,
+		rcvOMKeyJobBuildObjects,
 		rcvOMKeyLimits,
 		rcvOMKeyMove,
 		rcvOMKeyNetwork,
@@ -178,13 +182,13 @@ namespace Comm
 		const char* key;
 	};
 
-	// The following tables will be sorted once on startup so entries can be better grouped for code maintenance
+	// The following tables will be sorted before the first search so entries can be better grouped for code
+	// maintenance
 	// A '^' character indicates the position of an _ecv_array index, and a ':' character indicates the start of a
 	// sub-field name
-	// Needs to be sorted alphabetically by key for binary search to work
 	extern FieldTableEntry g_fieldTable[];
+	extern const size_t g_fieldTableSize;
 
-	void SortFieldTable();
 	const FieldTableEntry* SearchFieldTable(const char* id);
 } // namespace Comm
 
@@ -14,11 +14,20 @@
 
 #include "Comm/Communication.h"
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
 
 #include "Comm/JsonDecoder.h"
+#include "Comm/OmProjection.h"
+#include "Comm/OmSnapshot.h"
 #include "Hardware/Duet.h"
 #include "Hardware/Reset.h"
 #include "Hardware/SerialIo.h"
+#include "Hardware/UartBaudNegotiation.h"
+#include "Hardware/UartUpload.h"
 
 #include "Comm/ControlCommands.h"
 #include "ObjectModel/Alert.h"
@@ -32,6 +41,7 @@
 #include "UI/OmObserver.h"
 #include "uart/CommDef.h"
 #include "utils/TimeHelper.h"
+#include "utils/utils.h"
 
 // These defines control which detailed M409 requests will be sent
 // If one of the fields in the disabled ones need to be fetched the
@@ -56,7 +66,7 @@ namespace Comm
 
 	static long long s_lastResponseTime = 0;
 
-	Seq seqs[] = {
+	static const Seq s_keySeqs[] = {
 #if FETCH_NETWORK
 		{.event = rcvOMKeyNetwork,
 		 .seqid = rcvSeqsNetwork,
@@ -121,6 +131,14 @@ namespace Comm
 #endif
 #if FETCH_JOB
 		{.event = rcvOMKeyJob, .seqid = rcvSeqsJob, .lastSeq = 0, .state = SeqStateInit, .key = "job", .flags = "vn"},
+		// Plates with many objects do not fit in a single response, so the objects are fetched on their own and left
+		// out of the job responses
+		{.event = rcvOMKeyJobBuildObjects,
+		 .seqid = rcvSeqsJob,
+		 .lastSeq = 0,
+		 .state = SeqStateInit,
+		 .key = "job.build.objects",
+		 .flags = "vn"},
 #endif
 #if FETCH_SCANNER
 		{.event = rcvOMKeyScanner,
@@ -156,19 +174,112 @@ namespace Comm
 #endif
 	};
 
+	// The keys above, each followed by the parts it was projected into. Built once, so pointers to entries stay valid
+	static std::vector<Seq> seqs;
+	static bool s_projection = true;
+
 	Seq* g_currentReqSeq = nullptr;
-	Seq* g_currentRespSeq = nullptr;
+
+	static bool IsKeySeq(const char* key)
+	{
+		for (const Seq& seq : s_keySeqs)
+		{
+			if (strcasecmp(seq.key, key) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// The id of the first key fetched on its own that a response to key contains, e.g. "job:build:objects" for "job"
+	static const char* FindSkipId(const char* key, const std::vector<std::string>& separateKeys)
+	{
+		const size_t len = strlen(key);
+		for (const std::string& separate : separateKeys)
+		{
+			if (separate.compare(0, len, key) != 0 || separate.size() <= len || separate[len] != '.')
+				continue;
+			std::string id(separate);
+			std::replace(id.begin(), id.end(), '.', ':');
+			return strdup(id.c_str());
+		}
+		return nullptr;
+	}
+
+	static void BuildSeqs()
+	{
+		std::vector<std::string> separateKeys;
+		for (const Seq& seq : s_keySeqs)
+		{
+			if (strchr(seq.key, '.') != nullptr)
+			{
+				separateKeys.push_back(seq.key);
+			}
+		}
+
+		std::vector<std::vector<std::string>> parts;
+		size_t count = 0;
+		for (const Seq& seq : s_keySeqs)
+		{
+			// Keys that are already part of another key, e.g. job.build.objects, are left as they are
+			parts.push_back(strchr(seq.key, '.') == nullptr ? GetObservedPaths(seq.key, separateKeys)
+															: std::vector<std::string>());
+			count += 1 + parts.back().size();
+		}
+
+		seqs.reserve(count);
+		for (size_t i = 0; i < ARRAY_SIZE(s_keySeqs); i++)
+		{
+			const Seq& seq = s_keySeqs[i];
+			seqs.push_back(seq);
+			seqs.back().split = !parts[i].empty();
+			seqs.back().paged = strchr(seq.key, '.') != nullptr;
+			seqs.back().skipId = FindSkipId(seq.key, separateKeys);
+			for (const std::string& path : parts[i])
+			{
+				if (IsKeySeq(path.c_str()))
+					continue;
+				seqs.push_back({.event = seq.event,
+								.seqid = seq.seqid,
+								.lastSeq = 0,
+								.state = SeqStateInit,
+								.key = strdup(path.c_str()),
+								.flags = seq.flags,
+								.start = 0,
+								.next = 0,
+								.pageFlags = {},
+								.group = seq.key,
+								.split = false,
+								.size = 0,
+								.paged = false,
+								.skipId = FindSkipId(path.c_str(), separateKeys)});
+			}
+			if (!parts[i].empty())
+			{
+				info("Requesting %s as %u parts", seq.key, parts[i].size());
+			}
+		}
+	}
+
+	// A key split into parts is requested either whole or as its parts
+	static bool IsSeqActive(const Seq& seq)
+	{
+		return s_projection ? !seq.split : seq.group == nullptr;
+	}
 
 	struct Seq* GetNextSeq(struct Seq* current)
 	{
+		if (seqs.empty())
+			return nullptr;
 		if (current == nullptr)
 		{
-			current = seqs;
+			current = &seqs[0];
 		}
 
-		for (size_t i = current - seqs; i < ARRAY_SIZE(seqs); ++i)
+		for (size_t i = current - &seqs[0]; i < seqs.size(); ++i)
 		{
 			current = &seqs[i];
+			if (!IsSeqActive(*current))
+				continue;
 			if (current->state == SeqStateError)
 			{
 				warn("seq %s had an error\n", current->key);
@@ -189,7 +300,7 @@ namespace Comm
 	{
 		verbose("key %s\n", key);
 
-		for (size_t i = 0; i < ARRAY_SIZE(seqs); ++i)
+		for (size_t i = 0; i < seqs.size(); ++i)
 		{
 			if (strcasecmp(seqs[i].key, key) == 0)
 			{
@@ -202,7 +313,7 @@ namespace Comm
 
 	void UpdateSeq(const ReceivedDataEvent seqid, int32_t val)
 	{
-		for (size_t i = 0; i < ARRAY_SIZE(seqs); ++i)
+		for (size_t i = 0; i < seqs.size(); ++i)
 		{
 			if (seqs[i].seqid == seqid)
 			{
@@ -211,6 +322,7 @@ namespace Comm
 					dbg("%s %d -> %d\n", seqs[i].key, seqs[i].lastSeq, val);
 					seqs[i].lastSeq = val;
 					seqs[i].state = SeqStateUpdate;
+					seqs[i].next = 0; // Start again from the first element
 				}
 			}
 		}
@@ -218,10 +330,11 @@ namespace Comm
 
 	void ResetSeqs()
 	{
-		for (size_t i = 0; i < ARRAY_SIZE(seqs); ++i)
+		for (size_t i = 0; i < seqs.size(); ++i)
 		{
 			seqs[i].lastSeq = 0;
 			seqs[i].state = SeqStateInit;
+			seqs[i].next = 0;
 		}
 	}
 
@@ -302,6 +415,40 @@ namespace Comm
 		ResetSeqs();
 	}
 
+	void SetOmProjection(bool enabled)
+	{
+		if (enabled == s_projection)
+			return;
+		info("Object model projection %s", enabled ? "on" : "off");
+		s_projection = enabled;
+		g_currentReqSeq = nullptr;
+		ResetSeqs();
+	}
+
+	bool GetOmProjection()
+	{
+		return s_projection;
+	}
+
+	std::string GetOmProjectionSummary()
+	{
+		std::string summary;
+		for (const Seq& seq : seqs)
+		{
+			if (!seq.split)
+				continue;
+			uint32_t partsSize = 0;
+			std::string partKeys;
+			for (const Seq* part = &seq + 1; part <= &seqs.back() && part->group == seq.key; part++)
+			{
+				partsSize += part->size;
+				partKeys += utils::format(" %s(%u)", part->key, part->size);
+			}
+			summary += utils::format("%s: whole %u, parts %u:%s\n", seq.key, seq.size, partsSize, partKeys.c_str());
+		}
+		return summary;
+	}
+
 	void KickWatchdog()
 	{
 		s_lastResponseTime = TimeHelper::getCurrentTime();
@@ -309,33 +456,72 @@ namespace Comm
 
 	//------------------------------------------------------------------------------------------------------------------
 
+	static void RequestSeq(Seq* seq)
+	{
+		seq->start = seq->next;
+		if (seq->start == 0)
+		{
+			info("requesting %s\n", seq->key);
+			Comm::DUET.RequestModel(seq->key, seq->flags);
+		}
+		else
+		{
+			info("requesting %s from %u\n", seq->key, seq->start);
+			snprintf(seq->pageFlags, sizeof(seq->pageFlags), "%sa%u", seq->flags, seq->start);
+			Comm::DUET.RequestModel(seq->key, seq->pageFlags);
+		}
+	}
+
 	void sendNext()
 	{
+		// Requests would be sent at the wrong rate while the UART is switching, and written into the file while
+		// uploading
+		if (IsUartBaudNegotiating() || IsUartUploading())
+			return;
+
 		long long now = TimeHelper::getCurrentTime();
 		if (now > (s_lastResponseTime + DUET.GetScaledPollInterval() + PRINTER_REQUEST_TIMEOUT))
 		{
 			Reconnect();
 		}
 
+		if (DUET.IsModelPushed())
+		{
+			// DSF's object model has no seqs.reply to say that a reply is waiting
+			DUET.PollReply();
+			UI::HomeScreen::UpdateTemperatureGraph();
+			SaveOmSnapshotIfChanged();
+			return;
+		}
+
 		g_currentReqSeq = GetNextSeq(g_currentReqSeq);
 		if (g_currentReqSeq != nullptr)
 		{
 			Comm::DUET.RequestModel("state", "vn"); // Check if state is halted, if so we need to send M999
-			info("requesting %s\n", g_currentReqSeq->key);
-			Comm::DUET.RequestModel(g_currentReqSeq->key, g_currentReqSeq->flags);
+			RequestSeq(g_currentReqSeq);
+			// The parts of a projected key are small, the ones still pending go out together
+			while (g_currentReqSeq->group != nullptr)
+			{
+				Seq* next = GetNextSeq(g_currentReqSeq + 1);
+				if (next == nullptr || next->group != g_currentReqSeq->group)
+					break;
+				g_currentReqSeq = next;
+				RequestSeq(g_currentReqSeq);
+			}
 		}
 		else
 		{
 			Comm::DUET.RequestModel("d99f");
 		}
 		UI::HomeScreen::UpdateTemperatureGraph();
+		SaveOmSnapshotIfChanged();
 	}
 
 	void init()
 	{
-		// Sort the fieldTable prior searching using binary search
-		system("mkdir /tmp/thumbnails");
-		system("mkdir /tmp/heightmaps");
-		SortFieldTable();
+		// The field table is sorted on the first search
+		mkdir("/tmp/thumbnails", 0777);
+		mkdir("/tmp/heightmaps", 0777);
+		BuildSeqs();
 	}
 } // namespace Comm
@@ -10,6 +10,7 @@
 
 #include "Comm/Commands.h"
 #include <stdint.h>
+#include <string>
 #include "FileInfo.h"
 
 namespace Comm
@@ -34,10 +35,24 @@ namespace Comm
 
 		const char* const key;
 		const char* const flags;
+
+		// Keys whose result is an array may be split over several responses. "next" in a response is the index of
+		// the first element that did not fit, which is requested next using the "a" flag
+		uint16_t start; // First element of the response being received
+		uint16_t next;
+		char pageFlags[16];
+
+		// While the object model is projected, a key is requested as the parts the UI observes, see OmProjection.h
+		const char* group; // Key this part was projected from, nullptr for a whole key
+		bool split;		   // Whole key that has been projected into parts
+		uint32_t size;	   // Bytes of the last complete response, over all its pages
+
+		// Keys below another key, e.g. job.build.objects, are fetched on their own so their arrays can be paged
+		bool paged;			// Key fetched on its own, the end of its result array is only passed on after the last page
+		const char* skipId; // Id of such a key inside this key's responses, which is left to that key. Or nullptr
 	};
 
 	extern Seq* g_currentReqSeq;
-	extern Seq* g_currentRespSeq;
 
 	bool GetInteger(const char s[], int32_t& rslt);
 	bool GetUnsignedInteger(const char s[], unsigned int& rslt);
@@ -49,6 +64,12 @@ namespace Comm
 	void UpdateSeq(const ReceivedDataEvent seqid, int32_t val);
 	void ResetSeqs();
 
+	/// @brief Request the observed parts of keys rather than whole keys, on by default
+	void SetOmProjection(bool enabled);
+	bool GetOmProjection();
+	/// @brief Response sizes of each key, whole and as its parts, from the last time each was received
+	std::string GetOmProjectionSummary();
+
 	void KickWatchdog();
 
 	Seq* GetNextSeq(struct Seq* current);
@@ -12,10 +12,13 @@
 
 #include "Configuration.h"
 #include "Hardware/Duet.h"
+#include "ThumbnailListCache.h"
+#include "ThumbnailWorker.h"
 #include "ObjectModel/Job.h"
 #include "ObjectModel/PrinterStatus.h"
 #include "UI/Logic/FileList.h"
 #include "UI/UserInterface.h"
+#include "timer.h"
 #include "utils/utils.h"
 #include <sys/stat.h>
 #include <utils/TimeHelper.h>
@@ -34,6 +37,7 @@ namespace Comm
 		{
 			if (thumbnail == nullptr)
 				continue;
+			CancelThumbnailJobs(thumbnail);
 			delete thumbnail;
 		}
 	}
@@ -66,6 +70,7 @@ namespace Comm
 		{
 			if (m_thumbnails[i] == nullptr)
 				continue;
+			CancelThumbnailJobs(m_thumbnails[i]);
 			delete m_thumbnails[i];
 			count++;
 		}
@@ -84,6 +89,9 @@ namespace Comm
 
 	void FileInfoCache::Spin()
 	{
+		// Decoded chunks move their thumbnails on to the next state
+		RunThumbnailCompletions();
+
 		// Update status message
 		UI::GetUIControl<ZKTextView>(ID_MAIN_FileListInfo)
 			->setTextTrf(
@@ -184,8 +192,8 @@ namespace Comm
 				m_currentThumbnail->context.state = ThumbnailState::DataWait;
 				return;
 			case ThumbnailState::Cached:
-				m_currentThumbnail->image.Close();
 				info("Updating thumbnail %s", m_currentThumbnail->filename.c_str());
+				InvalidateListThumbnail(m_currentThumbnail->filename.c_str());
 				UI::FileList::GetThumbnail()->setText("");
 				UI::GetUIControl<ZKListView>(ID_MAIN_FileListView)->refreshListView();
 				if (m_currentThumbnail->AboveCacheLimit())
@@ -197,12 +205,15 @@ namespace Comm
 					if (GetFileSize(currentJobThumbnailFilePath) <
 						GetFileSize(m_currentThumbnail->GetThumbnailPath().c_str()))
 					{
-						system(utils::format("cp %s %s",
-											 m_currentThumbnail->GetThumbnailPath().c_str(),
-											 currentJobThumbnailFilePath)
-								   .c_str());
-						UI::GetUIControl<ZKTextView>(ID_MAIN_PrintThumbnail)
-							->setBackgroundPic(currentJobThumbnailFilePath);
+						QueueThumbnailCopy(m_currentThumbnail->GetThumbnailPath(),
+										   currentJobThumbnailFilePath,
+										   [](bool ok)
+										   {
+											   if (!ok)
+												   return;
+											   UI::GetUIControl<ZKTextView>(ID_MAIN_PrintThumbnail)
+												   ->setBackgroundPic(currentJobThumbnailFilePath);
+										   });
 					}
 					m_currentCachedJobPath = OM::GetJobName();
 				}
@@ -376,9 +387,22 @@ namespace Comm
 		{
 			m_fileInfoRequestQueue.push_back(filepath);
 		}
+		Wake();
 		return true;
 	}
 
+	void FileInfoCache::Wake()
+	{
+		setUserTimerPeriod(TIMER_THUMBNAIL, FILE_CACHE_POLL_INTERVAL);
+	}
+
+	bool FileInfoCache::IsIdle() const
+	{
+		return !m_fileInfoRequestInProgress && !m_thumbnailRequestInProgress && m_currentThumbnail == nullptr &&
+			   m_queuedLargeThumbnail == nullptr && m_fileInfoRequestQueue.empty() && m_thumbnailRequestQueue.empty() &&
+			   IsThumbnailWorkerIdle();
+	}
+
 	bool FileInfoCache::QueueThumbnailRequest(const std::string& filepath)
 	{
 		if (m_currentThumbnail != nullptr && m_currentThumbnail->filename.Equals(filepath.c_str()))
@@ -413,9 +437,31 @@ namespace Comm
 			return false;
 		}
 		m_thumbnailRequestQueue.push_back(largestValidThumbnail);
+		Wake();
 		return true;
 	}
 
+	bool FileInfoCache::PrioritiseThumbnailRequest(const std::string& filepath)
+	{
+		for (auto it = m_thumbnailRequestQueue.begin(); it != m_thumbnailRequestQueue.end(); ++it)
+		{
+			if (!(*it)->filename.Equals(filepath.c_str()))
+				continue;
+			Thumbnail* thumbnail = *it;
+			m_thumbnailRequestQueue.erase(it);
+			m_thumbnailRequestQueue.push_front(thumbnail);
+			return true;
+		}
+
+		// The thumbnail is only queued once the file info has arrived
+		for (auto& queuedPath : m_fileInfoRequestQueue)
+		{
+			if (queuedPath == filepath)
+				return QueueFileInfoRequest(filepath, true);
+		}
+		return false;
+	}
+
 	bool FileInfoCache::QueueLargeThumbnailRequest(const std::string& filepath)
 	{
 		m_queuedLargeThumbnail = nullptr;
@@ -457,6 +503,7 @@ namespace Comm
 			 largestThumbnail->meta.size,
 			 largestThumbnail->meta.offset);
 		m_queuedLargeThumbnail = largestThumbnail;
+		Wake();
 		return true;
 	}
 
@@ -481,6 +528,8 @@ namespace Comm
 			return false;
 		}
 
+		// A chunk of an earlier request may still be decoding into the image
+		CancelThumbnailJobs(thumbnail);
 		thumbnail->context.Init();
 		if (thumbnail->filename.IsEmpty() || thumbnail->meta.offset == 0)
 		{
@@ -507,6 +556,7 @@ namespace Comm
 		thumbnail->context.state = ThumbnailState::DataWait;
 		m_lastThumbnailRequestTime = TimeHelper::getCurrentTime();
 		DUET.RequestThumbnail(thumbnail->filename.c_str(), thumbnail->meta.offset);
+		Wake();
 		return true;
 	}
 
@@ -649,16 +699,12 @@ namespace Comm
 	size_t GetFileSize(const char* filepath)
 	{
 		struct stat sb;
-		if (system(utils::format("test -f \"%s\"", filepath).c_str()) == 0)
+		if (stat(filepath, &sb) == -1 || !S_ISREG(sb.st_mode))
 		{
-			if (stat(filepath, &sb) == -1)
-			{
-				// File doesn't exist
-				return 0;
-			}
-			return sb.st_size;
+			// File doesn't exist
+			return 0;
 		}
-		return 0;
+		return sb.st_size;
 	}
 
 	static Debug::DebugCommand s_dbgFileInfoCache("dbg_file_info_cache",
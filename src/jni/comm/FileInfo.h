@@ -10,6 +10,7 @@
 
 #include "Thumbnail.h"
 
+#include "AllocationTracker.h"
 #include "Comm/Commands.h"
 #include "Configuration.h"
 #include "Duet3D/General/String.h"
@@ -24,7 +25,7 @@ namespace Comm
 	constexpr const char* largeThumbnailFilename = "largeThumbnail";
 	constexpr const char* currentJobThumbnailFilePath = "/tmp/currentJobThumbnail";
 
-	struct FileInfo
+	struct FileInfo : public Memory::Tracked<Memory::Subsystem::Thumbnails>
 	{
 	  public:
 		FileInfo();
@@ -76,6 +77,8 @@ namespace Comm
 
 		bool QueueThumbnailRequest(const std::string& filepath);	  // returns true if the request was queued
 		bool QueueLargeThumbnailRequest(const std::string& filepath); // returns true if a thumbnail request was started
+		bool PrioritiseThumbnailRequest(const std::string& filepath); // moves a queued request for the file to the
+																	  // front, returns true if one was queued
 		bool RequestThumbnail(FileInfo& fileInfo,
 							  size_t index);			 // returns true if a thumbnail request was started
 		bool RequestThumbnail(Thumbnail* thumbnail);	 // returns true if a thumbnail request was started
@@ -86,6 +89,7 @@ namespace Comm
 															// processing thumbnail request. Will return nullptr if you
 															// the response has not been received, unless you use force
 		bool StopThumbnailRequest(bool largeOnly = false);
+		bool IsIdle() const; // returns true if there are no requests queued or in progress
 
 		void Debug(); // prints debug info
 
@@ -94,6 +98,7 @@ namespace Comm
 
 		bool QueueFileInfoRequest(const std::string& filepath,
 								  bool next = false);	// queues a file info request if not already queued
+		void Wake();									// switches Spin back to the fast poll interval
 		void SetCurrentThumbnail(Thumbnail* thumbnail); // set and return the current thumbnail being received
 		Thumbnail* GetNextThumbnail();					// returns the thumbnail for the next queued thumbail
 														// request, or nullptr if queue is empty.
@@ -17,8 +17,12 @@
 #include "Comm/Commands.h"
 #include "Comm/Communication.h"
 #include "Comm/ControlCommands.h"
+#include "Comm/OmSnapshot.h"
+#include "Comm/RequestTrace.h"
+#include "Comm/ThumbnailWorker.h"
 #include "Hardware/Reset.h"
 #include "Hardware/SerialIo.h"
+#include "Hardware/UartBaudNegotiation.h"
 #include "JsonDecoder.h"
 #include "ObjectModel/Alert.h"
 #include "ObjectModel/Job.h"
@@ -27,7 +31,10 @@
 #include "UI/OmObserver.h"
 #include "uart/UartContext.h"
 #include "utils/utils.h"
+#include <pthread.h>
+#include <string.h>
 #include <string>
+#include <system/Mutex.h>
 
 #include "Debug.h"
 
@@ -156,25 +163,57 @@ namespace Comm
 	const char* _ecv_array const trCedilla = "C\xC7"
 											 "c\xE7";
 
-	JsonDecoder::JsonDecoder() : m_serialIoErrors(0), m_nextOut(0), m_inError(false), m_arrayDepth(0)
+	JsonDecoder::JsonDecoder()
+		: m_serialIoErrors(0), m_nextOut(0), m_inError(false), m_arrayDepth(0), m_isModelResponse(false),
+		  m_sliceStart(0), m_messageTime(0), m_observerTime(0), m_messageBytes(0), m_respSeq(nullptr),
+		  m_resultEndPending(false), m_trackedSize(sizeof(JsonDecoder))
 	{
 		for (size_t i = 0; i < MAX_ARRAY_NESTING; i++)
 		{
 			m_arrayIndices[i] = 0;
+			m_resultEndIndices[i] = 0;
 		}
 	}
 
-	void JsonDecoder::StartReceivedMessage() {}
+	void JsonDecoder::StartReceivedMessage()
+	{
+		m_isModelResponse = false;
+		m_responseKey.Clear();
+		m_sliceStart = TraceNow();
+		m_messageTime = 0;
+		m_observerTime = 0;
+		m_messageBytes = 1; // The opening brace
+		m_respSeq = nullptr;
+		m_resultEndPending = false;
+	}
 
 	void JsonDecoder::EndReceivedMessage()
 	{
 		KickWatchdog();
 
-		if (g_currentRespSeq != nullptr)
+		// A message may arrive over several calls to CheckInput, only the time spent in them counts
+		const int64_t now = TraceNow();
+		m_messageTime += now - m_sliceStart;
+		m_sliceStart = now;
+		TraceMessageEnd(m_isModelResponse,
+						m_responseKey.c_str(),
+						m_messageTime > m_observerTime ? m_messageTime - m_observerTime : 0,
+						m_observerTime);
+
+		if (m_respSeq != nullptr)
 		{
-			g_currentRespSeq->state = SeqStateOk;
-			dbg("seq %s %d DONE", g_currentRespSeq->key, g_currentRespSeq->state);
-			g_currentRespSeq = nullptr;
+			if (m_resultEndPending && m_respSeq->next == 0)
+			{
+				ProcessArrayEnd(m_resultEndId.c_str(), m_resultEndIndices);
+			}
+			m_resultEndPending = false;
+			EndOmSnapshotSection(m_respSeq->key, m_respSeq->next == 0);
+			// Pages of an array add up to the size of the whole response
+			m_respSeq->size = (m_respSeq->start == 0 ? 0 : m_respSeq->size) + m_messageBytes;
+			// More elements to fetch, the seq is requested again from the next element
+			m_respSeq->state = m_respSeq->next != 0 ? SeqStateUpdate : SeqStateOk;
+			dbg("seq %s %d DONE", m_respSeq->key, m_respSeq->state);
+			m_respSeq = nullptr;
 		}
 
 		// FileManager::EndReceivedMessage();
@@ -221,8 +260,6 @@ namespace Comm
 					thumbnail->meta.height);
 			}
 #endif
-			int ret;
-
 			verbose("thumbnail->context state %d", thumbnail->context.state);
 			switch (thumbnail->context.state)
 			{
@@ -237,19 +274,22 @@ namespace Comm
 					thumbnail->context.state = ThumbnailState::Init;
 					break;
 				}
-				if ((ret = ThumbnailDecodeChunk(*thumbnail, g_thumbnailBuf)) < 0)
+				// The state stays Data until the worker has decoded the chunk
+				if (!QueueThumbnailDecode(thumbnail,
+										  g_thumbnailBuf,
+										  [thumbnail](bool ok)
+										  {
+											  if (!ok)
+											  {
+												  thumbnail->context.state = ThumbnailState::Init;
+												  return;
+											  }
+											  thumbnail->context.state = thumbnail->context.next == 0
+																			 ? ThumbnailState::Cached
+																			 : ThumbnailState::DataRequest;
+										  }))
 				{
-					error("failed to decode thumbnail chunk %d.\n", ret);
 					thumbnail->context.state = ThumbnailState::Init;
-					break;
-				}
-				if (thumbnail->context.next == 0)
-				{
-					thumbnail->context.state = ThumbnailState::Cached;
-				}
-				else
-				{
-					thumbnail->context.state = ThumbnailState::DataRequest;
 				}
 				break;
 			default:
@@ -266,42 +306,86 @@ namespace Comm
 		responseData = nullptr;
 	}
 
-	// Public functions called by the SerialIo module
-	void JsonDecoder::ProcessReceivedValue(StringRef id, const char data[], const size_t indices[])
+	// Returns the indices to report for a value of a response, which are offset by the first element of the response
+	// when the result is part of a longer array
+	static const size_t* OffsetIndices(const Seq* seq, bool inResult, const size_t indices[], size_t offsetIndices[])
 	{
-		dbg("%s (indices [%d|%d|%d|%d]) = %s", id.c_str(), indices[0], indices[1], indices[2], indices[3], data);
-		if (StringStartsWith(id.c_str(), "result"))
+		if (!inResult || seq == nullptr || seq->start == 0)
+			return indices;
+
+		for (size_t i = 0; i < MAX_ARRAY_NESTING; i++)
 		{
-			// We might either get something like:
-			// * "result[optional modified]:[key]:[field]" for a live response or
-			// * "result[optional modified]:[field]" for a detailed response
-			// If live response remove "result:"
-			// else replace "result" by "key" (do NOT replace anything beyond "result" as there might be an _ecv_array
-			// modifier)
-
-			id.Erase(0, 6);
-			if (g_currentRespSeq != nullptr)
-			{
-				id.Prepend(g_currentRespSeq->key);
-			}
-			else
-			{
-				// if empty key also erase the colon
-				id.Erase(0);
-			}
+			offsetIndices[i] = indices[i];
 		}
+		offsetIndices[0] += seq->start;
+		return offsetIndices;
+	}
 
-		// search for key in g_observerMap
-		verbose("searching for observers for %s\n", id.c_str());
-		auto observers = UI::g_observerMap.GetObservers(id.c_str());
-		if (observers.size() != 0)
+	// True if the id belongs to a key that is fetched on its own, so its values in this response are ignored
+	static bool IsSkippedId(const Seq* seq, const char* id)
+	{
+		if (seq == nullptr || seq->skipId == nullptr)
+			return false;
+		const size_t len = strlen(seq->skipId);
+		return strncmp(id, seq->skipId, len) == 0 &&
+			   (id[len] == '\0' || id[len] == ':' || id[len] == '^');
+	}
+
+	bool JsonDecoder::MapResultId(StringRef id)
+	{
+		if (!StringStartsWith(id.c_str(), "result"))
+			return false;
+
+		// We might either get something like:
+		// * "result[optional modified]:[key]:[field]" for a live response or
+		// * "result[optional modified]:[field]" for a detailed response
+		// If live response remove "result:"
+		// else replace "result" by "key" (do NOT replace anything beyond "result" as there might be an _ecv_array
+		// modifier)
+
+		id.Erase(0, 6);
+		if (m_respSeq != nullptr)
 		{
-			dbg("found %d observers for %s\n", observers.size(), id.c_str());
-			for (auto& observer : observers)
+			id.Prepend(m_respSeq->key);
+			// Keys of nested objects are requested with '.' separators
+			for (size_t i = 0; i < strlen(m_respSeq->key) && i < id.strlen(); i++)
 			{
-				observer.Update(this, data, indices);
+				if (id[i] == '.')
+					id[i] = ':';
 			}
 		}
+		else
+		{
+			// if empty key also erase the colon
+			id.Erase(0);
+		}
+		return true;
+	}
+
+	// Public functions called by the SerialIo module
+	void JsonDecoder::ProcessReceivedValue(StringRef id, const char data[], const size_t rawIndices[])
+	{
+		dbg("%s (indices [%d|%d|%d|%d]) = %s",
+			id.c_str(),
+			rawIndices[0],
+			rawIndices[1],
+			rawIndices[2],
+			rawIndices[3],
+			data);
+		size_t offsetIndices[MAX_ARRAY_NESTING];
+		const bool inResult = MapResultId(id);
+		if (inResult && IsSkippedId(m_respSeq, id.c_str()))
+		{
+			verbose("%s is fetched on its own", id.c_str());
+			return;
+		}
+		const size_t* indices = OffsetIndices(m_respSeq, inResult, rawIndices, offsetIndices);
+
+		NotifyObservers(id.c_str(), data, indices);
+		if (m_respSeq != nullptr)
+		{
+			RecordOmSnapshotValue(m_respSeq->key, id.c_str(), data, indices);
+		}
 
 		const FieldTableEntry* searchResult = SearchFieldTable(id.c_str());
 		// no matching key found
@@ -317,20 +401,35 @@ namespace Comm
 		// M409 section
 		// TODO: Uncomment stuff below related to UI/OM
 		case rcvKey: {
+			m_isModelResponse = true;
+			m_responseKey.copy(data);
+
 			// try a quick check otherwise search for key
 			if (g_currentReqSeq && (strcasecmp(data, g_currentReqSeq->key) == 0))
 			{
-				g_currentRespSeq = g_currentReqSeq;
+				m_respSeq = g_currentReqSeq;
 			}
 			else
 			{
-				g_currentRespSeq = FindSeqByKey(data);
+				m_respSeq = FindSeqByKey(data);
 			}
 
-			if (g_currentRespSeq == nullptr)
+			if (m_respSeq == nullptr)
 			{
 				break;
 			}
+			m_respSeq->next = 0;
+			StartOmSnapshotSection(m_respSeq->key, m_respSeq->start == 0);
+		}
+		break;
+
+		case rcvNext: {
+			unsigned int next;
+			if (m_isModelResponse && m_respSeq != nullptr && GetUnsignedInteger(data, next))
+			{
+				dbg("%s continues from element %u", m_respSeq->key, next);
+				m_respSeq->next = next;
+			}
 		}
 		break;
 
@@ -389,6 +488,23 @@ namespace Comm
 		}
 	}
 
+	void JsonDecoder::NotifyObservers(const char id[], const char data[], const size_t indices[])
+	{
+		// search for key in g_observerMap
+		verbose("searching for observers for %s\n", id);
+		auto observers = UI::g_observerMap.GetObservers(id);
+		if (observers.size() != 0)
+		{
+			dbg("found %d observers for %s\n", observers.size(), id);
+			const int64_t start = TraceNow();
+			for (auto& observer : observers)
+			{
+				observer.Update(this, data, indices);
+			}
+			m_observerTime += TraceNow() - start;
+		}
+	}
+
 	// Public function called when the serial I/O module finishes receiving an array of values
 	void JsonDecoder::ProcessArrayEnd(const char id[], const size_t indices[])
 	{
@@ -396,10 +512,12 @@ namespace Comm
 		auto observers = UI::g_observerMapArrayEnd.GetObservers(id);
 		if (observers.size() != 0)
 		{
+			const int64_t start = TraceNow();
 			for (auto& observer : observers)
 			{
 				observer.Update(this, indices);
 			}
+			m_observerTime += TraceNow() - start;
 		}
 	}
 
@@ -412,12 +530,13 @@ namespace Comm
 			UI::CONSOLE.AddResponse(utils::format("Warning: received %d malformed responses.", errors).c_str());
 			error("Warning: received %d malformed responses for id \"%s\"", errors, id);
 		}
-		if (g_currentRespSeq == nullptr)
+		ReportUartResponseErrors(errors);
+		if (m_respSeq == nullptr)
 		{
 			return;
 		}
 
-		g_currentRespSeq->state = SeqStateError;
+		m_respSeq->state = SeqStateError;
 	}
 
 	void JsonDecoder::RemoveLastId()
@@ -469,7 +588,36 @@ namespace Comm
 			m_arrayIndices[3],
 			m_arrayDepth);
 
-		ProcessArrayEnd(m_fieldId.c_str(), m_arrayIndices);
+		String<MAX_JSON_ID_LENGTH> id;
+		id.copy(m_fieldId.c_str());
+		size_t offsetIndices[MAX_ARRAY_NESTING];
+		const bool inResult = MapResultId(id.GetRef());
+		const size_t* indices = OffsetIndices(m_respSeq, inResult, m_arrayIndices, offsetIndices);
+		if (!inResult || m_respSeq == nullptr || !m_respSeq->paged)
+		{
+			// Array-end observers of other model responses only ever see the raw "result" ids
+			ProcessArrayEnd(m_fieldId.c_str(), m_arrayIndices);
+		}
+		else if (m_arrayDepth == 1)
+		{
+			// The end of a page is not the end of the array. "next" follows the result, so this waits for the end of
+			// the response to see whether more pages follow
+			m_resultEndPending = true;
+			m_resultEndId.copy(id.c_str());
+			for (size_t i = 0; i < MAX_ARRAY_NESTING; i++)
+			{
+				m_resultEndIndices[i] = indices[i];
+			}
+		}
+		else
+		{
+			ProcessArrayEnd(id.c_str(), indices);
+		}
+		if (m_respSeq != nullptr && inResult && !IsSkippedId(m_respSeq, id.c_str()))
+		{
+			// Recorded with the mapped id, a raw "result^" would not reach any observer when replayed
+			RecordOmSnapshotArrayEnd(m_respSeq->key, id.c_str(), indices);
+		}
 
 		if (m_arrayDepth != 0)
 		{ // should always be true
@@ -677,15 +825,40 @@ namespace Comm
 	}
 
 	// This is the JSON parser state machine
+	static Mutex s_observerLock;
+	static volatile bool s_observerLocked = false;
+	static pthread_t s_observerOwner;
+
+	JsonDecoder::ObserverGuard::ObserverGuard()
+		: m_nested(s_observerLocked && pthread_equal(s_observerOwner, pthread_self()))
+	{
+		if (m_nested)
+			return;
+		s_observerLock.lock();
+		s_observerOwner = pthread_self();
+		s_observerLocked = true;
+	}
+
+	JsonDecoder::ObserverGuard::~ObserverGuard()
+	{
+		if (m_nested)
+			return;
+		s_observerLocked = false;
+		s_observerLock.unlock();
+	}
+
 	void JsonDecoder::CheckInput(const unsigned char* rxBuffer, unsigned int len)
 	{
+		ObserverGuard observerGuard;
 		m_nextOut = 0;
-		dbg("CheckInput[%d]: %s", len, rxBuffer);
+		m_sliceStart = TraceNow();
+		dbg("CheckInput[%d]: %.*s", len, (int)len, rxBuffer);
 		while (len != m_nextOut)
 		{
 			char c = rxBuffer[m_nextOut];
 			// verbose("char %d: %c", m_nextOut, c);
 			m_nextOut = (m_nextOut + 1) % (len + 1);
+			m_messageBytes++;
 			if (c == '\n')
 			{
 				if (m_state == jsError)
@@ -697,7 +870,7 @@ namespace Comm
 					ParserErrorEncountered(m_lastState,
 										   m_fieldId.c_str(),
 										   m_serialIoErrors); // Notify the consumer that we ran into an error
-					error("rxBuffer: %s", rxBuffer);
+					error("rxBuffer: %.*s", (int)len, rxBuffer);
 					m_lastState = jsBegin;
 				}
 				m_state = jsBegin; // abandon current parse (if any) and start again
@@ -916,27 +1089,9 @@ namespace Comm
 							}
 							break;
 						case 'u':
-						{
-							if (len - m_nextOut < 4)
-							{
-								m_state = jsError;
-								jserror("jsUnicodeEscape, not enough characters left in buffer for \\uXXXX");
-								break;
-							}
-							const char* code = (const char*)(rxBuffer + m_nextOut);
-							// DSF replaces `+` with `\u002B` for some messages (e.g. rr_thumbnail)
-							if (strncmp(code, "002B", 4) == 0)
-							{
-								m_fieldVal.cat('+');
-							}
-							else
-							{
-								m_state = jsError;
-								jserror("jsUnicodeEscape, unknown code %s", code);
-							}
-							m_nextOut += 4;
+							m_unicodeVal.Clear();
+							m_state = jsUnicode;
 							break;
-						}
 						case 'b':
 						case 'f':
 						case 'r':
@@ -944,6 +1099,25 @@ namespace Comm
 							break;
 						}
 					}
+					if (m_state != jsUnicode)
+					{
+						m_state = jsStringVal;
+					}
+					break;
+
+				case jsUnicode: // had "\u" in a string, expecting 4 hex digits
+					m_unicodeVal.cat(c);
+					if (m_unicodeVal.strlen() < 4)
+						break;
+					// DSF replaces `+` with `\u002B` for some messages (e.g. rr_thumbnail)
+					if (m_unicodeVal.Equals("002B"))
+					{
+						m_fieldVal.cat('+');
+					}
+					else
+					{
+						jserror("jsUnicode, unknown code %s", m_unicodeVal.c_str());
+					}
 					m_state = jsStringVal;
 					break;
 
@@ -1032,6 +1206,7 @@ namespace Comm
 #endif
 			}
 		}
+		m_messageTime += TraceNow() - m_sliceStart;
 	}
 
 	// Called by the ISR to signify an error. We wait for the next end of line.
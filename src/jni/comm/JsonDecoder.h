@@ -11,6 +11,7 @@
 #ifndef JNI_COMM_JSONDECODER_H_
 #define JNI_COMM_JSONDECODER_H_
 
+#include "AllocationTracker.h"
 #include "Comm/FileInfo.h"
 #include "Configuration.h"
 #include "ecv.h"
@@ -24,6 +25,8 @@
 
 namespace Comm
 {
+	struct Seq;
+
 	class JsonDecoder
 	{
 	  public:
@@ -34,7 +37,7 @@ namespace Comm
 			thumbnail,
 		};
 
-		struct FileListData
+		struct FileListData : public Memory::Tracked<Memory::Subsystem::Json>
 		{
 			std::string dir = "";
 			uint32_t first = 0;
@@ -55,6 +58,7 @@ namespace Comm
 			jsVal,			// had ':', expecting value
 			jsStringVal,	// had '"' and expecting or in a string value
 			jsStringEscape, // just had backslash in a string
+			jsUnicode,		// had "\u" in a string, expecting 4 hex digits
 			jsIntVal,		// receiving an integer value
 			jsNegIntVal,	// had '-' so expecting a integer value
 			jsFracVal,		// receiving a fractional value
@@ -66,8 +70,27 @@ namespace Comm
 		JsonDecoder();
 		void CheckInput(const unsigned char* rxBuffer, unsigned int len);
 		void ProcessReceivedValue(StringRef id, const char val[], const size_t indices[]);
+		void ProcessArrayEnd(const char id[], const size_t indices[]);
+		// Only calls the observers of the field, used to replay values that were not received from the Duet
+		void NotifyObservers(const char id[], const char val[], const size_t indices[]);
 		bool SetPrefix(const char* prefix) { return m_fieldPrefix.copy(prefix); }
 
+		/// @brief Held by CheckInput while it passes a chunk to the observers, and by the object model snapshot for
+		/// its whole replay, so a replay never interleaves with a response decoded on another thread. The holding
+		/// thread may hold another one, as some observers fetch and decode a response themselves
+		class ObserverGuard
+		{
+		  public:
+			ObserverGuard();
+			~ObserverGuard();
+
+		  private:
+			ObserverGuard(const ObserverGuard&);
+			ObserverGuard& operator=(const ObserverGuard&);
+
+			bool m_nested;
+		};
+
 		// These variables are used for the
 		ResponseType responseType = ResponseType::unknown;
 		void* responseData = nullptr;
@@ -75,12 +98,12 @@ namespace Comm
 	  private:
 		void StartReceivedMessage(void);
 		void EndReceivedMessage(void);
-		void ProcessArrayEnd(const char id[], const size_t indices[]);
 		void ParserErrorEncountered(int currentState, const char* id, int errors);
 		void RemoveLastId();
 		void RemoveLastIdChar();
 		bool InArray();
 		void ProcessField();
+		bool MapResultId(StringRef id);
 		void EndArray();
 		void ConvertUnicode();
 		bool CheckValueCompleted(char c, bool doProcess);
@@ -91,6 +114,7 @@ namespace Comm
 		String<50> m_fieldPrefix;
 		String<MAX_JSON_ID_LENGTH> m_fieldId;
 		String<MAX_JSON_VALUE_LENGTH> m_fieldVal; // rr_thumbnail seems to be biggest response we get
+		String<4> m_unicodeVal; // The digits of a \u escape may arrive in separate calls to CheckInput
 		JsonState m_state = jsBegin;
 		JsonState m_lastState = jsBegin;
 		int m_serialIoErrors;
@@ -98,6 +122,26 @@ namespace Comm
 		bool m_inError;
 		size_t m_arrayIndices[MAX_ARRAY_NESTING];
 		size_t m_arrayDepth;
+
+		// Request tracing for the message being received, times in microseconds
+		bool m_isModelResponse;
+		String<24> m_responseKey;
+		int64_t m_sliceStart;
+		int64_t m_messageTime;
+		int64_t m_observerTime;
+		size_t m_messageBytes;
+
+		// Seq of the model response being received, found from its "key" field. Each decoder keeps its own, as the
+		// responses to several requests may be decoded at the same time
+		Seq* m_respSeq;
+
+		// End of the result array of a paged key, passed to the observers once the response shows it was the last page
+		bool m_resultEndPending;
+		String<MAX_JSON_ID_LENGTH> m_resultEndId;
+		size_t m_resultEndIndices[MAX_ARRAY_NESTING];
+
+		// The value buffer makes a decoder one of the largest objects around, wherever it is
+		Memory::TrackedBytes<Memory::Subsystem::Buffers> m_trackedSize;
 	};
 } // namespace Comm
 #endif /* JNI_COMM_JSONDECODER_H_ */
@@ -0,0 +1,416 @@
+/*
+ * MjpegStream.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "MjpegStream.h"
+
+#include "Configuration.h"
+#include "Library/bmp.h"
+#include "curl/curl.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <strings.h>
+#include <vector>
+
+#include "jpeglib.h"
+
+namespace Comm
+{
+	static const char* s_frameFiles[] = {"/tmp/webcam_stream0.bmp", "/tmp/webcam_stream1.bmp"};
+
+	struct JpegErrorManager
+	{
+		jpeg_error_mgr pub;
+		jmp_buf jump;
+	};
+
+	static void JpegErrorExit(j_common_ptr cinfo)
+	{
+		char message[JMSG_LENGTH_MAX];
+		(*cinfo->err->format_message)(cinfo, message);
+		warn("Failed to decode webcam frame: %s", message);
+		longjmp(reinterpret_cast<JpegErrorManager*>(cinfo->err)->jump, 1);
+	}
+
+	static size_t WriteCallback(void* data, size_t size, size_t nmemb, void* userdata)
+	{
+		MjpegStream* stream = reinterpret_cast<MjpegStream*>(userdata);
+		if (stream->GetState() == MjpegStream::State::Connecting)
+		{
+			// Body started without a multipart content type
+			stream->SetContentType("");
+		}
+		if (stream->IsStopping() || stream->GetState() != MjpegStream::State::Streaming)
+		{
+			return 0; // abort the transfer
+		}
+		stream->Feed(reinterpret_cast<const char*>(data), size * nmemb);
+		return size * nmemb;
+	}
+
+	static size_t HeaderCallback(void* data, size_t size, size_t nmemb, void* userdata)
+	{
+		MjpegStream* stream = reinterpret_cast<MjpegStream*>(userdata);
+		std::string header(reinterpret_cast<const char*>(data), size * nmemb);
+		if (strncasecmp(header.c_str(), "Content-Type:", 13) == 0)
+		{
+			stream->SetContentType(header.substr(13));
+		}
+		return size * nmemb;
+	}
+
+	MjpegStream::MjpegStream()
+		: m_width(0), m_height(0), m_state(State::Stopped), m_parseState(ParseState::Boundary), m_contentLength(0),
+		  m_backFrame(0), m_frameReady(false), m_receivedFrames(0), m_droppedFrames(0)
+	{
+	}
+
+	MjpegStream::~MjpegStream()
+	{
+		if (isRunning())
+		{
+			requestExitAndWait();
+		}
+	}
+
+	bool MjpegStream::Start(const std::string& url, int width, int height)
+	{
+		Stop();
+		if (url.empty())
+		{
+			return false;
+		}
+		if (isRunning())
+		{
+			// curl notices the exit request at its next progress callback, which can take up to a second
+			verbose("Waiting for the previous MJPEG stream to stop before starting %s", url.c_str());
+			return true;
+		}
+
+		info("Starting MJPEG stream %s at %dx%d", url.c_str(), width, height);
+		m_url = url;
+		m_width = width;
+		m_height = height;
+		m_receivedFrames = 0;
+		m_droppedFrames = 0;
+		m_frameReady = false;
+		m_state = State::Connecting;
+		return run("mjpeg_stream");
+	}
+
+	void MjpegStream::Stop()
+	{
+		Mutex::Autolock lock(m_frameLock);
+		if (isRunning() && !exitPending())
+		{
+			info("Stopping MJPEG stream %s", m_url.c_str());
+			requestExit();
+		}
+		m_frameReady = false;
+		m_state = State::Stopped;
+	}
+
+	void MjpegStream::SetState(State state)
+	{
+		Mutex::Autolock lock(m_frameLock);
+		if (exitPending())
+			return;
+		m_state = state;
+	}
+
+	const char* MjpegStream::TakeFrame()
+	{
+		Mutex::Autolock lock(m_frameLock);
+		if (!m_frameReady)
+		{
+			return nullptr;
+		}
+
+		const char* path = s_frameFiles[m_backFrame];
+		m_backFrame ^= 1;
+		m_frameReady = false;
+		return path;
+	}
+
+	void MjpegStream::SetContentType(const std::string& contentType)
+	{
+		if (contentType.find("multipart/x-mixed-replace") == std::string::npos)
+		{
+			info("%s is not an MJPEG stream, content type %s", m_url.c_str(), contentType.c_str());
+			SetState(State::NotAStream);
+			return;
+		}
+
+		m_boundary.clear();
+		size_t pos = contentType.find("boundary=");
+		if (pos != std::string::npos)
+		{
+			m_boundary = contentType.substr(pos + 9);
+			m_boundary.erase(m_boundary.find_last_not_of(" \t\r\n\";") + 1);
+			m_boundary.erase(0, m_boundary.find_first_not_of(" \t\""));
+			if (m_boundary.compare(0, 2, "--") != 0)
+			{
+				m_boundary.insert(0, "--");
+			}
+		}
+		dbg("MJPEG stream boundary \"%s\"", m_boundary.c_str());
+		ResetParser();
+		SetState(State::Streaming);
+	}
+
+	void MjpegStream::ResetParser()
+	{
+		m_buffer.clear();
+		m_parseState = ParseState::Boundary;
+		m_contentLength = 0;
+	}
+
+	void MjpegStream::Feed(const char* data, size_t len)
+	{
+		m_buffer.append(data, len);
+		if (m_buffer.size() > MAX_WEBCAM_FRAME_SIZE)
+		{
+			warn("MJPEG frame larger than %u bytes, discarding", MAX_WEBCAM_FRAME_SIZE);
+			ResetParser();
+			return;
+		}
+
+		while (true)
+		{
+			switch (m_parseState)
+			{
+			case ParseState::Boundary: {
+				// Without a boundary fall back to looking for the JPEG start of image marker
+				const std::string marker = m_boundary.empty() ? std::string("\xFF\xD8") : m_boundary;
+				size_t pos = m_buffer.find(marker);
+				if (pos == std::string::npos)
+				{
+					if (m_buffer.size() > marker.size())
+						m_buffer.erase(0, m_buffer.size() - marker.size());
+					return;
+				}
+				if (m_boundary.empty())
+				{
+					m_buffer.erase(0, pos);
+					m_contentLength = 0;
+					m_parseState = ParseState::Body;
+					break;
+				}
+				m_buffer.erase(0, pos + marker.size());
+				m_parseState = ParseState::Headers;
+				break;
+			}
+			case ParseState::Headers: {
+				size_t end = m_buffer.find("\r\n\r\n");
+				if (end == std::string::npos)
+				{
+					return;
+				}
+				m_contentLength = 0;
+				size_t lineStart = 0;
+				while (lineStart < end)
+				{
+					size_t lineEnd = m_buffer.find("\r\n", lineStart);
+					if (lineEnd == std::string::npos || lineEnd > end)
+						lineEnd = end;
+					if (strncasecmp(m_buffer.c_str() + lineStart, "Content-Length:", 15) == 0)
+					{
+						m_contentLength = strtoul(m_buffer.c_str() + lineStart + 15, nullptr, 10);
+					}
+					lineStart = lineEnd + 2;
+				}
+				m_buffer.erase(0, end + 4);
+				m_parseState = ParseState::Body;
+				break;
+			}
+			case ParseState::Body: {
+				size_t frameLen;
+				if (m_contentLength > 0)
+				{
+					if (m_buffer.size() < m_contentLength)
+						return;
+					frameLen = m_contentLength;
+				}
+				else if (m_boundary.empty())
+				{
+					size_t pos = m_buffer.find("\xFF\xD9", 2);
+					if (pos == std::string::npos)
+						return;
+					frameLen = pos + 2;
+				}
+				else
+				{
+					size_t pos = m_buffer.find(m_boundary);
+					if (pos == std::string::npos)
+						return;
+					frameLen = pos;
+					// Strip the line break that precedes the boundary
+					while (frameLen > 0 && (m_buffer[frameLen - 1] == '\n' || m_buffer[frameLen - 1] == '\r'))
+						frameLen--;
+				}
+				OnFrame(m_buffer.data(), frameLen);
+				m_buffer.erase(0, frameLen);
+				m_parseState = ParseState::Boundary;
+				break;
+			}
+			}
+		}
+	}
+
+	void MjpegStream::OnFrame(const char* data, size_t len)
+	{
+		m_receivedFrames++;
+		size_t backFrame;
+		{
+			Mutex::Autolock lock(m_frameLock);
+			if (m_frameReady)
+			{
+				// The UI has not displayed the previous frame yet, so don't spend time decoding this one
+				m_droppedFrames++;
+				verbose("Dropped MJPEG frame, %u/%u dropped", m_droppedFrames, m_receivedFrames);
+				return;
+			}
+			backFrame = m_backFrame;
+		}
+
+		if (!DecodeFrame(data, len, s_frameFiles[backFrame]))
+		{
+			return;
+		}
+
+		Mutex::Autolock lock(m_frameLock);
+		if (exitPending())
+			return; // Stopped while decoding, the UI no longer wants this frame
+		m_frameReady = true;
+	}
+
+	bool MjpegStream::DecodeFrame(const char* data, size_t len, const char* path)
+	{
+		static BMP s_bmp;
+		static std::vector<JSAMPLE> s_scanline;
+		static std::vector<rgba_t> s_row;
+
+		jpeg_decompress_struct cinfo;
+		JpegErrorManager jerr;
+		cinfo.err = jpeg_std_error(&jerr.pub);
+		jerr.pub.error_exit = JpegErrorExit;
+		if (setjmp(jerr.jump))
+		{
+			jpeg_destroy_decompress(&cinfo);
+			s_bmp.Close();
+			return false;
+		}
+
+		jpeg_create_decompress(&cinfo);
+		jpeg_mem_src(&cinfo, (unsigned char*)data, len);
+		jpeg_read_header(&cinfo, TRUE);
+
+		// Let the decoder scale down by the largest power of 2 that still covers the display area, this skips most of
+		// the IDCT work for high resolution cameras
+		cinfo.out_color_space = JCS_RGB;
+		cinfo.scale_num = 1;
+		cinfo.scale_denom = 1;
+		while (cinfo.scale_denom < 8 && (int)(cinfo.image_width / (cinfo.scale_denom * 2)) >= m_width &&
+			   (int)(cinfo.image_height / (cinfo.scale_denom * 2)) >= m_height)
+		{
+			cinfo.scale_denom *= 2;
+		}
+		cinfo.dct_method = JDCT_IFAST;
+		cinfo.do_fancy_upsampling = FALSE;
+		jpeg_start_decompress(&cinfo);
+
+		const int width = cinfo.output_width;
+		if (!s_bmp.New(width, cinfo.output_height, path))
+		{
+			jpeg_destroy_decompress(&cinfo);
+			return false;
+		}
+		s_scanline.resize(width * cinfo.output_components);
+		s_row.resize(width);
+
+		while (cinfo.output_scanline < cinfo.output_height)
+		{
+			JSAMPROW rowPtr = s_scanline.data();
+			jpeg_read_scanlines(&cinfo, &rowPtr, 1);
+			for (int x = 0; x < width; x++)
+			{
+				s_row[x].rgba.r = s_scanline[x * 3];
+				s_row[x].rgba.g = s_scanline[x * 3 + 1];
+				s_row[x].rgba.b = s_scanline[x * 3 + 2];
+				s_row[x].rgba.a = 0xFF;
+			}
+			s_bmp.appendPixels(s_row.data(), width);
+		}
+
+		jpeg_finish_decompress(&cinfo);
+		jpeg_destroy_decompress(&cinfo);
+		return s_bmp.Close();
+	}
+
+	static int ProgressCallback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+	{
+		return reinterpret_cast<MjpegStream*>(userdata)->IsStopping() ? 1 : 0;
+	}
+
+	bool MjpegStream::threadLoop()
+	{
+		CURL* curl = curl_easy_init();
+		if (curl == nullptr)
+		{
+			error("Failed to create curl handle for MJPEG stream");
+			SetState(State::Error);
+			return false;
+		}
+
+		ResetParser();
+		SetState(State::Connecting);
+		curl_easy_setopt(curl, CURLOPT_URL, m_url.c_str());
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, this);
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+		curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 3L);
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
+		// Treat a stream that stops delivering data as broken so it is reconnected
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 10L);
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
+
+		const uint32_t framesBefore = m_receivedFrames;
+		CURLcode res = curl_easy_perform(curl);
+		curl_easy_cleanup(curl);
+
+		if (exitPending())
+		{
+			return false;
+		}
+		if (m_state == State::NotAStream)
+		{
+			return false;
+		}
+		if (m_receivedFrames == framesBefore)
+		{
+			// Never got a frame from this connection, let the UI fall back to snapshots rather than retrying forever
+			warn("MJPEG stream %s failed: %s", m_url.c_str(), curl_easy_strerror(res));
+			SetState(State::Error);
+			return false;
+		}
+
+		warn("MJPEG stream %s ended: %s, reconnecting", m_url.c_str(), curl_easy_strerror(res));
+		SetState(State::Connecting);
+		for (int i = 0; i < MJPEG_RECONNECT_DELAY / 100 && !exitPending(); i++)
+		{
+			Thread::sleep(100);
+		}
+		return !exitPending();
+	}
+} // namespace Comm
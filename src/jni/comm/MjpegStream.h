@@ -0,0 +1,101 @@
+/*
+ * MjpegStream.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#ifndef JNI_COMM_MJPEGSTREAM_H_
+#define JNI_COMM_MJPEGSTREAM_H_
+
+#include <string>
+#include <sys/types.h>
+#include <system/Mutex.h>
+#include <system/Thread.h>
+
+namespace Comm
+{
+	/// @brief Client for multipart/x-mixed-replace MJPEG streams.
+	///
+	/// Frames are split out of the stream on a background thread and decoded straight from memory, scaled down to the
+	/// display size. Only one decoded frame is kept waiting for the UI; frames that arrive while it has not been
+	/// taken yet are dropped without being decoded.
+	class MjpegStream : public Thread
+	{
+	  public:
+		enum class State
+		{
+			Stopped = 0,
+			Connecting,
+			Streaming,
+			NotAStream, // the server responded with something other than a multipart stream
+			Error,		// the stream could not be connected to, or could not be reconnected to after it broke
+		};
+
+		MjpegStream();
+		virtual ~MjpegStream();
+
+		/// @brief Connect to a stream, stopping any stream that is already running. If the previous stream's thread has
+		/// not finished yet nothing is started and the state stays Stopped, so the caller can try again later
+		/// @param url The stream url
+		/// @param width Width of the area the frames will be displayed in
+		/// @param height Height of the area the frames will be displayed in
+		/// @return false if the url is empty or the thread could not be started
+		bool Start(const std::string& url, int width, int height);
+		/// @brief Ask the stream thread to finish without waiting for it. No more frames are delivered afterwards
+		void Stop();
+
+		State GetState() const { return m_state; }
+		const std::string& GetUrl() const { return m_url; }
+		bool IsStopping() const { return exitPending(); }
+
+		/// @brief Take the most recently decoded frame
+		/// @return Path of the decoded frame, or nullptr if no new frame is available since the last call
+		const char* TakeFrame();
+
+		uint32_t GetReceivedFrames() const { return m_receivedFrames; }
+		uint32_t GetDroppedFrames() const { return m_droppedFrames; }
+
+		/// @brief Feed raw stream data into the multipart parser. Used by the curl write callback
+		void Feed(const char* data, size_t len);
+		void SetContentType(const std::string& contentType);
+
+	  protected:
+		virtual bool threadLoop();
+
+	  private:
+		void SetState(State state);
+
+		enum class ParseState
+		{
+			Boundary,
+			Headers,
+			Body,
+		};
+
+		void ResetParser();
+		void OnFrame(const char* data, size_t len);
+		bool DecodeFrame(const char* data, size_t len, const char* path);
+
+		std::string m_url;
+		int m_width;
+		int m_height;
+		volatile State m_state;
+
+		// Parser state, only accessed from the stream thread
+		std::string m_buffer;
+		std::string m_boundary;
+		ParseState m_parseState;
+		size_t m_contentLength;
+
+		// Decoded frames alternate between two files so the UI never reads a file that is being written. Also guards
+		// state changes, so the thread cannot change the state once Stop has returned
+		mutable Mutex m_frameLock;
+		size_t m_backFrame;
+		bool m_frameReady;
+		uint32_t m_receivedFrames;
+		uint32_t m_droppedFrames;
+	};
+} // namespace Comm
+
+#endif /* JNI_COMM_MJPEGSTREAM_H_ */
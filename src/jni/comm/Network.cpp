@@ -8,13 +8,19 @@
 #include "DebugLevels.h"
 #define DEBUG_LEVEL DEBUG_LEVEL_VERBOSE
 
+#include "AllocationTracker.h"
 #include "Configuration.h"
 #include "Debug.h"
+#include "JsonDecoder.h"
 #include "Network.h"
+#include "RequestTrace.h"
 #include "curl/curl.h"
 #include "restclient-cpp/connection.h"
+#include "timer.h"
 #include "utils/utils.h"
 #include <manager/ConfigManager.h>
+#include <strings.h>
+#include <system/Mutex.h>
 #include <system/Thread.h>
 #include <vector>
 
@@ -27,31 +33,90 @@ namespace Comm
 		QueryParameters_t queryParameters;
 		function<bool(RestClient::Response&)> callback;
 		uint32_t sessionKey;
+		RestClient::HeaderFields headers;
+		RequestTrace trace;
+		const char* jsonPrefix;
+		bool notifyErrors;
+		Memory::TrackedBytes<Memory::Subsystem::Comm> trackedBytes;
 	};
 
-	class AsyncGetThread : public Thread
+	// Estimate of the heap held by the strings and maps of a request or response
+	static size_t RequestBytes(const std::string& url,
+							   const QueryParameters_t& queryParameters,
+							   const RestClient::HeaderFields& headers)
+	{
+		return Memory::HeapBytes(url) + Memory::HeapBytes(queryParameters) + Memory::HeapBytes(headers);
+	}
+
+	class AsyncGetThread : public Thread, public Memory::Tracked<Memory::Subsystem::Comm>
 	{
 	  public:
 		AsyncGetThread(std::string url,
 					   const char* subUrl,
 					   QueryParameters_t& queryParameters,
 					   function<bool(RestClient::Response&)> callback,
-					   uint32_t sessionKey)
+					   uint32_t sessionKey,
+					   const RestClient::HeaderFields& headers,
+					   const RequestTrace& trace,
+					   const char* jsonPrefix,
+					   bool notifyErrors)
 			: m_url(url), m_subUrl(subUrl), m_queryParameters(queryParameters), m_sessionKey(sessionKey),
+			  m_headers(headers), m_trace(trace), m_jsonPrefix(jsonPrefix), m_notifyErrors(notifyErrors),
 			  m_callback(callback)
 		{
+			m_trackedBytes.Set(RequestBytes(m_url, m_queryParameters, m_headers));
 			dbg("starting thread for %s%s", url.c_str(), subUrl);
 			run();
 		}
 		virtual bool threadLoop()
 		{
 			verbose("%s%s", m_url.c_str(), m_subUrl);
-			if (!Get(m_url, m_subUrl, m_r, m_queryParameters, m_sessionKey))
+			m_trace.Mark(TraceEvent::Dispatch);
+			if (m_jsonPrefix != nullptr)
 			{
-				return false;
+				// Parsing overlaps the transfer and the body is never held in memory
+				JsonDecoder decoder;
+				decoder.SetPrefix(m_jsonPrefix);
+				TraceScope scope(&m_trace);
+				if (!Get(
+						m_url,
+						m_subUrl,
+						m_r,
+						m_queryParameters,
+						[&decoder](const char* data, size_t len, size_t) {
+							decoder.CheckInput((const unsigned char*)data, len);
+							return true;
+						},
+						m_sessionKey,
+						m_headers,
+						&m_trace))
+				{
+					TrackResponse();
+					RecordTrace(m_trace);
+					return false;
+				}
+				TrackResponse();
+				m_callback(m_r);
 			}
+			else
+			{
+				if (!Get(m_url, m_subUrl, m_r, m_queryParameters, m_sessionKey, m_headers, &m_trace))
+				{
+					TrackResponse();
+					if (m_notifyErrors)
+					{
+						m_callback(m_r);
+					}
+					RecordTrace(m_trace);
+					return false;
+				}
 
-			m_callback(m_r);
+				TrackResponse();
+				TraceScope scope(&m_trace);
+				m_callback(m_r);
+			}
+			m_trace.Mark(TraceEvent::DispatchEnd);
+			RecordTrace(m_trace);
 			return false;
 		}
 
@@ -59,61 +124,106 @@ namespace Comm
 								  const char* subUrl,
 								  QueryParameters_t& queryParameters,
 								  function<bool(RestClient::Response&)> callback,
-								  uint32_t sessionKey)
+								  uint32_t sessionKey,
+								  const RestClient::HeaderFields& headers,
+								  const RequestTrace& trace,
+								  const char* jsonPrefix,
+								  bool notifyErrors)
 		{
 			m_url = url;
 			m_subUrl = subUrl;
 			m_queryParameters = queryParameters;
 			m_callback = callback;
 			m_sessionKey = sessionKey;
+			m_headers = headers;
+			m_trace = trace;
+			m_jsonPrefix = jsonPrefix;
+			m_notifyErrors = notifyErrors;
+			m_trackedBytes.Set(RequestBytes(m_url, m_queryParameters, m_headers));
 		}
 
 	  private:
+		// The thread keeps the containers of its last request and response until the next one replaces them
+		void TrackResponse()
+		{
+			m_trackedBytes.Set(RequestBytes(m_url, m_queryParameters, m_headers) + Memory::HeapBytes(m_r.body) +
+							   Memory::HeapBytes(m_r.headers));
+		}
+
 		std::string m_url;
 		const char* m_subUrl;
 		RestClient::Response m_r;
 		QueryParameters_t m_queryParameters;
 		uint32_t m_sessionKey;
+		RestClient::HeaderFields m_headers;
+		RequestTrace m_trace;
+		const char* m_jsonPrefix; // nullptr if the body is passed to the callback
+		bool m_notifyErrors;	  // Also call the callback when the request fails
 		function<bool(RestClient::Response&)> m_callback;
+		Memory::TrackedBytes<Memory::Subsystem::Comm> m_trackedBytes;
 	};
 
 	static std::vector<AsyncGetThread*> s_threadPool;
 	static std::vector<AsyncGetData> s_queuedData;
 
-	static void AddQueryParameters(std::string& url, QueryParameters_t& queryParameters)
+	static const char* FindQueryParameter(const QueryParameters_t& queryParameters, const char* name)
 	{
-		if (queryParameters.size() > 0)
-			url += "?";
+		auto query = queryParameters.find(name);
+		return query != queryParameters.end() ? query->second.c_str() : nullptr;
+	}
 
-		bool first = true;
-		for (auto& query : queryParameters)
+	static void AppendEncoded(std::string& url, const std::string& text)
+	{
+		static const char hex[] = "0123456789ABCDEF";
+		for (const char c : text)
 		{
-			utils::replaceSubstring(query.second, " ", "%20");
-			utils::replaceSubstring(query.second, "\"", "%22");
-			utils::replaceSubstring(query.second, ":", "%3A");
-			utils::replaceSubstring(query.second, "\\", "%5C");
-			utils::replaceSubstring(query.second, "/", "%2F");
-			utils::replaceSubstring(query.second, "\n", "%0A");
-			utils::removeCharFromString(query.second, '\r');
-
-			if (!first)
+			if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' ||
+				c == '.' || c == '~')
 			{
-				url += "&";
+				url += c;
 			}
-			url += query.first;
-			url += "=";
-			url += query.second;
+			else if (c != '\r')
+			{
+				url += '%';
+				url += hex[(unsigned char)c >> 4];
+				url += hex[c & 0x0F];
+			}
+		}
+	}
 
-			first = false;
+	void AppendRequestPath(std::string& url, const char* subUrl, const QueryParameters_t& queryParameters)
+	{
+		// Room for every character of the values to be encoded, so the URL is only allocated once
+		size_t length = url.size() + strlen(subUrl);
+		for (auto& query : queryParameters)
+		{
+			length += 2 + strlen(query.first) + 3 * query.second.size();
+		}
+		url.reserve(length);
+
+		url += subUrl;
+		char separator = '?';
+		for (auto& query : queryParameters)
+		{
+			url += separator;
+			url += query.first;
+			url += '=';
+			AppendEncoded(url, query.second);
+			separator = '&';
 		}
 	}
 
+	// If jsonPrefix is not nullptr the body is decoded as it arrives instead of being passed to the callback
 	static bool AsyncGetInner(std::string url,
 							  const char* subUrl,
 							  QueryParameters_t& queryParameters,
 							  function<bool(RestClient::Response&)> callback,
 							  uint32_t sessionKey,
-							  bool queue)
+							  bool queue,
+							  const RestClient::HeaderFields& headers,
+							  const RequestTrace& trace,
+							  const char* jsonPrefix,
+							  bool notifyErrors)
 	{
 		// Attempts to use a thread from the pool if one is not currently in use
 		for (auto thread : s_threadPool)
@@ -122,7 +232,8 @@ namespace Comm
 				continue;
 
 			verbose("Reusing thread from pool");
-			thread->SetRequestParameters(url, subUrl, queryParameters, callback, sessionKey);
+			thread->SetRequestParameters(
+				url, subUrl, queryParameters, callback, sessionKey, headers, trace, jsonPrefix, notifyErrors);
 			return thread->run();
 		}
 
@@ -139,8 +250,11 @@ namespace Comm
 					}
 				}
 			}
-			s_queuedData.push_back({url, subUrl, queryParameters, callback, sessionKey});
+			s_queuedData.push_back(
+				{url, subUrl, queryParameters, callback, sessionKey, headers, trace, jsonPrefix, notifyErrors});
+			s_queuedData.back().trackedBytes.Set(RequestBytes(url, queryParameters, headers));
 			info("Queued request %s, size=%d", (url + subUrl).c_str(), s_queuedData.size());
+			setUserTimerPeriod(TIMER_ASYNC_HTTP_REQUEST, ASYNC_REQUEST_QUEUE_POLL_INTERVAL);
 			return true;
 		}
 
@@ -151,7 +265,8 @@ namespace Comm
 		}
 
 		// Create a new thread and add it to the pool
-		AsyncGetThread* thread = new AsyncGetThread(url, subUrl, queryParameters, callback, sessionKey);
+		AsyncGetThread* thread = new AsyncGetThread(
+			url, subUrl, queryParameters, callback, sessionKey, headers, trace, jsonPrefix, notifyErrors);
 		s_threadPool.push_back(thread);
 		info("Added thread to pool, size=%d", s_threadPool.size());
 		return true;
@@ -162,31 +277,69 @@ namespace Comm
 				  QueryParameters_t& queryParameters,
 				  function<bool(RestClient::Response&)> callback,
 				  uint32_t sessionKey,
-				  bool queue)
+				  bool queue,
+				  const RestClient::HeaderFields& headers,
+				  bool notifyErrors)
 	{
+		RequestTrace trace(subUrl, FindQueryParameter(queryParameters, "key"));
+		trace.Mark(TraceEvent::Enqueue);
 		ProcessQueuedAsyncRequests();
-		return AsyncGetInner(url, subUrl, queryParameters, callback, sessionKey, queue);
+		return AsyncGetInner(
+			url, subUrl, queryParameters, callback, sessionKey, queue, headers, trace, nullptr, notifyErrors);
 	}
 
-	void ProcessQueuedAsyncRequests()
+	bool AsyncGetJson(std::string url,
+					  const char* subUrl,
+					  QueryParameters_t& queryParameters,
+					  const char* jsonPrefix,
+					  function<bool(RestClient::Response&)> callback,
+					  uint32_t sessionKey,
+					  bool queue)
+	{
+		RequestTrace trace(subUrl, FindQueryParameter(queryParameters, "key"));
+		trace.Mark(TraceEvent::Enqueue);
+		ProcessQueuedAsyncRequests();
+		return AsyncGetInner(url,
+							 subUrl,
+							 queryParameters,
+							 callback,
+							 sessionKey,
+							 queue,
+							 RestClient::HeaderFields(),
+							 trace,
+							 jsonPrefix != nullptr ? jsonPrefix : "",
+							 false);
+	}
+
+	bool ProcessQueuedAsyncRequests()
 	{
 		if (s_queuedData.empty())
-			return;
+			return false;
 
 		info("Processing queued requests, size=%d", s_queuedData.size());
 		auto data = s_queuedData.begin();
 		while (data != s_queuedData.end())
 		{
 			info("Processing queued request %s", (data->url + data->subUrl).c_str());
-			if (!AsyncGetInner(data->url, data->subUrl, data->queryParameters, data->callback, data->sessionKey, false))
+			if (!AsyncGetInner(data->url,
+							   data->subUrl,
+							   data->queryParameters,
+							   data->callback,
+							   data->sessionKey,
+							   false,
+							   data->headers,
+							   data->trace,
+							   data->jsonPrefix,
+							   data->notifyErrors))
 			{
 				warn("Failed to process queued request %s", (data->url + data->subUrl).c_str());
-				return;
+				return true;
 			}
 			info("Processed queued request %s", (data->url + data->subUrl).c_str());
 			data = s_queuedData.erase(data);
 		}
 		info("Processed all queued requests, size=%d", s_queuedData.size());
+		return false;
 	}
 
 	int ClearThreadPool()
@@ -196,21 +349,42 @@ namespace Comm
 		return count - s_threadPool.size();
 	}
 
-	bool Get(std::string url,
-			 const char* subUrl,
-			 RestClient::Response& r,
-			 QueryParameters_t& queryParameters,
-			 uint32_t sessionKey)
+	static void SetTransferTimes(RequestTrace& trace, RestClient::Connection* conn)
 	{
-		url += subUrl;
+		// curl reports times in seconds from the start of the transfer
+		const int64_t complete = TraceNow();
+		const RestClient::Connection::RequestInfo info = conn->GetInfo().lastRequest;
+		const int64_t start = complete - (int64_t)(info.totalTime * 1e6);
+		trace.Set(TraceEvent::Connect, start + (int64_t)(info.connectTime * 1e6));
+		trace.Set(TraceEvent::FirstByte, start + (int64_t)(info.startTransferTime * 1e6));
+		trace.Set(TraceEvent::Complete, complete);
+
+		// A streamed body is parsed as it arrives, so only the parsing left after the transfer is counted
+		if (trace.Has(TraceEvent::ParseEnd) && trace.Get(TraceEvent::ParseEnd) < complete)
+		{
+			trace.Set(TraceEvent::ParseEnd, complete);
+		}
+	}
 
-		AddQueryParameters(url, queryParameters);
+	// RestClient::Connection is a library class, so its objects are counted here rather than through Memory::Tracked
+	static RestClient::Connection* NewConnection(const std::string& url)
+	{
+		Memory::RecordAllocation(Memory::Subsystem::Comm, sizeof(RestClient::Connection));
+		return new RestClient::Connection(url);
+	}
 
-		// get a connection object
-		RestClient::Connection* conn = new RestClient::Connection(url);
+	static void DeleteConnection(RestClient::Connection* conn)
+	{
+		Memory::RecordFree(Memory::Subsystem::Comm, sizeof(RestClient::Connection));
+		delete conn;
+	}
 
-		// set connection timeout in seconds
-		conn->SetTimeout(30);
+	static RestClient::Connection* CreateGetConnection(const std::string& url,
+													   uint32_t sessionKey,
+													   const RestClient::HeaderFields& headers)
+	{
+		// get a connection object
+		RestClient::Connection* conn = NewConnection(url);
 
 		// enable following of redirects (default is off)
 		conn->FollowRedirects(true);
@@ -229,23 +403,202 @@ namespace Comm
 		}
 		conn->AppendHeader("Accept", "application/json");
 		conn->AppendHeader("Content-Type", "application/json");
+		for (auto& header : headers)
+		{
+			conn->AppendHeader(header.first, header.second);
+		}
 
 		// if using a non-standard Certificate Authority (CA) trust file
 		conn->SetCAInfoFilePath(CONFIGMANAGER->getResFilePath("cacert.pem"));
 
-		r = conn->get("");
+		return conn;
+	}
+
+	// Compression is offered until the server has answered HTTP_COMPRESSION_PROBE_RESPONSES requests in a row
+	// without it
+	static Mutex s_compressionLock;
+	static bool s_compressionEnabled = false;
+	static uint32_t s_uncompressedResponses = 0;
+	static uint32_t s_compressedResponses = 0;
+	static uint64_t s_compressedWireBytes = 0;
+	static uint64_t s_compressedBodyBytes = 0;
+
+	void SetHttpCompression(bool enabled)
+	{
+		Mutex::Autolock lock(s_compressionLock);
+		s_compressionEnabled = enabled;
+		s_uncompressedResponses = 0;
+	}
+
+	static bool OfferCompression()
+	{
+		Mutex::Autolock lock(s_compressionLock);
+		return s_compressionEnabled && s_uncompressedResponses < HTTP_COMPRESSION_PROBE_RESPONSES;
+	}
+
+	static void RecordCompression(const RestClient::Response& r, double wireBytes, size_t bodyBytes)
+	{
+		if (bodyBytes == 0)
+			return;
+
+		bool compressed = false;
+		for (auto& header : r.headers)
+		{
+			if (strcasecmp(header.first.c_str(), "Content-Encoding") == 0)
+			{
+				compressed = strcasecmp(header.second.c_str(), "identity") != 0;
+			}
+		}
+
+		Mutex::Autolock lock(s_compressionLock);
+		if (!compressed)
+		{
+			if (++s_uncompressedResponses == HTTP_COMPRESSION_PROBE_RESPONSES)
+			{
+				info("Server does not compress responses, no longer asking it to");
+			}
+			return;
+		}
+		s_uncompressedResponses = 0;
+		s_compressedResponses++;
+		s_compressedWireBytes += (uint64_t)wireBytes;
+		s_compressedBodyBytes += bodyBytes;
+	}
+
+	std::string GetHttpCompressionStats()
+	{
+		Mutex::Autolock lock(s_compressionLock);
+		return utils::format("HTTP compression %s%s: %u responses, %llu bytes received for %llu bytes of JSON",
+							 s_compressionEnabled ? "enabled" : "disabled",
+							 s_compressionEnabled && s_uncompressedResponses >= HTTP_COMPRESSION_PROBE_RESPONSES
+								 ? ", not supported by the server"
+								 : "",
+							 s_compressedResponses,
+							 (unsigned long long)s_compressedWireBytes,
+							 (unsigned long long)s_compressedBodyBytes);
+	}
+
+	struct DownloadSink
+	{
+		RestClient::Connection* conn;
+		function<bool(const char*, size_t, size_t)>* sink;
+		size_t received; // After content decoding
+	};
+
+	static size_t DownloadCallback(void* data, size_t size, size_t nmemb, void* userdata)
+	{
+		DownloadSink* download = (DownloadSink*)userdata;
+		// Error pages are not part of the response
+		if (download->conn->GetResponseCode() != 200)
+			return size * nmemb;
+		download->received += size * nmemb;
+		const double length = download->conn->GetContentLength();
+		if (!(*download->sink)((const char*)data, size * nmemb, length > 0 ? (size_t)length : 0))
+			return 0;
+		return size * nmemb;
+	}
+
+	// If sink is nullptr the body is returned in r. Compressed encodings are only offered for bodies passed to a sink
+	static bool GetInner(std::string& url,
+						 const char* subUrl,
+						 RestClient::Response& r,
+						 QueryParameters_t& queryParameters,
+						 function<bool(const char*, size_t, size_t)>* sink,
+						 bool compress,
+						 uint32_t sessionKey,
+						 const RestClient::HeaderFields& headers,
+						 RequestTrace* trace,
+						 int timeout)
+	{
+		// Blocking requests are dispatched as soon as they are made
+		RequestTrace blockingTrace(subUrl, FindQueryParameter(queryParameters, "key"));
+		if (trace == nullptr)
+		{
+			blockingTrace.Mark(TraceEvent::Enqueue);
+			blockingTrace.Set(TraceEvent::Dispatch, blockingTrace.Get(TraceEvent::Enqueue));
+		}
+		AppendRequestPath(url, subUrl, queryParameters);
+
+		RestClient::Connection* conn = CreateGetConnection(url, sessionKey, headers);
+		conn->SetTimeout(timeout);
+		if (sink != nullptr)
+		{
+			// curl inflates the body as it arrives, so the sink always receives JSON
+			compress = compress && OfferCompression();
+			if (compress)
+			{
+				conn->SetAcceptEncoding(HTTP_ACCEPT_ENCODING);
+			}
+			DownloadSink download = {conn, sink, 0};
+			r = conn->get("", DownloadCallback, &download);
+			if (compress && r.code == 200)
+			{
+				RecordCompression(r, conn->GetInfo().lastRequest.sizeDownload, download.received);
+			}
+		}
+		else
+		{
+			r = conn->get("");
+		}
+		SetTransferTimes(trace != nullptr ? *trace : blockingTrace, conn);
+		DeleteConnection(conn);
+		if (trace == nullptr)
+		{
+			RecordTrace(blockingTrace);
+		}
+		if (r.code == 304 && !headers.empty())
+		{
+			dbg("%s not modified", url.c_str());
+			return true;
+		}
 		if (r.code != 200)
 		{
 			error("%s failed, returned response %d", url.c_str(), r.code);
 			return false;
 		}
 		dbg("%s succeeded, returned response %d", url.c_str(), r.code);
-		verbose("Response body: %s", r.body.c_str());
-
-		delete conn;
+		if (sink == nullptr)
+		{
+			verbose("Response body: %s", r.body.c_str());
+		}
 		return true;
 	}
 
+	bool Get(std::string url,
+			 const char* subUrl,
+			 RestClient::Response& r,
+			 QueryParameters_t& queryParameters,
+			 uint32_t sessionKey,
+			 const RestClient::HeaderFields& headers,
+			 RequestTrace* trace)
+	{
+		return GetInner(url, subUrl, r, queryParameters, nullptr, false, sessionKey, headers, trace, 30);
+	}
+
+	bool Get(std::string url,
+			 const char* subUrl,
+			 RestClient::Response& r,
+			 QueryParameters_t& queryParameters,
+			 function<bool(const char*, size_t, size_t)> sink,
+			 uint32_t sessionKey,
+			 const RestClient::HeaderFields& headers,
+			 RequestTrace* trace)
+	{
+		return GetInner(url, subUrl, r, queryParameters, &sink, true, sessionKey, headers, trace, 30);
+	}
+
+	bool Download(std::string url,
+				  const char* subUrl,
+				  RestClient::Response& r,
+				  QueryParameters_t& queryParameters,
+				  function<bool(const char*, size_t, size_t)> sink,
+				  uint32_t sessionKey)
+	{
+		// Files can take much longer than a normal request
+		return GetInner(
+			url, subUrl, r, queryParameters, &sink, false, sessionKey, RestClient::HeaderFields(), nullptr, 600);
+	}
+
 	bool Post(std::string url,
 			  const char* subUrl,
 			  RestClient::Response& r,
@@ -253,12 +606,13 @@ namespace Comm
 			  const std::string& data,
 			  uint32_t sessionKey)
 	{
-		url += subUrl;
-
-		AddQueryParameters(url, queryParameters);
+		RequestTrace trace(subUrl, nullptr);
+		trace.Mark(TraceEvent::Enqueue);
+		trace.Set(TraceEvent::Dispatch, trace.Get(TraceEvent::Enqueue));
+		AppendRequestPath(url, subUrl, queryParameters);
 
 		// get a connection object
-		RestClient::Connection* conn = new RestClient::Connection(url);
+		RestClient::Connection* conn = NewConnection(url);
 
 		// set connection timeout in seconds
 		conn->SetTimeout(180);
@@ -277,6 +631,9 @@ namespace Comm
 
 		verbose("Post: \"%s\", data=\"%s\"", url.c_str(), data.substr(0, 50).c_str());
 		r = conn->post("", data);
+		SetTransferTimes(trace, conn);
+		DeleteConnection(conn);
+		RecordTrace(trace);
 		if (r.code != 200)
 		{
 			error("%s failed, returned response %d %s", url.c_str(), r.code, r.body.c_str());
@@ -8,31 +8,94 @@
 #ifndef JNI_COMM_NETWORK_H_
 #define JNI_COMM_NETWORK_H_
 
+#include "RequestTrace.h"
 #include "restclient-cpp/restclient.h"
 #include "std_fixed/functional.h"
 #include "sys/types.h"
 #include <map>
+#include <string.h>
 #include <string>
 
 namespace Comm
 {
-	typedef std::map<const char*, std::string> QueryParameters_t;
+	// Compares the names rather than the pointers, so the parameters are always in the same order in the URL
+	struct QueryParameterLess
+	{
+		bool operator()(const char* a, const char* b) const { return strcmp(a, b) < 0; }
+	};
+	typedef std::map<const char*, std::string, QueryParameterLess> QueryParameters_t;
 
+	/// @brief Append the endpoint and "?name=value&..." to a base URL, percent-encoding the values in one pass
+	void AppendRequestPath(std::string& url, const char* subUrl, const QueryParameters_t& queryParameters);
+
+	/// @param notifyErrors Also call the callback when the request fails, with the failed response. Otherwise the callback
+	/// is only called for a successful request
 	bool AsyncGet(std::string url,
 				  const char* subUrl,
 				  QueryParameters_t& queryParameters,
 				  function<bool(RestClient::Response&)> callback,
 				  uint32_t sessionKey = 0,
-				  bool queue = false);
+				  bool queue = false,
+				  const RestClient::HeaderFields& headers = RestClient::HeaderFields(),
+				  bool notifyErrors = false);
+
+	/// @brief Like AsyncGet, but the body is passed to a JsonDecoder as it arrives instead of being held in memory
+	/// @param jsonPrefix Prefix for the decoder's field ids, see JsonDecoder::SetPrefix. Must be a string literal
+	/// @param callback Called once the transfer has finished, with a response that has no body
+	bool AsyncGetJson(std::string url,
+					  const char* subUrl,
+					  QueryParameters_t& queryParameters,
+					  const char* jsonPrefix,
+					  function<bool(RestClient::Response&)> callback,
+					  uint32_t sessionKey = 0,
+					  bool queue = false);
 
-	void ProcessQueuedAsyncRequests();
+	/// @brief Attempts to start queued requests
+	/// @return true if requests are still waiting for a free thread
+	bool ProcessQueuedAsyncRequests();
 	int ClearThreadPool();
 
+	/// @brief Blocking GET request
+	/// @param headers Additional request headers
+	/// @param trace Trace to fill in with the connection and transfer times. If nullptr the request is traced on its
+	/// own
+	/// @return true if the request succeeded, or returned 304 Not Modified to a conditional request
+	bool Get(std::string url,
+			 const char* subUrl,
+			 RestClient::Response& r,
+			 QueryParameters_t& queryParameters,
+			 uint32_t sessionKey = 0,
+			 const RestClient::HeaderFields& headers = RestClient::HeaderFields(),
+			 RequestTrace* trace = nullptr);
+
+	/// @brief Blocking GET request that passes the body to `sink` as it arrives, so it is never held in memory. The
+	/// body may be sent compressed, see SetHttpCompression
+	/// @param sink Called with each block of the decoded body and the Content-Length as sent, 0 if unknown. Not called
+	/// with the body of an error response. Returning false aborts the transfer
 	bool Get(std::string url,
 			 const char* subUrl,
 			 RestClient::Response& r,
 			 QueryParameters_t& queryParameters,
-			 uint32_t sessionKey = 0);
+			 function<bool(const char*, size_t, size_t)> sink,
+			 uint32_t sessionKey = 0,
+			 const RestClient::HeaderFields& headers = RestClient::HeaderFields(),
+			 RequestTrace* trace = nullptr);
+
+	/// @brief Blocking GET request for a file, passing the body to `sink` as it arrives, see Get. Allows much longer
+	/// for the transfer than other requests
+	bool Download(std::string url,
+				  const char* subUrl,
+				  RestClient::Response& r,
+				  QueryParameters_t& queryParameters,
+				  function<bool(const char*, size_t, size_t)> sink,
+				  uint32_t sessionKey = 0);
+
+	/// @brief Ask for gzip or deflate compressed JSON responses. They are no longer asked for once the server has
+	/// answered HTTP_COMPRESSION_PROBE_RESPONSES requests in a row without compression, until this is called again
+	void SetHttpCompression(bool enabled);
+
+	/// @brief How much compression has saved
+	std::string GetHttpCompressionStats();
 
 	bool Post(std::string url,
 			  const char* subUrl,
@@ -0,0 +1,553 @@
+/*
+ * ObjectModelSocket.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "DebugLevels.h"
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+#include "Debug.h"
+
+#include "ObjectModelSocket.h"
+
+#include "Communication.h"
+#include "Configuration.h"
+#include "JsonDecoder.h"
+#include "utils/TimeHelper.h"
+#include "utils/utils.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Comm
+{
+	// WebSocket opcodes, RFC 6455
+	enum : uint8_t
+	{
+		opContinuation = 0x0,
+		opText = 0x1,
+		opClose = 0x8,
+		opPing = 0x9,
+		opPong = 0xA,
+	};
+
+	static const char* s_acceptGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+	static std::string Base64(const unsigned char* data, size_t len)
+	{
+		std::string encoded(4 * ((len + 2) / 3) + 1, '\0');
+		encoded.resize(EVP_EncodeBlock((unsigned char*)&encoded[0], data, (int)len));
+		return encoded;
+	}
+
+	static bool SendAll(int fd, const uint8_t* data, size_t len)
+	{
+		while (len > 0)
+		{
+			const ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+			if (sent < 0)
+			{
+				if (errno != EAGAIN && errno != EINTR)
+					return false;
+				struct pollfd pfd = {fd, POLLOUT, 0};
+				if (poll(&pfd, 1, OM_SOCKET_TIMEOUT) <= 0)
+					return false;
+				continue;
+			}
+			data += sent;
+			len -= sent;
+		}
+		return true;
+	}
+
+	ObjectModelSocket::ObjectModelSocket()
+		: m_port(80), m_sessionKey(0), m_state(State::Stopped), m_delivering(false), m_receivedMessages(0), m_fd(-1),
+		  m_decoder(nullptr),
+		  m_lastReceive(0), m_lastSend(0), m_headerLength(0), m_opcode(0), m_final(false), m_payloadLeft(0),
+		  m_inMessage(false), m_messageLength(0), m_jsonMessage(false)
+	{
+	}
+
+	ObjectModelSocket::~ObjectModelSocket()
+	{
+		Stop();
+		requestExitAndWait();
+	}
+
+	bool ObjectModelSocket::Start(const std::string& baseUrl, uint32_t sessionKey)
+	{
+		if (isRunning() && !exitPending() && baseUrl == m_baseUrl && sessionKey == m_sessionKey &&
+			GetState() == State::Streaming)
+			return true;
+		// Called from a request thread, the previous socket thread stops promptly once asked to
+		Stop();
+		requestExitAndWait();
+
+		const char* scheme = "http://";
+		if (baseUrl.compare(0, strlen(scheme), scheme) != 0)
+		{
+			warn("Object model socket not supported for %s", baseUrl.c_str());
+			SetState(State::Unsupported);
+			return false;
+		}
+		std::string host = baseUrl.substr(strlen(scheme));
+		host.erase(std::min(host.find('/'), host.size()));
+		m_port = 80;
+		const size_t colon = host.rfind(':');
+		if (colon != std::string::npos)
+		{
+			m_port = (uint16_t)atoi(host.c_str() + colon + 1);
+			host.erase(colon);
+		}
+
+		info("Starting object model socket to %s:%u", host.c_str(), m_port);
+		m_baseUrl = baseUrl;
+		m_host = host;
+		m_sessionKey = sessionKey;
+		m_receivedMessages = 0;
+		SetState(State::Connecting);
+		return run("om_socket");
+	}
+
+	void ObjectModelSocket::Stop()
+	{
+		if (isRunning() && !exitPending())
+		{
+			info("Stopping object model socket to %s", m_host.c_str());
+			requestExit();
+			// Ends a send blocked on a full socket, the thread checks exitPending() between its polls
+			{
+				Mutex::Autolock lock(m_fdLock);
+				if (m_fd >= 0)
+					shutdown(m_fd, SHUT_RDWR);
+			}
+		}
+		// Waits for data already being passed to the observers, the thread checks exitPending() before passing on more
+		Mutex::Autolock lock(m_deliverLock);
+		SetState(State::Stopped);
+	}
+
+	void ObjectModelSocket::SetState(State state)
+	{
+		__atomic_store_n(&m_state, state, __ATOMIC_RELEASE);
+	}
+
+	bool ObjectModelSocket::UpdateState(State state)
+	{
+		Mutex::Autolock lock(m_deliverLock);
+		if (exitPending())
+			return false;
+		SetState(state);
+		return true;
+	}
+
+	bool ObjectModelSocket::Open()
+	{
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo* addresses = nullptr;
+		const std::string port = utils::format("%u", m_port);
+		if (getaddrinfo(m_host.c_str(), port.c_str(), &hints, &addresses) != 0 || addresses == nullptr)
+		{
+			warn("Failed to resolve %s", m_host.c_str());
+			return false;
+		}
+
+		for (struct addrinfo* address = addresses; address != nullptr && m_fd < 0; address = address->ai_next)
+		{
+			const int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (fd < 0)
+				continue;
+			// Connect without blocking so that an unreachable server times out
+			fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+			if (connect(fd, address->ai_addr, address->ai_addrlen) == 0 ||
+				(errno == EINPROGRESS && WaitConnected(fd)))
+			{
+				Mutex::Autolock lock(m_fdLock);
+				m_fd = fd;
+				break;
+			}
+			close(fd);
+		}
+		freeaddrinfo(addresses);
+		if (m_fd < 0)
+		{
+			warn("Failed to connect to %s:%u", m_host.c_str(), m_port);
+			return false;
+		}
+		return true;
+	}
+
+	// Waits for a non-blocking connect to finish
+	bool ObjectModelSocket::WaitConnected(int fd)
+	{
+		const long long start = TimeHelper::getCurrentTime();
+		while (!exitPending() && TimeHelper::getCurrentTime() - start < OM_SOCKET_TIMEOUT)
+		{
+			struct pollfd pfd = {fd, POLLOUT, 0};
+			const int ready = poll(&pfd, 1, OM_SOCKET_POLL_INTERVAL);
+			if (ready < 0 && errno != EINTR)
+				return false;
+			if (ready <= 0)
+				continue;
+			int err = 0;
+			socklen_t len = sizeof(err);
+			return getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+		}
+		return false;
+	}
+
+	void ObjectModelSocket::Close()
+	{
+		Mutex::Autolock lock(m_fdLock);
+		if (m_fd < 0)
+			return;
+		close(m_fd);
+		m_fd = -1;
+	}
+
+	bool ObjectModelSocket::Handshake()
+	{
+		unsigned char nonce[16];
+		if (RAND_bytes(nonce, sizeof(nonce)) != 1)
+		{
+			for (size_t i = 0; i < sizeof(nonce); i++)
+			{
+				nonce[i] = (unsigned char)rand();
+			}
+		}
+		const std::string key = Base64(nonce, sizeof(nonce));
+		std::string path = OM_SOCKET_PATH;
+		if (m_sessionKey != 0)
+		{
+			path += utils::format("?sessionKey=%u", m_sessionKey);
+		}
+		const std::string request = utils::format("GET %s HTTP/1.1\r\n"
+												  "Host: %s:%u\r\n"
+												  "Upgrade: websocket\r\n"
+												  "Connection: Upgrade\r\n"
+												  "Sec-WebSocket-Key: %s\r\n"
+												  "Sec-WebSocket-Version: 13\r\n\r\n",
+												  path.c_str(),
+												  m_host.c_str(),
+												  m_port,
+												  key.c_str());
+		if (!SendAll(m_fd, (const uint8_t*)request.c_str(), request.size()))
+		{
+			warn("Failed to send object model socket request to %s", m_host.c_str());
+			return false;
+		}
+
+		// Anything after the headers is already part of the first frame
+		std::string response;
+		size_t end;
+		const long long start = TimeHelper::getCurrentTime();
+		while ((end = response.find("\r\n\r\n")) == std::string::npos)
+		{
+			if (exitPending() || response.size() > OM_SOCKET_BUFFER_SIZE ||
+				TimeHelper::getCurrentTime() - start > OM_SOCKET_TIMEOUT)
+			{
+				warn("No object model socket response from %s", m_host.c_str());
+				return false;
+			}
+			struct pollfd pfd = {m_fd, POLLIN, 0};
+			if (poll(&pfd, 1, OM_SOCKET_POLL_INTERVAL) <= 0)
+				continue;
+			char buffer[512];
+			const ssize_t received = recv(m_fd, buffer, sizeof(buffer), 0);
+			if (received < 0 && (errno == EAGAIN || errno == EINTR))
+				continue;
+			if (received <= 0)
+			{
+				warn("Object model socket closed by %s during the handshake", m_host.c_str());
+				return false;
+			}
+			response.append(buffer, received);
+		}
+
+		int status = 0;
+		if (sscanf(response.c_str(), "HTTP/%*s %d", &status) != 1 || status != 101)
+		{
+			// Older versions of DSF, or a proxy in the way
+			warn("Object model socket refused by %s with status %d, polling instead", m_host.c_str(), status);
+			UpdateState(State::Unsupported);
+			return false;
+		}
+
+		unsigned char digest[SHA_DIGEST_LENGTH];
+		const std::string accept = key + s_acceptGuid;
+		SHA1((const unsigned char*)accept.c_str(), accept.size(), digest);
+		const std::string expected = Base64(digest, sizeof(digest));
+		bool accepted = false;
+		for (size_t line = response.find("\r\n") + 2; line < end; line = response.find("\r\n", line) + 2)
+		{
+			if (strncasecmp(response.c_str() + line, "Sec-WebSocket-Accept:", 21) != 0)
+				continue;
+			std::string value = response.substr(line + 21, response.find("\r\n", line) - line - 21);
+			value.erase(0, value.find_first_not_of(" \t"));
+			value.erase(value.find_last_not_of(" \t") + 1);
+			accepted = value == expected;
+		}
+		if (!accepted)
+		{
+			warn("Object model socket from %s not accepted", m_host.c_str());
+			return false;
+		}
+
+		info("Object model socket open to %s:%u", m_host.c_str(), m_port);
+		m_lastReceive = m_lastSend = TimeHelper::getCurrentTime();
+		return Receive((const uint8_t*)response.c_str() + end + 4, response.size() - end - 4);
+	}
+
+	bool ObjectModelSocket::SendFrame(uint8_t opcode, const char* data, size_t len)
+	{
+		// Frames sent by a client are masked. Only short frames are sent
+		uint8_t frame[6 + 125];
+		if (len > 125)
+			return false;
+		frame[0] = 0x80 | opcode;
+		frame[1] = 0x80 | (uint8_t)len;
+		for (size_t i = 0; i < 4; i++)
+		{
+			frame[2 + i] = (uint8_t)rand();
+		}
+		for (size_t i = 0; i < len; i++)
+		{
+			frame[6 + i] = (uint8_t)data[i] ^ frame[2 + (i & 3)];
+		}
+		if (!SendAll(m_fd, frame, 6 + len))
+		{
+			warn("Failed to send to object model socket");
+			return false;
+		}
+		m_lastSend = TimeHelper::getCurrentTime();
+		return true;
+	}
+
+	size_t ObjectModelSocket::HeaderSize() const
+	{
+		if (m_headerLength < 2)
+			return 2;
+		const uint8_t length = m_header[1] & 0x7F;
+		return 2 + (length == 126 ? 2 : length == 127 ? 8 : 0) + ((m_header[1] & 0x80) ? 4 : 0);
+	}
+
+	bool ObjectModelSocket::StartFrame()
+	{
+		m_opcode = m_header[0] & 0x0F;
+		m_final = (m_header[0] & 0x80) != 0;
+		if (m_header[1] & 0x80)
+		{
+			warn("Masked frame received from the object model socket");
+			return false;
+		}
+		m_payloadLeft = m_header[1] & 0x7F;
+		if (m_payloadLeft >= 126)
+		{
+			const size_t lengthBytes = m_payloadLeft == 126 ? 2 : 8;
+			m_payloadLeft = 0;
+			for (size_t i = 0; i < lengthBytes; i++)
+			{
+				m_payloadLeft = (m_payloadLeft << 8) | m_header[2 + i];
+			}
+		}
+
+		if (m_opcode >= opClose)
+		{
+			if (!m_final || m_payloadLeft > 125)
+			{
+				warn("Invalid control frame received from the object model socket");
+				return false;
+			}
+			m_control.clear();
+			return true;
+		}
+		if (m_opcode == opContinuation)
+		{
+			if (!m_inMessage)
+			{
+				warn("Unexpected continuation frame received from the object model socket");
+				return false;
+			}
+			return true;
+		}
+		if (m_inMessage)
+		{
+			warn("Object model socket message started before the previous one ended");
+			return false;
+		}
+		m_inMessage = true;
+		m_messageLength = 0;
+		m_jsonMessage = false;
+		return true;
+	}
+
+	bool ObjectModelSocket::Receive(const uint8_t* data, size_t len)
+	{
+		while (len > 0)
+		{
+			if (m_headerLength < HeaderSize())
+			{
+				m_header[m_headerLength++] = *data++;
+				len--;
+				if (m_headerLength < HeaderSize())
+					continue;
+				if (!StartFrame())
+					return false;
+				if (m_payloadLeft == 0 && !EndFrame())
+					return false;
+				continue;
+			}
+
+			const size_t chunk = (size_t)std::min((uint64_t)len, m_payloadLeft);
+			if (m_opcode >= opClose)
+			{
+				m_control.append((const char*)data, chunk);
+			}
+			else
+			{
+				if (m_messageLength == 0)
+				{
+					m_jsonMessage = data[0] == '{';
+				}
+				m_messageLength += chunk;
+				if (m_jsonMessage)
+				{
+					Mutex::Autolock lock(m_deliverLock);
+					if (exitPending())
+						return false;
+					// Polling stops before the first message reaches the observers
+					__atomic_store_n(&m_delivering, true, __ATOMIC_RELEASE);
+					m_decoder->CheckInput(data, chunk);
+				}
+			}
+			data += chunk;
+			len -= chunk;
+			m_payloadLeft -= chunk;
+			if (m_payloadLeft == 0 && !EndFrame())
+				return false;
+		}
+		return true;
+	}
+
+	bool ObjectModelSocket::EndFrame()
+	{
+		m_headerLength = 0;
+		m_lastReceive = TimeHelper::getCurrentTime();
+		KickWatchdog();
+
+		switch (m_opcode)
+		{
+		case opClose:
+			info("Object model socket closed by %s", m_host.c_str());
+			return false;
+		case opPing:
+			return SendFrame(opPong, m_control.c_str(), m_control.size());
+		case opPong:
+			return true;
+		default:
+			break;
+		}
+		if (!m_final)
+			return true;
+
+		m_inMessage = false;
+		if (!m_jsonMessage)
+			return true;
+
+		{
+			Mutex::Autolock lock(m_deliverLock);
+			if (exitPending())
+				return false;
+			// Start the next message from a clean state, even if this one could not be parsed
+			m_decoder->CheckInput((const unsigned char*)"\n", 1);
+			m_receivedMessages++;
+			if (GetState() != State::Streaming)
+			{
+				info("Object model received from %s, %llu bytes", m_host.c_str(), (unsigned long long)m_messageLength);
+				SetState(State::Streaming);
+			}
+		}
+		// The next patch is only sent once this one has been acknowledged
+		return SendFrame(opText, "OK\n", 3);
+	}
+
+	bool ObjectModelSocket::threadLoop()
+	{
+		// DSF sends the object model itself, which is decoded like the result of a live rr_model response
+		JsonDecoder decoder;
+		decoder.SetPrefix("result:");
+		m_decoder = &decoder;
+		m_headerLength = 0;
+		m_inMessage = false;
+		UpdateState(State::Connecting);
+
+		if (Open() && Handshake())
+		{
+			uint8_t buffer[OM_SOCKET_BUFFER_SIZE];
+			while (!exitPending())
+			{
+				const long long now = TimeHelper::getCurrentTime();
+				if (now - m_lastReceive > OM_SOCKET_TIMEOUT)
+				{
+					warn("Nothing received from the object model socket for %d ms", OM_SOCKET_TIMEOUT);
+					break;
+				}
+				if (now - m_lastSend > OM_SOCKET_PING_INTERVAL && !SendFrame(opText, "PING\n", 5))
+					break;
+
+				struct pollfd pfd = {m_fd, POLLIN, 0};
+				const int ready = poll(&pfd, 1, OM_SOCKET_POLL_INTERVAL);
+				if (ready < 0 && errno != EINTR)
+					break;
+				if (ready <= 0)
+					continue;
+				const ssize_t received = recv(m_fd, buffer, sizeof(buffer), 0);
+				if (received < 0 && (errno == EAGAIN || errno == EINTR))
+					continue;
+				if (received <= 0)
+				{
+					// Also ends here once Stop has shut the socket down
+					if (!exitPending())
+						info("Object model socket closed by %s", m_host.c_str());
+					break;
+				}
+				if (!Receive(buffer, received))
+					break;
+			}
+		}
+		Close();
+		m_decoder = nullptr;
+		// Nothing more reaches the observers, polling can take over again
+		__atomic_store_n(&m_delivering, false, __ATOMIC_RELEASE);
+
+		if (exitPending())
+		{
+			SetState(State::Stopped);
+			return false;
+		}
+		if (GetState() == State::Unsupported || !UpdateState(State::Error))
+			return false;
+
+		const long long failed = TimeHelper::getCurrentTime();
+		while (!exitPending() && TimeHelper::getCurrentTime() - failed < OM_SOCKET_RETRY_INTERVAL)
+		{
+			Thread::sleep(OM_SOCKET_POLL_INTERVAL);
+		}
+		return !exitPending(); // reconnect
+	}
+} // namespace Comm
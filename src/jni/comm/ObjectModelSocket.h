@@ -0,0 +1,107 @@
+/*
+ * ObjectModelSocket.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#ifndef JNI_COMM_OBJECTMODELSOCKET_H_
+#define JNI_COMM_OBJECTMODELSOCKET_H_
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <system/Mutex.h>
+#include <system/Thread.h>
+
+namespace Comm
+{
+	class JsonDecoder;
+
+	/// @brief Client for the object model WebSocket of DuetSoftwareFramework, used in SBC mode instead of polling.
+	///
+	/// DSF sends the whole object model when the socket opens, then patches holding only the values that changed,
+	/// each one once the previous one has been acknowledged. Both are passed to the observers through a JsonDecoder
+	/// as they arrive. While the socket is not delivering the object model is polled as usual, and the socket is
+	/// opened again after OM_SOCKET_RETRY_INTERVAL.
+	class ObjectModelSocket : public Thread
+	{
+	  public:
+		enum class State
+		{
+			Stopped = 0,
+			Connecting,
+			Streaming,
+			Unsupported, // the server does not offer the socket
+			Error,
+		};
+
+		ObjectModelSocket();
+		virtual ~ObjectModelSocket();
+
+		/// @brief Open the socket, unless it is already open to the same server
+		/// @param baseUrl Base URL of the Duet, "http://host[:port]"
+		/// @param sessionKey Key returned by rr_connect, 0 if none
+		bool Start(const std::string& baseUrl, uint32_t sessionKey);
+		/// @brief Ask the socket thread to close the socket, without waiting for it to exit. Once this returns nothing
+		/// more is passed to the observers, so the object model can be cleared
+		void Stop();
+
+		State GetState() const { return __atomic_load_n(&m_state, __ATOMIC_ACQUIRE); }
+		/// @brief True from the first byte of the object model passed to the observers until the socket thread has
+		/// closed the socket, which may be after Stop has returned
+		bool IsDelivering() const { return __atomic_load_n(&m_delivering, __ATOMIC_ACQUIRE); }
+		uint32_t GetReceivedMessages() const { return m_receivedMessages; }
+
+	  protected:
+		virtual bool threadLoop();
+
+	  private:
+		void SetState(State state);
+		// Changes the state from the socket thread, unless Stop has been called
+		bool UpdateState(State state);
+		bool Open();
+		bool WaitConnected(int fd);
+		void Close();
+		bool Handshake();
+		bool SendFrame(uint8_t opcode, const char* data, size_t len);
+		bool Receive(const uint8_t* data, size_t len);
+		size_t HeaderSize() const;
+		bool StartFrame();
+		bool EndFrame();
+
+		std::string m_baseUrl;
+		std::string m_host;
+		uint16_t m_port;
+		uint32_t m_sessionKey;
+		// Read from any thread, only accessed through __atomic builtins
+		State m_state;
+		bool m_delivering;
+		uint32_t m_receivedMessages;
+
+		// Held by the socket thread while it passes data to the observers or changes the state, and by Stop
+		Mutex m_deliverLock;
+
+		// Set and closed by the socket thread, shut down by Stop to end a blocked send
+		Mutex m_fdLock;
+		int m_fd;
+
+		// Only accessed from the socket thread
+		JsonDecoder* m_decoder;
+		long long m_lastReceive;
+		long long m_lastSend;
+
+		// Frame parser state. The payload of data frames is passed on as it arrives, control frames are collected
+		uint8_t m_header[14];
+		size_t m_headerLength;
+		uint8_t m_opcode;
+		bool m_final;
+		uint64_t m_payloadLeft;
+		std::string m_control;
+		bool m_inMessage;
+		uint64_t m_messageLength;
+		bool m_jsonMessage; // Anything else, e.g. "PONG", is not passed to the decoder
+	};
+} // namespace Comm
+
+#endif /* JNI_COMM_OBJECTMODELSOCKET_H_ */
@@ -0,0 +1,131 @@
+/*
+ * OmProjection.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "DebugLevels.h"
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+#include "Debug.h"
+
+#include "Comm/Commands.h"
+#include "Configuration.h"
+#include "OmProjection.h"
+#include "UI/OmObserver.h"
+#include <algorithm>
+#include <string.h>
+
+namespace Comm
+{
+	// True if the id is the path or below it
+	static bool IdInPath(const char* id, const std::string& path)
+	{
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			if (id[i] != (path[i] == '.' ? ':' : path[i]))
+				return false;
+		}
+		const char next = id[path.size()];
+		return next == '\0' || next == ':' || next == '^';
+	}
+
+	// True if a key fetched on its own is below the path
+	static bool HoldsSeparateKey(const std::string& path, const std::vector<std::string>& separateKeys)
+	{
+		for (const std::string& separate : separateKeys)
+		{
+			if (separate.size() > path.size() && separate.compare(0, path.size(), path) == 0 &&
+				separate[path.size()] == '.')
+				return true;
+		}
+		return false;
+	}
+
+	// Adds the path needed for one id, sets wholeKey if the id needs the whole key
+	static void AddPath(const char* key,
+						const char* id,
+						const std::vector<std::string>& separateKeys,
+						std::vector<std::string>& paths,
+						bool& wholeKey)
+	{
+		const size_t keyLen = strlen(key);
+		if (strncmp(id, key, keyLen) != 0)
+			return;
+		for (const std::string& separate : separateKeys)
+		{
+			if (IdInPath(id, separate))
+				return;
+		}
+		if (id[keyLen] == '\0' || id[keyLen] == '^')
+		{
+			// The key itself, or an array of objects that can only be requested whole
+			wholeKey = true;
+			return;
+		}
+		if (id[keyLen] != ':')
+			return;
+
+		std::string path(key);
+		const char* component = id + keyLen + 1;
+		while (true)
+		{
+			const char* end = strpbrk(component, "^:");
+			const size_t len = end == nullptr ? strlen(component) : end - component;
+			const bool isArray = end != nullptr && *end == '^';
+			const bool isValue = end == nullptr;
+			// A value is requested through the object holding it, unless that is the key itself or the object also
+			// holds a key that is fetched on its own
+			if (isValue && path.size() > keyLen && !HoldsSeparateKey(path, separateKeys))
+				break;
+			path += '.';
+			path.append(component, len);
+			if (isArray || isValue)
+				break;
+			component = end + 1;
+		}
+		// An object holding a key fetched on its own is only observed for being null, which the response to that key
+		// shows as well
+		if (HoldsSeparateKey(path, separateKeys))
+			return;
+		paths.push_back(path);
+	}
+
+	std::vector<std::string> GetObservedPaths(const char* key, const std::vector<std::string>& separateKeys)
+	{
+		std::vector<std::string> paths;
+		bool wholeKey = false;
+		for (auto* observer = UI::g_omFieldObserverHead; observer != nullptr; observer = observer->next)
+		{
+			AddPath(key, observer->GetKey(), separateKeys, paths, wholeKey);
+		}
+		for (auto* observer = UI::g_omArrayEndObserverHead; observer != nullptr; observer = observer->next)
+		{
+			AddPath(key, observer->GetKey(), separateKeys, paths, wholeKey);
+		}
+		SearchFieldTable(""); // Sorts the table first, so it is not reordered while being read
+		for (size_t i = 0; i < g_fieldTableSize; i++)
+		{
+			AddPath(key, g_fieldTable[i].key, separateKeys, paths, wholeKey);
+		}
+		if (wholeKey || paths.empty())
+			return std::vector<std::string>();
+
+		// Drop duplicates, and paths inside another path
+		std::sort(paths.begin(), paths.end());
+		std::vector<std::string> projected;
+		for (const std::string& path : paths)
+		{
+			if (!projected.empty() && path.compare(0, projected.back().size(), projected.back()) == 0 &&
+				(path.size() == projected.back().size() || path[projected.back().size()] == '.'))
+				continue;
+			projected.push_back(path);
+		}
+		if (projected.size() > OM_PROJECTION_MAX_PATHS)
+		{
+			info("%s needs %u paths, requesting it whole", key, projected.size());
+			return std::vector<std::string>();
+		}
+		return projected;
+	}
+} // namespace Comm
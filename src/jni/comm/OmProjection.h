@@ -0,0 +1,28 @@
+/*
+ * OmProjection.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Works out which parts of each object model key the UI uses, from the ids of the registered observers and the
+ *  field table, so that M409 / rr_model requests can ask for those parts rather than the whole key. RRF only
+ *  accepts paths to objects and arrays, not to fields inside array elements, so a path ends at the first array, or
+ *  at the object holding a value. Values directly below the key are requested on their own.
+ */
+
+#ifndef JNI_COMM_OMPROJECTION_H_
+#define JNI_COMM_OMPROJECTION_H_
+
+#include <string>
+#include <vector>
+
+namespace Comm
+{
+	/// @brief Paths below a top-level key that cover every observed field, e.g. "move.axes" or "state.status"
+	/// @param separateKeys Keys below the key that are fetched on their own, e.g. "job.build.objects". They are left
+	/// out, so the objects holding them are not requested whole
+	/// @return Empty if the whole key has to be requested
+	std::vector<std::string> GetObservedPaths(const char* key, const std::vector<std::string>& separateKeys);
+} // namespace Comm
+
+#endif /* JNI_COMM_OMPROJECTION_H_ */
@@ -0,0 +1,515 @@
+/*
+ * OmSnapshot.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "DebugLevels.h"
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+
+#include "AllocationTracker.h"
+#include "Comm/JsonDecoder.h"
+#include "Configuration.h"
+#include "ObjectModel/Utils.h"
+#include "OmSnapshot.h"
+#include "utils/TimeHelper.h"
+#include <errno.h>
+#include <map>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <system/Mutex.h>
+#include <unistd.h>
+
+#include "Debug.h"
+
+namespace Comm
+{
+	struct SnapshotField
+	{
+		const char* id;
+		const char* fixedValue; // stored instead of the received value, for fields that only create the element
+	};
+
+	// Fields that describe the machine rather than its current state. Anything else received for a snapshot key is
+	// left for the live responses, so the snapshot only changes when the configuration does.
+	// Sorted by id, as FindField bisects it for every value of a detailed response
+	static constexpr SnapshotField s_fields[] = {
+		{"fans^", nullptr},
+		{"fans^:requestedValue", "0"},
+		{"heat:bedHeaters^", nullptr},
+		{"heat:chamberHeaters^", nullptr},
+		{"heat:heaters^", nullptr},
+		{"heat:heaters^:max", nullptr},
+		{"heat:heaters^:min", nullptr},
+		{"heat:heaters^:sensor", nullptr},
+		{"move:axes^:letter", nullptr},
+		{"move:axes^:max", nullptr},
+		{"move:axes^:min", nullptr},
+		{"move:axes^:visible", nullptr},
+		{"move:extruders^:filamentDiameter", nullptr},
+		{"move:extruders^:stepsPerMm", nullptr},
+		{"move:kinematics:name", nullptr},
+		{"sensors:analog^", nullptr},
+		{"sensors:analog^:name", nullptr},
+		{"spindles^", nullptr},
+		{"spindles^:canReverse", nullptr},
+		{"spindles^:max", nullptr},
+		{"spindles^:min", nullptr},
+		{"tools^", nullptr},
+		{"tools^:extruders^", nullptr},
+		{"tools^:fans^", nullptr},
+		{"tools^:filamentExtruder", nullptr},
+		{"tools^:heaters^", nullptr},
+		{"tools^:name", nullptr},
+		{"tools^:spindle", nullptr},
+	};
+	constexpr size_t FIELD_COUNT = sizeof(s_fields) / sizeof(s_fields[0]);
+	static_assert(FIELD_COUNT < 0xFF, "Field index must fit in a record tag");
+
+	// Same order as strcmp
+	constexpr bool IdLess(const char* a, const char* b)
+	{
+		return *a == *b ? *a != '\0' && IdLess(a + 1, b + 1) : (uint8_t)*a < (uint8_t)*b;
+	}
+
+	constexpr bool FieldsSortedFrom(size_t i)
+	{
+		return i + 1 >= FIELD_COUNT || (IdLess(s_fields[i].id, s_fields[i + 1].id) && FieldsSortedFrom(i + 1));
+	}
+	static_assert(FieldsSortedFrom(0), "Snapshot fields must be sorted by id");
+
+	// Replayed in this order so heaters and extruders exist before the tools that refer to them
+	static const char* s_keys[] = {"move", "heat", "tools", "spindles", "fans", "sensors"};
+	constexpr size_t KEY_COUNT = sizeof(s_keys) / sizeof(s_keys[0]);
+
+	constexpr uint8_t ARRAY_END_TAG = 0xFF;
+	constexpr uint8_t FILE_VERSION = 1;
+
+	struct SnapshotSection
+	{
+		std::string pending; // records of the response being received, from all its pages so far
+		bool recording;
+		std::string records;
+	};
+
+	// Keyed by the key that was requested. That is one of s_keys, or a path below one when the key is projected, see
+	// OmProjection.h. The sections of a key never overlap, receiving one drops the others it covers or is covered by
+	typedef std::map<std::string, SnapshotSection> SectionMap;
+
+	static Mutex s_lock;
+	static SectionMap s_sections;
+	static bool s_dirty = false;
+	static long long s_changedTime = 0;
+	static bool s_responseReceived = false; // a detailed response to a snapshot key arrived, so the file is older
+	static Memory::TrackedBytes<Memory::Subsystem::Json> s_sectionBytes;
+
+	// Changes whenever the field table does, so a snapshot written by another version is discarded rather than
+	// replayed against the wrong fields
+	static uint32_t FieldTableHash()
+	{
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < FIELD_COUNT; i++)
+		{
+			for (const char* c = s_fields[i].id; *c != '\0'; c++)
+			{
+				hash = (hash ^ (uint8_t)*c) * 16777619u;
+			}
+			hash = (hash ^ (s_fields[i].fixedValue != nullptr ? 1 : 0)) * 16777619u;
+		}
+		return hash;
+	}
+
+	// Index in s_keys of the key a path is below, KEY_COUNT if it is not a snapshot key
+	static size_t FindKey(const char* key)
+	{
+		const size_t len = strcspn(key, ".");
+		for (size_t i = 0; i < KEY_COUNT; i++)
+		{
+			if (strncmp(s_keys[i], key, len) == 0 && s_keys[i][len] == '\0')
+				return i;
+		}
+		return KEY_COUNT;
+	}
+
+	// True if one path is the other or is below it
+	static bool PathsOverlap(const std::string& a, const std::string& b)
+	{
+		const std::string& shorter = a.size() < b.size() ? a : b;
+		const std::string& longer = a.size() < b.size() ? b : a;
+		return longer.compare(0, shorter.size(), shorter) == 0 &&
+			   (longer.size() == shorter.size() || longer[shorter.size()] == '.');
+	}
+
+	// Called with s_lock held, whenever a whole section has been replaced
+	static void TrackSections()
+	{
+		size_t bytes = 0;
+		for (SectionMap::const_iterator it = s_sections.begin(); it != s_sections.end(); ++it)
+		{
+			bytes += Memory::MAP_NODE_OVERHEAD + sizeof(*it) + Memory::HeapBytes(it->first) +
+					 Memory::HeapBytes(it->second.pending) + Memory::HeapBytes(it->second.records);
+		}
+		s_sectionBytes.Set(bytes);
+	}
+
+	static SnapshotSection* FindSection(const char* key, bool create)
+	{
+		SectionMap::iterator it = s_sections.find(key);
+		if (it != s_sections.end())
+			return &it->second;
+		if (!create || FindKey(key) == KEY_COUNT)
+			return nullptr;
+		SnapshotSection& section = s_sections[key];
+		section.recording = false;
+		return &section;
+	}
+
+	static size_t FindField(const char* id)
+	{
+		size_t low = 0;
+		size_t high = FIELD_COUNT;
+		while (low < high)
+		{
+			const size_t mid = (low + high) / 2;
+			const int cmp = strcmp(s_fields[mid].id, id);
+			if (cmp == 0)
+				return mid;
+			if (cmp < 0)
+			{
+				low = mid + 1;
+			}
+			else
+			{
+				high = mid;
+			}
+		}
+		return FIELD_COUNT;
+	}
+
+	static bool AppendIndices(std::string& out, const size_t indices[])
+	{
+		for (size_t i = 0; i < MAX_ARRAY_NESTING; i++)
+		{
+			if (indices[i] > 0xFF)
+				return false;
+			out += (char)indices[i];
+		}
+		return true;
+	}
+
+	static void AppendString(std::string& out, const char* str)
+	{
+		size_t len = strlen(str);
+		if (len > 0xFF)
+		{
+			len = 0xFF;
+		}
+		out += (char)len;
+		out.append(str, len);
+	}
+
+	void StartOmSnapshotSection(const char* key, bool firstPage)
+	{
+		Mutex::Autolock lock(s_lock);
+		SnapshotSection* section = FindSection(key, true);
+		if (section == nullptr)
+			return;
+		s_responseReceived = true;
+		if (firstPage)
+		{
+			section->pending.clear();
+			section->recording = true;
+		}
+		// A later page without the first one, e.g. after a reset, would leave out the elements before it
+	}
+
+	void RecordOmSnapshotValue(const char* key, const char* id, const char* data, const size_t indices[])
+	{
+		const size_t field = FindField(id);
+		if (field == FIELD_COUNT)
+			return;
+
+		Mutex::Autolock lock(s_lock);
+		SnapshotSection* section = FindSection(key, false);
+		if (section == nullptr || !section->recording)
+			return;
+
+		std::string record;
+		record += (char)field;
+		if (!AppendIndices(record, indices))
+			return;
+		AppendString(record, s_fields[field].fixedValue != nullptr ? s_fields[field].fixedValue : data);
+		section->pending += record;
+	}
+
+	void RecordOmSnapshotArrayEnd(const char* key, const char* id, const size_t indices[])
+	{
+		Mutex::Autolock lock(s_lock);
+		SnapshotSection* section = FindSection(key, false);
+		if (section == nullptr || !section->recording)
+			return;
+
+		std::string record;
+		record += (char)ARRAY_END_TAG;
+		AppendString(record, id);
+		if (!AppendIndices(record, indices))
+			return;
+		section->pending += record;
+	}
+
+	void EndOmSnapshotSection(const char* key, bool lastPage)
+	{
+		Mutex::Autolock lock(s_lock);
+		SnapshotSection* section = FindSection(key, false);
+		if (section == nullptr || !section->recording || !lastPage)
+			return;
+
+		section->recording = false;
+		bool changed = section->pending != section->records;
+		section->records.swap(section->pending);
+		section->pending.clear();
+
+		// The key was requested whole after being projected, or the other way round
+		for (SectionMap::iterator it = s_sections.begin(); it != s_sections.end();)
+		{
+			if (it->first != key && PathsOverlap(it->first, key))
+			{
+				s_sections.erase(it++);
+				changed = true;
+				continue;
+			}
+			++it;
+		}
+		TrackSections();
+		if (!changed)
+			return;
+
+		dbg("Snapshot of %s changed (%u bytes)", key, (unsigned)section->records.size());
+		s_dirty = true;
+		s_changedTime = TimeHelper::getCurrentTime();
+	}
+
+	// Walks the records of a section, calling the functions for each one
+	// @return false if the records are malformed
+	template <typename ValueFunc, typename ArrayEndFunc>
+	static bool ParseRecords(const std::string& records, ValueFunc onValue, ArrayEndFunc onArrayEnd)
+	{
+		const uint8_t* p = (const uint8_t*)records.data();
+		const uint8_t* end = p + records.size();
+		char str[0x100];
+		size_t indices[MAX_ARRAY_NESTING];
+
+		while (p < end)
+		{
+			const uint8_t tag = *p++;
+			if (tag == ARRAY_END_TAG)
+			{
+				if (p >= end || end - p < 1 + *p + (ptrdiff_t)MAX_ARRAY_NESTING)
+					return false;
+				const size_t len = *p++;
+				memcpy(str, p, len);
+				str[len] = '\0';
+				p += len;
+				for (size_t i = 0; i < MAX_ARRAY_NESTING; i++)
+				{
+					indices[i] = *p++;
+				}
+				onArrayEnd(str, indices);
+				continue;
+			}
+
+			if (tag >= FIELD_COUNT || end - p < (ptrdiff_t)MAX_ARRAY_NESTING + 1)
+				return false;
+			for (size_t i = 0; i < MAX_ARRAY_NESTING; i++)
+			{
+				indices[i] = *p++;
+			}
+			const size_t len = *p++;
+			if (end - p < (ptrdiff_t)len)
+				return false;
+			memcpy(str, p, len);
+			str[len] = '\0';
+			p += len;
+			onValue(s_fields[tag].id, str, indices);
+		}
+		return true;
+	}
+
+	static bool LoadOmSnapshot()
+	{
+		FILE* f = fopen(OM_SNAPSHOT_FILE, "rb");
+		if (f == nullptr)
+		{
+			info("No object model snapshot");
+			return false;
+		}
+		std::string contents;
+		char buffer[1024];
+		size_t count;
+		while ((count = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		{
+			contents.append(buffer, count);
+		}
+		fclose(f);
+
+		// Header: "OMS", version, field table hash. Then per key: key, 16 bit length, records
+		const uint32_t hash = FieldTableHash();
+		if (contents.size() < 8 || memcmp(contents.data(), "OMS", 3) != 0 || (uint8_t)contents[3] != FILE_VERSION ||
+			memcmp(contents.data() + 4, &hash, sizeof(hash)) != 0)
+		{
+			warn("Discarding object model snapshot from another version");
+			return false;
+		}
+
+		SectionMap sections;
+		size_t pos = 8;
+		while (pos < contents.size())
+		{
+			const size_t keyLen = (uint8_t)contents[pos++];
+			if (contents.size() - pos < keyLen + 2)
+				break;
+			const std::string key = contents.substr(pos, keyLen);
+			pos += keyLen;
+			const size_t len = (uint8_t)contents[pos] | ((uint8_t)contents[pos + 1] << 8);
+			pos += 2;
+			if (contents.size() - pos < len)
+				break;
+
+			if (FindKey(key.c_str()) != KEY_COUNT)
+			{
+				SnapshotSection& section = sections[key];
+				section.recording = false;
+				section.records = contents.substr(pos, len);
+				if (!ParseRecords(
+						section.records,
+						[](const char*, const char*, const size_t*) {},
+						[](const char*, const size_t*) {}))
+					break;
+			}
+			pos += len;
+		}
+		if (pos != contents.size())
+		{
+			error("Object model snapshot is corrupt");
+			return false;
+		}
+
+		Mutex::Autolock lock(s_lock);
+		if (s_responseReceived)
+		{
+			info("Duet answered before the object model snapshot was loaded, not using it");
+			return false;
+		}
+		s_sections = sections;
+		TrackSections();
+		info("Loaded object model snapshot (%u bytes)", (unsigned)contents.size());
+		return true;
+	}
+
+	// Called with a JsonDecoder::ObserverGuard held
+	static void ReplayOmSnapshot()
+	{
+		std::string records[KEY_COUNT];
+		{
+			Mutex::Autolock lock(s_lock);
+			for (SectionMap::const_iterator it = s_sections.begin(); it != s_sections.end(); ++it)
+			{
+				records[FindKey(it->first.c_str())] += it->second.records;
+			}
+		}
+
+		JsonDecoder decoder;
+		for (size_t i = 0; i < KEY_COUNT; i++)
+		{
+			ParseRecords(
+				records[i],
+				[&decoder](const char* id, const char* data, const size_t* indices) {
+					decoder.NotifyObservers(id, data, indices);
+				},
+				[&decoder](const char* id, const size_t* indices) {
+					decoder.ProcessArrayEnd(id, indices);
+				});
+		}
+	}
+
+	bool RestoreOmSnapshot()
+	{
+		if (!LoadOmSnapshot())
+			return false;
+		// Decoding threads wait until the replay is done, so a response that arrives meanwhile overwrites the
+		// replayed values rather than the other way round
+		JsonDecoder::ObserverGuard observerGuard;
+		{
+			Mutex::Autolock lock(s_lock);
+			if (s_responseReceived)
+			{
+				info("Duet answered while the object model snapshot was loaded, not replaying it");
+				return false;
+			}
+		}
+		ReplayOmSnapshot();
+		return true;
+	}
+
+	void ResetToOmSnapshot()
+	{
+		JsonDecoder::ObserverGuard observerGuard;
+		OM::RemoveAll();
+		ReplayOmSnapshot();
+	}
+
+	void SaveOmSnapshotIfChanged()
+	{
+		std::string contents;
+		{
+			Mutex::Autolock lock(s_lock);
+			if (!s_dirty || TimeHelper::getCurrentTime() - s_changedTime < OM_SNAPSHOT_SAVE_DELAY)
+				return;
+			s_dirty = false;
+
+			const uint32_t hash = FieldTableHash();
+			contents.append("OMS", 3);
+			contents += (char)FILE_VERSION;
+			contents.append((const char*)&hash, sizeof(hash));
+			for (SectionMap::const_iterator it = s_sections.begin(); it != s_sections.end(); ++it)
+			{
+				const std::string& records = it->second.records;
+				if (records.empty() || records.size() > 0xFFFF)
+					continue;
+				AppendString(contents, it->first.c_str());
+				contents += (char)(records.size() & 0xFF);
+				contents += (char)(records.size() >> 8);
+				contents += records;
+			}
+		}
+
+		// Written to a temporary file first so a power cut leaves either the old or the new snapshot
+		const std::string tempFile = std::string(OM_SNAPSHOT_FILE) + ".tmp";
+		FILE* f = fopen(tempFile.c_str(), "wb");
+		if (f == nullptr)
+		{
+			error("Failed to create \"%s\": %s", tempFile.c_str(), strerror(errno));
+			return;
+		}
+		const bool ok = fwrite(contents.data(), 1, contents.size(), f) == contents.size() && fflush(f) == 0 &&
+						fsync(fileno(f)) == 0;
+		if (fclose(f) != 0 || !ok || rename(tempFile.c_str(), OM_SNAPSHOT_FILE) != 0)
+		{
+			error("Failed to write object model snapshot: %s", strerror(errno));
+			remove(tempFile.c_str());
+			return;
+		}
+		info("Saved object model snapshot (%u bytes)", (unsigned)contents.size());
+	}
+
+	void ClearOmSnapshot()
+	{
+		Mutex::Autolock lock(s_lock);
+		s_sections.clear();
+		TrackSections();
+		s_dirty = false;
+		remove(OM_SNAPSHOT_FILE);
+	}
+} // namespace Comm
@@ -0,0 +1,53 @@
+/*
+ * OmSnapshot.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Keeps the configuration-like parts of the object model (tools, heaters, axes, extruders, fans, sensors and
+ *  spindles) in a binary file on flash so the UI can show them at boot, before the Duet has answered.
+ *  The values that created them are recorded from the detailed M409 / rr_model responses to each key and replayed
+ *  through the observers. Every key is still requested on connect and again whenever its seq changes, so live
+ *  responses overwrite the restored values and the snapshot is updated from them.
+ */
+
+#ifndef JNI_COMM_OMSNAPSHOT_H_
+#define JNI_COMM_OMSNAPSHOT_H_
+
+#include <stddef.h>
+
+namespace Comm
+{
+	/// @brief Called by the JSON decoder when a detailed response to an object model key starts
+	/// @param firstPage False for the later pages of an array, which add to the records of the first one
+	void StartOmSnapshotSection(const char* key, bool firstPage);
+
+	/// @brief Called by the JSON decoder for each value of a detailed response
+	void RecordOmSnapshotValue(const char* key, const char* id, const char* data, const size_t indices[]);
+
+	/// @brief Called by the JSON decoder for each array that ends in a detailed response
+	/// @param id Mapped from "result" to the key like the ids of values, as it is replayed through the array-end
+	/// observers
+	void RecordOmSnapshotArrayEnd(const char* key, const char* id, const size_t indices[]);
+
+	/// @brief Called by the JSON decoder when a detailed response has been fully received
+	/// @param lastPage False if more pages of an array follow, the section only replaces the old one after the last
+	void EndOmSnapshotSection(const char* key, bool lastPage);
+
+	/// @brief Read the snapshot file written by a previous run and replay it through the observers, unless a detailed
+	/// response for a snapshot key has already been received. No response is decoded while it is replayed
+	/// @return true if the snapshot was replayed
+	bool RestoreOmSnapshot();
+
+	/// @brief Clear the object model and replay the snapshot through the observers, without a response being decoded
+	/// in between
+	void ResetToOmSnapshot();
+
+	/// @brief Write the snapshot if it changed and has been stable for OM_SNAPSHOT_SAVE_DELAY
+	void SaveOmSnapshotIfChanged();
+
+	/// @brief Forget the snapshot, in memory and on flash
+	void ClearOmSnapshot();
+} // namespace Comm
+
+#endif /* JNI_COMM_OMSNAPSHOT_H_ */
@@ -0,0 +1,344 @@
+/*
+ * RequestTrace.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "Configuration.h"
+#include "RequestTrace.h"
+#include "utils/utils.h"
+#include <Duet3D/General/StringFunctions.h>
+#include <string.h>
+#include <system/Mutex.h>
+#include <time.h>
+#include <vector>
+
+namespace Comm
+{
+	// Upper bounds of the histogram buckets in microseconds, the last bucket holds everything slower
+	static const int64_t s_bucketBounds[] = {
+		100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 5000000,
+	};
+	constexpr size_t BUCKET_COUNT = sizeof(s_bucketBounds) / sizeof(s_bucketBounds[0]) + 1;
+
+	static const char* s_intervalNames[] = {"queue", "connect", "server", "transfer", "parse", "observers", "total"};
+	static_assert(sizeof(s_intervalNames) / sizeof(s_intervalNames[0]) == (size_t)TraceInterval::COUNT,
+				  "Interval names out of date");
+
+	struct LatencyHistogram
+	{
+		uint32_t buckets[BUCKET_COUNT];
+		uint32_t count;
+		int64_t sum;
+		int64_t max;
+	};
+
+	struct LatencyStats
+	{
+		std::string name;
+		uint32_t requests;
+		uint32_t lost; // UART requests that never got a response
+		LatencyHistogram intervals[(size_t)TraceInterval::COUNT];
+	};
+
+	static Mutex s_lock;
+	static std::vector<LatencyStats> s_stats;
+	static RequestTrace s_uartPending[UART_MAX_PENDING_TRACES];
+	static size_t s_uartPendingStart = 0;
+	static size_t s_uartPendingCount = 0;
+	static __thread RequestTrace* s_currentTrace = nullptr;
+
+	RequestTrace::RequestTrace() : endpoint("")
+	{
+		key[0] = '\0';
+		memset(times, 0, sizeof(times));
+	}
+
+	RequestTrace::RequestTrace(const char* endpoint, const char* key) : endpoint(endpoint)
+	{
+		SafeStrncpy(this->key, key != nullptr ? key : "", sizeof(this->key));
+		memset(times, 0, sizeof(times));
+	}
+
+	void RequestTrace::Mark(TraceEvent event)
+	{
+		Set(event, TraceNow());
+	}
+
+	int64_t TraceNow()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + 1;
+	}
+
+	static void AddSample(LatencyHistogram& histogram, int64_t time)
+	{
+		if (time < 0)
+		{
+			time = 0; // parse end is estimated, so can be later than the callback end by a few microseconds
+		}
+		size_t bucket = 0;
+		while (bucket < BUCKET_COUNT - 1 && time > s_bucketBounds[bucket])
+		{
+			bucket++;
+		}
+		histogram.buckets[bucket]++;
+		histogram.count++;
+		histogram.sum += time;
+		if (time > histogram.max)
+		{
+			histogram.max = time;
+		}
+	}
+
+	static LatencyStats* FindStats(const std::string& name)
+	{
+		for (auto& stats : s_stats)
+		{
+			if (stats.name == name)
+				return &stats;
+		}
+		if (s_stats.size() >= LATENCY_MAX_ENTRIES)
+			return nullptr;
+
+		s_stats.push_back(LatencyStats());
+		LatencyStats& stats = s_stats.back();
+		memset(stats.intervals, 0, sizeof(stats.intervals));
+		stats.name = name;
+		stats.requests = 0;
+		stats.lost = 0;
+		return &stats;
+	}
+
+	static void AddTrace(LatencyStats& stats, const RequestTrace& trace)
+	{
+		static const TraceEvent intervalEvents[][2] = {
+			{TraceEvent::Enqueue, TraceEvent::Dispatch},
+			{TraceEvent::Dispatch, TraceEvent::Connect},
+			{TraceEvent::Connect, TraceEvent::FirstByte},
+			{TraceEvent::FirstByte, TraceEvent::Complete},
+			{TraceEvent::Complete, TraceEvent::ParseEnd},
+			{TraceEvent::ParseEnd, TraceEvent::DispatchEnd},
+		};
+
+		stats.requests++;
+		for (size_t i = 0; i < sizeof(intervalEvents) / sizeof(intervalEvents[0]); i++)
+		{
+			if (trace.Has(intervalEvents[i][0]) && trace.Has(intervalEvents[i][1]))
+			{
+				AddSample(stats.intervals[i], trace.Get(intervalEvents[i][1]) - trace.Get(intervalEvents[i][0]));
+			}
+		}
+
+		int64_t last = 0;
+		for (size_t i = 0; i < (size_t)TraceEvent::COUNT; i++)
+		{
+			if (trace.times[i] > last)
+				last = trace.times[i];
+		}
+		if (trace.Has(TraceEvent::Enqueue) && last > 0)
+		{
+			AddSample(stats.intervals[(size_t)TraceInterval::Total], last - trace.Get(TraceEvent::Enqueue));
+		}
+	}
+
+	static void RecordTraceLocked(const RequestTrace& trace)
+	{
+		LatencyStats* stats = FindStats(trace.endpoint);
+		if (stats != nullptr)
+		{
+			AddTrace(*stats, trace);
+		}
+		if (trace.key[0] == '\0')
+			return;
+
+		stats = FindStats(utils::format("%s?key=%s", trace.endpoint, trace.key));
+		if (stats != nullptr)
+		{
+			AddTrace(*stats, trace);
+		}
+	}
+
+	void RecordTrace(const RequestTrace& trace)
+	{
+		Mutex::Autolock lock(s_lock);
+		RecordTraceLocked(trace);
+	}
+
+	TraceScope::TraceScope(RequestTrace* trace) : m_previous(s_currentTrace)
+	{
+		s_currentTrace = trace;
+	}
+
+	TraceScope::~TraceScope()
+	{
+		s_currentTrace = m_previous;
+	}
+
+	static void SetParseTimes(RequestTrace& trace, int64_t parseTime, int64_t observerTime)
+	{
+		// Observers run while the message is being parsed, so parse end is placed after the pure parsing time
+		const int64_t complete = trace.Has(TraceEvent::Complete) ? trace.Get(TraceEvent::Complete) : TraceNow();
+		trace.Set(TraceEvent::ParseEnd, complete + parseTime);
+		trace.Set(TraceEvent::DispatchEnd, complete + parseTime + observerTime);
+	}
+
+	static void DropOldestUartTrace(bool lost)
+	{
+		RequestTrace& trace = s_uartPending[s_uartPendingStart];
+		if (lost)
+		{
+			LatencyStats* stats = FindStats(trace.endpoint);
+			if (stats != nullptr)
+				stats->lost++;
+		}
+		s_uartPendingStart = (s_uartPendingStart + 1) % UART_MAX_PENDING_TRACES;
+		s_uartPendingCount--;
+	}
+
+	void TraceMessageEnd(bool isModelResponse, const char* key, int64_t parseTime, int64_t observerTime)
+	{
+		if (s_currentTrace != nullptr)
+		{
+			SetParseTimes(*s_currentTrace, parseTime, observerTime);
+			return;
+		}
+		if (!isModelResponse)
+			return;
+
+		// UART responses arrive in the order the requests were sent, anything older than the match was not answered
+		Mutex::Autolock lock(s_lock);
+		for (size_t i = 0; i < s_uartPendingCount; i++)
+		{
+			RequestTrace& trace = s_uartPending[(s_uartPendingStart + i) % UART_MAX_PENDING_TRACES];
+			if (strcmp(trace.key, key) != 0)
+				continue;
+
+			trace.Mark(TraceEvent::Complete);
+			if (!trace.Has(TraceEvent::FirstByte))
+				trace.Set(TraceEvent::FirstByte, trace.Get(TraceEvent::Complete));
+			SetParseTimes(trace, parseTime, observerTime);
+			RecordTraceLocked(trace);
+			while (i-- > 0)
+			{
+				DropOldestUartTrace(true);
+			}
+			DropOldestUartTrace(false);
+			return;
+		}
+	}
+
+	void TraceUartRequest(const char* key)
+	{
+		Mutex::Autolock lock(s_lock);
+		if (s_uartPendingCount >= UART_MAX_PENDING_TRACES)
+		{
+			DropOldestUartTrace(true);
+		}
+		RequestTrace& trace =
+			s_uartPending[(s_uartPendingStart + s_uartPendingCount) % UART_MAX_PENDING_TRACES];
+		trace = RequestTrace("M409", key);
+		trace.Mark(TraceEvent::Enqueue);
+		trace.Set(TraceEvent::Dispatch, trace.Get(TraceEvent::Enqueue));
+		trace.Set(TraceEvent::Connect, trace.Get(TraceEvent::Enqueue));
+		s_uartPendingCount++;
+	}
+
+	void TraceUartDataReceived()
+	{
+		Mutex::Autolock lock(s_lock);
+		if (s_uartPendingCount == 0)
+			return;
+		RequestTrace& trace = s_uartPending[s_uartPendingStart];
+		if (!trace.Has(TraceEvent::FirstByte))
+		{
+			trace.Mark(TraceEvent::FirstByte);
+		}
+	}
+
+	static int64_t Percentile(const LatencyHistogram& histogram, uint32_t percent)
+	{
+		if (histogram.count == 0)
+			return 0;
+		const uint32_t target = (histogram.count * percent + 99) / 100;
+		uint32_t seen = 0;
+		for (size_t i = 0; i < BUCKET_COUNT - 1; i++)
+		{
+			seen += histogram.buckets[i];
+			if (seen >= target)
+				return s_bucketBounds[i] < histogram.max ? s_bucketBounds[i] : histogram.max;
+		}
+		return histogram.max;
+	}
+
+	std::string GetLatencySummary()
+	{
+		Mutex::Autolock lock(s_lock);
+		std::string summary;
+		for (auto& stats : s_stats)
+		{
+			summary += utils::format("%s: %u requests", stats.name.c_str(), stats.requests);
+			if (stats.lost > 0)
+			{
+				summary += utils::format(", %u lost", stats.lost);
+			}
+			for (size_t i = 0; i < (size_t)TraceInterval::COUNT; i++)
+			{
+				const LatencyHistogram& histogram = stats.intervals[i];
+				if (histogram.count == 0)
+					continue;
+				// milliseconds, median/90th percentile/maximum
+				summary += utils::format(", %s %.1f/%.1f/%.1f",
+										 s_intervalNames[i],
+										 Percentile(histogram, 50) / 1000.0,
+										 Percentile(histogram, 90) / 1000.0,
+										 histogram.max / 1000.0);
+			}
+			summary += "\n";
+		}
+		return summary;
+	}
+
+	std::string GetLatencyCsv()
+	{
+		Mutex::Autolock lock(s_lock);
+		std::string csv = "request,interval,requests,lost,count,mean_us,max_us";
+		for (size_t i = 0; i < BUCKET_COUNT - 1; i++)
+		{
+			csv += utils::format(",le_%lldus", (long long)s_bucketBounds[i]);
+		}
+		csv += utils::format(",gt_%lldus\n", (long long)s_bucketBounds[BUCKET_COUNT - 2]);
+
+		for (auto& stats : s_stats)
+		{
+			for (size_t i = 0; i < (size_t)TraceInterval::COUNT; i++)
+			{
+				const LatencyHistogram& histogram = stats.intervals[i];
+				csv += utils::format("\"%s\",%s,%u,%u,%u,%lld,%lld",
+									 stats.name.c_str(),
+									 s_intervalNames[i],
+									 stats.requests,
+									 stats.lost,
+									 histogram.count,
+									 histogram.count > 0 ? (long long)(histogram.sum / histogram.count) : 0LL,
+									 (long long)histogram.max);
+				for (size_t j = 0; j < BUCKET_COUNT; j++)
+				{
+					csv += utils::format(",%u", histogram.buckets[j]);
+				}
+				csv += "\n";
+			}
+		}
+		return csv;
+	}
+
+	void ResetLatencyStats()
+	{
+		Mutex::Autolock lock(s_lock);
+		s_stats.clear();
+	}
+} // namespace Comm
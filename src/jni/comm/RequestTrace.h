@@ -0,0 +1,103 @@
+/*
+ * RequestTrace.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Timestamps for each request to the Duet, aggregated into latency histograms per endpoint and per object model
+ *  key. HTTP requests are traced by Comm::AsyncGet, Comm::Get and Comm::Post, M409 requests sent over UART are
+ *  matched to their responses in the order they were sent.
+ */
+
+#ifndef JNI_COMM_REQUESTTRACE_H_
+#define JNI_COMM_REQUESTTRACE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+namespace Comm
+{
+	enum class TraceEvent : uint8_t
+	{
+		Enqueue = 0, // request made
+		Dispatch,	 // sent, or picked up by a network thread
+		Connect,	 // connection established
+		FirstByte,	 // first byte of the response received
+		Complete,	 // whole response received
+		ParseEnd,	 // response parsed, not counting time spent in observers
+		DispatchEnd, // observers and callbacks finished
+		COUNT
+	};
+
+	enum class TraceInterval : uint8_t
+	{
+		Queue = 0, // Enqueue -> Dispatch
+		Connect,   // Dispatch -> Connect
+		Server,	   // Connect -> FirstByte
+		Transfer,  // FirstByte -> Complete
+		Parse,	   // Complete -> ParseEnd
+		Observers, // ParseEnd -> DispatchEnd
+		Total,	   // Enqueue -> last event reached
+		COUNT
+	};
+
+	/// @brief Timestamps of one request in microseconds from TraceNow(), 0 if the event was not reached
+	struct RequestTrace
+	{
+		RequestTrace();
+		RequestTrace(const char* endpoint, const char* key);
+
+		void Mark(TraceEvent event);
+		void Set(TraceEvent event, int64_t time) { times[(size_t)event] = time; }
+		int64_t Get(TraceEvent event) const { return times[(size_t)event]; }
+		bool Has(TraceEvent event) const { return times[(size_t)event] != 0; }
+
+		const char* endpoint; // must outlive the request, e.g. a subUrl literal
+		char key[24];		  // object model key, empty if none
+		int64_t times[(size_t)TraceEvent::COUNT];
+	};
+
+	/// @brief Monotonic time in microseconds, never 0
+	int64_t TraceNow();
+
+	/// @brief Add a finished request to the latency histograms
+	void RecordTrace(const RequestTrace& trace);
+
+	/// @brief Makes a trace the target of TraceMessageEnd() on this thread until the scope is destroyed
+	class TraceScope
+	{
+	  public:
+		explicit TraceScope(RequestTrace* trace);
+		~TraceScope();
+
+	  private:
+		TraceScope(const TraceScope&);
+		TraceScope& operator=(const TraceScope&);
+
+		RequestTrace* m_previous;
+	};
+
+	/// @brief Called by the JSON decoder at the end of each message
+	/// @param isModelResponse true if the message was a response to M409 / rr_model
+	/// @param key Object model key of the response, empty for a live response
+	/// @param parseTime Microseconds spent parsing the message, excluding observers
+	/// @param observerTime Microseconds spent in observers for the message
+	void TraceMessageEnd(bool isModelResponse, const char* key, int64_t parseTime, int64_t observerTime);
+
+	/// @brief Start tracing an M409 request sent over UART
+	void TraceUartRequest(const char* key);
+
+	/// @brief Called when data arrives over UART
+	void TraceUartDataReceived();
+
+	/// @brief One line per endpoint and key with the number of requests and median/90th percentile/maximum times
+	std::string GetLatencySummary();
+
+	/// @brief Full histograms as CSV, one row per endpoint/key and interval
+	std::string GetLatencyCsv();
+
+	void ResetLatencyStats();
+} // namespace Comm
+
+#endif /* JNI_COMM_REQUESTTRACE_H_ */
@@ -9,9 +9,13 @@ extern "C"
 }
 
 #include "sys/param.h"
+#include <errno.h>
+#include <stdio.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "Comm/FileInfo.h"
+#include "Comm/ThumbnailListCache.h"
 #include "utils/utils.h"
 
 std::string GetThumbnailPath(const char* filepath)
@@ -31,6 +35,9 @@ namespace Comm
 		Close();
 		qoi.decoder_state = qoi_decoder_state::qoi_decoder_header;
 		imageFilename = GetThumbnailPath(filename);
+		InvalidateListThumbnail(filename);
+		// A new file rather than the old one truncated, so a link to it keeps the previous image
+		unlink(imageFilename.c_str());
 		switch (meta.imageFormat)
 		{
 		case ThumbnailMeta::ImageFormat::Png:
@@ -254,21 +261,17 @@ bool IsThumbnailCached(const char* filepath, bool includeBlank)
 {
 	std::string thumbnailPath = GetThumbnailPath(filepath);
 	struct stat sb;
-	if (system(utils::format("test -f \"%s\"", thumbnailPath.c_str()).c_str()) == 0)
+	if (stat(thumbnailPath.c_str(), &sb) == -1 || !S_ISREG(sb.st_mode))
 	{
-		if (stat(thumbnailPath.c_str(), &sb) == -1)
-		{
-			// File doesn't exist
-			return false;
-		}
-		if (!includeBlank && sb.st_size <= 1)
-		{
-			// File exists but is empty
-			return false;
-		}
-		return true;
+		// File doesn't exist
+		return false;
+	}
+	if (!includeBlank && sb.st_size <= 1)
+	{
+		// File exists but is empty
+		return false;
 	}
-	return false;
+	return true;
 }
 
 void SetThumbnail(ZKBase* base, const char* filepath)
@@ -280,19 +283,26 @@ void SetThumbnail(ZKBase* base, const char* filepath)
 bool ClearAllCachedThumbnails()
 {
 	info("Clearing all cached thumbnails");
+	Comm::InvalidateAllListThumbnails();
 	return system("rm -f /tmp/thumbnails/*") == 0;
 }
 
 bool DeleteCachedThumbnail(const char* filepath)
 {
 	info("Deleting thumbnail for %s", filepath);
+	Comm::InvalidateListThumbnail(filepath);
 	std::string thumbnailPath = GetThumbnailPath(filepath);
-	return system(utils::format("rm -f \"%s\"", thumbnailPath.c_str()).c_str()) == 0;
+	return unlink(thumbnailPath.c_str()) == 0 || errno == ENOENT;
 }
 
 bool CreateBlankThumbnailCache(const char* filepath)
 {
 	info("Creating blank thumbnail for %s", filepath);
+	Comm::InvalidateListThumbnail(filepath);
 	std::string thumbnailPath = GetThumbnailPath(filepath);
-	return system(utils::format("echo \"\" > \"%s\"", thumbnailPath.c_str()).c_str()) == 0;
+	FILE* f = fopen(thumbnailPath.c_str(), "w");
+	if (f == nullptr)
+		return false;
+	const bool ok = fputs("\n", f) >= 0;
+	return fclose(f) == 0 && ok;
 }
@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <sys/types.h>
 
+#include "AllocationTracker.h"
 #include "Configuration.h"
 #include "Duet3D/General/String.h"
 #include "Library/bmp.h"
@@ -75,7 +76,7 @@ namespace Comm
 		bool Close();
 	};
 
-	struct Thumbnail
+	struct Thumbnail : public Memory::Tracked<Memory::Subsystem::Thumbnails>
 	{
 		StringRef filename;
 		ThumbnailMeta meta;
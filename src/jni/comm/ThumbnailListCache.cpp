@@ -0,0 +1,117 @@
+/*
+ * ThumbnailListCache.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "Debug.h"
+
+#include "Configuration.h"
+#include "Thumbnail.h"
+#include "ThumbnailListCache.h"
+#include <list>
+#include <map>
+#include <string>
+#include <system/Mutex.h>
+
+namespace Comm
+{
+	struct ThumbnailLookup
+	{
+		std::string thumbnailPath;
+		bool cached;
+		uint32_t generation; // Changes whenever the thumbnail may have changed
+		std::list<std::string>::iterator recent;
+	};
+
+	struct RowPicture
+	{
+		std::string thumbnailPath; // Empty if the row shows no thumbnail
+		uint32_t generation;
+	};
+
+	static Mutex s_lock;
+	static std::map<std::string, ThumbnailLookup> s_lookups;
+	static std::list<std::string> s_recent; // Most recently shown first
+	static uint32_t s_generation = 0;
+
+	// Only used from the UI thread
+	static std::map<ZKBase*, RowPicture> s_rows;
+
+	// Called with s_lock held
+	static void Forget(std::map<std::string, ThumbnailLookup>::iterator it)
+	{
+		s_recent.erase(it->second.recent);
+		s_lookups.erase(it);
+	}
+
+	// Called with s_lock held
+	static const ThumbnailLookup& Lookup(const std::string& filepath)
+	{
+		auto it = s_lookups.find(filepath);
+		if (it != s_lookups.end())
+		{
+			s_recent.erase(it->second.recent);
+			s_recent.push_front(filepath);
+			it->second.recent = s_recent.begin();
+			return it->second;
+		}
+
+		while (s_lookups.size() >= FILE_LIST_THUMBNAIL_LOOKUPS && !s_recent.empty())
+		{
+			Forget(s_lookups.find(s_recent.back()));
+		}
+		s_recent.push_front(filepath);
+		ThumbnailLookup& lookup = s_lookups[filepath];
+		lookup.thumbnailPath = GetThumbnailPath(filepath.c_str());
+		lookup.cached = IsThumbnailCached(filepath.c_str());
+		// Not known to be unchanged since it was last looked up
+		lookup.generation = ++s_generation;
+		lookup.recent = s_recent.begin();
+		return lookup;
+	}
+
+	bool SetListThumbnail(ZKBase* base, const char* filepath)
+	{
+		RowPicture picture = {"", 0};
+		if (filepath != nullptr)
+		{
+			Mutex::Autolock lock(s_lock);
+			const ThumbnailLookup& lookup = Lookup(filepath);
+			if (lookup.cached)
+			{
+				picture.thumbnailPath = lookup.thumbnailPath;
+				picture.generation = lookup.generation;
+			}
+		}
+
+		auto row = s_rows.find(base);
+		if (row != s_rows.end() && row->second.thumbnailPath == picture.thumbnailPath &&
+			row->second.generation == picture.generation)
+		{
+			return !picture.thumbnailPath.empty();
+		}
+		verbose("Row %p shows %s", base, picture.thumbnailPath.c_str());
+		s_rows[base] = picture;
+		base->setBackgroundPic(picture.thumbnailPath.c_str());
+		return !picture.thumbnailPath.empty();
+	}
+
+	void InvalidateListThumbnail(const char* filepath)
+	{
+		Mutex::Autolock lock(s_lock);
+		auto it = s_lookups.find(filepath);
+		if (it != s_lookups.end())
+		{
+			Forget(it);
+		}
+	}
+
+	void InvalidateAllListThumbnails()
+	{
+		Mutex::Autolock lock(s_lock);
+		s_lookups.clear();
+		s_recent.clear();
+	}
+} // namespace Comm
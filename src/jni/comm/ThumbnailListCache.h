@@ -0,0 +1,32 @@
+/*
+ * ThumbnailListCache.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Keeps file list rows from loading their thumbnails again while scrolling. zkgui decodes a picture into the control
+ *  it is set on, so each recycled row already holds a decoded thumbnail. The picture is only set again when the row
+ *  is bound to another file or that file's thumbnail has changed. Whether a file has a cached thumbnail is remembered
+ *  for the most recently shown files, so binding a row does no file I/O.
+ */
+
+#ifndef JNI_COMM_THUMBNAILLISTCACHE_H_
+#define JNI_COMM_THUMBNAILLISTCACHE_H_
+
+#include "control/ZKBase.h"
+
+namespace Comm
+{
+	/// @brief Show the cached thumbnail of a file on a list row, or clear the row if filepath is nullptr or the file
+	/// has no cached thumbnail
+	/// @return true if the file has a cached thumbnail
+	bool SetListThumbnail(ZKBase* base, const char* filepath);
+
+	/// @brief Called when the cached thumbnail of a file is created, rewritten or deleted
+	void InvalidateListThumbnail(const char* filepath);
+
+	/// @brief Called when all cached thumbnails are deleted
+	void InvalidateAllListThumbnails();
+} // namespace Comm
+
+#endif /* JNI_COMM_THUMBNAILLISTCACHE_H_ */
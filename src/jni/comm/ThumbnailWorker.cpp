@@ -0,0 +1,230 @@
+/*
+ * ThumbnailWorker.cpp
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ */
+
+#include "DebugLevels.h"
+#define DEBUG_LEVEL DEBUG_LEVEL_INFO
+#include "Debug.h"
+
+#include "AllocationTracker.h"
+#include "Configuration.h"
+#include "ThumbnailWorker.h"
+#include <errno.h>
+#include <list>
+#include <stdio.h>
+#include <string.h>
+#include <system/Condition.h>
+#include <system/Mutex.h>
+#include <system/Thread.h>
+#include <unistd.h>
+
+namespace Comm
+{
+	struct ThumbnailJob : public Memory::Tracked<Memory::Subsystem::Thumbnails>
+	{
+		Thumbnail* thumbnail; // nullptr for a copy
+		ThumbnailBuf data;
+		std::string source;
+		std::string destination;
+		ThumbnailCompletion done;
+	};
+
+	struct ThumbnailJobResult
+	{
+		const Thumbnail* thumbnail;
+		ThumbnailCompletion done;
+		bool ok;
+	};
+
+	static Mutex s_lock;
+	static Condition s_queueChanged; // Signalled when a job is queued or taken, or finishes
+	static std::list<ThumbnailJob*> s_jobs;
+	static ThumbnailJob* s_currentJob = nullptr;
+	static std::list<ThumbnailJobResult> s_results;
+
+	// Held while completions run, so a thumbnail is not deleted under one
+	static Mutex s_completionLock;
+
+	static bool Decode(ThumbnailJob& job)
+	{
+		Thumbnail& thumbnail = *job.thumbnail;
+		const int ret = ThumbnailDecodeChunk(thumbnail, job.data);
+		if (ret < 0)
+		{
+			error("failed to decode thumbnail chunk %d.\n", ret);
+			return false;
+		}
+		if (thumbnail.context.next == 0)
+		{
+			thumbnail.image.Close();
+		}
+		return true;
+	}
+
+	static bool Copy(const std::string& source, const std::string& destination)
+	{
+		unlink(destination.c_str());
+		if (link(source.c_str(), destination.c_str()) == 0)
+			return true;
+		dbg("Failed to link %s to %s: %s, copying instead", destination.c_str(), source.c_str(), strerror(errno));
+
+		FILE* in = fopen(source.c_str(), "rb");
+		if (in == nullptr)
+		{
+			error("Failed to open \"%s\": %s", source.c_str(), strerror(errno));
+			return false;
+		}
+		FILE* out = fopen(destination.c_str(), "wb");
+		if (out == nullptr)
+		{
+			error("Failed to create \"%s\": %s", destination.c_str(), strerror(errno));
+			fclose(in);
+			return false;
+		}
+		char buffer[4096];
+		size_t count;
+		bool ok = true;
+		while (ok && (count = fread(buffer, 1, sizeof(buffer), in)) > 0)
+		{
+			ok = fwrite(buffer, 1, count, out) == count;
+		}
+		ok = ok && !ferror(in);
+		fclose(in);
+		if (fclose(out) != 0 || !ok)
+		{
+			error("Failed to copy \"%s\" to \"%s\"", source.c_str(), destination.c_str());
+			unlink(destination.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	class ThumbnailWorkerThread : public Thread
+	{
+	  protected:
+		virtual bool threadLoop()
+		{
+			ThumbnailJob* job;
+			{
+				Mutex::Autolock lock(s_lock);
+				while (s_jobs.empty())
+				{
+					s_queueChanged.wait(s_lock);
+				}
+				job = s_jobs.front();
+				s_jobs.pop_front();
+				s_currentJob = job;
+				s_queueChanged.broadcast(); // There is room in the queue
+			}
+
+			const bool ok = job->thumbnail != nullptr ? Decode(*job) : Copy(job->source, job->destination);
+
+			{
+				Mutex::Autolock lock(s_lock);
+				s_results.push_back({job->thumbnail, job->done, ok});
+				s_currentJob = nullptr;
+				s_queueChanged.broadcast(); // A cancel may be waiting for the job
+			}
+			delete job;
+			return true;
+		}
+	};
+
+	static ThumbnailWorkerThread s_thread;
+
+	static bool Queue(ThumbnailJob* job)
+	{
+		Mutex::Autolock lock(s_lock);
+		if (!s_thread.isRunning() && !s_thread.run("thumbnail"))
+		{
+			error("Failed to start the thumbnail worker");
+			delete job;
+			return false;
+		}
+		// The thread receiving the responses waits here rather than buffering without limit
+		while (s_jobs.size() >= THUMBNAIL_WORKER_QUEUE_LENGTH)
+		{
+			s_queueChanged.wait(s_lock);
+		}
+		s_jobs.push_back(job);
+		s_queueChanged.broadcast();
+		return true;
+	}
+
+	bool QueueThumbnailDecode(Thumbnail* thumbnail, const ThumbnailBuf& data, ThumbnailCompletion done)
+	{
+		ThumbnailJob* job = new ThumbnailJob;
+		job->thumbnail = thumbnail;
+		job->data.size = data.size;
+		memcpy(job->data.buffer, data.buffer, data.size);
+		job->done = done;
+		return Queue(job);
+	}
+
+	bool QueueThumbnailCopy(const std::string& source, const std::string& destination, ThumbnailCompletion done)
+	{
+		ThumbnailJob* job = new ThumbnailJob;
+		job->thumbnail = nullptr;
+		job->data.size = 0;
+		job->source = source;
+		job->destination = destination;
+		job->done = done;
+		return Queue(job);
+	}
+
+	void RunThumbnailCompletions()
+	{
+		Mutex::Autolock completionLock(s_completionLock);
+		std::list<ThumbnailJobResult> results;
+		{
+			Mutex::Autolock lock(s_lock);
+			if (s_results.empty())
+				return;
+			results = s_results;
+			s_results.clear();
+		}
+		for (ThumbnailJobResult& jobResult : results)
+		{
+			jobResult.done(jobResult.ok);
+		}
+	}
+
+	void CancelThumbnailJobs(const Thumbnail* thumbnail)
+	{
+		Mutex::Autolock completionLock(s_completionLock);
+		Mutex::Autolock lock(s_lock);
+		for (auto it = s_jobs.begin(); it != s_jobs.end();)
+		{
+			if ((*it)->thumbnail != thumbnail)
+			{
+				++it;
+				continue;
+			}
+			delete *it;
+			it = s_jobs.erase(it);
+			s_queueChanged.broadcast();
+		}
+		while (s_currentJob != nullptr && s_currentJob->thumbnail == thumbnail)
+		{
+			s_queueChanged.wait(s_lock);
+		}
+		for (auto it = s_results.begin(); it != s_results.end();)
+		{
+			if (it->thumbnail == thumbnail)
+			{
+				it = s_results.erase(it);
+				continue;
+			}
+			++it;
+		}
+	}
+
+	bool IsThumbnailWorkerIdle()
+	{
+		Mutex::Autolock lock(s_lock);
+		return s_jobs.empty() && s_currentJob == nullptr && s_results.empty();
+	}
+} // namespace Comm
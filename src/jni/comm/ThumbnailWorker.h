@@ -0,0 +1,43 @@
+/*
+ * ThumbnailWorker.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Decodes thumbnail data and writes the cached image files on a thread of its own, so neither the UI nor the thread
+ *  receiving the responses waits on base64 and QOI decoding or the file system. Jobs go through a bounded queue and
+ *  their completions are run on the UI thread by FileInfoCache::Spin.
+ */
+
+#ifndef JNI_COMM_THUMBNAILWORKER_H_
+#define JNI_COMM_THUMBNAILWORKER_H_
+
+#include "Thumbnail.h"
+#include "std_fixed/functional.h"
+#include <string>
+
+namespace Comm
+{
+	/// @brief Run on the UI thread once a job is done, with whether it succeeded
+	typedef function<void(bool)> ThumbnailCompletion;
+
+	/// @brief Decode a chunk of thumbnail data into the thumbnail's image file, closing it after the last chunk.
+	/// Blocks while the queue is full
+	/// @return false if the worker could not be started
+	bool QueueThumbnailDecode(Thumbnail* thumbnail, const ThumbnailBuf& data, ThumbnailCompletion done);
+
+	/// @brief Make destination a hard link to source, or a copy of it if it cannot be linked
+	bool QueueThumbnailCopy(const std::string& source, const std::string& destination, ThumbnailCompletion done);
+
+	/// @brief Run the completions of finished jobs, called from the UI thread
+	void RunThumbnailCompletions();
+
+	/// @brief Drop the queued jobs and completions of a thumbnail, waiting if one of its jobs is being processed.
+	/// Must be called before a thumbnail is deleted or its image is started again
+	void CancelThumbnailJobs(const Thumbnail* thumbnail);
+
+	/// @brief True if no job is queued, being processed or waiting for its completion to run
+	bool IsThumbnailWorkerIdle();
+} // namespace Comm
+
+#endif /* JNI_COMM_THUMBNAILWORKER_H_ */
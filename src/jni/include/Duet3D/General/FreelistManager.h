@@ -17,6 +17,24 @@
 
 namespace FreelistManager
 {
+	// Usage statistics for one free list, linked together so all the free lists in use can be listed.
+	// Items are allocated from more than one thread, so the counts and the list are only changed atomically.
+	struct FreelistStats
+	{
+		size_t itemSize;
+		size_t heapItems;			// items ever allocated from the heap; these are never returned to it
+		size_t inUse;				// items currently handed out
+		FreelistStats *next;
+		bool registered;
+	};
+
+	// Returns the first free list that has been used, or nullptr
+	inline FreelistStats *&FirstFreelistStats() noexcept
+	{
+		static FreelistStats *first = nullptr;
+		return first;
+	}
+
 	// Free list manager class
 	template<size_t Sz> class Freelist
 	{
@@ -26,9 +44,11 @@ namespace FreelistManager
 
 	private:
 		static void * freelist;
+		static FreelistStats stats;
 	};
 
 	template<size_t Sz> void *Freelist<Sz>::freelist = nullptr;
+	template<size_t Sz> FreelistStats Freelist<Sz>::stats = { Sz, 0, 0, nullptr, false };
 
 	template<size_t Sz> void *Freelist<Sz>::AllocateItem() noexcept
 	{
@@ -36,12 +56,24 @@ namespace FreelistManager
 		TaskCriticalSectionLocker lock;
 #endif
 
+		if (!__atomic_test_and_set(&stats.registered, __ATOMIC_ACQ_REL))
+		{
+			FreelistStats *first = __atomic_load_n(&FirstFreelistStats(), __ATOMIC_ACQUIRE);
+			do
+			{
+				stats.next = first;
+			} while (!__atomic_compare_exchange_n(&FirstFreelistStats(), &first, &stats, true,
+												  __ATOMIC_RELEASE, __ATOMIC_ACQUIRE));
+		}
+		__atomic_add_fetch(&stats.inUse, 1, __ATOMIC_RELAXED);
+
 		if (freelist != nullptr)
 		{
 			void * const p = freelist;
 			freelist = *reinterpret_cast<void **>(p);
 			return p;
 		}
+		__atomic_add_fetch(&stats.heapItems, 1, __ATOMIC_RELAXED);
 		return ::operator new(Sz);
 	}
 
@@ -53,6 +85,7 @@ namespace FreelistManager
 
 		*reinterpret_cast<void **>(p) = freelist;
 		freelist = p;
+		__atomic_sub_fetch(&stats.inUse, 1, __ATOMIC_RELAXED);
 	}
 
 	// Macro to return the size of objects of a given type rounded up to a multiple of 8 bytes.
@@ -0,0 +1,165 @@
+/*
+ * LineBuffer.h
+ *
+ *  Created on: 18 Oct 2026
+ *      Author: Andy Everitt
+ *
+ *  Ring buffer of variable length, null terminated strings stored back to back in a fixed byte arena.
+ *  Each line only uses its own length plus a terminator, and lines are read by reference.
+ *  When either the arena or the line index is exhausted the oldest lines are evicted in O(1).
+ */
+
+#ifndef JNI_INCLUDE_DUET3D_GENERAL_LINEBUFFER_HPP_
+#define JNI_INCLUDE_DUET3D_GENERAL_LINEBUFFER_HPP_
+
+#include "Debug.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+template <size_t ArenaSize, size_t MaxLines>
+class LineBuffer
+{
+	static_assert(ArenaSize > 1 && ArenaSize <= UINT32_MAX, "ArenaSize out of range");
+	static_assert(MaxLines > 0, "MaxLines must be greater than 0");
+
+  public:
+	LineBuffer() : head_(0), tail_(0), filled_(0), write_(0) { arena_[0] = '\0'; }
+
+	/// @brief Append a copy of a line, evicting the oldest lines until it fits
+	/// @param str The characters to copy, does not need to be null terminated
+	/// @param len The number of characters to copy. Lines longer than the arena are truncated
+	void Push(const char* str, size_t len)
+	{
+		if (len > MaxLineLength())
+		{
+			len = MaxLineLength();
+		}
+		const size_t needed = len + 1;
+
+		if (filled_ == MaxLines)
+		{
+			PopOldest();
+		}
+
+		size_t start = write_;
+		if (start + needed > ArenaSize)
+		{
+			// Not enough contiguous space left before the end of the arena, so wrap around. All lines stored beyond
+			// the current write position are older than everything at the start of the arena.
+			while (filled_ > 0 && index_[tail_].offset >= write_)
+			{
+				PopOldest();
+			}
+			start = 0;
+		}
+
+		while (filled_ > 0 && Overlaps(index_[tail_], start, needed))
+		{
+			PopOldest();
+		}
+
+		memcpy(arena_ + start, str, len);
+		arena_[start + len] = '\0';
+
+		index_[head_].offset = (uint32_t)start;
+		index_[head_].length = (uint32_t)len;
+		head_ = (head_ + 1) % MaxLines;
+		filled_++;
+		write_ = start + needed;
+	}
+
+	void Push(const char* str) { Push(str, strlen(str)); }
+
+	/// @brief Remove the oldest line
+	/// @return false if the buffer was already empty
+	bool Pop()
+	{
+		if (Empty())
+		{
+			return false;
+		}
+		PopOldest();
+		return true;
+	}
+
+	bool Empty() const { return filled_ == 0; }
+
+	void Reset()
+	{
+		head_ = 0;
+		tail_ = 0;
+		filled_ = 0;
+		write_ = 0;
+	}
+
+	/// @brief Number of lines currently held
+	size_t GetFilled() const { return filled_; }
+
+	/// @brief Total number of bytes currently used by the held lines, including terminators
+	size_t GetUsedBytes() const
+	{
+		if (Empty())
+		{
+			return 0;
+		}
+		const size_t oldest = index_[tail_].offset;
+		return (write_ > oldest) ? write_ - oldest : (ArenaSize - oldest) + write_;
+	}
+
+	constexpr size_t GetArenaSize() const { return ArenaSize; }
+	constexpr size_t GetMaxLines() const { return MaxLines; }
+	constexpr size_t MaxLineLength() const { return ArenaSize - 1; }
+
+	/// @brief Get a line by age, 0 being the oldest
+	/// @return Pointer into the arena, valid until the next call to Push. Empty string if out of range
+	const char* GetItem(const size_t index) const
+	{
+		if (index >= filled_)
+		{
+			warn("Accessing out of bounds index %d, filled=%d", index, filled_);
+			return "";
+		}
+		return arena_ + index_[(tail_ + index) % MaxLines].offset;
+	}
+
+	size_t GetItemLength(const size_t index) const
+	{
+		if (index >= filled_)
+		{
+			return 0;
+		}
+		return index_[(tail_ + index) % MaxLines].length;
+	}
+
+  private:
+	struct Entry
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	static bool Overlaps(const Entry& entry, size_t start, size_t len)
+	{
+		return entry.offset < start + len && start < entry.offset + entry.length + 1;
+	}
+
+	void PopOldest()
+	{
+		tail_ = (tail_ + 1) % MaxLines;
+		filled_--;
+		if (filled_ == 0)
+		{
+			write_ = 0;
+		}
+	}
+
+	char arena_[ArenaSize];
+	Entry index_[MaxLines];
+	size_t head_;
+	size_t tail_;
+	size_t filled_;
+	size_t write_;
+};
+
+#endif /* JNI_INCLUDE_DUET3D_GENERAL_LINEBUFFER_HPP_ */
@@ -253,6 +253,17 @@ RestClient::Connection::SetKeyPassword(const std::string& keyPassword) {
   this->keyPassword = keyPassword;
 }
 
+/**
+ * @brief set the content encodings to accept, see CURLOPT_ACCEPT_ENCODING
+ *
+ * @param acceptEncoding comma separated list of encodings
+ *
+ */
+void
+RestClient::Connection::SetAcceptEncoding(const std::string& acceptEncoding) {
+  this->acceptEncoding = acceptEncoding;
+}
+
 /**
  * @brief set HTTP proxy address and port
  *
@@ -386,6 +397,12 @@ RestClient::Connection::performCurlRequest(const std::string& uri, const std::st
                      1L);
   }
 
+  // set accepted content encodings
+  if (!this->acceptEncoding.empty()) {
+    curl_easy_setopt(this->curlHandle, CURLOPT_ACCEPT_ENCODING,
+                     this->acceptEncoding.c_str());
+  }
+
   char error_buffer[CURL_ERROR_SIZE] = { 0 };
   curl_easy_setopt(this->curlHandle, CURLOPT_ERRORBUFFER, error_buffer);
 
@@ -427,6 +444,8 @@ RestClient::Connection::performCurlRequest(const std::string& uri, const std::st
                     &this->lastRequest.redirectTime);
   curl_easy_getinfo(this->curlHandle, CURLINFO_REDIRECT_COUNT,
                     &this->lastRequest.redirectCount);
+  curl_easy_getinfo(this->curlHandle, CURLINFO_SIZE_DOWNLOAD,
+                    &this->lastRequest.sizeDownload);
   // free header list
   curl_slist_free_all(headerList);
   // reset curl handle
@@ -532,6 +551,45 @@ RestClient::Connection::head(const std::string& url) {
 }
 
 
+/**
+ * @brief HTTP GET method streaming the body to a callback
+ *
+ * @param url to query
+ * @param callback called with each block of the body
+ * @param userdata passed to the callback
+ *
+ * @return response struct, with an empty body
+ */
+RestClient::Response
+RestClient::Connection::get(const std::string& uri, WriteCallback callback,
+		void* userdata) {
+    /** set callback function */
+    curl_easy_setopt(this->curlHandle, CURLOPT_WRITEFUNCTION, callback);
+    /** set data object to pass to callback function */
+    curl_easy_setopt(this->curlHandle, CURLOPT_WRITEDATA, userdata);
+    return this->performCurlRequest(uri, "download");
+}
+
+double
+RestClient::Connection::GetContentLength() {
+  double length = -1;
+  if (curl_easy_getinfo(this->curlHandle, CURLINFO_CONTENT_LENGTH_DOWNLOAD,
+                        &length) != CURLE_OK) {
+    return -1;
+  }
+  return length;
+}
+
+int
+RestClient::Connection::GetResponseCode() {
+  long code = 0;
+  if (curl_easy_getinfo(this->curlHandle, CURLINFO_RESPONSE_CODE,
+                        &code) != CURLE_OK) {
+    return 0;
+  }
+  return static_cast<int>(code);
+}
+
 /**
  * @brief HTTP GET method
  *
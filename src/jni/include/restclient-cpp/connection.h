@@ -55,6 +55,9 @@ class Connection {
       *  @var RequestInfo::redirectCount
       *  Member 'redirectCount' contains the number of redirects followed. See
       *  CURLINFO_REDIRECT_COUNT
+      *  @var RequestInfo::sizeDownload
+      *  Member 'sizeDownload' contains the number of body bytes received,
+      *  before any content decoding. See CURLINFO_SIZE_DOWNLOAD
       */
     typedef struct {
         double totalTime;
@@ -65,6 +68,7 @@ class Connection {
         double startTransferTime;
         double redirectTime;
         int redirectCount;
+        double sizeDownload;
       } RequestInfo;
     /**
       *  @struct Info
@@ -166,6 +170,10 @@ class Connection {
     // set CURLOPT_PROXY
     void SetProxy(const std::string& uriProxy);
 
+    // set CURLOPT_ACCEPT_ENCODING, e.g. "gzip, deflate". A compressed body is
+    // decoded before it is returned or passed to a write callback
+    void SetAcceptEncoding(const std::string& acceptEncoding);
+
     std::string GetUserAgent();
 
     RestClient::Connection::Info GetInfo();
@@ -192,6 +200,22 @@ class Connection {
 
     RestClient::Response download(const std::string& uri, const std::string& file_to_save);
 
+    // GET with the body passed to a CURLOPT_WRITEFUNCTION style callback as
+    // it arrives instead of being collected in the response. Returning less
+    // than size * nmemb aborts the transfer
+    typedef size_t (*WriteCallback)(void *data, size_t size, size_t nmemb,
+                                    void *userdata);
+    RestClient::Response get(const std::string& uri, WriteCallback callback,
+                             void* userdata);
+
+    // Content-Length of the response being received, -1 if unknown. Can be
+    // called from a write callback
+    double GetContentLength();
+
+    // HTTP status of the response being received. Can be called from a
+    // write callback
+    int GetResponseCode();
+
  private:
     CURL* curlHandle;
     std::string baseUrl;
@@ -212,6 +236,7 @@ class Connection {
     std::string keyPath;
     std::string keyPassword;
     std::string uriProxy;
+    std::string acceptEncoding;
     RestClient::Response performCurlRequest(const std::string& uri, const std::string method_type = "");
 };
 };  // namespace RestClient
@@ -4,12 +4,16 @@
 
 #include "Comm/Communication.h"
 #include "Comm/JsonDecoder.h"
+#include "Comm/OmSnapshot.h"
+#include "Comm/RequestTrace.h"
 #include "Configuration.h"
 #include "Debug.h"
 #include "DebugCommands.h"
 #include "Hardware/Duet.h"
 #include "Hardware/Reset.h"
 #include "Hardware/Usb.h"
+#include "Hardware/UartBaudNegotiation.h"
+#include "Hardware/UartUpload.h"
 #include "Library/bmp.h"
 #include "ObjectModel/Alert.h"
 #include "ObjectModel/Fan.h"
@@ -17,6 +21,8 @@
 #include "ObjectModel/Heightmap.h"
 #include "ObjectModel/PrinterStatus.h"
 #include "ObjectModel/Utils.h"
+#include "StallWatchdog.h"
+#include "StartupTimeline.h"
 #include "Storage.h"
 #include "UI/Graph.h"
 #include "UI/GuidedSetup.h"
@@ -92,9 +98,8 @@
  * Note: id cannot be repeated
  */
 static S_ACTIVITY_TIMEER REGISTER_ACTIVITY_TIMER_TAB[] = {
-	{TIMER_DELAYED_TASK, 50},
-	{TIMER_ASYNC_HTTP_REQUEST, 50},
-	{TIMER_THUMBNAIL, 50},
+	// TIMER_DELAYED_TASK and TIMER_ASYNC_HTTP_REQUEST are only armed while they have pending work
+	// TIMER_THUMBNAIL is registered after startup so its period can adapt to the file info cache load
 };
 
 /**
@@ -103,56 +108,78 @@ static S_ACTIVITY_TIMEER REGISTER_ACTIVITY_TIMER_TAB[] = {
 static void onUI_init()
 {
 	// Tips : Add the display code for UI initialization here, such as: mText1Ptr->setText("123");
+	Debug::StartupPhase initPhase("onUI_init");
 	srand(0);
-	InitUpgradeMountListener();
+	{
+		Debug::StartupPhase phase("debug");
+		Debug::StartLogger();
+		Debug::StartStallWatchdog();
+		Debug::TimeListViews(mRootWindowPtr, mActivityPtr, mActivityPtr);
+		InitUpgradeMountListener();
+	}
 
 	initTimer(mActivityPtr);
 	registerUserTimer(TIMER_UPDATE_DATA,
 					  (int)DEFAULT_PRINTER_POLL_INTERVAL); // Register here so it can be reset with stored poll interval
+	registerDelayedCallback("AllocationLog", ALLOCATION_LOG_INTERVAL, []() {
+		Debug::LogAllocationSummary();
+		return true;
+	});
 
 	// Comm
-	Comm::DUET.Init();
-
-	// UI
-	UI::Init(mRootWindowPtr);
-	UI::Settings::Init(); // Sets various UI elements states
-	UI::Sidebar::Init();
-	UI::HomeScreen::Init();
-	UI::Move::Init();
-	UI::ExtrusionControl::Init();
-	UI::PrintStatus::Init();
-	UI::FileList::Init();
-	UI::Heightmap::Init();
-	UI::ObjectCancel::Init();
-
-	UI::WINDOW.AddHome(mMainWindowPtr);
-	UI::CONSOLE.Init(mConsoleListViewPtr, mConsoleInputPtr);
-	UI::NUMPAD_WINDOW.Init(mNumPadWindowPtr, mNumPadHeaderPtr, mNumPadInputPtr);
-	UI::SLIDER_WINDOW.Init(
-		mSliderWindowPtr, mSliderPtr, mSliderHeaderPtr, mSliderValuePtr, mSliderPrefixPtr, mSliderSuffixPtr);
-
-	// Guided setup
-	UI::GuidedSetup::Init(mGuidedSetupWindowPtr);
-
-	// Hide clock here so that it is visible when editing the GUI
-	mDigitalClock1Ptr->setVisible(false);
-
-	/* Initialise UI observer updaters that run on each field value that is received from the OM */
-	auto* observer = UI::g_omFieldObserverHead;
-	while (observer != nullptr)
 	{
-		observer->Init(UI::g_observerMap);
-		observer = observer->next;
+		Debug::StartupPhase phase("comm");
+		Comm::DUET.Init();
 	}
 
-	/* Initialise UI observer updaters that run after an array has been received */
-	auto* observerArrayEnd = UI::g_omArrayEndObserverHead;
-	while (observerArrayEnd != nullptr)
+	// UI
 	{
-		observerArrayEnd->Init(UI::g_observerMapArrayEnd);
-		observerArrayEnd = observerArrayEnd->next;
+		Debug::StartupPhase phase("ui");
+		UI::Init(mRootWindowPtr);
+		UI::Settings::Init(); // Sets various UI elements states
+		UI::Sidebar::Init();
+		UI::HomeScreen::Init();
+		UI::Move::Init();
+		UI::ExtrusionControl::Init();
+		UI::PrintStatus::Init();
+		UI::FileList::Init();
+		UI::Heightmap::Init();
+		UI::ObjectCancel::Init();
+
+		UI::WINDOW.AddHome(mMainWindowPtr);
+		UI::CONSOLE.Init(mConsoleListViewPtr, mConsoleInputPtr);
+		UI::NUMPAD_WINDOW.Init(mNumPadWindowPtr, mNumPadHeaderPtr, mNumPadInputPtr);
+		UI::SLIDER_WINDOW.Init(
+			mSliderWindowPtr, mSliderPtr, mSliderHeaderPtr, mSliderValuePtr, mSliderPrefixPtr, mSliderSuffixPtr);
+
+		// Hide clock here so that it is visible when editing the GUI
+		mDigitalClock1Ptr->setVisible(false);
 	}
 
+	// UI observers are registered on the first object model update, see UI::ObserverMap
+
+	// Runs on the first timer tick, once the UI thread is free after onUI_init
+	registerDelayedCallback("DeferredInit", 0, []() {
+		Debug::MarkUiReady();
+		{
+			/* Show the configuration saved by the previous run until the Duet has answered. Polling has already
+			 * started, so it is skipped if a response got here first */
+			Debug::StartupPhase phase("om_snapshot");
+			Comm::RestoreOmSnapshot();
+		}
+		{
+			Debug::StartupPhase phase("webcam");
+			UI::Webcam::RestoreWebcamSettings();
+		}
+		{
+			Debug::StartupPhase phase("guides");
+			UI::GuidedSetup::Init(mGuidedSetupWindowPtr);
+		}
+		registerUserTimer(TIMER_THUMBNAIL, (int)FILE_CACHE_POLL_INTERVAL);
+		Debug::LogStartupTimeline();
+		return false;
+	});
+
 	info("UI initialized");
 }
 
@@ -189,6 +216,9 @@ static void onProtocolDataUpdate(const SProtocolData &rxData)
 {
 	// We want a single decoder for all uart data
 	static Comm::JsonDecoder decoder;
+	Comm::TraceUartDataReceived();
+	Comm::HandleUartUploadResponse(rxData.data, rxData.len);
+	Comm::HandleUartBaudProbeResponse(rxData.data, rxData.len);
 	decoder.CheckInput(rxData.data, rxData.len);
 }
 
@@ -203,6 +233,8 @@ static void onProtocolDataUpdate(const SProtocolData &rxData)
  */
 static bool onUI_Timer(int id)
 {
+	Debug::UiTimingScope timing(getUserTimerName(id), getUserTimerPeriod(id));
+	applyPendingTimerChanges();
 	switch (id)
 	{
 	case TIMER_UPDATE_DATA:
@@ -217,15 +249,18 @@ static bool onUI_Timer(int id)
 		break;
 	}
 	case TIMER_DELAYED_TASK: {
-		runDelayedCallbacks();
-		break;
+		return runDelayedCallbacks();
 	}
 	case TIMER_ASYNC_HTTP_REQUEST: {
-		Comm::ProcessQueuedAsyncRequests();
-		break;
+		if (Comm::ProcessQueuedAsyncRequests())
+			break;
+		userTimerStopped(TIMER_ASYNC_HTTP_REQUEST); // Nothing left queued, re-armed when a request is queued
+		return false;
 	}
 	case TIMER_THUMBNAIL: {
 		FILEINFO_CACHE->Spin();
+		setUserTimerPeriod(TIMER_THUMBNAIL,
+						   FILEINFO_CACHE->IsIdle() ? BACKGROUND_FILE_CACHE_POLL_INTERVAL : FILE_CACHE_POLL_INTERVAL);
 		break;
 	}
 	default:
@@ -9,19 +9,170 @@
 #define DEBUG_LEVEL DEBUG_LEVEL_DBG
 
 #include "timer.h"
+#include "AllocationTracker.h"
 #include "Debug.h"
+#include "StallWatchdog.h"
 #include "utils/TimeHelper.h"
+#include <algorithm>
+#include <list>
+#include <pthread.h>
+#include <string.h>
+#include <system/Mutex.h>
 #include <system/Thread.h>
-#include <vector>
 
 static mainActivity* s_mainActivity = nullptr;
+static pthread_t s_uiThread;
+static int s_userTimerPeriods[TIMER_COUNT]; // period each user timer is running with, 0 if stopped
+
+/*
+ * The zkgui timers and the timer wheel are only touched from the UI thread. Changes made from other threads, such as
+ * observers and HTTP callbacks, are queued and applied by applyPendingTimerChanges() on the next UI timer tick.
+ */
+struct PendingTimerChange
+{
+	enum class Type
+	{
+		RegisterUserTimer,
+		UnregisterUserTimer,
+		ResetUserTimer,
+		SetUserTimerPeriod,
+		RegisterCallback,
+		UnregisterCallback,
+		SetCallbackDelay,
+	};
+
+	Type type;
+	int timerId;
+	int time;
+	const char* callbackId;
+	long long delay;
+	function<bool()> callback;
+};
+
+static Mutex s_pendingChangesLock;
+static std::list<PendingTimerChange> s_pendingChanges;
+
+static void ArmDelayedTaskTimer();
+static void RegisterUserTimerNow(int id, int time);
+static void UnregisterUserTimerNow(int id);
+static void ResetUserTimerNow(int id, int time);
+static void SetUserTimerPeriodNow(int id, int time);
+static void RegisterDelayedCallbackNow(const char* id, long long delay, function<bool()> callback);
+static void UnregisterDelayedCallbackNow(const char* id);
+static void SetDelayedCallbackDelayNow(const char* id, long long delay);
+
+static bool IsUiThread()
+{
+	// Before the activity exists everything runs from its constructor
+	return s_mainActivity == nullptr || pthread_equal(pthread_self(), s_uiThread);
+}
+
+static void QueueTimerChange(const PendingTimerChange& change)
+{
+	Mutex::Autolock lock(s_pendingChangesLock);
+	if (change.type == PendingTimerChange::Type::SetUserTimerPeriod && !s_pendingChanges.empty())
+	{
+		// Only the latest period matters, e.g. FileInfoCache::Wake is called for every response. Only merged with the
+		// change just before it, as merging across a register or unregister of the timer would reorder them
+		PendingTimerChange& last = s_pendingChanges.back();
+		if (last.type == change.type && last.timerId == change.timerId)
+		{
+			last.time = change.time;
+			return;
+		}
+	}
+	s_pendingChanges.push_back(change);
+}
+
+void applyPendingTimerChanges()
+{
+	std::list<PendingTimerChange> changes;
+	{
+		Mutex::Autolock lock(s_pendingChangesLock);
+		if (s_pendingChanges.empty())
+			return;
+		changes = s_pendingChanges;
+		s_pendingChanges.clear();
+	}
+	for (PendingTimerChange& change : changes)
+	{
+		switch (change.type)
+		{
+		case PendingTimerChange::Type::RegisterUserTimer:
+			RegisterUserTimerNow(change.timerId, change.time);
+			break;
+		case PendingTimerChange::Type::UnregisterUserTimer:
+			UnregisterUserTimerNow(change.timerId);
+			break;
+		case PendingTimerChange::Type::ResetUserTimer:
+			ResetUserTimerNow(change.timerId, change.time);
+			break;
+		case PendingTimerChange::Type::SetUserTimerPeriod:
+			SetUserTimerPeriodNow(change.timerId, change.time);
+			break;
+		case PendingTimerChange::Type::RegisterCallback:
+			RegisterDelayedCallbackNow(change.callbackId, change.delay, change.callback);
+			break;
+		case PendingTimerChange::Type::UnregisterCallback:
+			UnregisterDelayedCallbackNow(change.callbackId);
+			break;
+		case PendingTimerChange::Type::SetCallbackDelay:
+			SetDelayedCallbackDelayNow(change.callbackId, change.delay);
+			break;
+		}
+	}
+}
+
+/// @brief Queue a change made off the UI thread, or apply earlier queued changes first so they keep their order
+/// @return true if the change was queued and must not be applied by the caller
+static bool DeferTimerChange(const PendingTimerChange& change)
+{
+	if (IsUiThread())
+	{
+		applyPendingTimerChanges();
+		return false;
+	}
+	verbose("Queued timer change %d from another thread", (int)change.type);
+	QueueTimerChange(change);
+	return true;
+}
 
 void initTimer(mainActivity* main)
 {
-    s_mainActivity = main;
+	s_uiThread = pthread_self();
+	s_mainActivity = main;
+	ArmDelayedTaskTimer(); // in case callbacks were registered before the activity existed
 }
 
 void registerUserTimer(int id, int time)
+{
+	if (DeferTimerChange({PendingTimerChange::Type::RegisterUserTimer, id, time, nullptr, 0, function<bool()>()}))
+		return;
+	RegisterUserTimerNow(id, time);
+}
+
+void unregisterUserTimer(int id)
+{
+	if (DeferTimerChange({PendingTimerChange::Type::UnregisterUserTimer, id, 0, nullptr, 0, function<bool()>()}))
+		return;
+	UnregisterUserTimerNow(id);
+}
+
+void resetUserTimer(int id, int time)
+{
+	if (DeferTimerChange({PendingTimerChange::Type::ResetUserTimer, id, time, nullptr, 0, function<bool()>()}))
+		return;
+	ResetUserTimerNow(id, time);
+}
+
+void setUserTimerPeriod(int id, int time)
+{
+	if (DeferTimerChange({PendingTimerChange::Type::SetUserTimerPeriod, id, time, nullptr, 0, function<bool()>()}))
+		return;
+	SetUserTimerPeriodNow(id, time);
+}
+
+static void RegisterUserTimerNow(int id, int time)
 {
 	if (s_mainActivity == nullptr)
 	{
@@ -30,9 +181,11 @@ void registerUserTimer(int id, int time)
 	}
 	info("%d, %d", id, time);
 	s_mainActivity->registerUserTimer(id, time);
+	if (id >= 0 && id < TIMER_COUNT)
+		s_userTimerPeriods[id] = time;
 }
 
-void unregisterUserTimer(int id)
+static void UnregisterUserTimerNow(int id)
 {
 	if (s_mainActivity == nullptr)
 	{
@@ -41,9 +194,10 @@ void unregisterUserTimer(int id)
 	}
 	info("%d", id);
 	s_mainActivity->unregisterUserTimer(id);
+	userTimerStopped(id);
 }
 
-void resetUserTimer(int id, int time)
+static void ResetUserTimerNow(int id, int time)
 {
 	if (s_mainActivity == nullptr)
 	{
@@ -52,65 +206,428 @@ void resetUserTimer(int id, int time)
 	}
 	info("%d, %d", id, time);
 	s_mainActivity->resetUserTimer(id, time);
+	if (id >= 0 && id < TIMER_COUNT)
+		s_userTimerPeriods[id] = time;
+}
+
+static void SetUserTimerPeriodNow(int id, int time)
+{
+	if (id < 0 || id >= TIMER_COUNT)
+	{
+		error("Invalid user timer id %d", id);
+		return;
+	}
+	if (time <= 0)
+	{
+		if (s_userTimerPeriods[id] > 0)
+			UnregisterUserTimerNow(id);
+		return;
+	}
+	if (s_userTimerPeriods[id] == time)
+		return;
+	if (s_userTimerPeriods[id] > 0)
+		ResetUserTimerNow(id, time);
+	else
+		RegisterUserTimerNow(id, time);
 }
 
-struct DelayedCallback
+bool isUserTimerRunning(int id)
+{
+	return id >= 0 && id < TIMER_COUNT && s_userTimerPeriods[id] > 0;
+}
+
+int getUserTimerPeriod(int id)
+{
+	return id >= 0 && id < TIMER_COUNT ? s_userTimerPeriods[id] : 0;
+}
+
+const char* getUserTimerName(int id)
+{
+	static const char* names[] = {
+		"TIMER_UPDATE_DATA",
+		"TIMER_DELAYED_TASK",
+		"TIMER_ASYNC_HTTP_REQUEST",
+		"TIMER_THUMBNAIL",
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == TIMER_COUNT, "Timer names out of date");
+	return id >= 0 && id < TIMER_COUNT ? names[id] : "TIMER_UNKNOWN";
+}
+
+void userTimerStopped(int id)
+{
+	if (id >= 0 && id < TIMER_COUNT)
+		s_userTimerPeriods[id] = 0;
+}
+
+/*
+ * Delayed callbacks are kept in a hierarchical timer wheel. Each level has TIMER_WHEEL_SLOTS slots and each slot covers
+ * TIMER_WHEEL_SLOTS times as many ticks as a slot on the level below. A callback is placed on the level of the most
+ * significant digit in which its expiry tick differs from the current tick, so inserting and cancelling are O(1) and
+ * slots on the higher levels are cascaded down as time reaches them.
+ *
+ * TIMER_DELAYED_TASK is only armed for the earliest tick that needs servicing, and is stopped while the wheel is empty.
+ */
+constexpr long long TIMER_WHEEL_TICK = 10; // ms
+constexpr size_t TIMER_WHEEL_BITS = 6;
+constexpr size_t TIMER_WHEEL_SLOTS = 1 << TIMER_WHEEL_BITS;
+constexpr size_t TIMER_WHEEL_LEVELS = 4;
+// Keep at least one top level slot between the current tick and the furthest expiry, so wrapped entries are unambiguous
+constexpr long long TIMER_WHEEL_MAX_TICKS =
+	(1LL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - (1LL << (TIMER_WHEEL_BITS * (TIMER_WHEEL_LEVELS - 1)));
+constexpr size_t DELAYED_CALLBACK_BUCKETS = 32;
+
+struct DelayedCallback : public Memory::Tracked<Memory::Subsystem::UI>
 {
 	DelayedCallback(const char* id, long long delay, function<bool()> callback)
-		: id(id), delay(delay), callback(callback)
+		: id(id), delay(delay), expiry(0), callback(callback), prev(this), next(this), hashNext(nullptr), level(-1),
+		  slot(0), cancelled(false)
 	{
-		lastRun = TimeHelper::getCurrentTime();
+	}
+
+	void Unlink()
+	{
+		prev->next = next;
+		next->prev = prev;
+		prev = next = this;
 	}
 
 	const char* id;
 	long long delay;
-	long long lastRun;
+	long long expiry; // tick at which the callback is due
 	function<bool()> callback;
+
+	DelayedCallback* prev; // wheel slot list
+	DelayedCallback* next;
+	DelayedCallback* hashNext; // id lookup chain
+	int level;				   // -1 if not in the wheel
+	size_t slot;
+	bool cancelled;
 };
 
-static std::vector<DelayedCallback> s_delayedCallbacks;
+struct WheelSlot
+{
+	WheelSlot() : head(nullptr, 0, function<bool()>()) {}
+	bool Empty() const { return head.next == &head; }
+	void Append(DelayedCallback* cb)
+	{
+		cb->prev = head.prev;
+		cb->next = &head;
+		head.prev->next = cb;
+		head.prev = cb;
+	}
+	DelayedCallback head; // sentinel
+};
+
+static WheelSlot s_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t s_wheelOccupied[TIMER_WHEEL_LEVELS];
+static long long s_wheelTick = -1;
+static size_t s_delayedCallbackCount = 0;
+static DelayedCallback* s_delayedCallbackIds[DELAYED_CALLBACK_BUCKETS];
+static DelayedCallback* s_runningCallback = nullptr;
+static bool s_runningDelayedCallbacks = false;
+
+static long long CurrentTick()
+{
+	return TimeHelper::getCurrentTime() / TIMER_WHEEL_TICK;
+}
+
+static size_t Digit(long long tick, size_t level)
+{
+	return (size_t)(tick >> (level * TIMER_WHEEL_BITS)) & (TIMER_WHEEL_SLOTS - 1);
+}
+
+static size_t HashId(const char* id)
+{
+	size_t hash = 5381;
+	while (*id != '\0')
+	{
+		hash = hash * 33 + (unsigned char)*id++;
+	}
+	return hash % DELAYED_CALLBACK_BUCKETS;
+}
+
+static DelayedCallback** FindId(const char* id)
+{
+	DelayedCallback** cb = &s_delayedCallbackIds[HashId(id)];
+	while (*cb != nullptr && strcmp((*cb)->id, id) != 0)
+	{
+		cb = &(*cb)->hashNext;
+	}
+	return cb;
+}
+
+static void WheelRemove(DelayedCallback* cb)
+{
+	cb->Unlink();
+	if (cb->level < 0)
+		return;
+	if (s_wheel[cb->level][cb->slot].Empty())
+	{
+		s_wheelOccupied[cb->level] &= ~(1ULL << cb->slot);
+	}
+	cb->level = -1;
+}
+
+static void WheelPlace(DelayedCallback* cb)
+{
+	// Place on the level of the most significant digit that differs from the current tick
+	size_t level = TIMER_WHEEL_LEVELS - 1;
+	while (level > 0 && Digit(cb->expiry, level) == Digit(s_wheelTick, level))
+	{
+		level--;
+	}
+	cb->level = (int)level;
+	cb->slot = Digit(cb->expiry, level);
+	s_wheel[level][cb->slot].Append(cb);
+	s_wheelOccupied[level] |= 1ULL << cb->slot;
+}
+
+static bool WheelEmpty()
+{
+	for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		if (s_wheelOccupied[level] != 0)
+			return false;
+	}
+	return true;
+}
+
+static void WheelInsert(DelayedCallback* cb)
+{
+	// The wheel only advances while something is in it, so after it has been idle its tick is stale and the callback
+	// would be due at once
+	if (WheelEmpty())
+	{
+		s_wheelTick = std::max(s_wheelTick, CurrentTick());
+	}
+
+	// The current tick has already been serviced, so the earliest a new callback can run is the next one
+	if (cb->expiry <= s_wheelTick)
+	{
+		cb->expiry = s_wheelTick + 1;
+	}
+	if (cb->expiry - s_wheelTick > TIMER_WHEEL_MAX_TICKS)
+	{
+		cb->expiry = s_wheelTick + TIMER_WHEEL_MAX_TICKS;
+	}
+	WheelPlace(cb);
+}
+
+/// @brief The next tick after the current one at which a slot needs to be cascaded or run, or -1 if the wheel is empty
+static long long NextWheelEvent()
+{
+	for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++)
+	{
+		if (s_wheelOccupied[level] == 0)
+			continue;
+
+		// Slots at or before the current digit were already serviced in this rotation
+		const size_t digit = Digit(s_wheelTick, level);
+		const size_t shift = level * TIMER_WHEEL_BITS;
+		long long base = (s_wheelTick >> (shift + TIMER_WHEEL_BITS)) << (shift + TIMER_WHEEL_BITS);
+		uint64_t ahead = (digit + 1 < TIMER_WHEEL_SLOTS) ? s_wheelOccupied[level] & (~0ULL << (digit + 1)) : 0;
+		if (ahead == 0)
+		{
+			if (level < TIMER_WHEEL_LEVELS - 1)
+				continue;
+
+			// Only the top level wraps around, anything left on it belongs to its next rotation
+			ahead = s_wheelOccupied[level];
+			base += 1LL << (shift + TIMER_WHEEL_BITS);
+		}
+		return base | ((long long)__builtin_ctzll(ahead) << shift);
+	}
+	return -1;
+}
+
+static void ArmDelayedTaskTimer()
+{
+	if (s_runningDelayedCallbacks)
+		return; // runDelayedCallbacks() re-arms the timer once it has finished
+
+	long long next = NextWheelEvent();
+	if (next < 0)
+	{
+		SetUserTimerPeriodNow(TIMER_DELAYED_TASK, 0);
+		return;
+	}
+	if (s_mainActivity == nullptr)
+		return;
+
+	SetUserTimerPeriodNow(TIMER_DELAYED_TASK,
+					   (int)std::max(next * TIMER_WHEEL_TICK - TimeHelper::getCurrentTime(), TIMER_WHEEL_TICK));
+}
+
+static void DeleteDelayedCallback(DelayedCallback* cb)
+{
+	DelayedCallback** entry = FindId(cb->id);
+	if (*entry == cb)
+	{
+		*entry = cb->hashNext;
+	}
+	WheelRemove(cb);
+	s_delayedCallbackCount--;
+	delete cb;
+}
 
 void registerDelayedCallback(const char* id, long long delay, function<bool()> callback)
 {
-	unregisterDelayedCallback(id);
-	s_delayedCallbacks.push_back(DelayedCallback(id, delay, callback));
-	info("Registered delayed callback %s", id);
+	if (DeferTimerChange({PendingTimerChange::Type::RegisterCallback, 0, 0, id, delay, callback}))
+		return;
+	RegisterDelayedCallbackNow(id, delay, callback);
 }
 
 void unregisterDelayedCallback(const char* id)
 {
-	size_t index = 0;
-	for (auto& cb : s_delayedCallbacks)
+	if (DeferTimerChange({PendingTimerChange::Type::UnregisterCallback, 0, 0, id, 0, function<bool()>()}))
+		return;
+	UnregisterDelayedCallbackNow(id);
+}
+
+void setDelayedCallbackDelay(const char* id, long long delay)
+{
+	if (DeferTimerChange({PendingTimerChange::Type::SetCallbackDelay, 0, 0, id, delay, function<bool()>()}))
+		return;
+	SetDelayedCallbackDelayNow(id, delay);
+}
+
+static void RegisterDelayedCallbackNow(const char* id, long long delay, function<bool()> callback)
+{
+	UnregisterDelayedCallbackNow(id);
+
+	DelayedCallback* cb = new DelayedCallback(id, delay, callback);
+	DelayedCallback** entry = FindId(id);
+	cb->hashNext = *entry;
+	*entry = cb;
+	cb->expiry = (TimeHelper::getCurrentTime() + delay + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK;
+	WheelInsert(cb);
+	s_delayedCallbackCount++;
+	info("Registered delayed callback %s", id);
+	ArmDelayedTaskTimer();
+}
+
+static void UnregisterDelayedCallbackNow(const char* id)
+{
+	DelayedCallback* cb = *FindId(id);
+	if (cb == nullptr)
+		return;
+
+	info("Unregistered delayed callback %s", id);
+	if (cb == s_runningCallback)
+	{
+		// Deleted by runDelayedCallbacks() once the callback has returned
+		DelayedCallback** entry = FindId(id);
+		*entry = cb->hashNext;
+		cb->hashNext = nullptr;
+		cb->cancelled = true;
+		return;
+	}
+	DeleteDelayedCallback(cb);
+	ArmDelayedTaskTimer();
+}
+
+static void SetDelayedCallbackDelayNow(const char* id, long long delay)
+{
+	DelayedCallback* cb = *FindId(id);
+	if (cb == nullptr)
+		return;
+
+	if (cb->delay != delay)
+		verbose("Delayed callback %s delay changed to %lld", id, delay);
+	cb->delay = delay;
+}
+
+static void RunExpired(WheelSlot& slot)
+{
+	// Move the slot into a local list first, so callbacks can safely register and unregister other callbacks
+	WheelSlot expired;
+	while (!slot.Empty())
 	{
-		if (strcmp(cb.id, id) == 0)
+		DelayedCallback* cb = slot.head.next;
+		cb->Unlink();
+		cb->level = -1;
+		expired.Append(cb);
+	}
+
+	while (!expired.Empty())
+	{
+		DelayedCallback* cb = expired.head.next;
+		cb->Unlink();
+
+		s_runningCallback = cb;
+		bool repeat;
 		{
-			s_delayedCallbacks.erase(s_delayedCallbacks.begin() + index);
-			info("Unregistered delayed callback %s", id);
-			return;
+			Debug::UiTimingScope timing(cb->id, (int)cb->delay);
+			repeat = cb->callback();
 		}
-		index++;
+		s_runningCallback = nullptr;
+
+		if (cb->cancelled)
+		{
+			s_delayedCallbackCount--;
+			delete cb;
+			continue;
+		}
+		if (!repeat)
+		{
+			info("Unregistering delayed callback %s", cb->id);
+			DeleteDelayedCallback(cb);
+			continue;
+		}
+		cb->expiry = (TimeHelper::getCurrentTime() + cb->delay + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK;
+		WheelInsert(cb);
+		verbose("Delayed callback %s scheduled for %lld", cb->id, cb->expiry * TIMER_WHEEL_TICK);
 	}
 }
 
-void runDelayedCallbacks()
+bool runDelayedCallbacks()
 {
-	auto cb = s_delayedCallbacks.begin();
-	while (cb != s_delayedCallbacks.end())
+	const long long now = CurrentTick();
+	s_runningDelayedCallbacks = true;
+	while (s_wheelTick < now)
 	{
-		if (TimeHelper::getCurrentTime() - cb->lastRun >= cb->delay)
+		long long next = NextWheelEvent();
+		if (next < 0 || next > now)
 		{
-			if (cb->callback())
-			{
-				cb->lastRun = TimeHelper::getCurrentTime();
-				info("Delayed callback %s scheduled for %lld", cb->id, cb->lastRun + cb->delay);
-			}
-			else
-			{
-				info("Unregistering delayed callback %s", cb->id);
-				cb = s_delayedCallbacks.erase(cb);
+			s_wheelTick = now;
+			break;
+		}
+		s_wheelTick = next;
+
+		// Cascade any higher level slot that has been reached down towards level 0
+		for (size_t level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+		{
+			if ((s_wheelTick & ((1LL << (level * TIMER_WHEEL_BITS)) - 1)) != 0)
 				continue;
+			WheelSlot& slot = s_wheel[level][Digit(s_wheelTick, level)];
+			while (!slot.Empty())
+			{
+				DelayedCallback* cb = slot.head.next;
+				WheelRemove(cb);
+				WheelPlace(cb);
 			}
 		}
-		++cb;
+
+		size_t digit = Digit(s_wheelTick, 0);
+		if (!s_wheel[0][digit].Empty())
+		{
+			s_wheelOccupied[0] &= ~(1ULL << digit);
+			RunExpired(s_wheel[0][digit]);
+		}
 	}
+	s_runningDelayedCallbacks = false;
+
+	// The timer framework stops this timer when we return false, otherwise re-arm it for the next event
+	if (NextWheelEvent() < 0)
+	{
+		userTimerStopped(TIMER_DELAYED_TASK);
+		return false;
+	}
+	ArmDelayedTaskTimer();
+	return true;
+}
+
+size_t getDelayedCallbackCount()
+{
+	return s_delayedCallbackCount;
 }
@@ -15,14 +15,35 @@ constexpr int TIMER_UPDATE_DATA = 0;  // Id of the timer used to update values f
 constexpr int TIMER_DELAYED_TASK = 1; // Id of the timer used to run a task after a delay
 constexpr int TIMER_ASYNC_HTTP_REQUEST = 2; // Id of the timer used to run queued async HTTP requests
 constexpr int TIMER_THUMBNAIL = 3;			// Id of the timer used to request thumbnail data
+constexpr int TIMER_COUNT = 4;
 
+/*
+ * These functions may be called from any thread. Calls made off the UI thread are queued and applied on the UI thread
+ * by applyPendingTimerChanges(), so they take effect on the next tick of a running UI timer.
+ */
 void initTimer(mainActivity* main);
+/// @brief Apply timer changes queued by other threads, called from the UI thread on every timer tick
+void applyPendingTimerChanges();
 void registerUserTimer(int id, int time);
 void unregisterUserTimer(int id);
 void resetUserTimer(int id, int time);
 
+/// @brief Start a user timer if it is stopped, or change its period if it differs. A time <= 0 stops the timer
+void setUserTimerPeriod(int id, int time);
+bool isUserTimerRunning(int id);
+/// @return Period the timer is running with in ms, 0 if stopped
+int getUserTimerPeriod(int id);
+const char* getUserTimerName(int id);
+/// @brief Must be called when a timer callback returns false, as the timer framework then stops the timer
+void userTimerStopped(int id);
+
 void registerDelayedCallback(const char* id, long long delay, function<bool()> callback);
 void unregisterDelayedCallback(const char* id);
-void runDelayedCallbacks();
+/// @brief Change the repeat delay of a registered callback, taking effect from the next time it is rescheduled
+void setDelayedCallbackDelay(const char* id, long long delay);
+/// @brief Runs due callbacks and re-arms TIMER_DELAYED_TASK for the next one
+/// @return false if no callbacks are pending and the timer should stop
+bool runDelayedCallbacks();
+size_t getDelayedCallbackCount();
 
 #endif /* JNI_LOGIC_TIMER_H_ */
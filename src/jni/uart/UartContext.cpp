@@ -17,6 +17,7 @@
 #include "UI/UserInterface.h"
 #include "uart/UartContext.h"
 
+#include "AllocationTracker.h"
 #include "Comm/Communication.h"
 #include "Hardware/Duet.h"
 #include "manager/LanguageManager.h"
@@ -57,6 +58,10 @@ static const char* getBaudRate(UINT baudRate) {
 UartContext::UartContext() : m_isOpen(false), m_uartID(0), m_dataBufPtr(NULL), m_dataBufLen(0) {}
 
 UartContext::~UartContext() {
+	if (m_dataBufPtr != NULL)
+	{
+		Memory::RecordFree(Memory::Subsystem::Buffers, UART_DATA_BUF_LEN);
+	}
 	delete[] m_dataBufPtr;
 	closeUart();
 }
@@ -121,7 +126,7 @@ bool UartContext::send(const BYTE *pData, UINT len) {
 	{
 		return false;
 	}
-	int delay = (int)ceilf((float)(1e4 * len) / Comm::DUET.GetBaudRate().rate);
+	int delay = (int)ceilf((float)(1e4 * len) / Comm::DUET.GetActiveBaudRate().rate);
 
 	int ret = write(m_uartID, pData, len);
 	Thread::sleep(delay); // Ensure we don't accidentally send data while previous data is still being sent
@@ -142,6 +147,7 @@ bool UartContext::readyToRun() {
 	if (m_dataBufPtr == NULL)
 	{
 		m_dataBufPtr = new BYTE[UART_DATA_BUF_LEN];
+		Memory::RecordAllocation(Memory::Subsystem::Buffers, UART_DATA_BUF_LEN);
 	}
 
 	if (m_dataBufPtr == NULL)
@@ -7,6 +7,7 @@
 
 #include "Debug.h"
 
+#include "AllocationTracker.h"
 #include "Configuration.h"
 #include "ObjectModel/Files.h"
 #include "Upgrade.h"
@@ -15,14 +16,20 @@
 #include <bits/alltypes.h>
 #include <cstdlib>
 #include <cstring>
-#include <fstream>
 
 #include "Hardware/Duet.h"
 #include "Hardware/Usb.h"
+#include "Library/CRC.h"
 #include "Storage.h"
+#include "UI/UserInterface.h"
 #include "utils/utils.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <vector>
 
 void InitUpgradeMountListener()
@@ -31,28 +38,215 @@ void InitUpgradeMountListener()
 	/* Disables opening the upgrade activity if `update.img` is in root USB directory */
 	// MOUNTMONITOR->removeMountListener(&UPGRADEMONITOR->getUpgradeMountListener());
 	MOUNTMONITOR->addMountListener(&s_upgradeMountListener);
-	system("rm /tmp/update.img");
+	unlink(UPGRADE_STAGING_FILE);
+	unlink(UPGRADE_PARTIAL_FILE);
+}
+
+static const CRC::Table<crcpp_uint32, 32>& CrcTable()
+{
+	static const CRC::Table<crcpp_uint32, 32> s_table(CRC::CRC_32());
+	return s_table;
+}
+
+static char* NewBlockBuffer()
+{
+	Memory::RecordAllocation(Memory::Subsystem::Buffers, UPGRADE_BLOCK_SIZE);
+	return new char[UPGRADE_BLOCK_SIZE];
+}
+
+static char* BlockBuffer()
+{
+	static char* s_buffer = NewBlockBuffer();
+	return s_buffer;
+}
+
+static void ReportProgress(size_t done, size_t total)
+{
+	static int s_lastPercent = -1;
+	const int percent = total > 0 ? (int)(100ull * done / total) : 0;
+	if (percent == s_lastPercent)
+		return;
+	s_lastPercent = percent;
+	UI::POPUP_WINDOW.SetProgress(percent);
+	dbg("Staged %u of %u bytes", done, total);
+}
+
+static bool WriteAll(int fd, const char* data, size_t len)
+{
+	while (len > 0)
+	{
+		const ssize_t written = write(fd, data, len);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			error("Failed to write to %s: %d", UPGRADE_PARTIAL_FILE, errno);
+			return false;
+		}
+		data += written;
+		len -= written;
+	}
+	return true;
+}
+
+static bool ChecksumFile(int fd, crcpp_uint32& crc, size_t& size)
+{
+	if (lseek(fd, 0, SEEK_SET) != 0)
+		return false;
+	char* buffer = BlockBuffer();
+	crc = CRC::Calculate(buffer, 0, CrcTable());
+	size = 0;
+	ssize_t len;
+	while ((len = read(fd, buffer, UPGRADE_BLOCK_SIZE)) != 0)
+	{
+		if (len < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		crc = CRC::Calculate(buffer, len, CrcTable(), crc);
+		size += len;
+	}
+	return true;
+}
+
+static int OpenPartialFile()
+{
+	unlink(UPGRADE_STAGING_FILE); // Remove any previous upgrade file
+	const int fd = open(UPGRADE_PARTIAL_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		error("Failed to create file \"%s\": %d", UPGRADE_PARTIAL_FILE, errno);
+	}
+	return fd;
+}
+
+// The image only becomes update.img once it is on flash and reads back as what was received, so a failed or
+// partial transfer is never offered as an upgrade
+static bool CommitPartialFile(int fd, crcpp_uint32 expectedCrc, size_t expectedSize)
+{
+	crcpp_uint32 crc;
+	size_t size;
+	if (fsync(fd) != 0)
+	{
+		error("Failed to sync %s: %d", UPGRADE_PARTIAL_FILE, errno);
+		close(fd);
+		unlink(UPGRADE_PARTIAL_FILE);
+		return false;
+	}
+	const bool readBack = ChecksumFile(fd, crc, size);
+	close(fd);
+	if (!readBack || crc != expectedCrc || size != expectedSize)
+	{
+		error("Staged upgrade image does not match, %u bytes crc %08x, expected %u bytes crc %08x",
+			  size,
+			  crc,
+			  expectedSize,
+			  expectedCrc);
+		unlink(UPGRADE_PARTIAL_FILE);
+		return false;
+	}
+	if (rename(UPGRADE_PARTIAL_FILE, UPGRADE_STAGING_FILE) != 0)
+	{
+		error("Failed to rename %s: %d", UPGRADE_PARTIAL_FILE, errno);
+		unlink(UPGRADE_PARTIAL_FILE);
+		return false;
+	}
+	const int dirFd = open(UPGRADE_STAGING_DIR, O_RDONLY | O_DIRECTORY);
+	if (dirFd >= 0)
+	{
+		fsync(dirFd);
+		close(dirFd);
+	}
+	info("Staged upgrade image, %u bytes crc %08x", size, crc);
+	return true;
 }
 
 bool UpgradeFromUSB(const std::string& filePath)
 {
 	info("Attempting upgrade from USB file %s", filePath.c_str());
+	const std::string sourcePath = std::string("/mnt/usb1/") + filePath;
+	const int source = open(sourcePath.c_str(), O_RDONLY);
 	struct stat sb;
-	if (stat((std::string("/mnt/usb1/") + filePath).c_str(), &sb) == -1)
+	if (source < 0 || fstat(source, &sb) == -1)
 	{
 		error("Failed to get file stats for %s", filePath.c_str());
+		if (source >= 0)
+			close(source);
 		return false;
 	}
 
-	system("rm /tmp/update.img"); // Remove any previous upgrade file
-	int ret = system(utils::format("cd /mnt/usb1 && cp \"%s\" /tmp/update.img", filePath.c_str()).c_str());
-	if (ret != 0)
+	const int fd = OpenPartialFile();
+	if (fd < 0)
 	{
-		error("Failed to copy file \"%s\" to /tmp, code=%d", filePath.c_str(), ret);
+		close(source);
 		return false;
 	}
-	verbose("File \"%s\" copied to /tmp, code=%d", filePath.c_str(), ret);
-	if (!UPGRADEMONITOR->checkUpgradeFile("/tmp"))
+
+	// Copied in the kernel where possible, the checksum of the source is compared with the staged copy afterwards
+	const size_t total = (size_t)sb.st_size;
+	size_t copied = 0;
+	bool useSendfile = true;
+	bool success = true;
+	crcpp_uint32 crc = CRC::Calculate(BlockBuffer(), 0, CrcTable());
+	while (copied < total)
+	{
+		const size_t blockSize = std::min(total - copied, UPGRADE_BLOCK_SIZE);
+		if (useSendfile)
+		{
+			off_t offset = (off_t)copied;
+			const ssize_t sent = sendfile(fd, source, &offset, blockSize);
+			if (sent > 0)
+			{
+				copied += sent;
+				ReportProgress(copied, total);
+				continue;
+			}
+			if (sent < 0 && errno == EINTR)
+				continue;
+			if (sent < 0 && (errno == EINVAL || errno == ENOSYS) && copied == 0)
+			{
+				// Not supported between these file systems
+				useSendfile = false;
+				continue;
+			}
+			error("Failed to copy %s: %d", filePath.c_str(), sent < 0 ? errno : 0);
+			success = false;
+			break;
+		}
+
+		const ssize_t len = pread(source, BlockBuffer(), blockSize, (off_t)copied);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0 || !WriteAll(fd, BlockBuffer(), len))
+		{
+			error("Failed to copy %s: %d", filePath.c_str(), len < 0 ? errno : 0);
+			success = false;
+			break;
+		}
+		crc = CRC::Calculate(BlockBuffer(), len, CrcTable(), crc);
+		copied += len;
+		ReportProgress(copied, total);
+	}
+
+	size_t sourceSize = copied;
+	if (success && useSendfile)
+	{
+		success = ChecksumFile(source, crc, sourceSize);
+	}
+	close(source);
+	if (!success)
+	{
+		close(fd);
+		unlink(UPGRADE_PARTIAL_FILE);
+		return false;
+	}
+	if (!CommitPartialFile(fd, crc, sourceSize))
+		return false;
+
+	verbose("File \"%s\" copied to %s", filePath.c_str(), UPGRADE_STAGING_DIR);
+	if (!UPGRADEMONITOR->checkUpgradeFile(UPGRADE_STAGING_DIR))
 	{
 		error("No upgrade file found");
 		return false;
@@ -67,25 +261,38 @@ bool UpgradeFromDuet()
 	std::string filePath = utils::format("/firmware/%s", UPGRADE_FILE_NAME);
 
 	info("Attempting upgrade from Duet file %s", filePath.c_str());
-	system("rm /tmp/update.img"); // Remove any previous upgrade file
-
-	std::string contents;
-	if (!Comm::DUET.DownloadFile(filePath.c_str(), contents))
-	{
-		error("Failed to download file \"%s\" from Duet", filePath.c_str());
+	const int fd = OpenPartialFile();
+	if (fd < 0)
 		return false;
-	}
 
-	std::ofstream file("/tmp/update.img", std::ios::binary);
-	if (!file.is_open())
+	// Written as it arrives, so the image is never held in memory
+	crcpp_uint32 crc = CRC::Calculate(BlockBuffer(), 0, CrcTable());
+	size_t received = 0;
+	size_t expected = 0;
+	const bool downloaded = Comm::DUET.DownloadFile(
+		filePath.c_str(), [fd, &crc, &received, &expected](const char* data, size_t len, size_t total) {
+			if (!WriteAll(fd, data, len))
+				return false;
+			crc = CRC::Calculate(data, len, CrcTable(), crc);
+			received += len;
+			expected = total;
+			ReportProgress(received, total);
+			return true;
+		});
+	if (!downloaded || (expected > 0 && received != expected))
 	{
-		error("Failed to create file \"/tmp/update.img\"");
+		error("Failed to download file \"%s\" from Duet, received %u of %u bytes",
+			  filePath.c_str(),
+			  received,
+			  expected);
+		close(fd);
+		unlink(UPGRADE_PARTIAL_FILE);
 		return false;
 	}
-	file.write(contents.c_str(), contents.size());
-	file.close();
+	if (!CommitPartialFile(fd, crc, received))
+		return false;
 
-	if (!UPGRADEMONITOR->checkUpgradeFile("/tmp"))
+	if (!UPGRADEMONITOR->checkUpgradeFile(UPGRADE_STAGING_DIR))
 	{
 		error("No upgrade file found");
 		return false;
@@ -99,6 +306,7 @@ void UpgradeMountListener::notify(int what, int status, const char* msg)
 	switch (status)
 	{
 	case MountMonitor::E_MOUNT_STATUS_MOUNTED: {
+		USB::ClearDirectoryCache();
 		OM::FileSystem::RequestUsbFiles("");
 		std::vector<USB::FileInfo> files = USB::ListEntriesInDirectory(msg);
 		for (auto& file : files)
@@ -118,6 +326,7 @@ void UpgradeMountListener::notify(int what, int status, const char* msg)
 	}
 	case MountMonitor::E_MOUNT_STATUS_REMOVE:
 		EASYUICONTEXT->closeActivity("UpgradeActivity");
+		USB::ClearDirectoryCache();
 		if (OM::FileSystem::IsUsbFolder())
 			OM::FileSystem::RequestUsbFiles("");
 		break;